@@ -8,6 +8,16 @@
 #include "global.h"
 #include "commands.h"
 #include "wifi.h"
+#include "tasks.h"
+#include "stats.h"
+#include "timesync.h"
+#include "config.h"
+#include "axis.h"
+#include "button.h"
+#include "encoder.h"
+#if NAGI_TRACE
+#include "trace.h"
+#endif
 
 static const char* TAG = "commands";
 
@@ -42,6 +52,65 @@ static struct {
   struct arg_end* end;
 } server_args;
 
+/// @brief Timing command information.
+static struct {
+  struct arg_lit* reset;
+  struct arg_end* end;
+} timing_args;
+
+/// @brief Rate command information.
+static struct {
+  struct arg_int* rate;
+  struct arg_end* end;
+} rate_args;
+
+/// @brief Redundancy command information.
+static struct {
+  struct arg_int* redundancy;
+  struct arg_end* end;
+} redundancy_args;
+
+/// @brief Stats command information.
+static struct {
+  struct arg_lit* reset;
+  struct arg_end* end;
+} stats_args;
+
+/// @brief Encoder command information.
+static struct {
+  struct arg_int* index;
+  struct arg_str* mode;
+  struct arg_str* accel;
+  struct arg_end* end;
+} encoder_args;
+
+/// @brief Button command information.
+static struct {
+  struct arg_int* index;
+  struct arg_str* debounce;
+  struct arg_end* end;
+} button_args;
+
+/// @brief Axis command information.
+static struct {
+  struct arg_int* index;
+  struct arg_str* filter;
+  struct arg_str* calibrate;
+  struct arg_str* range;
+  struct arg_int* deadzone;
+  struct arg_str* curve;
+  struct arg_end* end;
+} axis_args;
+
+#if NAGI_TRACE
+/// @brief Trace command information.
+static struct {
+  struct arg_str* action;
+  struct arg_str* file;
+  struct arg_end* end;
+} trace_args;
+#endif
+
 /// @brief List command.
 /// @param argc The number of arguments.
 /// @param argv The arguments.
@@ -250,6 +319,371 @@ static int server_command(int argc, char **argv) {
   return 0;
 }
 
+/// @brief Print the timing of a task.
+/// @param name The task name.
+/// @param timing The task timing.
+static void print_task_timing(const char* name, const task_timing_t* timing) {
+  if (timing->count == 0) {
+    ESP_LOGI(TAG, "%s: no data.", name);
+    return;
+  }
+  ESP_LOGI(
+    TAG,
+    "%s: period %luus, min %luus, avg %lluus, max %luus, busy max %luus, late %lu/%lu, missed %lu",
+    name,
+    timing->period_us,
+    timing->min_period_us,
+    timing->total_period_us / timing->count,
+    timing->max_period_us,
+    timing->max_busy_us,
+    timing->late_count,
+    timing->count,
+    timing->missed_count
+  );
+}
+
+/// @brief Timing command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int timing_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&timing_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, timing_args.end, argv[0]);
+    return 1;
+  }
+
+  print_task_timing("sampler", &g_sampler_timing);
+  print_task_timing("network", &g_network_timing);
+
+  if (timing_args.reset->count > 0) {
+    reset_task_timing(&g_sampler_timing, g_sampler_timing.period_us);
+    reset_task_timing(&g_network_timing, g_network_timing.period_us);
+  }
+
+  return 0;
+}
+
+/// @brief Rate command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int rate_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&rate_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, rate_args.end, argv[0]);
+    return 1;
+  }
+
+  if (rate_args.rate->count == 0) {
+    ESP_LOGI(TAG, "Polling rate: %luHz, missed %lu/%lu periods.", get_polling_rate(), g_sampler_timing.missed_count, g_sampler_timing.count);
+    return 0;
+  }
+
+  const int rate = rate_args.rate->ival[0];
+  if (rate <= 0 || set_polling_rate(rate) != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid rate %d, must be 1000, 2000, 4000 or 8000.", rate);
+    return 1;
+  }
+
+  // Write the rate to the "/data/rate.txt" file.
+  FILE *f = fopen("/data/rate.txt", "w");
+  if (f == NULL) {
+    ESP_LOGW(TAG, "Failed to save the polling rate.");
+    return 1;
+  }
+  fprintf(f, "%d\n", rate);
+  fclose(f);
+
+  return 0;
+}
+
+/// @brief Redundancy command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int redundancy_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&redundancy_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, redundancy_args.end, argv[0]);
+    return 1;
+  }
+
+  if (redundancy_args.redundancy->count == 0) {
+    ESP_LOGI(TAG, "Redundancy: %lu previous states.", get_sync_redundancy());
+    return 0;
+  }
+
+  const int redundancy = redundancy_args.redundancy->ival[0];
+  if (redundancy < 0 || set_sync_redundancy(redundancy) != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid redundancy %d.", redundancy);
+    return 1;
+  }
+
+  // Write the redundancy to the "/data/redund.txt" file.
+  FILE *f = fopen("/data/redund.txt", "w");
+  if (f == NULL) {
+    ESP_LOGW(TAG, "Failed to save the redundancy.");
+    return 1;
+  }
+  fprintf(f, "%d\n", redundancy);
+  fclose(f);
+
+  return 0;
+}
+
+/// @brief Stats command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int stats_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&stats_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, stats_args.end, argv[0]);
+    return 1;
+  }
+
+  print_stats();
+  ESP_LOGI(TAG, "adc: %lu frames lost.", g_axis_adc_overflows);
+  if (is_time_synced()) {
+    ESP_LOGI(TAG, "clock: offset %lldus, rtt %lldus", get_clock_offset(), get_round_trip_time());
+  } else {
+    ESP_LOGI(TAG, "clock: not synced.");
+  }
+
+  if (stats_args.reset->count > 0) {
+    reset_stats();
+    g_axis_adc_overflows = 0;
+  }
+
+  return 0;
+}
+
+/// @brief Encoder command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int encoder_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&encoder_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, encoder_args.end, argv[0]);
+    return 1;
+  }
+
+  const int index = encoder_args.index->ival[0];
+  if (index < 0 || index >= NAGI_MAX_NUM_OF_ENCODERS) {
+    ESP_LOGE(TAG, "Invalid encoder %d.", index);
+    return 1;
+  }
+  encoder_settings_t settings = g_encoder_settings[index];
+  if (encoder_args.mode->count > 0 && !parse_encoder_mode(encoder_args.mode->sval[0], &settings.mode)) {
+    ESP_LOGE(TAG, "Invalid mode %s, must be buttons, axis or pulses.", encoder_args.mode->sval[0]);
+    return 1;
+  }
+  if (encoder_args.accel->count > 0 && parse_encoder_accel(encoder_args.accel->sval[0], &settings.accel) != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid acceleration %s, must be none or up to %d <speed>:<gain> points.", encoder_args.accel->sval[0], NAGI_ENCODER_ACCEL_MAX_POINTS);
+    return 1;
+  }
+
+  char accel[64];
+  format_encoder_accel(&settings.accel, accel, sizeof(accel));
+  if (encoder_args.mode->count == 0 && encoder_args.accel->count == 0) {
+    ESP_LOGI(
+      TAG, "Encoder[%d]: mode %s, acceleration %s, dropped %lu pulses.",
+      index, get_encoder_mode_name(settings.mode), accel, g_encoder_data[index].dropped_pulses
+    );
+    return 0;
+  }
+  g_encoder_settings[index] = settings;
+
+  // Write the settings to the "/data/encoder<index>.txt" file.
+  char path[32];
+  snprintf(path, sizeof(path), "/data/encoder%d.txt", index);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    ESP_LOGW(TAG, "Failed to save the encoder settings.");
+    return 1;
+  }
+  fprintf(f, "%s %s\n", get_encoder_mode_name(settings.mode), accel);
+  fclose(f);
+
+  return 0;
+}
+
+/// @brief Button command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int button_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&button_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, button_args.end, argv[0]);
+    return 1;
+  }
+
+  const int index = button_args.index->ival[0];
+  if (index < 0 || index >= NAGI_MAX_NUM_OF_BUTTONS) {
+    ESP_LOGE(TAG, "Invalid button %d.", index);
+    return 1;
+  }
+  if (button_args.debounce->count == 0) {
+    ESP_LOGI(TAG, "Button[%d]: debounce %s.", index, get_button_debounce_name(g_button_debounces[index]));
+    return 0;
+  }
+  button_debounce_t debounce;
+  if (!parse_button_debounce(button_args.debounce->sval[0], &debounce)) {
+    ESP_LOGE(TAG, "Invalid debounce %s, must be integrate, eager or eager-press.", button_args.debounce->sval[0]);
+    return 1;
+  }
+  set_button_debounce(index, debounce);
+
+  // Write the settings to the "/data/button<index>.txt" file.
+  char path[32];
+  snprintf(path, sizeof(path), "/data/button%d.txt", index);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    ESP_LOGW(TAG, "Failed to save the button settings.");
+    return 1;
+  }
+  fprintf(f, "%s\n", get_button_debounce_name(debounce));
+  fclose(f);
+
+  return 0;
+}
+
+/// @brief Axis command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int axis_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&axis_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, axis_args.end, argv[0]);
+    return 1;
+  }
+
+  const int index = axis_args.index->ival[0];
+  if (index < 0 || index >= NAGI_MAX_NUM_OF_AXES) {
+    ESP_LOGE(TAG, "Invalid axis %d.", index);
+    return 1;
+  }
+  axis_filter_t filter = g_axis_filters[index];
+  if (axis_args.filter->count > 0 && !parse_axis_filter(axis_args.filter->sval[0], &filter)) {
+    ESP_LOGE(TAG, "Invalid filter %s, must be deadband or one-euro.", axis_args.filter->sval[0]);
+    return 1;
+  }
+  axis_profile_t profile = g_axis_profiles[index];
+  if (axis_args.range->count > 0) {
+    if (strcmp(axis_args.range->sval[0], "default") == 0) {
+      get_default_axis_profile(index, &profile);
+    } else if (parse_axis_range(axis_args.range->sval[0], &profile) != ESP_OK) {
+      ESP_LOGE(TAG, "Invalid range %s, must be default or <min>:<center>:<max> in mV.", axis_args.range->sval[0]);
+      return 1;
+    }
+  }
+  if (axis_args.deadzone->count > 0) {
+    if (axis_args.deadzone->ival[0] < 0 || axis_args.deadzone->ival[0] >= 100) {
+      ESP_LOGE(TAG, "Invalid deadzone %d, must be from 0 to 99 percent.", axis_args.deadzone->ival[0]);
+      return 1;
+    }
+    profile.deadzone = axis_args.deadzone->ival[0];
+  }
+  if (axis_args.curve->count > 0 && parse_axis_curve(axis_args.curve->sval[0], &profile.curve) != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid curve %s, must be linear or up to %d <deflection>:<output> points.", axis_args.curve->sval[0], NAGI_AXIS_CURVE_MAX_POINTS);
+    return 1;
+  }
+  if (axis_args.calibrate->count > 0) {
+    const char* step = axis_args.calibrate->sval[0];
+    if (strcmp(step, "start") == 0) {
+      // The ends are taken on stop, nothing is saved until then.
+      start_axis_calibration(index);
+      ESP_LOGI(TAG, "Axis[%d]: calibrating from %d mV, move the axis to both ends, then --calibrate stop.", index, g_axes_voltages[index]);
+      return 0;
+    } else if (strcmp(step, "center") == 0) {
+      capture_axis_center(index, &profile);
+    } else if (strcmp(step, "stop") == 0) {
+      esp_err_t err = finish_axis_calibration(index, &profile);
+      if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to calibrate axis %d. Error %s", index, esp_err_to_name(err));
+        return 1;
+      }
+    } else {
+      ESP_LOGE(TAG, "Invalid calibration step %s, must be start, center or stop.", step);
+      return 1;
+    }
+  }
+
+  char curve[64];
+  format_axis_curve(&profile.curve, curve, sizeof(curve));
+  if (axis_args.filter->count == 0 && axis_args.range->count == 0 && axis_args.deadzone->count == 0 && axis_args.curve->count == 0 && axis_args.calibrate->count == 0) {
+    ESP_LOGI(
+      TAG, "Axis[%d]: filter %s, range %u:%u:%u mV, deadzone %u%%, curve %s, %d mV reported as %d.",
+      index, get_axis_filter_name(filter), profile.min, profile.center, profile.max, profile.deadzone, curve,
+      g_axes_voltages[index], g_axes_data[index]
+    );
+    return 0;
+  }
+  if (set_axis_profile(index, &profile) != ESP_OK) {
+    ESP_LOGE(TAG, "Invalid range %u:%u:%u, the center must be between the ends.", profile.min, profile.center, profile.max);
+    return 1;
+  }
+  if (filter != g_axis_filters[index]) {
+    set_axis_filter(index, filter);
+  }
+
+  // Write the settings to the "/data/axis<index>.txt" file.
+  char path[32];
+  snprintf(path, sizeof(path), "/data/axis%d.txt", index);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    ESP_LOGW(TAG, "Failed to save the axis settings.");
+    return 1;
+  }
+  fprintf(f, "%s %u:%u:%u %u %s\n", get_axis_filter_name(filter), profile.min, profile.center, profile.max, profile.deadzone, curve);
+  fclose(f);
+
+  return 0;
+}
+
+#if NAGI_TRACE
+/// @brief Trace command.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The result of the command.
+static int trace_command(int argc, char **argv) {
+  int nerrors = arg_parse(argc, argv, (void **)&trace_args);
+  if (nerrors != 0) {
+    arg_print_errors(stderr, trace_args.end, argv[0]);
+    return 1;
+  }
+
+  if (trace_args.action->count == 0) {
+    uint32_t records;
+    uint32_t dropped;
+    get_trace_stats(&records, &dropped);
+    ESP_LOGI(TAG, "Trace: %s, %lu records, dropped %lu.", is_trace_recording() ? "recording" : "stopped", records, dropped);
+    return 0;
+  }
+
+  const char* action = trace_args.action->sval[0];
+  if (strcmp(action, "start") == 0) {
+    const char* path = trace_args.file->count > 0 ? trace_args.file->sval[0] : "/data/trace.bin";
+    esp_err_t err = start_trace(path, AXIS_SCAN_FREQ_HZ);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to start the trace. Error %s", esp_err_to_name(err));
+      return 1;
+    }
+  } else if (strcmp(action, "stop") == 0) {
+    stop_trace();
+  } else {
+    ESP_LOGE(TAG, "Invalid action %s, must be start or stop.", action);
+    return 1;
+  }
+
+  return 0;
+}
+#endif
+
 /// @brief Register the user commands.
 /// @return The result of the registration.
 esp_err_t register_user_commands(void) {
@@ -324,6 +758,129 @@ esp_err_t register_user_commands(void) {
   if (err != ESP_OK)
     return err;
 
+  // Register the timing command.
+  timing_args.reset = arg_lit0(NULL, "reset", "Reset the statistics after printing.");
+  timing_args.end = arg_end(1);
+
+  const esp_console_cmd_t timing_console_cmd = {
+    .command = "timing",
+    .help = "Print the sampler and network task timing.",
+    .func = &timing_command,
+    .argtable = &timing_args
+  };
+  err = esp_console_cmd_register(&timing_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the rate command.
+  rate_args.rate = arg_int0(NULL, NULL, "<int>", "The polling rate in Hz: 1000, 2000, 4000 or 8000.");
+  rate_args.end = arg_end(1);
+
+  const esp_console_cmd_t rate_console_cmd = {
+    .command = "rate",
+    .help = "Get or set the input polling rate.",
+    .func = &rate_command,
+    .argtable = &rate_args
+  };
+  err = esp_console_cmd_register(&rate_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the redundancy command.
+  redundancy_args.redundancy = arg_int0(NULL, NULL, "<int>", "The number of previous states repeated in every packet.");
+  redundancy_args.end = arg_end(1);
+
+  const esp_console_cmd_t redundancy_console_cmd = {
+    .command = "redundancy",
+    .help = "Get or set the redundancy of the redundant joystick format.",
+    .func = &redundancy_command,
+    .argtable = &redundancy_args
+  };
+  err = esp_console_cmd_register(&redundancy_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the stats command.
+  stats_args.reset = arg_lit0(NULL, "reset", "Reset the statistics after printing.");
+  stats_args.end = arg_end(1);
+
+  const esp_console_cmd_t stats_console_cmd = {
+    .command = "stats",
+    .help = "Print the latency of every input stage and the packet counts.",
+    .func = &stats_command,
+    .argtable = &stats_args
+  };
+  err = esp_console_cmd_register(&stats_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the encoder command.
+  encoder_args.index = arg_int1(NULL, NULL, "<int>", "The encoder number.");
+  encoder_args.mode = arg_str0(NULL, "mode", "<buttons|axis|pulses>", "Report the encoder as held buttons, a relative axis or queued pulses.");
+  encoder_args.accel = arg_str0(NULL, "accel", "<string>", "The acceleration curve, none or <speed>:<gain>,... with the speed in detents per second.");
+  encoder_args.end = arg_end(3);
+
+  const esp_console_cmd_t encoder_console_cmd = {
+    .command = "encoder",
+    .help = "Get or set how an encoder is reported.",
+    .func = &encoder_command,
+    .argtable = &encoder_args
+  };
+  err = esp_console_cmd_register(&encoder_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the button command.
+  button_args.index = arg_int1(NULL, NULL, "<int>", "The button number.");
+  button_args.debounce = arg_str0(NULL, "debounce", "<integrate|eager|eager-press>", "Report a stable level, the first edge, or the first edge of a press and a stable release.");
+  button_args.end = arg_end(2);
+
+  const esp_console_cmd_t button_console_cmd = {
+    .command = "button",
+    .help = "Get or set how a button is debounced.",
+    .func = &button_command,
+    .argtable = &button_args
+  };
+  err = esp_console_cmd_register(&button_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+  // Register the axis command.
+  axis_args.index = arg_int1(NULL, NULL, "<int>", "The axis number.");
+  axis_args.filter = arg_str0(NULL, "filter", "<deadband|one-euro>", "Report a move past the jitter threshold, or low-pass with a cutoff rising with the speed.");
+  axis_args.calibrate = arg_str0(NULL, "calibrate", "<start|center|stop>", "Start taking the ends with the axis at rest, take the center again, or keep the ends seen.");
+  axis_args.range = arg_str0(NULL, "range", "<string>", "The calibrated voltages, default or <min>:<center>:<max> in mV.");
+  axis_args.deadzone = arg_int0(NULL, "deadzone", "<int>", "The deflection around the center reported as centered, in percent.");
+  axis_args.curve = arg_str0(NULL, "curve", "<string>", "The response curve, linear or <deflection>:<output>,... in percent.");
+  axis_args.end = arg_end(6);
+
+  const esp_console_cmd_t axis_console_cmd = {
+    .command = "axis",
+    .help = "Get or set how an axis is filtered, calibrated and scaled.",
+    .func = &axis_command,
+    .argtable = &axis_args
+  };
+  err = esp_console_cmd_register(&axis_console_cmd);
+  if (err != ESP_OK)
+    return err;
+
+#if NAGI_TRACE
+  // Register the trace command.
+  trace_args.action = arg_str0(NULL, NULL, "<start|stop>", "Start or stop recording the raw inputs.");
+  trace_args.file = arg_str0(NULL, "file", "<string>", "The trace file, /data/trace.bin by default.");
+  trace_args.end = arg_end(2);
+
+  const esp_console_cmd_t trace_console_cmd = {
+    .command = "trace",
+    .help = "Record the raw axis, button and encoder samples for replay.",
+    .func = &trace_command,
+    .argtable = &trace_args
+  };
+  err = esp_console_cmd_register(&trace_console_cmd);
+  if (err != ESP_OK)
+    return err;
+#endif
+
   return ESP_OK;
 }
 
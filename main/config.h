@@ -8,10 +8,64 @@
 #define NAGI_WS2812_LED_NUM 1
 
 #define NAGI_AXIS_USE_ADC_CONTINUOUS 1
-#define NAGI_MAX_NUM_OF_AXES 1
+#define NAGI_AXIS_USE_ADC_CALLBACK 1
+#define NAGI_AXIS_ADC_FRAME_QUEUE_SIZE 4
+#define NAGI_MAX_NUM_OF_AXES 2
+#define NAGI_AXIS_ADC_CHANNELS {1, 2}
 #define NAGI_AXIS_JITTER_THRESHOLD 8
+#define NAGI_AXIS_ONE_EURO_MIN_CUTOFF_MHZ 1000
+#define NAGI_AXIS_ONE_EURO_BETA 50
+#define NAGI_AXIS_ONE_EURO_SPEED_CUTOFF_MHZ 5000
+#define NAGI_AXIS_SAMPLE_FREQ_HZ 4000
+#define NAGI_AXIS_OUTPUT_FREQ_HZ 500
+#define NAGI_AXIS_CIC_ORDER 2
+#define NAGI_AXIS_VOLTAGE_FRACTION_BITS 4
+#define NAGI_AXIS_DECIMATION_BUDGET_CYCLES 1600
+// Needs "adc_cali, data, 0x40, , 0xF000," appended to partitions.csv.
+#define NAGI_AXIS_VOLTAGE_TABLE_IN_FLASH 0
+#define NAGI_AXIS_VOLTAGE_TABLE_PARTITION "adc_cali"
+#define NAGI_AXIS_CURVE_MAX_POINTS 4
 #define NAGI_MAX_NUM_OF_BUTTONS 9
 #define NAGI_BUTTON_JITTER_THRESHOLD 5
+#define NAGI_BUTTON_SAMPLE_US 1000
+#define NAGI_BUTTON_COUNTER_BITS 3
+#define NAGI_BUTTON_LOCKOUT 5
+#define NAGI_BUTTON_SCANNER BUTTON_SCANNER_GPIO
+#define NAGI_BUTTON_MATRIX_ROW_GPIO_NUMS {5, 4, 14}
+#define NAGI_BUTTON_MATRIX_COLUMN_GPIO_NUMS {15, 18, 9}
+#define NAGI_BUTTON_MATRIX_SETTLE_US 5
+#define NAGI_BUTTON_SHIFT_GPIO_NUMS {22, 21, 23}
+#define NAGI_BUTTON_SHIFT_CLOCK_HZ 4000000
+#define NAGI_BUTTON_SCAN_BUDGET_US 100
 #define NAGI_MAX_NUM_OF_ENCODERS 2
+#define NAGI_ENCODER_BACKENDS {ENCODER_BACKEND_PCNT, ENCODER_BACKEND_PCNT}
+#define NAGI_ENCODER_GLITCH_FILTER_NS 1000
+#define NAGI_ENCODER_COUNTS_PER_DETENT 4
+#define NAGI_ENCODER_ACCEL_MAX_POINTS 4
+#define NAGI_ENCODER_PULSE_QUEUE_SIZE 64
+#define NAGI_ENCODER_PULSE_US 2000
+
+#define NAGI_TRACE 1
+#define NAGI_TRACE_BUFFER_SIZE 4096
+#define NAGI_TRACE_FLUSH_INTERVAL 100
+
+#define NAGI_UPDATE_INTERVAL 10
+#define NAGI_DEFAULT_POLLING_RATE 1000
+
+#define NAGI_SYNC_PIPELINED 1
+#define NAGI_SYNC_RESEND_INTERVAL 20
+#define NAGI_SYNC_DELTA 1
+#define NAGI_SYNC_DELTA_HISTORY_SIZE 32
+#define NAGI_SYNC_KEYFRAME_INTERVAL 1000
+#define NAGI_SYNC_COMPACT 1
+#define NAGI_SYNC_REDUNDANT 1
+#define NAGI_SYNC_DEFAULT_REDUNDANCY 2
+#define NAGI_TIME_SYNC_INTERVAL 1000
+#define NAGI_SYNC_EVENT_DRIVEN 1
+#define NAGI_SYNC_KEEPALIVE_INTERVAL 100
+
+#if (NAGI_SYNC_DELTA || NAGI_SYNC_COMPACT || NAGI_SYNC_REDUNDANT) && !NAGI_SYNC_PIPELINED
+#error "NAGI_SYNC_DELTA, NAGI_SYNC_COMPACT and NAGI_SYNC_REDUNDANT require NAGI_SYNC_PIPELINED."
+#endif
 
 #endif // __CONFIG_H__
\ No newline at end of file
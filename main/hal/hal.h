@@ -0,0 +1,250 @@
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+
+struct sockaddr_in;
+struct sockaddr_storage;
+
+/// @brief A GPIO interrupt handler.
+typedef void (*hal_isr_t)(void* arg);
+
+/// @brief A timer callback, dispatched from the timer ISR.
+/// @return True if a higher priority task was woken.
+typedef bool (*hal_timer_callback_t)(void* arg);
+
+/// @brief The conversions of every channel in a DMA frame of the continuous mode.
+#define HAL_ADC_CONVERSIONS_PER_FRAME 8
+
+/// @brief A timer handle.
+typedef struct hal_timer* hal_timer_handle_t;
+
+/// @brief A shift register chain handle.
+typedef struct hal_shift_in* hal_shift_in_handle_t;
+
+/// @brief A pulse counter handle.
+typedef struct hal_pcnt* hal_pcnt_handle_t;
+
+/// @brief The action of a pulse counter channel on an edge, as pcnt_channel_edge_action_t.
+typedef enum {
+  HAL_PCNT_EDGE_HOLD = 0,
+  HAL_PCNT_EDGE_INCREASE,
+  HAL_PCNT_EDGE_DECREASE,
+} hal_pcnt_edge_action_t;
+
+/// @brief How the level signal changes the edge action, as pcnt_channel_level_action_t.
+typedef enum {
+  HAL_PCNT_LEVEL_KEEP = 0,
+  HAL_PCNT_LEVEL_INVERSE,
+  HAL_PCNT_LEVEL_HOLD,
+} hal_pcnt_level_action_t;
+
+/// @brief A pulse counter channel, counting the edges of one GPIO gated by the level of another.
+typedef struct {
+  int edge_gpio_num;
+  int level_gpio_num;
+  hal_pcnt_edge_action_t pos_edge_action;
+  hal_pcnt_edge_action_t neg_edge_action;
+  hal_pcnt_level_action_t high_level_action;
+  hal_pcnt_level_action_t low_level_action;
+} hal_pcnt_channel_config_t;
+
+/// @brief A raw ADC conversion.
+typedef struct {
+  // The ADC channel.
+  uint32_t channel;
+  // The raw conversion code.
+  uint32_t raw;
+} hal_adc_sample_t;
+
+/// @brief A frame of continuous conversions, dispatched from the ADC ISR as soon as the DMA finished it.
+/// @param samples The conversions, in conversion order.
+/// @param num_of_samples The number of conversions.
+/// @param arg The callback argument.
+/// @return True if a higher priority task was woken.
+typedef bool (*hal_adc_frame_callback_t)(const hal_adc_sample_t* samples, uint32_t num_of_samples, void* arg);
+
+/// @brief The conversion pool overflowed and a frame was lost, dispatched from the ADC ISR.
+/// @param arg The callback argument.
+/// @return True if a higher priority task was woken.
+typedef bool (*hal_adc_overflow_callback_t)(void* arg);
+
+/// @brief Get the time since boot.
+/// @return The time in microseconds.
+int64_t hal_get_time_us(void);
+
+/// @brief Get the CPU cycle count, for profiling.
+/// @return The cycle count.
+uint32_t hal_get_cycle_count(void);
+
+/// @brief Get the CPU cycles per microsecond.
+/// @return The cycles per microsecond.
+uint32_t hal_get_cycles_per_us(void);
+
+/// @brief Busy-wait.
+/// @param time_us The time in microseconds.
+void hal_delay_us(uint32_t time_us);
+
+/// @brief Configure GPIOs as outputs, set high.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_open_drain True to only pull low, high is left to the pull-ups.
+/// @return The result.
+esp_err_t hal_gpio_config_output(uint64_t pin_bit_mask, bool is_open_drain);
+
+/// @brief Set the level of an output GPIO.
+/// @param gpio_num The GPIO number.
+/// @param level The level, 0 or 1.
+void hal_gpio_set_level(int gpio_num, int level);
+
+/// @brief Configure GPIOs as inputs with the internal pull-up.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_interrupt_enabled True to interrupt on any edge.
+/// @return The result.
+esp_err_t hal_gpio_config_input(uint64_t pin_bit_mask, bool is_interrupt_enabled);
+
+/// @brief Get the level of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @return The level, 0 or 1.
+int hal_gpio_get_level(int gpio_num);
+
+/// @brief Get the levels of the first 32 GPIOs with one read of the input register.
+/// @return The levels, bit gpio_num is the level of the GPIO.
+uint32_t hal_gpio_get_levels(void);
+
+/// @brief Add the interrupt handler of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @param handler The handler.
+/// @param arg The handler argument.
+/// @return The result.
+esp_err_t hal_gpio_add_isr(int gpio_num, hal_isr_t handler, void* arg);
+
+/// @brief Create a timer.
+/// @param name The name.
+/// @param callback The callback.
+/// @param arg The callback argument.
+/// @param handle The timer handle to fill.
+/// @return The result.
+esp_err_t hal_timer_create(const char* name, hal_timer_callback_t callback, void* arg, hal_timer_handle_t* handle);
+
+/// @brief Start a periodic timer.
+/// @param handle The timer handle.
+/// @param period_us The period in microseconds.
+/// @return The result.
+esp_err_t hal_timer_start_periodic(hal_timer_handle_t handle, uint64_t period_us);
+
+/// @brief Stop a timer.
+/// @param handle The timer handle.
+/// @return The result.
+esp_err_t hal_timer_stop(hal_timer_handle_t handle);
+
+/// @brief Create a started pulse counter unit, its count is accumulated past the hardware limits.
+/// @param channels The channels.
+/// @param num_of_channels The number of channels, at most 2.
+/// @param glitch_filter_ns The pulses shorter than this are ignored, 0 for no filter.
+/// @param handle The pulse counter handle to fill.
+/// @return The result.
+esp_err_t hal_pcnt_create(const hal_pcnt_channel_config_t* channels, uint32_t num_of_channels, uint32_t glitch_filter_ns, hal_pcnt_handle_t* handle);
+
+/// @brief Get the accumulated count of a pulse counter unit.
+/// @param handle The pulse counter handle.
+/// @param count The count to fill.
+/// @return The result.
+esp_err_t hal_pcnt_get_count(hal_pcnt_handle_t handle, int* count);
+
+/// @brief Create a chain of parallel-in serial-out shift registers, as 74HC165, clocked in over SPI with DMA.
+/// @param load_gpio_num The parallel load GPIO, active low.
+/// @param clock_gpio_num The clock GPIO.
+/// @param data_gpio_num The serial data GPIO, the last output of the chain.
+/// @param num_of_bits The number of bits in the chain, a multiple of 8.
+/// @param clock_hz The clock rate.
+/// @param handle The shift register handle to fill.
+/// @return The result.
+esp_err_t hal_shift_in_create(int load_gpio_num, int clock_gpio_num, int data_gpio_num, uint32_t num_of_bits, uint32_t clock_hz, hal_shift_in_handle_t* handle);
+
+/// @brief Latch the parallel inputs and clock them in.
+/// @param handle The shift register handle.
+/// @param bits The bits to fill, bit n of word n / 32 is the n-th bit shifted out.
+/// @return The result.
+esp_err_t hal_shift_in_read(hal_shift_in_handle_t handle, uint32_t* bits);
+
+/// @brief Initialize ADC1 and the calibration of every channel.
+/// @param channels The channels, in scan order.
+/// @param num_of_channels The number of channels.
+/// @param sample_freq_hz The conversion rate of the continuous mode, over all the channels.
+/// @return The result.
+esp_err_t hal_adc_initialize(const uint8_t* channels, uint32_t num_of_channels, uint32_t sample_freq_hz);
+
+/// @brief Deinitialize ADC1.
+void hal_adc_deinitialize(void);
+
+/// @brief Register the callbacks of the continuous mode, between hal_adc_initialize() and hal_adc_start().
+/// With a frame callback the frames are taken in the ISR and hal_adc_read() is not used, so the overflows
+/// of the pool are not reported.
+/// @param on_frame The frame callback, NULL to pool the frames.
+/// @param on_overflow The overflow callback, NULL for none.
+/// @param arg The callback argument.
+/// @return The result.
+esp_err_t hal_adc_register_callbacks(hal_adc_frame_callback_t on_frame, hal_adc_overflow_callback_t on_overflow, void* arg);
+
+/// @brief Start the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_start(void);
+
+/// @brief Stop the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_stop(void);
+
+/// @brief Read the pending continuous conversions without blocking.
+/// @param samples The samples to fill.
+/// @param max_samples The size of samples.
+/// @param num_of_samples The number of filled samples.
+/// @return ESP_OK, or ESP_ERR_TIMEOUT if no conversion is pending.
+esp_err_t hal_adc_read(hal_adc_sample_t* samples, uint32_t max_samples, uint32_t* num_of_samples);
+
+/// @brief Convert one channel in oneshot mode.
+/// @param channel The channel.
+/// @param raw The raw conversion code to fill.
+/// @return The result.
+esp_err_t hal_adc_read_oneshot(uint32_t channel, int* raw);
+
+/// @brief Convert a raw code of a channel to the calibrated voltage.
+/// @param channel The channel.
+/// @param raw The raw conversion code.
+/// @param voltage The voltage in millivolts to fill.
+/// @return The result.
+esp_err_t hal_adc_raw_to_voltage(uint32_t channel, int raw, int* voltage);
+
+/// @brief Map the start of a data partition read-only, the data is read through the flash cache.
+/// @param label The partition label.
+/// @param size The size to map.
+/// @param data The mapped data to fill.
+/// @return The result.
+esp_err_t hal_flash_map(const char* label, size_t size, const void** data);
+
+/// @brief Erase the start of a data partition and write it, which unmaps it.
+/// @param label The partition label.
+/// @param data The data.
+/// @param size The size of the data.
+/// @return The result.
+esp_err_t hal_flash_write(const char* label, const void* data, size_t size);
+
+/// @brief Send a UDP datagram.
+/// @param data The data.
+/// @param length The length of the data.
+/// @param addr The destination address.
+/// @return The sent length, or -1 with errno set.
+int hal_udp_send(const void* data, size_t length, const struct sockaddr_in* addr);
+
+/// @brief Receive a UDP datagram, blocking up to the socket timeout.
+/// @param buffer The buffer.
+/// @param size The size of the buffer.
+/// @param source_addr The source address to fill.
+/// @param flags The receive flags, e.g. MSG_DONTWAIT.
+/// @return The received length, or -1 with errno set.
+int hal_udp_receive(void* buffer, size_t size, struct sockaddr_storage* source_addr, int flags);
+
+#endif // __HAL_H__
@@ -0,0 +1,726 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "hal.h"
+#include "udp.h"
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/pulse_cnt.h"
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "soc/soc_caps.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_filter.h"
+#else
+#include "esp_adc/adc_oneshot.h"
+#endif
+#include "lwip/sockets.h"
+
+// The most timers created through the HAL.
+#define HAL_MAX_NUM_OF_TIMERS 2
+
+// The count limits of a pulse counter unit, the driver accumulates the count past them.
+#define HAL_PCNT_HIGH_LIMIT 32767
+#define HAL_PCNT_LOW_LIMIT -32768
+
+_Static_assert(HAL_PCNT_EDGE_DECREASE == (int)PCNT_CHANNEL_EDGE_ACTION_DECREASE, "The edge actions must match the driver.");
+_Static_assert(HAL_PCNT_LEVEL_HOLD == (int)PCNT_CHANNEL_LEVEL_ACTION_HOLD, "The level actions must match the driver.");
+
+/// @brief A pulse counter unit.
+struct hal_pcnt {
+  pcnt_unit_handle_t unit;
+};
+
+/// @brief A shift register chain on the SPI bus.
+struct hal_shift_in {
+  spi_device_handle_t device;
+  int load_gpio_num;
+  uint32_t num_of_bits;
+  // The DMA buffer.
+  uint8_t* buffer;
+};
+
+/// @brief A timer, dispatching an esp_timer ISR callback.
+struct hal_timer {
+  esp_timer_handle_t timer;
+  hal_timer_callback_t callback;
+  void* arg;
+};
+
+static const char* TAG = "hal";
+
+static struct hal_timer _timers[HAL_MAX_NUM_OF_TIMERS];
+static int _num_of_timers;
+
+static struct hal_pcnt _pcnts[SOC_PCNT_UNITS_PER_GROUP];
+static int _num_of_pcnts;
+
+static struct hal_shift_in _shift_in;
+
+// The mapping of hal_flash_map(), one at a time.
+static esp_partition_mmap_handle_t _flash_map_handle;
+static bool _is_flash_mapped;
+
+// @brief The ADC calibration handles of the ADC1 channels, every channel has its own compensation.
+static adc_cali_handle_t g_adc1_cali_handles[SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)];
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+// @brief The ADC continuous handle for ADC1.
+static adc_continuous_handle_t g_adc1_cont_handle = NULL;
+// @brief The ADC IIR filter handles for ADC1, one per channel while the channels are as few as the filters.
+static adc_iir_filter_handle_t g_adc1_iir_filter_handles[SOC_ADC_DIGI_IIR_FILTER_NUM];
+
+_Static_assert(
+  NAGI_AXIS_SAMPLE_FREQ_HZ * NAGI_MAX_NUM_OF_AXES >= SOC_ADC_SAMPLE_FREQ_THRES_LOW &&
+  NAGI_AXIS_SAMPLE_FREQ_HZ * NAGI_MAX_NUM_OF_AXES <= SOC_ADC_SAMPLE_FREQ_THRES_HIGH,
+  "The conversion rate of the scan is out of the ADC range."
+);
+
+static uint8_t g_conv_results[HAL_ADC_CONVERSIONS_PER_FRAME * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * NAGI_MAX_NUM_OF_AXES];
+
+// @brief The callbacks of the continuous mode and their argument.
+static hal_adc_frame_callback_t g_adc_frame_callback;
+static hal_adc_overflow_callback_t g_adc_overflow_callback;
+static void* g_adc_callback_arg;
+// @brief The conversions of the frame the ISR hands to the frame callback.
+static hal_adc_sample_t g_frame_samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+#else
+// @brief The ADC oneshot handle for ADC1.
+static adc_oneshot_unit_handle_t g_adc1_oneshot_handle = NULL;
+#endif
+
+/// @brief Get the time since boot.
+/// @return The time in microseconds.
+int64_t IRAM_ATTR hal_get_time_us(void) {
+  return esp_timer_get_time();
+}
+
+/// @brief Get the CPU cycle count, for profiling.
+/// @return The cycle count.
+uint32_t IRAM_ATTR hal_get_cycle_count(void) {
+  return esp_cpu_get_cycle_count();
+}
+
+/// @brief Get the CPU cycles per microsecond.
+/// @return The cycles per microsecond.
+uint32_t hal_get_cycles_per_us(void) {
+  return esp_rom_get_cpu_ticks_per_us();
+}
+
+/// @brief Busy-wait.
+/// @param time_us The time in microseconds.
+void IRAM_ATTR hal_delay_us(uint32_t time_us) {
+  esp_rom_delay_us(time_us);
+}
+
+/// @brief Configure GPIOs as outputs, set high.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_open_drain True to only pull low, high is left to the pull-ups.
+/// @return The result.
+esp_err_t hal_gpio_config_output(uint64_t pin_bit_mask, bool is_open_drain) {
+  for (int i = 0; i < GPIO_NUM_MAX; i++) {
+    if (pin_bit_mask & (1ULL << i)) {
+      gpio_set_level(i, 1);
+    }
+  }
+  gpio_config_t io_conf = {
+    .intr_type = GPIO_INTR_DISABLE,
+    .mode = is_open_drain ? GPIO_MODE_OUTPUT_OD : GPIO_MODE_OUTPUT,
+    .pin_bit_mask = pin_bit_mask,
+    .pull_down_en = 0,
+    .pull_up_en = 0,
+  };
+  return gpio_config(&io_conf);
+}
+
+/// @brief Set the level of an output GPIO.
+/// @param gpio_num The GPIO number.
+/// @param level The level, 0 or 1.
+void IRAM_ATTR hal_gpio_set_level(int gpio_num, int level) {
+  gpio_set_level(gpio_num, level);
+}
+
+/// @brief Configure GPIOs as inputs with the internal pull-up.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_interrupt_enabled True to interrupt on any edge.
+/// @return The result.
+esp_err_t hal_gpio_config_input(uint64_t pin_bit_mask, bool is_interrupt_enabled) {
+  gpio_config_t io_conf = {
+    .intr_type = is_interrupt_enabled ? GPIO_INTR_ANYEDGE : GPIO_INTR_DISABLE,
+    .mode = GPIO_MODE_INPUT,        // Set as input mode.
+    .pin_bit_mask = pin_bit_mask,
+    .pull_down_en = 0,              // Disable the internal pull-down resistor.
+    .pull_up_en = 1,                // Use the internal pull-up resistor.
+  };
+  return gpio_config(&io_conf);
+}
+
+/// @brief Get the level of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @return The level, 0 or 1.
+int IRAM_ATTR hal_gpio_get_level(int gpio_num) {
+  return gpio_get_level(gpio_num);
+}
+
+/// @brief Get the levels of the first 32 GPIOs with one read of the input register.
+/// @return The levels, bit gpio_num is the level of the GPIO.
+uint32_t IRAM_ATTR hal_gpio_get_levels(void) {
+  return REG_READ(GPIO_IN_REG);
+}
+
+/// @brief Add the interrupt handler of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @param handler The handler.
+/// @param arg The handler argument.
+/// @return The result.
+esp_err_t hal_gpio_add_isr(int gpio_num, hal_isr_t handler, void* arg) {
+  // Install the ISR service, it may be already installed by another module.
+  esp_err_t err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    return err;
+  }
+  return gpio_isr_handler_add(gpio_num, handler, arg);
+}
+
+/// @brief The esp_timer callback, dispatched from the timer ISR.
+/// @param arg The timer.
+static void IRAM_ATTR timer_isr_callback(void* arg) {
+  struct hal_timer* timer = (struct hal_timer*)arg;
+  if (timer->callback(timer->arg)) {
+    esp_timer_isr_dispatch_need_yield();
+  }
+}
+
+/// @brief Create a timer.
+/// @param name The name.
+/// @param callback The callback.
+/// @param arg The callback argument.
+/// @param handle The timer handle to fill.
+/// @return The result.
+esp_err_t hal_timer_create(const char* name, hal_timer_callback_t callback, void* arg, hal_timer_handle_t* handle) {
+  if (_num_of_timers >= HAL_MAX_NUM_OF_TIMERS) {
+    return ESP_ERR_NO_MEM;
+  }
+  struct hal_timer* timer = &_timers[_num_of_timers];
+  timer->callback = callback;
+  timer->arg = arg;
+
+  const esp_timer_create_args_t timer_args = {
+    .callback = timer_isr_callback,
+    .arg = timer,
+    .dispatch_method = ESP_TIMER_ISR,
+    .name = name,
+    .skip_unhandled_events = true,
+  };
+  esp_err_t err = esp_timer_create(&timer_args, &timer->timer);
+  if (err != ESP_OK) {
+    return err;
+  }
+  _num_of_timers++;
+  *handle = timer;
+  return ESP_OK;
+}
+
+/// @brief Start a periodic timer.
+/// @param handle The timer handle.
+/// @param period_us The period in microseconds.
+/// @return The result.
+esp_err_t hal_timer_start_periodic(hal_timer_handle_t handle, uint64_t period_us) {
+  return esp_timer_start_periodic(handle->timer, period_us);
+}
+
+/// @brief Stop a timer.
+/// @param handle The timer handle.
+/// @return The result.
+esp_err_t hal_timer_stop(hal_timer_handle_t handle) {
+  return esp_timer_stop(handle->timer);
+}
+
+/// @brief Create a started pulse counter unit, its count is accumulated past the hardware limits.
+/// @param channels The channels.
+/// @param num_of_channels The number of channels, at most 2.
+/// @param glitch_filter_ns The pulses shorter than this are ignored, 0 for no filter.
+/// @param handle The pulse counter handle to fill.
+/// @return The result.
+esp_err_t hal_pcnt_create(const hal_pcnt_channel_config_t* channels, uint32_t num_of_channels, uint32_t glitch_filter_ns, hal_pcnt_handle_t* handle) {
+  if (num_of_channels == 0 || num_of_channels > SOC_PCNT_CHANNELS_PER_UNIT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (_num_of_pcnts >= SOC_PCNT_UNITS_PER_GROUP) {
+    return ESP_ERR_NO_MEM;
+  }
+  struct hal_pcnt* pcnt = &_pcnts[_num_of_pcnts];
+
+  pcnt_unit_config_t unit_config = {
+    .high_limit = HAL_PCNT_HIGH_LIMIT,
+    .low_limit = HAL_PCNT_LOW_LIMIT,
+    .flags.accum_count = true,
+  };
+  esp_err_t err = pcnt_new_unit(&unit_config, &pcnt->unit);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (glitch_filter_ns > 0) {
+    pcnt_glitch_filter_config_t filter_config = {
+      .max_glitch_ns = glitch_filter_ns,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt->unit, &filter_config));
+  }
+
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    pcnt_chan_config_t chan_config = {
+      .edge_gpio_num = channels[i].edge_gpio_num,
+      .level_gpio_num = channels[i].level_gpio_num,
+    };
+    pcnt_channel_handle_t channel = NULL;
+    ESP_ERROR_CHECK(pcnt_new_channel(pcnt->unit, &chan_config, &channel));
+    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(channel, channels[i].pos_edge_action, channels[i].neg_edge_action));
+    ESP_ERROR_CHECK(pcnt_channel_set_level_action(channel, channels[i].high_level_action, channels[i].low_level_action));
+  }
+
+  // The driver accumulates an overflow when the count reaches a watch point at a limit.
+  ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt->unit, HAL_PCNT_HIGH_LIMIT));
+  ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt->unit, HAL_PCNT_LOW_LIMIT));
+
+  ESP_ERROR_CHECK(pcnt_unit_enable(pcnt->unit));
+  ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt->unit));
+  ESP_ERROR_CHECK(pcnt_unit_start(pcnt->unit));
+
+  _num_of_pcnts++;
+  *handle = pcnt;
+  return ESP_OK;
+}
+
+/// @brief Get the accumulated count of a pulse counter unit.
+/// @param handle The pulse counter handle.
+/// @param count The count to fill.
+/// @return The result.
+esp_err_t hal_pcnt_get_count(hal_pcnt_handle_t handle, int* count) {
+  return pcnt_unit_get_count(handle->unit, count);
+}
+
+/// @brief Create a chain of parallel-in serial-out shift registers, as 74HC165, clocked in over SPI with DMA.
+/// @param load_gpio_num The parallel load GPIO, active low.
+/// @param clock_gpio_num The clock GPIO.
+/// @param data_gpio_num The serial data GPIO, the last output of the chain.
+/// @param num_of_bits The number of bits in the chain, a multiple of 8.
+/// @param clock_hz The clock rate.
+/// @param handle The shift register handle to fill.
+/// @return The result.
+esp_err_t hal_shift_in_create(int load_gpio_num, int clock_gpio_num, int data_gpio_num, uint32_t num_of_bits, uint32_t clock_hz, hal_shift_in_handle_t* handle) {
+  if (num_of_bits == 0 || num_of_bits % 8 != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (_shift_in.device != NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  struct hal_shift_in* shift_in = &_shift_in;
+
+  spi_bus_config_t bus_config = {
+    .sclk_io_num = clock_gpio_num,
+    .miso_io_num = data_gpio_num,
+    .mosi_io_num = -1,
+    .quadwp_io_num = -1,
+    .quadhd_io_num = -1,
+    .max_transfer_sz = num_of_bits / 8,
+  };
+  esp_err_t err = spi_bus_initialize(SPI2_HOST, &bus_config, SPI_DMA_CH_AUTO);
+  if (err != ESP_OK) {
+    return err;
+  }
+  // The first bit out lands in bit 0, so the bytes are the input mask as they are.
+  spi_device_interface_config_t device_config = {
+    .clock_speed_hz = clock_hz,
+    .mode = 0,
+    .spics_io_num = -1,
+    .queue_size = 1,
+    .flags = SPI_DEVICE_HALFDUPLEX | SPI_DEVICE_RXBIT_LSBFIRST,
+  };
+  err = spi_bus_add_device(SPI2_HOST, &device_config, &shift_in->device);
+  if (err != ESP_OK) {
+    spi_bus_free(SPI2_HOST);
+    return err;
+  }
+  // The DMA writes whole words.
+  shift_in->buffer = heap_caps_calloc(1, (num_of_bits / 8 + 3) & ~3, MALLOC_CAP_DMA);
+  if (shift_in->buffer == NULL) {
+    spi_bus_remove_device(shift_in->device);
+    spi_bus_free(SPI2_HOST);
+    shift_in->device = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  shift_in->load_gpio_num = load_gpio_num;
+  shift_in->num_of_bits = num_of_bits;
+  ESP_ERROR_CHECK(hal_gpio_config_output(1ULL << load_gpio_num, false));
+
+  *handle = shift_in;
+  return ESP_OK;
+}
+
+/// @brief Latch the parallel inputs and clock them in.
+/// @param handle The shift register handle.
+/// @param bits The bits to fill, bit n of word n / 32 is the n-th bit shifted out.
+/// @return The result.
+esp_err_t hal_shift_in_read(hal_shift_in_handle_t handle, uint32_t* bits) {
+  // A low pulse on the load latches the inputs, the 74HC165 needs 100 ns at 2 V.
+  gpio_set_level(handle->load_gpio_num, 0);
+  esp_rom_delay_us(1);
+  gpio_set_level(handle->load_gpio_num, 1);
+
+  spi_transaction_t transaction = {
+    .rxlength = handle->num_of_bits,
+    .rx_buffer = handle->buffer,
+  };
+  esp_err_t err = spi_device_polling_transmit(handle->device, &transaction);
+  if (err != ESP_OK) {
+    return err;
+  }
+  memcpy(bits, handle->buffer, handle->num_of_bits / 8);
+  return ESP_OK;
+}
+
+/// @brief Initialize ADC1 and the calibration of every channel.
+/// @param channels The channels, in scan order.
+/// @param num_of_channels The number of channels.
+/// @param sample_freq_hz The conversion rate of the continuous mode, over all the channels.
+/// @return The result.
+esp_err_t hal_adc_initialize(const uint8_t* channels, uint32_t num_of_channels, uint32_t sample_freq_hz) {
+  if (num_of_channels == 0 || num_of_channels > NAGI_MAX_NUM_OF_AXES) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    if (channels[i] >= SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)) {
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+
+  // Initialize the ADC calibration.
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    adc_cali_curve_fitting_config_t cali_config = {
+      .unit_id = ADC_UNIT_1,
+      .chan = channels[i],
+      .atten = ADC_ATTEN_DB_12,
+      .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+
+    ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&cali_config, &g_adc1_cali_handles[channels[i]]));
+  }
+
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  // Initialize the ADC continuous.
+  adc_continuous_handle_cfg_t adc_config = {
+    .max_store_buf_size = HAL_ADC_CONVERSIONS_PER_FRAME * 2 * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * num_of_channels,
+    .conv_frame_size = HAL_ADC_CONVERSIONS_PER_FRAME * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * num_of_channels,
+  };
+
+  ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &g_adc1_cont_handle));
+
+  adc_continuous_config_t adc_cont_config = {
+    .sample_freq_hz = sample_freq_hz,
+    .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+    .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+  };
+
+  adc_digi_pattern_config_t adc_patterns[NAGI_MAX_NUM_OF_AXES];
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    adc_patterns[i] = (adc_digi_pattern_config_t){
+      .atten = ADC_ATTEN_DB_12,
+      .bit_width = ADC_BITWIDTH_12,
+      .channel = channels[i],
+      .unit = ADC_UNIT_1,
+    };
+  }
+
+  adc_cont_config.pattern_num = num_of_channels;
+  adc_cont_config.adc_pattern = adc_patterns;
+
+  ESP_ERROR_CHECK(adc_continuous_config(g_adc1_cont_handle, &adc_cont_config));
+
+  // Filter every channel or none, so the axes respond alike, the frame average smooths the rest.
+  if (num_of_channels <= SOC_ADC_DIGI_IIR_FILTER_NUM) {
+    for (uint32_t i = 0; i < num_of_channels; i++) {
+      adc_continuous_iir_filter_config_t adc_iir_filter_config = {
+        .unit = ADC_UNIT_1,
+        .channel = channels[i],
+        .coeff = ADC_DIGI_IIR_FILTER_COEFF_8,
+      };
+
+      ESP_ERROR_CHECK(adc_new_continuous_iir_filter(g_adc1_cont_handle, &adc_iir_filter_config, &g_adc1_iir_filter_handles[i]));
+      ESP_ERROR_CHECK(adc_continuous_iir_filter_enable(g_adc1_iir_filter_handles[i]));
+    }
+  } else {
+    ESP_LOGI(TAG, "%lu ADC channels and %d IIR filters, the channels are not filtered.", num_of_channels, SOC_ADC_DIGI_IIR_FILTER_NUM);
+  }
+
+  // Fill the conversion results with 0x0.
+  memset(g_conv_results, 0x0, sizeof(g_conv_results));
+#else
+  // Initialize the ADC oneshot.
+  adc_oneshot_unit_init_cfg_t adc_oneshot_config = {
+    .unit_id = ADC_UNIT_1,
+  };
+
+  ESP_ERROR_CHECK(adc_oneshot_new_unit(&adc_oneshot_config, &g_adc1_oneshot_handle));
+
+  adc_oneshot_chan_cfg_t adc_oneshot_chan_config = {
+    .bitwidth = ADC_BITWIDTH_12,
+    .atten = ADC_ATTEN_DB_12,
+  };
+
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    ESP_ERROR_CHECK(adc_oneshot_config_channel(g_adc1_oneshot_handle, channels[i], &adc_oneshot_chan_config));
+  }
+#endif
+
+  return ESP_OK;
+}
+
+/// @brief Deinitialize ADC1.
+void hal_adc_deinitialize(void) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  // Deinitialize the ADC IIR filters.
+  for (int i = 0; i < SOC_ADC_DIGI_IIR_FILTER_NUM; i++) {
+    if (g_adc1_iir_filter_handles[i] != NULL) {
+      adc_continuous_iir_filter_disable(g_adc1_iir_filter_handles[i]);
+      adc_del_continuous_iir_filter(g_adc1_iir_filter_handles[i]);
+      g_adc1_iir_filter_handles[i] = NULL;
+    }
+  }
+  // Deinitialize the ADC continuous.
+  if (g_adc1_cont_handle != NULL) {
+    adc_continuous_deinit(g_adc1_cont_handle);
+    g_adc1_cont_handle = NULL;
+  }
+#else
+  // Deinitialize the ADC oneshot.
+  if (g_adc1_oneshot_handle != NULL) {
+    adc_oneshot_del_unit(g_adc1_oneshot_handle);
+    g_adc1_oneshot_handle = NULL;
+  }
+#endif
+
+  // Deinitialize the ADC calibration.
+  for (int i = 0; i < SOC_ADC_CHANNEL_NUM(ADC_UNIT_1); i++) {
+    if (g_adc1_cali_handles[i] != NULL) {
+      adc_cali_delete_scheme_curve_fitting(g_adc1_cali_handles[i]);
+      g_adc1_cali_handles[i] = NULL;
+    }
+  }
+}
+
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+/// @brief Decode a finished frame and hand it to the frame callback, in the ADC ISR.
+/// @param handle The ADC continuous handle.
+/// @param edata The frame.
+/// @param user_data The user data.
+/// @return True if a higher priority task was woken.
+static bool IRAM_ATTR on_adc_conv_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data) {
+  uint32_t num_of_samples = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= edata->size; i += SOC_ADC_DIGI_RESULT_BYTES) {
+    const adc_digi_output_data_t* p = (const adc_digi_output_data_t*)&edata->conv_frame_buffer[i];
+    if (p->type2.channel < SOC_ADC_CHANNEL_NUM(ADC_UNIT_1) && num_of_samples < sizeof(g_frame_samples) / sizeof(g_frame_samples[0])) {
+      g_frame_samples[num_of_samples].channel = p->type2.channel;
+      g_frame_samples[num_of_samples].raw = p->type2.data;
+      num_of_samples++;
+    }
+  }
+  return g_adc_frame_callback(g_frame_samples, num_of_samples, g_adc_callback_arg);
+}
+
+/// @brief Report a frame lost to a full pool, in the ADC ISR.
+/// @param handle The ADC continuous handle.
+/// @param edata The event data.
+/// @param user_data The user data.
+/// @return True if a higher priority task was woken.
+static bool IRAM_ATTR on_adc_pool_ovf(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data) {
+  return g_adc_overflow_callback(g_adc_callback_arg);
+}
+#endif
+
+/// @brief Register the callbacks of the continuous mode, between hal_adc_initialize() and hal_adc_start().
+/// @param on_frame The frame callback, NULL to pool the frames.
+/// @param on_overflow The overflow callback, NULL for none.
+/// @param arg The callback argument.
+/// @return The result.
+esp_err_t hal_adc_register_callbacks(hal_adc_frame_callback_t on_frame, hal_adc_overflow_callback_t on_overflow, void* arg) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  g_adc_frame_callback = on_frame;
+  g_adc_overflow_callback = on_overflow;
+  g_adc_callback_arg = arg;
+  // The driver still pools the frames the ISR takes, and nothing reads them, so the pool is full for good.
+  adc_continuous_evt_cbs_t cbs = {
+    .on_conv_done = on_frame != NULL ? on_adc_conv_done : NULL,
+    .on_pool_ovf = on_frame == NULL && on_overflow != NULL ? on_adc_pool_ovf : NULL,
+  };
+  return adc_continuous_register_event_callbacks(g_adc1_cont_handle, &cbs, NULL);
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/// @brief Start the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_start(void) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  return adc_continuous_start(g_adc1_cont_handle);
+#else
+  return ESP_OK;
+#endif
+}
+
+/// @brief Stop the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_stop(void) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  return adc_continuous_stop(g_adc1_cont_handle);
+#else
+  return ESP_OK;
+#endif
+}
+
+/// @brief Read the pending continuous conversions without blocking.
+/// @param samples The samples to fill.
+/// @param max_samples The size of samples.
+/// @param num_of_samples The number of filled samples.
+/// @return ESP_OK, or ESP_ERR_TIMEOUT if no conversion is pending.
+esp_err_t hal_adc_read(hal_adc_sample_t* samples, uint32_t max_samples, uint32_t* num_of_samples) {
+  *num_of_samples = 0;
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  uint32_t length = max_samples * SOC_ADC_DIGI_RESULT_BYTES;
+  if (length > sizeof(g_conv_results)) {
+    length = sizeof(g_conv_results);
+  }
+  uint32_t ret_num = 0;
+  esp_err_t ret = adc_continuous_read(g_adc1_cont_handle, g_conv_results, length, &ret_num, 0);
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  for (uint32_t i = 0; i < ret_num; i += SOC_ADC_DIGI_RESULT_BYTES) {
+    adc_digi_output_data_t *p = (adc_digi_output_data_t*)&g_conv_results[i];
+    uint32_t chan_num = p->type2.channel;
+    if (chan_num >= SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)) {
+      ESP_LOGW(TAG, "Invalid ADC channel number %lu", chan_num);
+      continue;
+    }
+    samples[*num_of_samples].channel = chan_num;
+    samples[*num_of_samples].raw = p->type2.data;
+    (*num_of_samples)++;
+  }
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/// @brief Convert one channel in oneshot mode.
+/// @param channel The channel.
+/// @param raw The raw conversion code to fill.
+/// @return The result.
+esp_err_t hal_adc_read_oneshot(uint32_t channel, int* raw) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  return ESP_ERR_NOT_SUPPORTED;
+#else
+  return adc_oneshot_read(g_adc1_oneshot_handle, channel, raw);
+#endif
+}
+
+/// @brief Convert a raw code of a channel to the calibrated voltage.
+/// @param channel The channel.
+/// @param raw The raw conversion code.
+/// @param voltage The voltage in millivolts to fill.
+/// @return The result.
+esp_err_t hal_adc_raw_to_voltage(uint32_t channel, int raw, int* voltage) {
+  if (channel >= SOC_ADC_CHANNEL_NUM(ADC_UNIT_1) || g_adc1_cali_handles[channel] == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return adc_cali_raw_to_voltage(g_adc1_cali_handles[channel], raw, voltage);
+}
+
+/// @brief Find a data partition by its label.
+/// @param label The partition label.
+/// @param size The size to fit.
+/// @param partition The partition to fill.
+/// @return The result.
+static esp_err_t find_data_partition(const char* label, size_t size, const esp_partition_t** partition) {
+  *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  if (*partition == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return size <= (*partition)->size ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+/// @brief Map the start of a data partition read-only, the data is read through the flash cache.
+/// @param label The partition label.
+/// @param size The size to map.
+/// @param data The mapped data to fill.
+/// @return The result.
+esp_err_t hal_flash_map(const char* label, size_t size, const void** data) {
+  const esp_partition_t* partition;
+  esp_err_t err = find_data_partition(label, size, &partition);
+  if (err != ESP_OK) {
+    return err;
+  }
+  if (_is_flash_mapped) {
+    esp_partition_munmap(_flash_map_handle);
+    _is_flash_mapped = false;
+  }
+  err = esp_partition_mmap(partition, 0, size, ESP_PARTITION_MMAP_DATA, data, &_flash_map_handle);
+  _is_flash_mapped = err == ESP_OK;
+  return err;
+}
+
+/// @brief Erase the start of a data partition and write it, which unmaps it.
+/// @param label The partition label.
+/// @param data The data.
+/// @param size The size of the data.
+/// @return The result.
+esp_err_t hal_flash_write(const char* label, const void* data, size_t size) {
+  const esp_partition_t* partition;
+  esp_err_t err = find_data_partition(label, size, &partition);
+  if (err != ESP_OK) {
+    return err;
+  }
+  // The cache would keep serving the old data through the mapping.
+  if (_is_flash_mapped) {
+    esp_partition_munmap(_flash_map_handle);
+    _is_flash_mapped = false;
+  }
+  size_t erase_size = (size + partition->erase_size - 1) / partition->erase_size * partition->erase_size;
+  err = esp_partition_erase_range(partition, 0, erase_size);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return esp_partition_write(partition, 0, data, size);
+}
+
+/// @brief Send a UDP datagram.
+/// @param data The data.
+/// @param length The length of the data.
+/// @param addr The destination address.
+/// @return The sent length, or -1 with errno set.
+int hal_udp_send(const void* data, size_t length, const struct sockaddr_in* addr) {
+  return sendto(g_sock, data, length, 0, (const struct sockaddr*)addr, sizeof(struct sockaddr_in));
+}
+
+/// @brief Receive a UDP datagram, blocking up to the socket timeout.
+/// @param buffer The buffer.
+/// @param size The size of the buffer.
+/// @param source_addr The source address to fill.
+/// @param flags The receive flags, e.g. MSG_DONTWAIT.
+/// @return The received length, or -1 with errno set.
+int hal_udp_receive(void* buffer, size_t size, struct sockaddr_storage* source_addr, int flags) {
+  socklen_t socklen = sizeof(struct sockaddr_storage);
+  return recvfrom(g_sock, buffer, size, flags, (struct sockaddr*)source_addr, &socklen);
+}
@@ -0,0 +1,908 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/sockets.h"
+
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+
+// The number of simulated GPIOs.
+#define SIM_NUM_OF_GPIOS 64
+#define SIM_MAX_SHIFT_IN_BITS 128
+// The most timers created through the HAL.
+#define SIM_MAX_NUM_OF_TIMERS 2
+// The most replies of the in-process server in flight.
+#define SIM_MAX_NUM_OF_REPLIES 256
+// The receive timeout of the UDP client, as its SO_RCVTIMEO.
+#define SIM_UDP_TIMEOUT_US 1000000
+// The frames the pool holds, as hal_esp.c configures the driver.
+#define SIM_ADC_POOL_FRAMES 2
+// The IIR filter coefficient, as ADC_DIGI_IIR_FILTER_COEFF_8.
+#define SIM_ADC_IIR_COEFF 8
+// The IIR filters and the ADC1 channels, as SOC_ADC_DIGI_IIR_FILTER_NUM and SOC_ADC_CHANNEL_NUM.
+#define SIM_ADC_IIR_FILTERS 2
+#define SIM_ADC_CHANNELS 7
+// The size of the simulated data partition of hal_flash_map().
+#define SIM_FLASH_SIZE 0xF000
+// The pulse counter units, as SOC_PCNT_UNITS_PER_GROUP.
+#define SIM_MAX_NUM_OF_PCNTS 4
+// The count limit of a pulse counter unit, far below the hardware one so a run exercises the accumulation.
+#define SIM_PCNT_LIMIT 100
+
+/// @brief A simulated esp_timer.
+struct hal_timer {
+  hal_timer_callback_t callback;
+  void* arg;
+  int64_t period_us;
+  int64_t next_time_us;
+  bool is_running;
+};
+
+/// @brief A simulated pulse counter unit.
+struct hal_pcnt {
+  hal_pcnt_channel_config_t channels[2];
+  uint32_t num_of_channels;
+  int64_t glitch_filter_ns;
+  // The hardware count, cleared at a limit.
+  int count;
+  // The count accumulated at the limits, as the driver does with accum_count.
+  int accumulated;
+  // The time of the last edge and its change of the count, per channel.
+  int64_t last_edge_us[2];
+  int last_delta[2];
+};
+
+/// @brief A reply of the in-process server.
+typedef struct {
+  int64_t arrival_us;
+  size_t length;
+  uint8_t data[64];
+} sim_reply_t;
+
+// The clock.
+static bool _is_realtime;
+static int64_t _time_us;
+static int64_t _realtime_start_us;
+
+// The GPIOs.
+static uint8_t _gpio_levels[SIM_NUM_OF_GPIOS];
+static bool _gpio_is_driven[SIM_NUM_OF_GPIOS];
+static bool _gpio_is_interrupt_enabled[SIM_NUM_OF_GPIOS];
+static hal_isr_t _gpio_handlers[SIM_NUM_OF_GPIOS];
+static void* _gpio_handler_args[SIM_NUM_OF_GPIOS];
+static uint64_t _gpio_interrupts;
+// The levels of the first 32 GPIOs, kept in step with _gpio_levels as the input register is.
+static uint32_t _gpio_input_register;
+
+// The open drain outputs driven low, and the closed switches from every row GPIO to the column GPIOs.
+static uint64_t _gpio_low_outputs;
+static uint64_t _matrix_switches[SIM_NUM_OF_GPIOS];
+static uint64_t _matrix_columns;
+
+// The shift register chain.
+struct hal_shift_in {
+  int load_gpio_num;
+  uint32_t num_of_bits;
+  uint32_t clock_hz;
+};
+static struct hal_shift_in _shift_in;
+// The inputs are pulled up.
+static uint32_t _shift_in_levels[SIM_MAX_SHIFT_IN_BITS / 32] = {UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+// The pulse counters.
+static struct hal_pcnt _pcnts[SIM_MAX_NUM_OF_PCNTS];
+static int _num_of_pcnts;
+
+// The timers.
+static struct hal_timer _timers[SIM_MAX_NUM_OF_TIMERS];
+static int _num_of_timers;
+
+// The ADC.
+static sim_adc_signal_t _adc_signal;
+static bool _adc_is_filter_enabled = true;
+static uint8_t _adc_channels[NAGI_MAX_NUM_OF_AXES];
+static uint32_t _adc_num_of_channels;
+static uint32_t _adc_sample_freq_hz;
+static bool _adc_is_running;
+static int64_t _adc_start_us;
+// The next conversion to read, and the conversions skipped when the pool overflowed.
+static uint64_t _adc_read_index;
+static uint64_t _adc_skip_begin;
+static uint64_t _adc_skip_end;
+static int32_t _adc_filtered[NAGI_MAX_NUM_OF_AXES];
+static uint64_t _adc_conversions;
+static uint64_t _adc_dropped;
+// The callbacks of the continuous mode, and the next frame the ISR hands to the frame callback.
+static hal_adc_frame_callback_t _adc_frame_callback;
+static hal_adc_overflow_callback_t _adc_overflow_callback;
+static void* _adc_callback_arg;
+static uint64_t _adc_next_frame;
+// The conversion time of the newest sample hal_adc_read() returned.
+static int64_t _adc_read_us;
+
+// The flash, one data partition that reads erased until written.
+static uint8_t _flash[SIM_FLASH_SIZE];
+static bool _is_flash_initialized;
+
+// The UDP client.
+static sim_udp_handler_t _udp_handler;
+static struct sockaddr_in _udp_server_addr;
+static sim_reply_t _udp_replies[SIM_MAX_NUM_OF_REPLIES];
+static uint32_t _udp_reply_head;
+static uint32_t _udp_reply_tail;
+static int _udp_sock = -1;
+
+/// @brief Get the host monotonic time.
+/// @return The time in nanoseconds.
+static int64_t get_host_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// @brief Run the clock in real time instead of simulated time.
+/// @param is_realtime True for real time.
+void sim_set_realtime(bool is_realtime) {
+  _is_realtime = is_realtime;
+  _realtime_start_us = get_host_time_ns() / 1000 - _time_us;
+}
+
+/// @brief Advance the clock, in real time it sleeps until the time.
+/// @param time_us The time in microseconds.
+void sim_advance_time(int64_t time_us) {
+  if (_is_realtime) {
+    int64_t wake_ns = (_realtime_start_us + time_us) * 1000;
+    struct timespec ts = {
+      .tv_sec = wake_ns / 1000000000,
+      .tv_nsec = wake_ns % 1000000000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+  } else if (time_us > _time_us) {
+    _time_us = time_us;
+  }
+}
+
+/// @brief Get the time since boot.
+/// @return The time in microseconds.
+int64_t hal_get_time_us(void) {
+  if (_is_realtime) {
+    return get_host_time_ns() / 1000 - _realtime_start_us;
+  }
+  return _time_us;
+}
+
+/// @brief Get the CPU cycle count, for profiling.
+/// @return The host time in nanoseconds, so the stages are profiled on the host CPU.
+uint32_t hal_get_cycle_count(void) {
+  return (uint32_t)get_host_time_ns();
+}
+
+/// @brief Get the CPU cycles per microsecond.
+/// @return The cycles per microsecond.
+uint32_t hal_get_cycles_per_us(void) {
+  return 1000;
+}
+
+/// @brief Busy-wait, the simulated clock moves on.
+/// @param time_us The time in microseconds.
+void hal_delay_us(uint32_t time_us) {
+  sim_advance_time(hal_get_time_us() + time_us);
+}
+
+/// @brief Drive the switch matrix columns, a column is low when a closed switch joins it to a row driven low.
+static void update_matrix_columns(void) {
+  uint64_t low_columns = 0;
+  for (uint64_t rows = _gpio_low_outputs; rows != 0; rows &= rows - 1) {
+    low_columns |= _matrix_switches[__builtin_ctzll(rows)];
+  }
+  for (uint64_t columns = _matrix_columns; columns != 0; columns &= columns - 1) {
+    int gpio_num = __builtin_ctzll(columns);
+    sim_set_gpio_level(gpio_num, (low_columns >> gpio_num) & 1 ? 0 : 1);
+  }
+}
+
+/// @brief Configure GPIOs as outputs, set high.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_open_drain True to only pull low, high is left to the pull-ups.
+/// @return The result.
+esp_err_t hal_gpio_config_output(uint64_t pin_bit_mask, bool is_open_drain) {
+  (void)is_open_drain;
+  _gpio_low_outputs &= ~pin_bit_mask;
+  update_matrix_columns();
+  return ESP_OK;
+}
+
+/// @brief Set the level of an output GPIO.
+/// @param gpio_num The GPIO number.
+/// @param level The level, 0 or 1.
+void hal_gpio_set_level(int gpio_num, int level) {
+  if (gpio_num < 0 || gpio_num >= SIM_NUM_OF_GPIOS) {
+    return;
+  }
+  uint64_t bit = 1ULL << gpio_num;
+  _gpio_low_outputs = level ? _gpio_low_outputs & ~bit : _gpio_low_outputs | bit;
+  if (_matrix_switches[gpio_num] != 0) {
+    update_matrix_columns();
+  }
+}
+
+/// @brief Open or close a switch of a diode matrix, from a row output to a column input.
+/// @param row_gpio_num The row GPIO.
+/// @param column_gpio_num The column GPIO.
+/// @param is_closed True when the switch is closed, the button pressed.
+void sim_set_matrix_switch(int row_gpio_num, int column_gpio_num, bool is_closed) {
+  if (row_gpio_num < 0 || row_gpio_num >= SIM_NUM_OF_GPIOS || column_gpio_num < 0 || column_gpio_num >= SIM_NUM_OF_GPIOS) {
+    return;
+  }
+  uint64_t bit = 1ULL << column_gpio_num;
+  _matrix_switches[row_gpio_num] = is_closed ? _matrix_switches[row_gpio_num] | bit : _matrix_switches[row_gpio_num] & ~bit;
+  _matrix_columns |= bit;
+  update_matrix_columns();
+}
+
+/// @brief Configure GPIOs as inputs with the internal pull-up.
+/// @param pin_bit_mask The GPIOs, 1 << gpio_num.
+/// @param is_interrupt_enabled True to interrupt on any edge.
+/// @return The result.
+esp_err_t hal_gpio_config_input(uint64_t pin_bit_mask, bool is_interrupt_enabled) {
+  for (int i = 0; i < SIM_NUM_OF_GPIOS; i++) {
+    if (pin_bit_mask & (1ULL << i)) {
+      // An undriven input is pulled up.
+      if (!_gpio_is_driven[i]) {
+        _gpio_levels[i] = 1;
+        if (i < 32) {
+          _gpio_input_register |= 1u << i;
+        }
+      }
+      _gpio_is_interrupt_enabled[i] = is_interrupt_enabled;
+    }
+  }
+  return ESP_OK;
+}
+
+/// @brief Get the level of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @return The level, 0 or 1.
+int hal_gpio_get_level(int gpio_num) {
+  return gpio_num >= 0 && gpio_num < SIM_NUM_OF_GPIOS ? _gpio_levels[gpio_num] : 0;
+}
+
+/// @brief Get the levels of the first 32 GPIOs with one read of the input register.
+/// @return The levels, bit gpio_num is the level of the GPIO.
+uint32_t hal_gpio_get_levels(void) {
+  return _gpio_input_register;
+}
+
+/// @brief Add the interrupt handler of a GPIO.
+/// @param gpio_num The GPIO number.
+/// @param handler The handler.
+/// @param arg The handler argument.
+/// @return The result.
+esp_err_t hal_gpio_add_isr(int gpio_num, hal_isr_t handler, void* arg) {
+  if (gpio_num < 0 || gpio_num >= SIM_NUM_OF_GPIOS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  _gpio_handlers[gpio_num] = handler;
+  _gpio_handler_args[gpio_num] = arg;
+  return ESP_OK;
+}
+
+/// @brief Add a change to the count of a pulse counter unit.
+/// @param pcnt The pulse counter.
+/// @param delta The change.
+static void add_pcnt_count(struct hal_pcnt* pcnt, int delta) {
+  pcnt->count += delta;
+  if (pcnt->count >= SIM_PCNT_LIMIT || pcnt->count <= -SIM_PCNT_LIMIT) {
+    pcnt->accumulated += pcnt->count;
+    pcnt->count = 0;
+  }
+}
+
+/// @brief Count an edge on the pulse counters watching a GPIO.
+/// @param gpio_num The GPIO number.
+/// @param level The new level.
+static void count_pcnt_edge(int gpio_num, int level) {
+  int64_t now_us = hal_get_time_us();
+  for (int i = 0; i < _num_of_pcnts; i++) {
+    struct hal_pcnt* pcnt = &_pcnts[i];
+    for (uint32_t j = 0; j < pcnt->num_of_channels; j++) {
+      const hal_pcnt_channel_config_t* channel = &pcnt->channels[j];
+      if (channel->edge_gpio_num != gpio_num) {
+        continue;
+      }
+
+      // A pulse shorter than the filter never reaches the counter, so take back its first edge.
+      if (pcnt->last_edge_us[j] >= 0 && (now_us - pcnt->last_edge_us[j]) * 1000 < pcnt->glitch_filter_ns) {
+        add_pcnt_count(pcnt, -pcnt->last_delta[j]);
+        pcnt->last_edge_us[j] = -1;
+        continue;
+      }
+
+      hal_pcnt_edge_action_t action = level ? channel->pos_edge_action : channel->neg_edge_action;
+      int delta = action == HAL_PCNT_EDGE_INCREASE ? 1 : (action == HAL_PCNT_EDGE_DECREASE ? -1 : 0);
+      hal_pcnt_level_action_t level_action = hal_gpio_get_level(channel->level_gpio_num) ? channel->high_level_action : channel->low_level_action;
+      if (level_action == HAL_PCNT_LEVEL_INVERSE) {
+        delta = -delta;
+      } else if (level_action == HAL_PCNT_LEVEL_HOLD) {
+        delta = 0;
+      }
+      add_pcnt_count(pcnt, delta);
+      pcnt->last_edge_us[j] = now_us;
+      pcnt->last_delta[j] = delta;
+    }
+  }
+}
+
+/// @brief Drive a GPIO, the interrupt handler runs on a change.
+/// @param gpio_num The GPIO number.
+/// @param level The level, 0 or 1.
+void sim_set_gpio_level(int gpio_num, int level) {
+  if (gpio_num < 0 || gpio_num >= SIM_NUM_OF_GPIOS) {
+    return;
+  }
+  _gpio_is_driven[gpio_num] = true;
+  if (_gpio_levels[gpio_num] == level) {
+    return;
+  }
+  _gpio_levels[gpio_num] = level;
+  if (gpio_num < 32) {
+    _gpio_input_register = (_gpio_input_register & ~(1u << gpio_num)) | ((uint32_t)level << gpio_num);
+  }
+  count_pcnt_edge(gpio_num, level);
+  if (_gpio_is_interrupt_enabled[gpio_num] && _gpio_handlers[gpio_num] != NULL) {
+    _gpio_interrupts++;
+    _gpio_handlers[gpio_num](_gpio_handler_args[gpio_num]);
+  }
+}
+
+/// @brief Get the number of GPIO interrupts that ran a handler.
+/// @return The number of interrupts.
+uint64_t sim_get_gpio_interrupt_count(void) {
+  return _gpio_interrupts;
+}
+
+/// @brief Create a started pulse counter unit, its count is accumulated past the hardware limits.
+/// @param channels The channels.
+/// @param num_of_channels The number of channels, at most 2.
+/// @param glitch_filter_ns The pulses shorter than this are ignored, 0 for no filter.
+/// @param handle The pulse counter handle to fill.
+/// @return The result.
+esp_err_t hal_pcnt_create(const hal_pcnt_channel_config_t* channels, uint32_t num_of_channels, uint32_t glitch_filter_ns, hal_pcnt_handle_t* handle) {
+  if (num_of_channels == 0 || num_of_channels > 2) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (_num_of_pcnts >= SIM_MAX_NUM_OF_PCNTS) {
+    return ESP_ERR_NO_MEM;
+  }
+  struct hal_pcnt* pcnt = &_pcnts[_num_of_pcnts++];
+  memset(pcnt, 0, sizeof(*pcnt));
+  memcpy(pcnt->channels, channels, num_of_channels * sizeof(hal_pcnt_channel_config_t));
+  pcnt->num_of_channels = num_of_channels;
+  pcnt->glitch_filter_ns = glitch_filter_ns;
+  pcnt->last_edge_us[0] = pcnt->last_edge_us[1] = -1;
+  *handle = pcnt;
+  return ESP_OK;
+}
+
+/// @brief Get the accumulated count of a pulse counter unit.
+/// @param handle The pulse counter handle.
+/// @param count The count to fill.
+/// @return The result.
+esp_err_t hal_pcnt_get_count(hal_pcnt_handle_t handle, int* count) {
+  *count = handle->accumulated + handle->count;
+  return ESP_OK;
+}
+
+/// @brief Create a chain of parallel-in serial-out shift registers, as 74HC165, clocked in over SPI with DMA.
+/// @param load_gpio_num The parallel load GPIO, active low.
+/// @param clock_gpio_num The clock GPIO.
+/// @param data_gpio_num The serial data GPIO, the last output of the chain.
+/// @param num_of_bits The number of bits in the chain, a multiple of 8.
+/// @param clock_hz The clock rate.
+/// @param handle The shift register handle to fill.
+/// @return The result.
+esp_err_t hal_shift_in_create(int load_gpio_num, int clock_gpio_num, int data_gpio_num, uint32_t num_of_bits, uint32_t clock_hz, hal_shift_in_handle_t* handle) {
+  (void)clock_gpio_num;
+  (void)data_gpio_num;
+  if (clock_hz == 0 || num_of_bits == 0 || num_of_bits % 8 != 0 || num_of_bits > SIM_MAX_SHIFT_IN_BITS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  _shift_in.load_gpio_num = load_gpio_num;
+  _shift_in.num_of_bits = num_of_bits;
+  _shift_in.clock_hz = clock_hz;
+  *handle = &_shift_in;
+  return ESP_OK;
+}
+
+/// @brief Latch the parallel inputs and clock them in.
+/// @param handle The shift register handle.
+/// @param bits The bits to fill, bit n of word n / 32 is the n-th bit shifted out.
+/// @return The result.
+esp_err_t hal_shift_in_read(hal_shift_in_handle_t handle, uint32_t* bits) {
+  // The load pulse, then the bits at the clock rate, rounded up.
+  hal_delay_us(1 + (uint32_t)(((uint64_t)handle->num_of_bits * 1000000 + handle->clock_hz - 1) / handle->clock_hz));
+  memcpy(bits, _shift_in_levels, handle->num_of_bits / 8);
+  return ESP_OK;
+}
+
+/// @brief Set a parallel input of the shift register chain.
+/// @param bit The input, in the order the bits are shifted out.
+/// @param level The level, 0 or 1.
+void sim_set_shift_in_level(int bit, int level) {
+  if (bit < 0 || bit >= SIM_MAX_SHIFT_IN_BITS) {
+    return;
+  }
+  uint32_t mask = 1u << (bit % 32);
+  _shift_in_levels[bit / 32] = level ? _shift_in_levels[bit / 32] | mask : _shift_in_levels[bit / 32] & ~mask;
+}
+
+/// @brief Create a timer.
+/// @param name The name.
+/// @param callback The callback.
+/// @param arg The callback argument.
+/// @param handle The timer handle to fill.
+/// @return The result.
+esp_err_t hal_timer_create(const char* name, hal_timer_callback_t callback, void* arg, hal_timer_handle_t* handle) {
+  (void)name;
+  if (_num_of_timers >= SIM_MAX_NUM_OF_TIMERS) {
+    return ESP_ERR_NO_MEM;
+  }
+  struct hal_timer* timer = &_timers[_num_of_timers++];
+  timer->callback = callback;
+  timer->arg = arg;
+  timer->is_running = false;
+  *handle = timer;
+  return ESP_OK;
+}
+
+/// @brief Start a periodic timer.
+/// @param handle The timer handle.
+/// @param period_us The period in microseconds.
+/// @return The result.
+esp_err_t hal_timer_start_periodic(hal_timer_handle_t handle, uint64_t period_us) {
+  if (handle->is_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  handle->period_us = period_us;
+  handle->next_time_us = hal_get_time_us() + period_us;
+  handle->is_running = true;
+  return ESP_OK;
+}
+
+/// @brief Stop a timer.
+/// @param handle The timer handle.
+/// @return The result.
+esp_err_t hal_timer_stop(hal_timer_handle_t handle) {
+  if (!handle->is_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  handle->is_running = false;
+  return ESP_OK;
+}
+
+// The ADC ISR, on the simulated clock as the timer ISR.
+static int64_t get_adc_frame_time(uint64_t frame);
+static void run_adc_frames(int64_t now_us);
+
+/// @brief Get the time of the next timer alarm, or ADC frame with a frame callback.
+/// @return The time in microseconds, INT64_MAX if no timer is running.
+int64_t sim_get_next_timer_time(void) {
+  int64_t next_time_us = INT64_MAX;
+  for (int i = 0; i < _num_of_timers; i++) {
+    if (_timers[i].is_running && _timers[i].next_time_us < next_time_us) {
+      next_time_us = _timers[i].next_time_us;
+    }
+  }
+  if (_adc_is_running && _adc_frame_callback != NULL) {
+    int64_t frame_time_us = get_adc_frame_time(_adc_next_frame);
+    next_time_us = frame_time_us < next_time_us ? frame_time_us : next_time_us;
+  }
+  return next_time_us;
+}
+
+/// @brief Run the callbacks of the due timers and ADC frames.
+void sim_run_timers(void) {
+  int64_t now_us = hal_get_time_us();
+  for (int i = 0; i < _num_of_timers; i++) {
+    struct hal_timer* timer = &_timers[i];
+    // The timer ISR preempts everything, so every elapsed period fires.
+    while (timer->is_running && timer->next_time_us <= now_us) {
+      timer->next_time_us += timer->period_us;
+      timer->callback(timer->arg);
+    }
+  }
+  run_adc_frames(now_us);
+}
+
+/// @brief Set the ADC input signal.
+/// @param signal The signal.
+void sim_set_adc_signal(sim_adc_signal_t signal) {
+  _adc_signal = signal;
+}
+
+/// @brief Enable the IIR filter emulation, a replayed signal is already filtered.
+/// @param is_enabled True to filter.
+void sim_set_adc_filter(bool is_enabled) {
+  _adc_is_filter_enabled = is_enabled;
+}
+
+/// @brief Get the ADC conversion statistics.
+/// @param conversions The number of conversions read.
+/// @param dropped The number of conversions dropped because the pool was full.
+void sim_get_adc_stats(uint64_t* conversions, uint64_t* dropped) {
+  *conversions = _adc_conversions;
+  *dropped = _adc_dropped;
+}
+
+/// @brief Get the conversion time of the newest sample hal_adc_read() returned.
+/// @return The time in microseconds, the start of the conversions before the first read.
+int64_t sim_get_adc_read_time(void) {
+  return _adc_read_us;
+}
+
+/// @brief Convert a channel at a time.
+/// @param channel The channel.
+/// @param time_us The time in microseconds.
+/// @return The raw conversion code.
+static int convert_adc(uint32_t channel, int64_t time_us) {
+  int raw = _adc_signal != NULL ? _adc_signal(channel, time_us) : 2048;
+  return raw < 0 ? 0 : (raw > 4095 ? 4095 : raw);
+}
+
+/// @brief Convert the conversions of the scan from an index on, through the IIR filters.
+/// @param index The index of the first conversion since the start.
+/// @param count The number of conversions.
+/// @param samples The samples to fill.
+static void convert_adc_scan(uint64_t index, uint32_t count, hal_adc_sample_t* samples) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t slot = (index + i) % _adc_num_of_channels;
+    int64_t time_us = _adc_start_us + (int64_t)((index + i) * 1000000 / _adc_sample_freq_hz);
+    samples[i].channel = _adc_channels[slot];
+    // As hal_esp.c, every channel is filtered while the filters are enough, else none.
+    if (_adc_is_filter_enabled && _adc_num_of_channels <= SIM_ADC_IIR_FILTERS) {
+      // The hardware IIR filter, out += (in - out) / coeff.
+      int32_t* filtered = &_adc_filtered[slot];
+      *filtered += convert_adc(_adc_channels[slot], time_us) - *filtered / SIM_ADC_IIR_COEFF;
+      samples[i].raw = *filtered / SIM_ADC_IIR_COEFF;
+    } else {
+      samples[i].raw = convert_adc(_adc_channels[slot], time_us);
+    }
+  }
+}
+
+/// @brief Get the time the DMA finishes a frame.
+/// @param frame The frame since the start.
+/// @return The time in microseconds, rounded up.
+static int64_t get_adc_frame_time(uint64_t frame) {
+  uint64_t end = (frame + 1) * HAL_ADC_CONVERSIONS_PER_FRAME * _adc_num_of_channels;
+  return _adc_start_us + (int64_t)((end * 1000000 + _adc_sample_freq_hz - 1) / _adc_sample_freq_hz);
+}
+
+/// @brief Hand the finished frames to the frame callback, as the ADC ISR does.
+/// @param now_us The current time in microseconds.
+static void run_adc_frames(int64_t now_us) {
+  if (!_adc_is_running || _adc_frame_callback == NULL) {
+    return;
+  }
+  uint32_t frame_size = HAL_ADC_CONVERSIONS_PER_FRAME * _adc_num_of_channels;
+  hal_adc_sample_t samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+  while (get_adc_frame_time(_adc_next_frame) <= now_us) {
+    convert_adc_scan(_adc_next_frame * frame_size, frame_size, samples);
+    _adc_next_frame++;
+    _adc_conversions += frame_size;
+    _adc_frame_callback(samples, frame_size, _adc_callback_arg);
+  }
+}
+
+/// @brief Initialize ADC1 and the calibration of every channel.
+/// @param channels The channels, in scan order.
+/// @param num_of_channels The number of channels.
+/// @param sample_freq_hz The conversion rate of the continuous mode, over all the channels.
+/// @return The result.
+esp_err_t hal_adc_initialize(const uint8_t* channels, uint32_t num_of_channels, uint32_t sample_freq_hz) {
+  if (num_of_channels == 0 || num_of_channels > NAGI_MAX_NUM_OF_AXES || sample_freq_hz == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  for (uint32_t i = 0; i < num_of_channels; i++) {
+    if (channels[i] >= SIM_ADC_CHANNELS) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    _adc_channels[i] = channels[i];
+  }
+  _adc_num_of_channels = num_of_channels;
+  _adc_sample_freq_hz = sample_freq_hz;
+  _adc_is_running = false;
+  return ESP_OK;
+}
+
+/// @brief Deinitialize ADC1.
+void hal_adc_deinitialize(void) {
+  _adc_num_of_channels = 0;
+  _adc_is_running = false;
+  _adc_frame_callback = NULL;
+  _adc_overflow_callback = NULL;
+}
+
+/// @brief Register the callbacks of the continuous mode, between hal_adc_initialize() and hal_adc_start().
+/// @param on_frame The frame callback, NULL to pool the frames.
+/// @param on_overflow The overflow callback, NULL for none.
+/// @param arg The callback argument.
+/// @return The result.
+esp_err_t hal_adc_register_callbacks(hal_adc_frame_callback_t on_frame, hal_adc_overflow_callback_t on_overflow, void* arg) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  if (_adc_is_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  _adc_frame_callback = on_frame;
+  // As hal_esp.c, the pool of the frames the ISR takes is full for good.
+  _adc_overflow_callback = on_frame == NULL ? on_overflow : NULL;
+  _adc_callback_arg = arg;
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/// @brief Start the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_start(void) {
+#if NAGI_AXIS_USE_ADC_CONTINUOUS
+  _adc_is_running = true;
+  _adc_start_us = hal_get_time_us();
+  _adc_read_index = 0;
+  _adc_skip_begin = _adc_skip_end = 0;
+  _adc_next_frame = 0;
+  _adc_read_us = _adc_start_us;
+  for (uint32_t i = 0; i < _adc_num_of_channels; i++) {
+    _adc_filtered[i] = convert_adc(_adc_channels[i], _adc_start_us) * SIM_ADC_IIR_COEFF;
+  }
+#endif
+  return ESP_OK;
+}
+
+/// @brief Stop the continuous conversions.
+/// @return The result.
+esp_err_t hal_adc_stop(void) {
+  _adc_is_running = false;
+  return ESP_OK;
+}
+
+/// @brief Read the pending continuous conversions without blocking.
+/// @param samples The samples to fill.
+/// @param max_samples The size of samples.
+/// @param num_of_samples The number of filled samples.
+/// @return ESP_OK, or ESP_ERR_TIMEOUT if no conversion is pending.
+esp_err_t hal_adc_read(hal_adc_sample_t* samples, uint32_t max_samples, uint32_t* num_of_samples) {
+  *num_of_samples = 0;
+  if (!_adc_is_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // The DMA hands over whole frames.
+  uint64_t frame_size = HAL_ADC_CONVERSIONS_PER_FRAME * _adc_num_of_channels;
+  uint64_t pool_size = frame_size * SIM_ADC_POOL_FRAMES;
+  int64_t now_us = hal_get_time_us();
+  uint64_t produced = (uint64_t)(now_us - _adc_start_us) * _adc_sample_freq_hz / 1000000;
+  produced -= produced % frame_size;
+
+  // Without flush_pool, a full pool keeps the oldest frames and drops the new ones.
+  if (_adc_skip_end <= _adc_read_index && produced - _adc_read_index > pool_size) {
+    _adc_skip_begin = _adc_read_index + pool_size;
+    _adc_skip_end = produced;
+    _adc_dropped += _adc_skip_end - _adc_skip_begin;
+    for (uint64_t i = 0; _adc_overflow_callback != NULL && i < (_adc_skip_end - _adc_skip_begin) / frame_size; i++) {
+      _adc_overflow_callback(_adc_callback_arg);
+    }
+  }
+  uint64_t available = (_adc_skip_end > _adc_read_index ? _adc_skip_begin : produced) - _adc_read_index;
+  if (available == 0) {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  uint32_t count = available < max_samples ? available : max_samples;
+  convert_adc_scan(_adc_read_index, count, samples);
+  _adc_read_index += count;
+  _adc_read_us = _adc_start_us + (int64_t)((_adc_read_index - 1) * 1000000 / _adc_sample_freq_hz);
+  if (_adc_read_index == _adc_skip_begin && _adc_skip_end > _adc_read_index) {
+    _adc_read_index = _adc_skip_end;
+  }
+  _adc_conversions += count;
+  *num_of_samples = count;
+  return ESP_OK;
+}
+
+/// @brief Convert one channel in oneshot mode.
+/// @param channel The channel.
+/// @param raw The raw conversion code to fill.
+/// @return The result.
+esp_err_t hal_adc_read_oneshot(uint32_t channel, int* raw) {
+  bool is_configured = false;
+  for (uint32_t i = 0; i < _adc_num_of_channels; i++) {
+    is_configured |= _adc_channels[i] == channel;
+  }
+  if (!is_configured) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *raw = convert_adc(channel, hal_get_time_us());
+  _adc_conversions++;
+  return ESP_OK;
+}
+
+/// @brief Convert a raw code of a channel to the calibrated voltage.
+/// @param channel The channel.
+/// @param raw The raw conversion code.
+/// @param voltage The voltage in millivolts to fill.
+/// @return The result.
+esp_err_t hal_adc_raw_to_voltage(uint32_t channel, int raw, int* voltage) {
+  // The curve fitting scheme of the driver: a linear fit of the 12dB attenuation range, less a
+  // polynomial of the reading error, in 64-bit integers as adc_cali_raw_to_voltage() does it.
+  static const uint64_t ERROR_COEFFS[][2] = {{23, 1}, {200000000000000, 10000000000000000}, {10000000000, 10000000000000000}, {1000000, 10000000000000000}};
+  static const int32_t ERROR_SIGNS[] = {1, -1, 1, -1};
+  // The offset compensation of every channel, as the eFuse holds it.
+  static const int32_t CHANNEL_OFFSETS[SIM_ADC_CHANNELS] = {0, 4, -3, 2, -5, 1, 3};
+  if (channel >= SIM_ADC_CHANNELS || raw < 0 || raw > 4095) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint64_t linear = (uint64_t)raw * 3300 / 4095;
+  if (linear == 0) {
+    *voltage = 0;
+    return ESP_OK;
+  }
+  uint64_t variable = 1;
+  int32_t error = 0;
+  for (int i = 0; i < sizeof(ERROR_SIGNS) / sizeof(ERROR_SIGNS[0]); i++) {
+    error += (int32_t)(variable * ERROR_COEFFS[i][0] / ERROR_COEFFS[i][1]) * ERROR_SIGNS[i];
+    variable *= linear;
+  }
+  *voltage = (int32_t)linear - error + CHANNEL_OFFSETS[channel];
+  return ESP_OK;
+}
+
+/// @brief Map the start of a data partition read-only, the data is read through the flash cache.
+/// @param label The partition label.
+/// @param size The size to map.
+/// @param data The mapped data to fill.
+/// @return The result.
+esp_err_t hal_flash_map(const char* label, size_t size, const void** data) {
+  if (size > SIM_FLASH_SIZE) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (!_is_flash_initialized) {
+    memset(_flash, 0xFF, sizeof(_flash));
+    _is_flash_initialized = true;
+  }
+  *data = _flash;
+  return ESP_OK;
+}
+
+/// @brief Erase the start of a data partition and write it, which unmaps it.
+/// @param label The partition label.
+/// @param data The data.
+/// @param size The size of the data.
+/// @return The result.
+esp_err_t hal_flash_write(const char* label, const void* data, size_t size) {
+  if (size > SIM_FLASH_SIZE) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(_flash, data, size);
+  _is_flash_initialized = true;
+  return ESP_OK;
+}
+
+/// @brief Set the in-process server.
+/// @param handler The server.
+void sim_set_udp_handler(sim_udp_handler_t handler) {
+  _udp_handler = handler;
+}
+
+/// @brief Queue a reply of the in-process server.
+/// @param data The datagram.
+/// @param length The length of the datagram.
+/// @param arrival_us The time the reply reaches the firmware.
+void sim_queue_udp_reply(const void* data, size_t length, int64_t arrival_us) {
+  if (_udp_reply_tail - _udp_reply_head >= SIM_MAX_NUM_OF_REPLIES || length > sizeof(_udp_replies[0].data)) {
+    return;
+  }
+  // Keep the queue in arrival order.
+  uint32_t i = _udp_reply_tail++;
+  while (i != _udp_reply_head && _udp_replies[(i - 1) % SIM_MAX_NUM_OF_REPLIES].arrival_us > arrival_us) {
+    _udp_replies[i % SIM_MAX_NUM_OF_REPLIES] = _udp_replies[(i - 1) % SIM_MAX_NUM_OF_REPLIES];
+    i--;
+  }
+  sim_reply_t* reply = &_udp_replies[i % SIM_MAX_NUM_OF_REPLIES];
+  reply->arrival_us = arrival_us;
+  reply->length = length;
+  memcpy(reply->data, data, length);
+}
+
+/// @brief Get the arrival time of the next reply.
+/// @return The time in microseconds, INT64_MAX if no reply is queued.
+int64_t sim_get_next_udp_reply_time(void) {
+  if (_udp_sock >= 0) {
+    // Poll the real socket every tick.
+    return hal_get_time_us() + 1000;
+  }
+  if (_udp_reply_head == _udp_reply_tail) {
+    return INT64_MAX;
+  }
+  return _udp_replies[_udp_reply_head % SIM_MAX_NUM_OF_REPLIES].arrival_us;
+}
+
+/// @brief Use a real UDP socket instead of the in-process server.
+/// @return True if the socket is open.
+bool sim_open_udp_socket(void) {
+  _udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (_udp_sock < 0) {
+    return false;
+  }
+  fcntl(_udp_sock, F_SETFL, fcntl(_udp_sock, F_GETFL, 0) | O_NONBLOCK);
+  return true;
+}
+
+/// @brief Send a UDP datagram.
+/// @param data The data.
+/// @param length The length of the data.
+/// @param addr The destination address.
+/// @return The sent length, or -1 with errno set.
+int hal_udp_send(const void* data, size_t length, const struct sockaddr_in* addr) {
+  if (_udp_sock >= 0) {
+    return sendto(_udp_sock, data, length, 0, (const struct sockaddr*)addr, sizeof(struct sockaddr_in));
+  }
+  _udp_server_addr = *addr;
+  if (_udp_handler != NULL) {
+    _udp_handler(data, length, hal_get_time_us());
+  }
+  return length;
+}
+
+/// @brief Receive a pending datagram without blocking.
+/// @param buffer The buffer.
+/// @param size The size of the buffer.
+/// @param source_addr The source address to fill.
+/// @return The received length, or -1 with errno set.
+static int try_receive(void* buffer, size_t size, struct sockaddr_storage* source_addr) {
+  if (_udp_sock >= 0) {
+    socklen_t socklen = sizeof(struct sockaddr_storage);
+    return recvfrom(_udp_sock, buffer, size, MSG_DONTWAIT, (struct sockaddr*)source_addr, &socklen);
+  }
+  if (_udp_reply_head == _udp_reply_tail || _udp_replies[_udp_reply_head % SIM_MAX_NUM_OF_REPLIES].arrival_us > hal_get_time_us()) {
+    errno = EAGAIN;
+    return -1;
+  }
+  const sim_reply_t* reply = &_udp_replies[_udp_reply_head++ % SIM_MAX_NUM_OF_REPLIES];
+  size_t length = reply->length < size ? reply->length : size;
+  memcpy(buffer, reply->data, length);
+  memset(source_addr, 0, sizeof(struct sockaddr_storage));
+  memcpy(source_addr, &_udp_server_addr, sizeof(struct sockaddr_in));
+  return length;
+}
+
+/// @brief Receive a UDP datagram, blocking up to the socket timeout.
+/// @param buffer The buffer.
+/// @param size The size of the buffer.
+/// @param source_addr The source address to fill.
+/// @param flags The receive flags, e.g. MSG_DONTWAIT.
+/// @return The received length, or -1 with errno set.
+int hal_udp_receive(void* buffer, size_t size, struct sockaddr_storage* source_addr, int flags) {
+  int64_t deadline_us = hal_get_time_us() + SIM_UDP_TIMEOUT_US;
+  for (;;) {
+    int len = try_receive(buffer, size, source_addr);
+    if (len >= 0 || (flags & MSG_DONTWAIT)) {
+      return len;
+    }
+    int64_t now_us = hal_get_time_us();
+    if (now_us >= deadline_us) {
+      errno = EAGAIN;
+      return -1;
+    }
+
+    // Block, the other tasks keep running meanwhile.
+    int64_t wake_us = sim_get_next_udp_reply_time();
+    sim_wait(wake_us < deadline_us ? wake_us : deadline_us);
+  }
+}
@@ -0,0 +1,8 @@
+#ifndef __SIM_ESP_ATTR_H__
+#define __SIM_ESP_ATTR_H__
+
+// The simulator has no IRAM, the attributes are empty.
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif // __SIM_ESP_ATTR_H__
@@ -0,0 +1,6 @@
+#ifndef __SIM_ESP_NETIF_TYPES_H__
+#define __SIM_ESP_NETIF_TYPES_H__
+
+typedef struct esp_netif_obj esp_netif_t;
+
+#endif // __SIM_ESP_NETIF_TYPES_H__
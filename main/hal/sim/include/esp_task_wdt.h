@@ -0,0 +1,18 @@
+#ifndef __SIM_ESP_TASK_WDT_H__
+#define __SIM_ESP_TASK_WDT_H__
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// The simulator has no watchdog.
+static inline esp_err_t esp_task_wdt_add(TaskHandle_t task_handle) {
+  (void)task_handle;
+  return ESP_OK;
+}
+
+static inline esp_err_t esp_task_wdt_reset(void) {
+  return ESP_OK;
+}
+
+#endif // __SIM_ESP_TASK_WDT_H__
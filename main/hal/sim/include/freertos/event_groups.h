@@ -0,0 +1,15 @@
+#ifndef __SIM_FREERTOS_EVENT_GROUPS_H__
+#define __SIM_FREERTOS_EVENT_GROUPS_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+typedef struct EventGroupDef_t* EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, EventBits_t bits);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t event_group, EventBits_t bits, BaseType_t is_clear_on_exit, BaseType_t is_wait_for_all, TickType_t ticks_to_wait);
+
+#endif // __SIM_FREERTOS_EVENT_GROUPS_H__
@@ -0,0 +1,27 @@
+#ifndef __SIM_FREERTOS_TASK_H__
+#define __SIM_FREERTOS_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+/// @brief A simulated task, see sim.h.
+typedef struct sim_task* TaskHandle_t;
+
+typedef enum {
+  eNoAction = 0,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t* previous_wake_time, TickType_t increment);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* is_higher_priority_task_woken);
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t* value, TickType_t ticks_to_wait);
+uint32_t ulTaskNotifyTake(BaseType_t is_clear_on_exit, TickType_t ticks_to_wait);
+
+#endif // __SIM_FREERTOS_TASK_H__
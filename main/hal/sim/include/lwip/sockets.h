@@ -0,0 +1,16 @@
+#ifndef __SIM_LWIP_SOCKETS_H__
+#define __SIM_LWIP_SOCKETS_H__
+
+// lwIP uses the BSD socket API, and its headers bring in FreeRTOS.
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#endif // __SIM_LWIP_SOCKETS_H__
@@ -0,0 +1,9 @@
+#ifndef __SIM_SOC_GPIO_NUM_H__
+#define __SIM_SOC_GPIO_NUM_H__
+
+// The ESP32-C6 has 31 GPIOs.
+typedef int gpio_num_t;
+
+#define GPIO_NUM_MAX 31
+
+#endif // __SIM_SOC_GPIO_NUM_H__
@@ -0,0 +1,165 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "hal.h"
+#include "sim.h"
+
+/// @brief A simulated event group.
+struct EventGroupDef_t {
+  EventBits_t bits;
+};
+
+sim_task_t g_sim_sampler_task = {.name = "sampler"};
+sim_task_t g_sim_network_task = {.name = "network"};
+esp_log_level_t g_sim_log_level = ESP_LOG_WARN;
+
+static sim_task_t* _current_task;
+
+/// @brief Set the task running the current step.
+/// @param task The task.
+void sim_set_current_task(sim_task_t* task) {
+  _current_task = task;
+}
+
+/// @brief Write a log line with the simulated time.
+/// @param level The level.
+/// @param tag The tag.
+/// @param format The format.
+void sim_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+  static const char LEVELS[] = "NEWIDV";
+  if (level > g_sim_log_level) {
+    return;
+  }
+  fprintf(stderr, "%c (%.6f) %s: ", LEVELS[level], hal_get_time_us() / 1e6, tag);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+/// @brief Get the name of an error code.
+/// @param code The error code.
+/// @return The name.
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(hal_get_time_us() / (1000000 / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+  return xTaskGetTickCount();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  sim_wait(hal_get_time_us() + (int64_t)ticks * (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake_time, TickType_t increment) {
+  *previous_wake_time += increment;
+  sim_wait((int64_t)*previous_wake_time * (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return _current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  task->notify_count++;
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* is_higher_priority_task_woken) {
+  switch (action) {
+    case eSetBits:
+      task->notify_bits |= value;
+      break;
+    case eIncrement:
+      task->notify_count++;
+      break;
+    case eSetValueWithOverwrite:
+    case eSetValueWithoutOverwrite:
+      task->notify_bits = value;
+      break;
+    default:
+      break;
+  }
+  if (is_higher_priority_task_woken != NULL) {
+    *is_higher_priority_task_woken = task != _current_task;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t* value, TickType_t ticks_to_wait) {
+  // The scheduler only runs a task step when it is notified, so nothing blocks here.
+  (void)ticks_to_wait;
+  sim_task_t* task = _current_task;
+  task->notify_bits &= ~bits_to_clear_on_entry;
+  if (value != NULL) {
+    *value = task->notify_bits;
+  }
+  BaseType_t result = task->notify_bits != 0 ? pdTRUE : pdFALSE;
+  task->notify_bits &= ~bits_to_clear_on_exit;
+  return result;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t is_clear_on_exit, TickType_t ticks_to_wait) {
+  (void)ticks_to_wait;
+  sim_task_t* task = _current_task;
+  uint32_t count = task->notify_count;
+  if (is_clear_on_exit) {
+    task->notify_count = 0;
+  } else if (count > 0) {
+    task->notify_count--;
+  }
+  return count;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+  return calloc(1, sizeof(struct EventGroupDef_t));
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group) {
+  return event_group->bits;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits) {
+  event_group->bits |= bits;
+  return event_group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, EventBits_t bits) {
+  EventBits_t old_bits = event_group->bits;
+  event_group->bits &= ~bits;
+  return old_bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t event_group, EventBits_t bits, BaseType_t is_clear_on_exit, BaseType_t is_wait_for_all, TickType_t ticks_to_wait) {
+  (void)is_wait_for_all;
+  (void)ticks_to_wait;
+  EventBits_t current_bits = event_group->bits;
+  if (is_clear_on_exit) {
+    event_group->bits &= ~bits;
+  }
+  return current_bits;
+}
@@ -0,0 +1,122 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_log.h"
+
+struct sockaddr_in;
+
+/// @brief A simulated task. The tasks run as steps of one scheduler, so a task handle only
+/// holds its pending notifications.
+typedef struct sim_task {
+  const char* name;
+  // The bits set by xTaskNotifyFromISR().
+  uint32_t notify_bits;
+  // The count given by xTaskNotifyGive().
+  uint32_t notify_count;
+} sim_task_t;
+
+/// @brief The ADC input signal.
+/// @param channel The ADC channel.
+/// @param time_us The conversion time in microseconds.
+/// @return The raw conversion code.
+typedef int (*sim_adc_signal_t)(uint32_t channel, int64_t time_us);
+
+/// @brief The in-process server, called for every datagram the firmware sends.
+/// @param data The datagram.
+/// @param length The length of the datagram.
+/// @param time_us The send time in microseconds.
+typedef void (*sim_udp_handler_t)(const void* data, size_t length, int64_t time_us);
+
+/// @brief The sampler task.
+extern sim_task_t g_sim_sampler_task;
+
+/// @brief The network task.
+extern sim_task_t g_sim_network_task;
+
+/// @brief The log level.
+extern esp_log_level_t g_sim_log_level;
+
+/// @brief Run the clock in real time instead of simulated time.
+/// @param is_realtime True for real time.
+void sim_set_realtime(bool is_realtime);
+
+/// @brief Advance the clock, in real time it sleeps until the time.
+/// @param time_us The time in microseconds.
+void sim_advance_time(int64_t time_us);
+
+/// @brief Set the task running the current step.
+/// @param task The task.
+void sim_set_current_task(sim_task_t* task);
+
+/// @brief Run the other tasks until the time, while the current task blocks.
+/// Implemented by the simulator program.
+/// @param time_us The time in microseconds.
+void sim_wait(int64_t time_us);
+
+/// @brief Drive a GPIO, the interrupt handler runs on a change.
+/// @param gpio_num The GPIO number.
+/// @param level The level, 0 or 1.
+void sim_set_gpio_level(int gpio_num, int level);
+
+/// @brief Open or close a switch of a diode matrix, from a row output to a column input.
+/// @param row_gpio_num The row GPIO.
+/// @param column_gpio_num The column GPIO.
+/// @param is_closed True when the switch is closed, the button pressed.
+void sim_set_matrix_switch(int row_gpio_num, int column_gpio_num, bool is_closed);
+
+/// @brief Set a parallel input of the shift register chain.
+/// @param bit The input, in the order the bits are shifted out.
+/// @param level The level, 0 or 1.
+void sim_set_shift_in_level(int bit, int level);
+
+/// @brief Get the number of GPIO interrupts that ran a handler.
+/// @return The number of interrupts.
+uint64_t sim_get_gpio_interrupt_count(void);
+
+/// @brief Set the ADC input signal.
+/// @param signal The signal.
+void sim_set_adc_signal(sim_adc_signal_t signal);
+
+/// @brief Enable the IIR filter emulation, a replayed signal is already filtered.
+/// @param is_enabled True to filter.
+void sim_set_adc_filter(bool is_enabled);
+
+/// @brief Get the ADC conversion statistics.
+/// @param conversions The number of conversions read.
+/// @param dropped The number of conversions dropped because the pool was full.
+void sim_get_adc_stats(uint64_t* conversions, uint64_t* dropped);
+
+/// @brief Get the conversion time of the newest sample hal_adc_read() returned.
+/// @return The time in microseconds, the start of the conversions before the first read.
+int64_t sim_get_adc_read_time(void);
+
+/// @brief Get the time of the next timer alarm, or ADC frame with a frame callback.
+/// @return The time in microseconds, INT64_MAX if no timer is running.
+int64_t sim_get_next_timer_time(void);
+
+/// @brief Run the callbacks of the due timers and ADC frames.
+void sim_run_timers(void);
+
+/// @brief Set the in-process server.
+/// @param handler The server.
+void sim_set_udp_handler(sim_udp_handler_t handler);
+
+/// @brief Queue a reply of the in-process server.
+/// @param data The datagram.
+/// @param length The length of the datagram.
+/// @param arrival_us The time the reply reaches the firmware.
+void sim_queue_udp_reply(const void* data, size_t length, int64_t arrival_us);
+
+/// @brief Get the arrival time of the next reply.
+/// @return The time in microseconds, INT64_MAX if no reply is queued.
+int64_t sim_get_next_udp_reply_time(void);
+
+/// @brief Use a real UDP socket instead of the in-process server.
+/// @return True if the socket is open.
+bool sim_open_udp_socket(void);
+
+#endif // __SIM_H__
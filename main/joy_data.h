@@ -37,4 +37,32 @@ typedef struct joystick_info {
   uint32_t hats[4];     // Lower 4 bits: HAT switch or 16-bit of continuous HAT switch
 } joystick_info_t, *joystick_info_ptr_t;
 
+// The compact layout must match the host, so these are part of the wire format.
+#ifndef JOYSTICK_COMPACT_NUM_OF_AXES
+#define JOYSTICK_COMPACT_NUM_OF_AXES 4
+#endif
+#ifndef JOYSTICK_COMPACT_NUM_OF_BUTTONS
+#define JOYSTICK_COMPACT_NUM_OF_BUTTONS 32
+#endif
+#ifndef JOYSTICK_COMPACT_NUM_OF_HATS
+#define JOYSTICK_COMPACT_NUM_OF_HATS 2
+#endif
+
+/// @brief Compact joystick information structure.
+// Axes are the fields from axis_x on, clamped to 16 bits. Buttons are a little-endian
+// bit array, button 1 is bit 0 of buttons[0]. Hats take 4 bits each, the even hat in the low nibble.
+typedef struct __attribute__((packed)) joystick_compact {
+  uint16_t axes[JOYSTICK_COMPACT_NUM_OF_AXES];
+  uint8_t buttons[JOYSTICK_COMPACT_NUM_OF_BUTTONS / 8];
+  uint8_t hats[JOYSTICK_COMPACT_NUM_OF_HATS / 2];
+} joystick_compact_t;
+
+_Static_assert(JOYSTICK_COMPACT_NUM_OF_AXES <= 19, "The compact axes start at axis_x.");
+_Static_assert(JOYSTICK_COMPACT_NUM_OF_BUTTONS % 8 == 0 && JOYSTICK_COMPACT_NUM_OF_BUTTONS <= 128, "Invalid number of compact buttons.");
+_Static_assert(JOYSTICK_COMPACT_NUM_OF_HATS % 2 == 0 && JOYSTICK_COMPACT_NUM_OF_HATS <= 4, "Invalid number of compact hats.");
+_Static_assert(
+  sizeof(joystick_compact_t) == JOYSTICK_COMPACT_NUM_OF_AXES * 2 + JOYSTICK_COMPACT_NUM_OF_BUTTONS / 8 + JOYSTICK_COMPACT_NUM_OF_HATS / 2,
+  "The compact layout must have no padding."
+);
+
 #endif  // __JOY_DATA_H__
\ No newline at end of file
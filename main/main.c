@@ -21,6 +21,9 @@
 #include "button.h"
 #include "encoder.h"
 #include "tasks.h"
+#if NAGI_TRACE
+#include "trace.h"
+#endif
 
 static const char *TAG = "main";
 
@@ -41,7 +44,10 @@ static esp_err_t initialize_filesystem(void) {
 
   static wl_handle_t wl_handle;
   const esp_vfs_fat_mount_config_t mount_config = {
-    .max_files = 6, // history.txt, wifi0.txt, wifi1.txt, server.txt, joy.txt
+    // The files are open one at a time, except the trace while recording, so at most trace.bin, the settings
+    // file a command writes (wifi<n>, server, rate, redund, encoder<n>, button<n> or axis<n>.txt) and
+    // history.txt, which the console saves after the command.
+    .max_files = 7,
     .format_if_mount_failed = true
   };
   esp_err_t err = esp_vfs_fat_spiflash_mount_rw_wl(MOUNT_PATH, "storage", &mount_config, &wl_handle);
@@ -106,6 +112,96 @@ void app_main(void) {
     memset(&g_server_addr, 0, sizeof(g_server_addr));
   }
 
+  // Read the polling rate from the "/data/rate.txt" file.
+  f = fopen("/data/rate.txt", "r");
+  if (f != NULL) {
+    int rate;
+    if (fscanf(f, "%d", &rate) == 1 && rate > 0 && set_polling_rate(rate) == ESP_OK) {
+      ESP_LOGI(TAG, "Polling rate: %dHz", rate);
+    }
+    fclose(f);
+  }
+
+  // Read the redundancy from the "/data/redund.txt" file.
+  f = fopen("/data/redund.txt", "r");
+  if (f != NULL) {
+    int redundancy;
+    if (fscanf(f, "%d", &redundancy) == 1 && redundancy >= 0 && set_sync_redundancy(redundancy) == ESP_OK) {
+      ESP_LOGI(TAG, "Redundancy: %d", redundancy);
+    }
+    fclose(f);
+  }
+
+  // Read the encoder settings from the "/data/encoder<index>.txt" files.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    char path[32];
+    snprintf(path, sizeof(path), "/data/encoder%d.txt", i);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    char mode[16];
+    char accel[64];
+    encoder_settings_t settings = {0};
+    if (
+      fscanf(f, "%15s %63s", mode, accel) == 2 &&
+      parse_encoder_mode(mode, &settings.mode) &&
+      parse_encoder_accel(accel, &settings.accel) == ESP_OK
+    ) {
+      g_encoder_settings[i] = settings;
+      ESP_LOGI(TAG, "Encoder[%d]: mode %s, acceleration %s", i, mode, accel);
+    }
+    fclose(f);
+  }
+
+  // Read the button settings from the "/data/button<index>.txt" files.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    char path[32];
+    snprintf(path, sizeof(path), "/data/button%d.txt", i);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    char name[16];
+    button_debounce_t debounce;
+    if (fscanf(f, "%15s", name) == 1 && parse_button_debounce(name, &debounce)) {
+      set_button_debounce(i, debounce);
+      ESP_LOGI(TAG, "Button[%d]: debounce %s", i, name);
+    }
+    fclose(f);
+  }
+
+  // Read the axis settings from the "/data/axis<index>.txt" files.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    char path[32];
+    snprintf(path, sizeof(path), "/data/axis%d.txt", i);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    char name[16];
+    char range[32];
+    unsigned deadzone = 0;
+    char curve[64];
+    axis_filter_t filter;
+    int num_of_fields = fscanf(f, "%15s %31s %u %63s", name, range, &deadzone, curve);
+    if (num_of_fields >= 1 && parse_axis_filter(name, &filter)) {
+      set_axis_filter(i, filter);
+      ESP_LOGI(TAG, "Axis[%d]: filter %s", i, name);
+    }
+    // The files of the filter alone have no profile.
+    axis_profile_t profile = {.deadzone = deadzone};
+    if (
+      num_of_fields == 4 && deadzone < 100 &&
+      parse_axis_range(range, &profile) == ESP_OK &&
+      parse_axis_curve(curve, &profile.curve) == ESP_OK &&
+      set_axis_profile(i, &profile) == ESP_OK
+    ) {
+      ESP_LOGI(TAG, "Axis[%d]: range %s mV, deadzone %u%%, curve %s", i, range, deadzone, curve);
+    }
+    fclose(f);
+  }
+
   // Initialize wifi.
   initialize_wifi();
 
@@ -134,14 +230,38 @@ void app_main(void) {
   ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl));
   ESP_ERROR_CHECK(esp_console_start_repl(repl));
 
-  // Start the main loop task.
+  // Start the sampler task, it runs above the network task so sampling never waits on the socket.
+  xTaskCreatePinnedToCore(
+    sampler_task,
+    "sampler",
+    4096,
+    NULL,
+    6,
+    NULL,
+    tskNO_AFFINITY
+  );
+
+  // Start the network task.
   xTaskCreatePinnedToCore(
-    main_loop_task,
-    "main_loop",
+    network_task,
+    "network",
     4096,
     NULL,
     5,
     NULL,
     tskNO_AFFINITY
   );
+
+#if NAGI_TRACE
+  // Start the trace task, it writes the recorded inputs to the storage in the background.
+  xTaskCreatePinnedToCore(
+    trace_task,
+    "trace",
+    4096,
+    NULL,
+    1,
+    NULL,
+    tskNO_AFFINITY
+  );
+#endif
 }
\ No newline at end of file
@@ -6,10 +6,30 @@
 #define MESSAGE_MAJOR_ID_COMMON 0x0000
 #define MESSAGE_MINOR_ID_COMMON_PING 0x0000
 #define MESSAGE_MINOR_ID_COMMON_PONG 0x0001
+#define MESSAGE_MINOR_ID_COMMON_TIME_REQUEST 0x0002
+#define MESSAGE_MINOR_ID_COMMON_TIME_RESPONSE 0x0003
 
 #define MESSAGE_MAJOR_ID_JOYSTICK 0x0001
 #define MESSAGE_MINOR_ID_JOYSTICK_DATA_SYNC 0x0000
 #define MESSAGE_MINOR_ID_JOYSTICK_DATA_ACK 0x0001
+#define MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_SYNC 0x0002
+#define MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_ACK 0x0003
+#define MESSAGE_MINOR_ID_JOYSTICK_DATA_DELTA_SYNC 0x0004
+#define MESSAGE_MINOR_ID_JOYSTICK_DATA_COMPACT_SYNC 0x0005
+#define MESSAGE_MINOR_ID_JOYSTICK_DATA_REDUNDANT_SYNC 0x0006
+
+// The joystick data formats, negotiated by the ping and pong messages.
+#define MESSAGE_JOYSTICK_FORMAT_FULL 0
+#define MESSAGE_JOYSTICK_FORMAT_DELTA 1
+#define MESSAGE_JOYSTICK_FORMAT_COMPACT 2
+#define MESSAGE_JOYSTICK_FORMAT_REDUNDANT 3
+
+/// @brief The most states a redundant sync message can carry.
+#define MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES 8
+
+/// @brief The number of 32-bit fields in the joystick information.
+#define JOYSTICK_INFO_FIELD_COUNT (sizeof(joystick_info_t) / sizeof(uint32_t))
+_Static_assert(JOYSTICK_INFO_FIELD_COUNT <= 32, "The delta field mask must cover every field.");
 
 /// @brief The message header.
 // Align the struct to 2 bytes.
@@ -23,14 +43,43 @@ typedef struct {
 typedef struct {
   message_header_t header;
   uint32_t magic;
+  // The supported joystick formats, 1 << MESSAGE_JOYSTICK_FORMAT_*.
+  // 0 means only the stop-and-wait DATA_SYNC.
+  uint32_t formats;
+  // The device time in microseconds when the ping was sent.
+  uint64_t origin_time;
 } message_common_ping_t;
 
 /// @brief The common pong message.
 typedef struct {
   message_header_t header;
   uint32_t magic;
+  // The joystick format selected by the server, optional.
+  uint32_t format;
+  // The clock fields are optional, see message_common_time_response_t.
+  uint64_t origin_time;
+  uint64_t receive_time;
+  uint64_t transmit_time;
 } message_common_pong_t;
 
+/// @brief The common time request message, sent periodically to track the host clock.
+typedef struct {
+  message_header_t header;
+  // The device time in microseconds when the request was sent.
+  uint64_t origin_time;
+} message_common_time_request_t;
+
+/// @brief The common time response message.
+typedef struct {
+  message_header_t header;
+  // The origin_time of the request, echoed.
+  uint64_t origin_time;
+  // The host time in microseconds when the request was received.
+  uint64_t receive_time;
+  // The host time in microseconds when the response was sent.
+  uint64_t transmit_time;
+} message_common_time_response_t;
+
 /// @brief The joystick data sync message.
 typedef struct {
   message_header_t header;
@@ -43,4 +92,62 @@ typedef struct {
   uint16_t payload;
 } message_joystick_ack_t;
 
+/// @brief The sequence-numbered joystick data sync message.
+// The timestamp of every pipelined sync message is the sample time in host
+// microseconds, truncated to 32 bits.
+typedef struct {
+  message_header_t header;
+  uint32_t sequence;
+  uint32_t timestamp;
+  joystick_info_t data;
+} message_joystick_seq_sync_t;
+
+/// @brief The sequence-numbered joystick data ack message.
+typedef struct {
+  message_header_t header;
+  uint32_t sequence;
+  uint16_t payload;
+} message_joystick_seq_ack_t;
+
+/// @brief The delta-encoded joystick data sync message.
+// Only the fields set in field_mask are sent, in field order, as values against the
+// state of base_sequence. A base_sequence of 0 is a keyframe against the all-zero state.
+// It is acknowledged with message_joystick_seq_ack_t.
+typedef struct {
+  message_header_t header;
+  uint32_t sequence;
+  uint32_t timestamp;
+  uint32_t base_sequence;
+  uint32_t field_mask;
+  uint32_t values[JOYSTICK_INFO_FIELD_COUNT];
+} message_joystick_delta_sync_t;
+
+/// @brief The compact joystick data sync message.
+// It is acknowledged with message_joystick_seq_ack_t.
+typedef struct __attribute__((packed)) {
+  message_header_t header;
+  uint32_t sequence;
+  uint32_t timestamp;
+  joystick_compact_t data;
+} message_joystick_compact_sync_t;
+
+/// @brief The redundant joystick data sync message.
+// states[0] is the state of sequence, states[i] the state of sequence - i, so the host can
+// rebuild lost updates from the next packet. Only count states are sent. The timestamp is
+// the sample time of states[0].
+// It is acknowledged with message_joystick_seq_ack_t for sequence.
+typedef struct __attribute__((packed)) {
+  message_header_t header;
+  uint32_t sequence;
+  uint32_t timestamp;
+  uint8_t count;
+  joystick_compact_t states[MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES];
+} message_joystick_redundant_sync_t;
+
+_Static_assert(sizeof(message_header_t) == 8, "The message header must be 8 bytes.");
+_Static_assert(
+  sizeof(message_joystick_compact_sync_t) == sizeof(message_header_t) + 2 * sizeof(uint32_t) + sizeof(joystick_compact_t),
+  "The compact sync message must have no padding."
+);
+
 #endif // __MESSAGE_H__
\ No newline at end of file
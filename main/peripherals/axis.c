@@ -1,207 +1,782 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <assert.h>
 
 #include "config.h"
 #include "axis.h"
-
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
-#include "esp_adc/adc_continuous.h"
-#include "esp_adc/adc_filter.h"
-#else
-#include "esp_adc/adc_oneshot.h"
+#if NAGI_TRACE
+#include "trace.h"
 #endif
+
+#include "hal.h"
+#include "esp_attr.h"
+#include "esp_err.h"
 #include "esp_log.h"
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+#include "stats.h"
+#endif
 
 static const char* TAG = "axis";
 
-// @brief The ADC calibration handle for ADC1 channel 1.
-static adc_cali_handle_t g_adc1_cali_chan1_handle = NULL;
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
-// @brief The ADC continuous handle for ADC1.
-static adc_continuous_handle_t g_adc1_cont_handle = NULL;
-// @brief The ADC IIR filter handle for ADC1.
-static adc_iir_filter_handle_t g_adc1_iir_filter_handle = NULL;
+// @brief The ADC1 channel of every axis, in scan order.
+static const uint8_t g_adc_channels[] = NAGI_AXIS_ADC_CHANNELS;
+_Static_assert(sizeof(g_adc_channels) == NAGI_MAX_NUM_OF_AXES, "NAGI_AXIS_ADC_CHANNELS must list one channel per axis.");
 
-static uint8_t g_conv_results[8 * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * NAGI_MAX_NUM_OF_AXES];
-#else
-// @brief The ADC oneshot handle for ADC1.
-static adc_oneshot_unit_handle_t g_adc1_oneshot_handle = NULL;
+// @brief The conversions of an axis per decimated output, and the most outputs of a DMA frame.
+#define AXIS_DECIMATION_FACTOR (NAGI_AXIS_SAMPLE_FREQ_HZ / NAGI_AXIS_OUTPUT_FREQ_HZ)
+#define AXIS_OUTPUTS_PER_FRAME \
+  (AXIS_DECIMATION_FACTOR < HAL_ADC_CONVERSIONS_PER_FRAME ? HAL_ADC_CONVERSIONS_PER_FRAME / AXIS_DECIMATION_FACTOR : 1)
+_Static_assert(
+  NAGI_AXIS_SAMPLE_FREQ_HZ % NAGI_AXIS_OUTPUT_FREQ_HZ == 0 && (AXIS_DECIMATION_FACTOR & (AXIS_DECIMATION_FACTOR - 1)) == 0,
+  "NAGI_AXIS_OUTPUT_FREQ_HZ must divide NAGI_AXIS_SAMPLE_FREQ_HZ by a power of two."
+);
+_Static_assert(NAGI_AXIS_VOLTAGE_FRACTION_BITS <= 8, "The One-Euro filter works in 1/256 mV.");
+
+// @brief A millivolt in the fixed point of the readings.
+#define AXIS_MILLIVOLT (1 << NAGI_AXIS_VOLTAGE_FRACTION_BITS)
+
+// @brief The channel numbers the conversion results can carry, and the mark of a channel without an axis.
+#define AXIS_MAX_ADC_CHANNELS 8
+#define AXIS_NO_AXIS 0xFF
 
+// @brief The entries of the raw-to-millivolt table, one per 12-bit code.
+#define AXIS_VOLTAGE_TABLE_SIZE 4096
+#define AXIS_VOLTAGE_TABLE_MAGIC 0x4C4F5641 // "AVOL"
+
+// @brief The raw-to-millivolt tables as stored in flash, one per axis as every channel has its own compensation.
+typedef struct {
+  uint32_t magic;
+  uint32_t size;
+  uint8_t channels[NAGI_MAX_NUM_OF_AXES];
+  uint16_t voltages[NAGI_MAX_NUM_OF_AXES][AXIS_VOLTAGE_TABLE_SIZE];
+} axis_voltage_table_t;
+
+// @brief The axis of every channel, so a conversion result is sorted with one load.
+static uint8_t g_channel_axes[AXIS_MAX_ADC_CHANNELS];
+
+// @brief The millivolts of every raw code of every axis, so the hot path does not evaluate the calibration curve.
+static const uint16_t* g_voltages[NAGI_MAX_NUM_OF_AXES];
+#if !NAGI_AXIS_VOLTAGE_TABLE_IN_FLASH
+static uint16_t g_voltage_tables[NAGI_MAX_NUM_OF_AXES][AXIS_VOLTAGE_TABLE_SIZE];
+#endif
+
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+// @brief A frame decimated in the ADC ISR, the outputs of the decimator of every axis.
+typedef struct {
+  int32_t outputs[NAGI_MAX_NUM_OF_AXES][AXIS_OUTPUTS_PER_FRAME];
+  uint8_t num_of_outputs[NAGI_MAX_NUM_OF_AXES];
+  // The time the DMA finished the frame.
+  int64_t done_us;
+#if NAGI_TRACE
+  // The raw conversions, only kept while a trace is recording.
+  hal_adc_sample_t samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+  uint32_t num_of_samples;
+#endif
+} axis_frame_t;
+
+// @brief The frames the sampler has not read yet, the ISR writes over the oldest when they are full.
+static axis_frame_t g_frames[NAGI_AXIS_ADC_FRAME_QUEUE_SIZE];
+// @brief The frames the ISR wrote, and the frames the sampler read.
+static uint32_t g_frame_head;
+static uint32_t g_frame_tail;
+#if NAGI_TRACE
+// @brief The raw conversions of the frame being read, copied out of the queue for the trace.
+static hal_adc_sample_t g_trace_samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+#endif
+#elif NAGI_AXIS_USE_ADC_CONTINUOUS
+static hal_adc_sample_t g_adc1_samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+#else
 #define FILTER_WINDOW_SIZE 4
 #define FILTER_ALPHA_SHIFT (FILTER_WINDOW_SIZE - 1)
 static int g_adc1_raw[NAGI_MAX_NUM_OF_AXES];
 static int g_adc1_voltage[NAGI_MAX_NUM_OF_AXES][FILTER_WINDOW_SIZE];
-static int g_exp_weights_filter_index = 0;
+static int g_exp_weights_filter_indexes[NAGI_MAX_NUM_OF_AXES];
+static int64_t g_last_read_us[NAGI_MAX_NUM_OF_AXES];
 #endif
 
 // @brief The axis data.
 uint16_t g_axes_data[NAGI_MAX_NUM_OF_AXES];
 
-// @brief Initialize the axis module.
-void initialize_axis(void) {
-  // Initialize the ADC calibration.
-  adc_unit_t unit = ADC_UNIT_1;
-  adc_channel_t channel = ADC_CHANNEL_1;
-  adc_atten_t atten = ADC_ATTEN_DB_12;
-
-  adc_cali_curve_fitting_config_t cali_config = {
-    .unit_id = unit,
-    .chan = channel,
-    .atten = atten,
-    .bitwidth = ADC_BITWIDTH_DEFAULT,
-  };
+// @brief The filtered voltage of every axis.
+uint16_t g_axes_voltages[NAGI_MAX_NUM_OF_AXES];
 
-  ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&cali_config, &g_adc1_cali_chan1_handle));
+// @brief The reported voltage of every axis, in 1/AXIS_MILLIVOLT mV.
+static int32_t g_readings[NAGI_MAX_NUM_OF_AXES];
 
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
-  // Initialize the ADC continuous.
-  adc_continuous_handle_cfg_t adc_config = {
-    .max_store_buf_size = 8 * 2 * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * NAGI_MAX_NUM_OF_AXES,
-    .conv_frame_size = 8 * SOC_ADC_DIGI_DATA_BYTES_PER_CONV * NAGI_MAX_NUM_OF_AXES,
-  };
+// @brief The decimator of every axis.
+static axis_decimator_t g_decimators[NAGI_MAX_NUM_OF_AXES];
 
-  ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &g_adc1_cont_handle));
+// @brief The time of the newest conversions in the axis data.
+int64_t g_axes_sample_us;
 
-  adc_continuous_config_t adc_cont_config = {
-    .sample_freq_hz = 4 * 1000,
-    .conv_mode = ADC_CONV_SINGLE_UNIT_1,
-    .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
-  };
+// @brief The ADC frames lost.
+uint32_t g_axis_adc_overflows;
 
-  adc_digi_pattern_config_t adc_pattern = {
-    .atten = ADC_ATTEN_DB_12,
-    .bit_width = ADC_BITWIDTH_12,
-    .channel = ADC_CHANNEL_1,
-    .unit = ADC_UNIT_1,
-  };
+// @brief The profile of every axis.
+axis_profile_t g_axis_profiles[NAGI_MAX_NUM_OF_AXES];
 
-  adc_cont_config.pattern_num = 1;
-  adc_cont_config.adc_pattern = &adc_pattern;
+// @brief The entries of the response table, one per millivolt, past the top of the attenuation range.
+#define AXIS_RESPONSE_TABLE_SIZE 4096
 
-  ESP_ERROR_CHECK(adc_continuous_config(g_adc1_cont_handle, &adc_cont_config));
+// @brief The value of every filtered voltage, the compiled profiles, one table per axis and a spare one.
+static uint16_t g_response_tables[NAGI_MAX_NUM_OF_AXES + 1][AXIS_RESPONSE_TABLE_SIZE];
 
-  adc_continuous_iir_filter_config_t adc_iir_filter_config = {
-    .unit = ADC_UNIT_1,
-    .channel = ADC_CHANNEL_1,
-    .coeff = ADC_DIGI_IIR_FILTER_COEFF_8,
-  };
+// @brief The table of every axis, and the spare table a new profile is built into before it is swapped in,
+// so the sampler never looks up a half-built table.
+static uint16_t* g_responses[NAGI_MAX_NUM_OF_AXES];
+static uint16_t* g_spare_responses;
 
-  ESP_ERROR_CHECK(adc_new_continuous_iir_filter(g_adc1_cont_handle, &adc_iir_filter_config, &g_adc1_iir_filter_handle));
-  ESP_ERROR_CHECK(adc_continuous_iir_filter_enable(g_adc1_iir_filter_handle));
+// @brief The smallest calibrated deflection on either side of the center, in millivolts.
+#define AXIS_MIN_CALIBRATION_SPAN 100
 
-  // Fill the conversion results with 0x0.
-  memset(g_conv_results, 0x0, sizeof(g_conv_results));
-#else
-  // Initialize the ADC oneshot.
-  adc_oneshot_unit_init_cfg_t adc_oneshot_config = {
-    .unit_id = ADC_UNIT_1,
-  };
+// @brief The axes being calibrated, their center and the lowest and highest voltages since.
+static bool g_is_calibrating[NAGI_MAX_NUM_OF_AXES];
+static uint16_t g_calibration_centers[NAGI_MAX_NUM_OF_AXES];
+static uint16_t g_calibration_lows[NAGI_MAX_NUM_OF_AXES];
+static uint16_t g_calibration_highs[NAGI_MAX_NUM_OF_AXES];
 
-  ESP_ERROR_CHECK(adc_oneshot_new_unit(&adc_oneshot_config, &g_adc1_oneshot_handle));
+// @brief The filter of every axis.
+axis_filter_t g_axis_filters[NAGI_MAX_NUM_OF_AXES];
 
-  adc_oneshot_chan_cfg_t adc_oneshot_chan_config = {
-    .bitwidth = ADC_BITWIDTH_12,
-    .atten = ADC_ATTEN_DB_12,
-  };
+// @brief The names of the filters, as axis_filter_t.
+static const char* const FILTER_NAMES[] = {"deadband", "one-euro"};
+
+// @brief The One-Euro filter of every axis.
+static axis_one_euro_t g_one_euros[NAGI_MAX_NUM_OF_AXES];
 
-  ESP_ERROR_CHECK(adc_oneshot_config_channel(g_adc1_oneshot_handle, ADC_CHANNEL_1, &adc_oneshot_chan_config));
+// @brief The One-Euro output holds until the filtered voltage is this far from it, in 1/256 mV, so the
+// residue of the noise at rest does not send a report on every frame.
+#define AXIS_ONE_EURO_HYSTERESIS 384
 
-  // Fill the axis data with 0xFFFF.
-  memset(g_axes_data, 0xFF, sizeof(uint16_t) * NAGI_MAX_NUM_OF_AXES);
+// @brief Evaluate the calibration of a channel for every raw code.
+// @param channel The ADC channel.
+// @param voltages The table to fill.
+static void build_voltage_table(uint32_t channel, uint16_t* voltages) {
+  for (int raw = 0; raw < AXIS_VOLTAGE_TABLE_SIZE; raw++) {
+    int voltage;
+    ESP_ERROR_CHECK(hal_adc_raw_to_voltage(channel, raw, &voltage));
+    // The fitted curve can dip below zero at the bottom codes.
+    voltages[raw] = voltage < 0 ? 0 : (voltage > UINT16_MAX ? UINT16_MAX : voltage);
+  }
+}
+
+#if NAGI_AXIS_VOLTAGE_TABLE_IN_FLASH
+// @brief Check a stored table against the calibration of this chip.
+// @param table The stored table.
+// @return True if the table can be used.
+static bool is_voltage_table_valid(const axis_voltage_table_t* table) {
+  if (table->magic != AXIS_VOLTAGE_TABLE_MAGIC || table->size != sizeof(axis_voltage_table_t)) {
+    return false;
+  }
+  // A table of another chip or attenuation differs somewhere along the curve.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    if (table->channels[i] != g_adc_channels[i]) {
+      return false;
+    }
+    for (int raw = AXIS_VOLTAGE_TABLE_SIZE / 16; raw < AXIS_VOLTAGE_TABLE_SIZE; raw += AXIS_VOLTAGE_TABLE_SIZE / 16) {
+      int voltage;
+      if (hal_adc_raw_to_voltage(g_adc_channels[i], raw, &voltage) != ESP_OK || voltage != table->voltages[i][raw]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// @brief Map the tables stored in flash, and store them first if they are missing or stale.
+// @return The mapped tables, NULL if the flash is unusable.
+static const axis_voltage_table_t* load_voltage_tables(void) {
+  const axis_voltage_table_t* table;
+  esp_err_t err = hal_flash_map(NAGI_AXIS_VOLTAGE_TABLE_PARTITION, sizeof(axis_voltage_table_t), (const void**)&table);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to map the voltage table. Error %s", esp_err_to_name(err));
+    return NULL;
+  }
+  if (is_voltage_table_valid(table)) {
+    return table;
+  }
+
+  ESP_LOGI(TAG, "Storing the voltage table.");
+  axis_voltage_table_t* built = malloc(sizeof(axis_voltage_table_t));
+  if (built == NULL) {
+    return NULL;
+  }
+  memset(built, 0, sizeof(axis_voltage_table_t));
+  built->magic = AXIS_VOLTAGE_TABLE_MAGIC;
+  built->size = sizeof(axis_voltage_table_t);
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    built->channels[i] = g_adc_channels[i];
+    build_voltage_table(g_adc_channels[i], built->voltages[i]);
+  }
+  err = hal_flash_write(NAGI_AXIS_VOLTAGE_TABLE_PARTITION, built, sizeof(axis_voltage_table_t));
+  free(built);
+  if (err == ESP_OK) {
+    err = hal_flash_map(NAGI_AXIS_VOLTAGE_TABLE_PARTITION, sizeof(axis_voltage_table_t), (const void**)&table);
+  }
+  if (err != ESP_OK || !is_voltage_table_valid(table)) {
+    ESP_LOGW(TAG, "Failed to store the voltage table. Error %s", esp_err_to_name(err));
+    return NULL;
+  }
+  return table;
+}
+#endif
+
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+// @brief Decimate a finished frame into the outputs of the axes, in the ADC ISR.
+// @param samples The conversions.
+// @param num_of_samples The number of conversions.
+// @param arg Unused.
+// @return False, no task is woken, the sampler reads the frames on its period.
+static bool IRAM_ATTR reduce_adc_frame(const hal_adc_sample_t* samples, uint32_t num_of_samples, void* arg) {
+  uint32_t begin = begin_stage();
+  uint32_t head = g_frame_head;
+  axis_frame_t* frame = &g_frames[head % NAGI_AXIS_ADC_FRAME_QUEUE_SIZE];
+  memset(frame->num_of_outputs, 0, sizeof(frame->num_of_outputs));
+  for (uint32_t i = 0; i < num_of_samples; i++) {
+    uint32_t chan_num = samples[i].channel;
+    uint32_t axis_num = chan_num < AXIS_MAX_ADC_CHANNELS ? g_channel_axes[chan_num] : AXIS_NO_AXIS;
+    int32_t output;
+    if (axis_num < NAGI_MAX_NUM_OF_AXES &&
+        decimate_axis(&g_decimators[axis_num], g_voltages[axis_num][samples[i].raw & (AXIS_VOLTAGE_TABLE_SIZE - 1)], &output) &&
+        frame->num_of_outputs[axis_num] < AXIS_OUTPUTS_PER_FRAME) {
+      frame->outputs[axis_num][frame->num_of_outputs[axis_num]++] = output;
+    }
+  }
+#if NAGI_TRACE
+  // The trace is written on the sampler task, the samples are only copied while it records.
+  frame->num_of_samples = 0;
+  if (is_trace_recording()) {
+    frame->num_of_samples = num_of_samples < HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES ? num_of_samples : HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES;
+    memcpy(frame->samples, samples, sizeof(hal_adc_sample_t) * frame->num_of_samples);
+  }
 #endif
+  frame->done_us = hal_get_time_us();
+  __atomic_store_n(&g_frame_head, head + 1, __ATOMIC_RELEASE);
+  end_stage(STATS_STAGE_REDUCE_FRAME, begin);
+  return false;
 }
+#elif NAGI_AXIS_USE_ADC_CONTINUOUS
+// @brief Count a frame the driver dropped as the pool was full, in the ADC ISR.
+// @param arg Unused.
+// @return False, no task is woken.
+static bool IRAM_ATTR count_adc_overflow(void* arg) {
+  __atomic_fetch_add(&g_axis_adc_overflows, 1, __ATOMIC_RELAXED);
+  return false;
+}
+#endif
 
-// @brief Deinitialize the axis module.
-void deinitialize_axis(void) {
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
-  // Deinitialize the ADC IIR filter.
-  if (g_adc1_iir_filter_handle != NULL) {
-    adc_continuous_iir_filter_disable(g_adc1_iir_filter_handle);
-    adc_del_continuous_iir_filter(g_adc1_iir_filter_handle);
-    g_adc1_iir_filter_handle = NULL;
-  }
-  // Deinitialize the ADC continuous.
-  if (g_adc1_cont_handle != NULL) {
-    adc_continuous_deinit(g_adc1_cont_handle);
-    g_adc1_cont_handle = NULL;
+// @brief Initialize the axis module.
+void initialize_axis(void) {
+  // The scan converts every channel in turn, so its rate scales with the axes.
+  ESP_ERROR_CHECK(hal_adc_initialize(g_adc_channels, NAGI_MAX_NUM_OF_AXES, AXIS_SCAN_FREQ_HZ));
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+  ESP_ERROR_CHECK(hal_adc_register_callbacks(reduce_adc_frame, NULL, NULL));
+  ESP_LOGI(TAG, "Reducing the ADC frames in the ISR, up to %d frames queued.", NAGI_AXIS_ADC_FRAME_QUEUE_SIZE);
+#elif NAGI_AXIS_USE_ADC_CONTINUOUS
+  ESP_ERROR_CHECK(hal_adc_register_callbacks(NULL, count_adc_overflow, NULL));
+#endif
+
+  memset(g_channel_axes, AXIS_NO_AXIS, sizeof(g_channel_axes));
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    assert(g_adc_channels[i] < AXIS_MAX_ADC_CHANNELS && g_channel_axes[g_adc_channels[i]] == AXIS_NO_AXIS);
+    g_channel_axes[g_adc_channels[i]] = i;
   }
+
+  // Tabulate the calibration once, the driver evaluates the fitted curve on every call.
+  if (g_voltages[0] == NULL) {
+#if NAGI_AXIS_VOLTAGE_TABLE_IN_FLASH
+    const axis_voltage_table_t* table = load_voltage_tables();
+    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+      if (table != NULL) {
+        g_voltages[i] = table->voltages[i];
+      } else {
+        // Keep working from RAM, the table is rebuilt on every boot.
+        uint16_t* voltages = malloc(sizeof(uint16_t) * AXIS_VOLTAGE_TABLE_SIZE);
+        assert(voltages != NULL);
+        build_voltage_table(g_adc_channels[i], voltages);
+        g_voltages[i] = voltages;
+      }
+    }
 #else
-  // Deinitialize the ADC oneshot.
-  if (g_adc1_oneshot_handle != NULL) {
-    adc_oneshot_del_unit(g_adc1_oneshot_handle);
-    g_adc1_oneshot_handle = NULL;
+    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+      build_voltage_table(g_adc_channels[i], g_voltage_tables[i]);
+      g_voltages[i] = g_voltage_tables[i];
+    }
+#endif
+  }
+
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+  // Clear the frames.
+  memset(g_frames, 0x0, sizeof(g_frames));
+#elif NAGI_AXIS_USE_ADC_CONTINUOUS
+  // Clear the samples.
+  memset(g_adc1_samples, 0x0, sizeof(g_adc1_samples));
+#else
+  // Fill the voltages with 0xFFFF, so the first reading is reported.
+  memset(g_axes_voltages, 0xFF, sizeof(uint16_t) * NAGI_MAX_NUM_OF_AXES);
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    g_readings[i] = UINT16_MAX * AXIS_MILLIVOLT;
   }
 #endif
 
-  // Deinitialize the ADC calibration.
-  if (g_adc1_cali_chan1_handle != NULL) {
-    adc_cali_delete_scheme_curve_fitting(g_adc1_cali_chan1_handle);
-    g_adc1_cali_chan1_handle = NULL;
+  // Hand out the response tables once, the profiles survive a restart.
+  if (g_spare_responses == NULL) {
+    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+      g_responses[i] = g_response_tables[i];
+    }
+    g_spare_responses = g_response_tables[NAGI_MAX_NUM_OF_AXES];
+  }
+
+  // An axis without a stored profile reports the whole range of its channel.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    if (g_axis_profiles[i].min == g_axis_profiles[i].max) {
+      axis_profile_t profile;
+      get_default_axis_profile(i, &profile);
+      ESP_ERROR_CHECK(set_axis_profile(i, &profile));
+    }
   }
 }
 
+// @brief Deinitialize the axis module.
+void deinitialize_axis(void) {
+  hal_adc_deinitialize();
+}
+
 // @brief Start the axis module.
 void start_axis(void) {
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
-  // Start the ADC continuous.
-  ESP_ERROR_CHECK(adc_continuous_start(g_adc1_cont_handle));
+  // The decimators start over with the conversions.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    ESP_ERROR_CHECK(initialize_axis_decimator(&g_decimators[i], NAGI_AXIS_CIC_ORDER, AXIS_DECIMATION_FACTOR, NAGI_AXIS_VOLTAGE_FRACTION_BITS));
+  }
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+  // The ISR is not running, the frames start over.
+  g_frame_head = 0;
+  g_frame_tail = 0;
 #endif
+  // Start the ADC continuous.
+  ESP_ERROR_CHECK(hal_adc_start());
 }
 
 // @brief Stop the axis module.
 void stop_axis(void) {
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
   // Stop the ADC continuous.
-  ESP_ERROR_CHECK(adc_continuous_stop(g_adc1_cont_handle));
-#endif
+  ESP_ERROR_CHECK(hal_adc_stop());
+}
+
+// @brief Get the smoothing factor of a low-pass over a period, 1 / (1 + 1 / (2 pi fc dt)).
+// @param cutoff_mhz The cutoff frequency in mHz.
+// @param dt_us The period in microseconds.
+// @return The factor in 1/65536.
+static uint32_t get_smoothing_factor(uint32_t cutoff_mhz, uint32_t dt_us) {
+  // 2 pi fc dt in 1/65536, mHz times us is 1e-9 and 2 pi is 411775 / 65536.
+  uint64_t rate = (uint64_t)cutoff_mhz * dt_us * 411775 / 1000000000;
+  return (uint32_t)((rate << 16) / (rate + 65536));
+}
+
+// @brief Filter a reading with the One-Euro filter.
+int32_t filter_one_euro(axis_one_euro_t* filter, int32_t voltage, uint32_t dt_us) {
+  int32_t value = voltage;
+  if (!filter->is_initialized || dt_us == 0) {
+    *filter = (axis_one_euro_t){.value = value, .speed = 0, .is_initialized = true};
+    return value;
+  }
+
+  // The speed against the last output, smoothed at a fixed cutoff so noise does not open the filter.
+  int64_t speed = (int64_t)(value - filter->value) * 1000000 / 256 / dt_us;
+  uint32_t alpha = get_smoothing_factor(NAGI_AXIS_ONE_EURO_SPEED_CUTOFF_MHZ, dt_us);
+  filter->speed += (int32_t)((speed - filter->speed) * alpha / 65536);
+
+  // The faster the axis moves, the higher the cutoff and the less the lag.
+  uint64_t cutoff = NAGI_AXIS_ONE_EURO_MIN_CUTOFF_MHZ + (uint64_t)abs(filter->speed) * NAGI_AXIS_ONE_EURO_BETA;
+  alpha = get_smoothing_factor(cutoff < UINT32_MAX ? (uint32_t)cutoff : UINT32_MAX, dt_us);
+  filter->value += (int32_t)((int64_t)(value - filter->value) * alpha / 65536);
+  return filter->value;
+}
+
+// @brief Initialize a decimator.
+esp_err_t initialize_axis_decimator(axis_decimator_t* decimator, uint32_t order, uint32_t factor, uint32_t fraction_bits) {
+  uint32_t factor_bits = 0;
+  while ((1u << factor_bits) < factor) {
+    factor_bits++;
+  }
+  // The registers wrap at 32 bits, they must hold the gain over the 12-bit voltages.
+  if (order == 0 || order > AXIS_CIC_MAX_ORDER || factor != (1u << factor_bits) || 12 + order * factor_bits > 32 ||
+      fraction_bits > 16) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *decimator = (axis_decimator_t){
+    .order = order,
+    .factor = factor,
+    .shift = (int32_t)(order * factor_bits) - (int32_t)fraction_bits,
+    .warmup = order - 1,
+  };
+  return ESP_OK;
+}
+
+// @brief Feed a conversion to a decimator.
+bool IRAM_ATTR decimate_axis(axis_decimator_t* decimator, int32_t voltage, int32_t* output) {
+  // The integrators run at the conversion rate.
+  uint32_t value = (uint32_t)voltage;
+  for (uint32_t i = 0; i < decimator->order; i++) {
+    decimator->integrators[i] += value;
+    value = decimator->integrators[i];
+  }
+  if (++decimator->phase < decimator->factor) {
+    return false;
+  }
+  decimator->phase = 0;
+
+  // The combs at the output rate, the differences are exact however often the integrators wrapped.
+  for (uint32_t i = 0; i < decimator->order; i++) {
+    uint32_t delayed = decimator->combs[i];
+    decimator->combs[i] = value;
+    value -= delayed;
+  }
+  // The combs see a partial window until every stage is full.
+  if (decimator->warmup > 0) {
+    decimator->warmup--;
+    return false;
+  }
+  // The gain is factor ^ order, scaled to the fraction bits with rounding.
+  if (decimator->shift > 0) {
+    *output = (int32_t)((value + (1u << (decimator->shift - 1))) >> decimator->shift);
+  } else {
+    *output = (int32_t)(value << -decimator->shift);
+  }
+  return true;
+}
+
+// @brief Look up the value of a reading in the response table of an axis.
+// @param axis_num The axis number.
+// @param voltage The reading in 1/AXIS_MILLIVOLT mV.
+// @return The value, interpolated between the millivolts.
+static uint16_t look_up_axis_response(uint32_t axis_num, int32_t voltage) {
+  // The calibration, deadzone and curve are compiled into the table.
+  const uint16_t* responses = __atomic_load_n(&g_responses[axis_num], __ATOMIC_ACQUIRE);
+  uint32_t index = voltage / AXIS_MILLIVOLT;
+  if (index >= AXIS_RESPONSE_TABLE_SIZE - 1) {
+    return responses[AXIS_RESPONSE_TABLE_SIZE - 1];
+  }
+  int32_t step = responses[index + 1] - responses[index];
+  return responses[index] + step * (voltage % AXIS_MILLIVOLT) / AXIS_MILLIVOLT;
+}
+
+// @brief Update an axis from a reading.
+// @param axis_num The axis number.
+// @param voltage The reading in 1/AXIS_MILLIVOLT mV.
+// @param dt_us The time since the last reading of the axis.
+static void update_axis(uint32_t axis_num, int32_t voltage, uint32_t dt_us) {
+  if (g_axis_filters[axis_num] == AXIS_FILTER_ONE_EURO) {
+    int32_t filtered = filter_one_euro(&g_one_euros[axis_num], voltage * (256 / AXIS_MILLIVOLT), dt_us);
+    if (abs(filtered - g_readings[axis_num] * (256 / AXIS_MILLIVOLT)) <= AXIS_ONE_EURO_HYSTERESIS) {
+      return;
+    }
+    voltage = (filtered + 128 / AXIS_MILLIVOLT) / (256 / AXIS_MILLIVOLT);
+  } else if (abs(voltage - g_readings[axis_num]) <= NAGI_AXIS_JITTER_THRESHOLD * AXIS_MILLIVOLT) {
+    return;
+  }
+  g_readings[axis_num] = voltage;
+  g_axes_voltages[axis_num] = (voltage + AXIS_MILLIVOLT / 2) / AXIS_MILLIVOLT;
+  g_axes_data[axis_num] = look_up_axis_response(axis_num, voltage);
+
+  if (g_is_calibrating[axis_num]) {
+    uint16_t millivolts = g_axes_voltages[axis_num];
+    if (millivolts < g_calibration_lows[axis_num]) {
+      g_calibration_lows[axis_num] = millivolts;
+    }
+    if (millivolts > g_calibration_highs[axis_num]) {
+      g_calibration_highs[axis_num] = millivolts;
+    }
+  }
+}
+
+// @brief Set the filter of an axis.
+void set_axis_filter(int axis_num, axis_filter_t filter) {
+  g_axis_filters[axis_num] = filter;
+  g_one_euros[axis_num].is_initialized = false;
+}
+
+// @brief Get the output of a deflection on a response curve.
+// @param curve The curve.
+// @param deflection The deflection in 1/65536 of the half range.
+// @return The output in 1/65536 of the half range.
+static uint32_t get_curve_output(const axis_curve_t* curve, uint32_t deflection) {
+  // The curve starts from 0:0 and holds past its last point.
+  int64_t x0 = 0;
+  int64_t y0 = 0;
+  for (uint32_t i = 0; i < curve->num_of_points; i++) {
+    int64_t x1 = curve->inputs[i] * 65536 / 100;
+    int64_t y1 = curve->outputs[i] * 65536 / 100;
+    if (deflection < x1) {
+      return (uint32_t)(y0 + (y1 - y0) * (deflection - x0) / (x1 - x0));
+    }
+    x0 = x1;
+    y0 = y1;
+  }
+  return curve->num_of_points > 0 ? (uint32_t)y0 : deflection;
+}
+
+// @brief Build the output of every voltage of a profile.
+void build_axis_response(const axis_profile_t* profile, uint16_t* values, uint32_t size) {
+  const int32_t center = profile->center;
+  const int32_t deadzone = profile->deadzone * 65536 / 100;
+  for (uint32_t voltage = 0; voltage < size; voltage++) {
+    // The deflection toward the max end is positive, whichever way round the ends are.
+    int32_t offset = (int32_t)voltage - center;
+    int32_t span = profile->max - center;
+    bool is_positive = (offset >= 0) == (span >= 0);
+    if (!is_positive) {
+      span = profile->min - center;
+    }
+    int64_t deflection = (int64_t)offset * 65536 / span;
+    deflection = deflection > 65536 ? 65536 : deflection;
+    deflection = deflection <= deadzone ? 0 : (deflection - deadzone) * 65536 / (65536 - deadzone);
+    uint32_t output = get_curve_output(&profile->curve, (uint32_t)deflection);
+    values[voltage] = is_positive ? AXIS_CENTER_VALUE + (uint64_t)output * 32767 / 65536 : AXIS_CENTER_VALUE - (uint64_t)output * 32768 / 65536;
+  }
+}
+
+// @brief Set the profile of an axis.
+esp_err_t set_axis_profile(int axis_num, const axis_profile_t* profile) {
+  if ((profile->min < profile->center) != (profile->center < profile->max) || profile->min == profile->center || profile->center == profile->max) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (profile->deadzone >= 100) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  g_axis_profiles[axis_num] = *profile;
+  // Build into the spare table and swap it in, the previous table becomes the spare.
+  uint16_t* responses = g_spare_responses;
+  build_axis_response(profile, responses, AXIS_RESPONSE_TABLE_SIZE);
+  g_spare_responses = __atomic_exchange_n(&g_responses[axis_num], responses, __ATOMIC_ACQ_REL);
+  // The data only follows a move past the filter, so look the current voltage up again.
+  g_axes_data[axis_num] = look_up_axis_response(axis_num, g_readings[axis_num]);
+  return ESP_OK;
+}
+
+// @brief Get the profile of an uncalibrated axis.
+void get_default_axis_profile(int axis_num, axis_profile_t* profile) {
+  memset(profile, 0, sizeof(axis_profile_t));
+  profile->min = g_voltages[axis_num][0];
+  profile->max = g_voltages[axis_num][AXIS_VOLTAGE_TABLE_SIZE - 1];
+  profile->center = (profile->min + profile->max) / 2;
+}
+
+// @brief Start calibrating an axis.
+void start_axis_calibration(int axis_num) {
+  uint16_t voltage = g_axes_voltages[axis_num];
+  g_calibration_centers[axis_num] = voltage;
+  g_calibration_lows[axis_num] = voltage;
+  g_calibration_highs[axis_num] = voltage;
+  g_is_calibrating[axis_num] = true;
+}
+
+// @brief Take the current voltage of an axis as its center.
+void capture_axis_center(int axis_num, axis_profile_t* profile) {
+  profile->center = g_axes_voltages[axis_num];
+}
+
+// @brief Finish calibrating an axis.
+esp_err_t finish_axis_calibration(int axis_num, axis_profile_t* profile) {
+  if (!g_is_calibrating[axis_num]) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  g_is_calibrating[axis_num] = false;
+  uint16_t center = g_calibration_centers[axis_num];
+  uint16_t low = g_calibration_lows[axis_num];
+  uint16_t high = g_calibration_highs[axis_num];
+  if (center - low < AXIS_MIN_CALIBRATION_SPAN || high - center < AXIS_MIN_CALIBRATION_SPAN) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  // Keep an inverted axis inverted.
+  bool is_inverted = profile->min > profile->max;
+  profile->min = is_inverted ? high : low;
+  profile->center = center;
+  profile->max = is_inverted ? low : high;
+  return ESP_OK;
+}
+
+// @brief Parse a response curve.
+esp_err_t parse_axis_curve(const char* text, axis_curve_t* curve) {
+  axis_curve_t result = {0};
+  if (strcmp(text, "linear") != 0) {
+    const char* p = text;
+    while (*p != '\0') {
+      if (result.num_of_points >= NAGI_AXIS_CURVE_MAX_POINTS) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      char* end;
+      long input = strtol(p, &end, 10);
+      if (end == p || *end != ':' || input < 0 || input > 100) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      p = end + 1;
+      long output = strtol(p, &end, 10);
+      if (end == p || output < 0 || output > 100) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (result.num_of_points > 0 && input <= result.inputs[result.num_of_points - 1]) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      result.inputs[result.num_of_points] = input;
+      result.outputs[result.num_of_points] = output;
+      result.num_of_points++;
+      p = *end == ',' ? end + 1 : end;
+      if (*end != ',' && *end != '\0') {
+        return ESP_ERR_INVALID_ARG;
+      }
+    }
+  }
+  *curve = result;
+  return ESP_OK;
+}
+
+// @brief Format a response curve as parse_axis_curve() reads it.
+void format_axis_curve(const axis_curve_t* curve, char* text, size_t size) {
+  if (curve->num_of_points == 0) {
+    snprintf(text, size, "linear");
+    return;
+  }
+  size_t length = 0;
+  text[0] = '\0';
+  for (uint32_t i = 0; i < curve->num_of_points && length < size; i++) {
+    length += snprintf(text + length, size - length, "%s%u:%u", i > 0 ? "," : "", curve->inputs[i], curve->outputs[i]);
+  }
+}
+
+// @brief Parse calibrated voltages.
+esp_err_t parse_axis_range(const char* text, axis_profile_t* profile) {
+  unsigned min;
+  unsigned center;
+  unsigned max;
+  char end;
+  if (sscanf(text, "%u:%u:%u%c", &min, &center, &max, &end) != 3) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (min > UINT16_MAX || center > UINT16_MAX || max > UINT16_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  profile->min = min;
+  profile->center = center;
+  profile->max = max;
+  return ESP_OK;
+}
+
+// @brief Get the name of a filter.
+const char* get_axis_filter_name(axis_filter_t filter) {
+  return (unsigned)filter < sizeof(FILTER_NAMES) / sizeof(FILTER_NAMES[0]) ? FILTER_NAMES[filter] : "unknown";
+}
+
+// @brief Parse a filter name.
+bool parse_axis_filter(const char* text, axis_filter_t* filter) {
+  for (int i = 0; i < sizeof(FILTER_NAMES) / sizeof(FILTER_NAMES[0]); i++) {
+    if (strcmp(text, FILTER_NAMES[i]) == 0) {
+      *filter = (axis_filter_t)i;
+      return true;
+    }
+  }
+  return false;
 }
 
 #if !NAGI_AXIS_USE_ADC_CONTINUOUS
-void oneshot_read_axis(uint32_t chan_num);
+// @brief Read an axis with the ADC oneshot mode.
+static void oneshot_read_axis(uint32_t axis_num) {
+  // Read the ADC oneshot data.
+  uint32_t chan_num = g_adc_channels[axis_num];
+  esp_err_t ret = hal_adc_read_oneshot(chan_num, &g_adc1_raw[axis_num]);
+  if (ret == ESP_OK) {
+#if NAGI_TRACE
+    hal_adc_sample_t sample = {chan_num, g_adc1_raw[axis_num]};
+    trace_adc_samples(&sample, 1, hal_get_time_us());
 #endif
+    // Convert the raw data to the calibrated data.
+    int* index = &g_exp_weights_filter_indexes[axis_num];
+    g_adc1_voltage[axis_num][*index] = g_voltages[axis_num][g_adc1_raw[axis_num] & (AXIS_VOLTAGE_TABLE_SIZE - 1)];
+    *index = (*index + 1) % FILTER_WINDOW_SIZE;
+
+    int sum = 0;
+    int weight = 1 << FILTER_ALPHA_SHIFT;
+    int total_weight = 0;
+    for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
+      int idx = (*index - i - 1 + FILTER_WINDOW_SIZE) % FILTER_WINDOW_SIZE;
+      sum += g_adc1_voltage[axis_num][idx] * weight;
+      total_weight += weight;
+      weight >>= 1;
+    }
+
+    int64_t now_us = hal_get_time_us();
+    update_axis(axis_num, sum * AXIS_MILLIVOLT / total_weight, (uint32_t)(now_us - g_last_read_us[axis_num]));
+    g_last_read_us[axis_num] = now_us;
+    g_axes_sample_us = now_us;
+  } else {
+    ESP_LOGE(TAG, "Error occurred during reading the ADC oneshot. Error %s", esp_err_to_name(ret));
+  }
+}
+#endif
+
 // @brief Read the axis data.
 void read_axis(void) {
-#if NAGI_AXIS_USE_ADC_CONTINUOUS
+#if NAGI_AXIS_USE_ADC_CONTINUOUS && NAGI_AXIS_USE_ADC_CALLBACK
+  uint32_t head = __atomic_load_n(&g_frame_head, __ATOMIC_ACQUIRE);
+  // The ISR wrote over the oldest frames while the sampler was late.
+  if (head - g_frame_tail > NAGI_AXIS_ADC_FRAME_QUEUE_SIZE) {
+    g_axis_adc_overflows += head - g_frame_tail - NAGI_AXIS_ADC_FRAME_QUEUE_SIZE;
+    g_frame_tail = head - NAGI_AXIS_ADC_FRAME_QUEUE_SIZE;
+  }
+  for (; g_frame_tail != head; g_frame_tail++) {
+    // Copy the fields used out of the frame, the ISR may write over it meanwhile.
+    const axis_frame_t* frame = &g_frames[g_frame_tail % NAGI_AXIS_ADC_FRAME_QUEUE_SIZE];
+    int32_t outputs[NAGI_MAX_NUM_OF_AXES][AXIS_OUTPUTS_PER_FRAME];
+    uint8_t num_of_outputs[NAGI_MAX_NUM_OF_AXES];
+    memcpy(num_of_outputs, frame->num_of_outputs, sizeof(num_of_outputs));
+    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+      num_of_outputs[i] = num_of_outputs[i] < AXIS_OUTPUTS_PER_FRAME ? num_of_outputs[i] : AXIS_OUTPUTS_PER_FRAME;
+      memcpy(outputs[i], frame->outputs[i], sizeof(int32_t) * num_of_outputs[i]);
+    }
+    int64_t done_us = frame->done_us;
+#if NAGI_TRACE
+    uint32_t num_of_samples = frame->num_of_samples;
+    num_of_samples = num_of_samples < HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES ? num_of_samples : HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES;
+    memcpy(g_trace_samples, frame->samples, sizeof(hal_adc_sample_t) * num_of_samples);
+#endif
+    // The ISR may have been writing over the frame while it was copied.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&g_frame_head, __ATOMIC_RELAXED) - g_frame_tail > NAGI_AXIS_ADC_FRAME_QUEUE_SIZE) {
+      g_axis_adc_overflows++;
+      continue;
+    }
+#if NAGI_TRACE
+    trace_adc_samples(g_trace_samples, num_of_samples, done_us);
+#endif
+    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+      for (uint32_t j = 0; j < num_of_outputs[i]; j++) {
+        update_axis(i, outputs[i][j], 1000000 / NAGI_AXIS_OUTPUT_FREQ_HZ);
+      }
+    }
+    g_axes_sample_us = done_us;
+  }
+#elif NAGI_AXIS_USE_ADC_CONTINUOUS
   // Read the ADC continuous data.
-  uint32_t ret_num = 0;
-  esp_err_t ret = adc_continuous_read(g_adc1_cont_handle, g_conv_results, sizeof(g_conv_results), &ret_num, 0);
+  uint32_t num_of_samples = 0;
+  esp_err_t ret = hal_adc_read(g_adc1_samples, sizeof(g_adc1_samples) / sizeof(g_adc1_samples[0]), &num_of_samples);
   if (ret == ESP_OK) {
-    static int chan_data[NAGI_MAX_NUM_OF_AXES];
-    static int chan_count[NAGI_MAX_NUM_OF_AXES];
-    memset(chan_data, 0, sizeof(chan_data));
-    memset(chan_count, 0, sizeof(chan_count));
-    for (int i = 0; i < ret_num; i += SOC_ADC_DIGI_RESULT_BYTES) {
-      adc_digi_output_data_t *p = (adc_digi_output_data_t*)&g_conv_results[i];
-      uint32_t chan_num = p->type2.channel;
-      uint32_t data = p->type2.data;
-      if (chan_num < SOC_ADC_CHANNEL_NUM(ADC_UNIT_1)) {
-        // The first axis is the ADC1 channel 1, we don't use channel 0.
-        if (chan_num - ADC_CHANNEL_1 < NAGI_MAX_NUM_OF_AXES) {
-          // Convert the raw data to the calibrated data.
-          int voltage;
-          ret = adc_cali_raw_to_voltage(g_adc1_cali_chan1_handle, data, &voltage);
-          if (ret == ESP_OK) {
-            chan_data[chan_num - ADC_CHANNEL_1] += voltage;
-            chan_count[chan_num - ADC_CHANNEL_1]++;
-          } else {
-            ESP_LOGE(TAG, "Error occurred during converting the raw data to voltage. Error %s", esp_err_to_name(ret));
-          }
-        } else {
-          ESP_LOGW(TAG, "Invalid ADC channel number %lu", chan_num);
-        }
-      } else {
+#if NAGI_TRACE
+    trace_adc_samples(g_adc1_samples, num_of_samples, hal_get_time_us());
+#endif
+    // Decimate the frame into the axes in one pass, whatever the order of the channels in it.
+    for (uint32_t i = 0; i < num_of_samples; i++) {
+      uint32_t chan_num = g_adc1_samples[i].channel;
+      uint32_t data = g_adc1_samples[i].raw;
+      uint32_t axis_num = chan_num < AXIS_MAX_ADC_CHANNELS ? g_channel_axes[chan_num] : AXIS_NO_AXIS;
+      int32_t output;
+      if (axis_num >= NAGI_MAX_NUM_OF_AXES) {
         ESP_LOGW(TAG, "Invalid ADC channel number %lu", chan_num);
-      }
-    }
-    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
-      if (chan_count[i] > 0) {
-        int voltage = chan_data[i] / chan_count[i];
-        if (abs(voltage - (int)g_axes_data[i]) > NAGI_AXIS_JITTER_THRESHOLD) {
-          g_axes_data[i] = voltage;
-        }
+      } else if (decimate_axis(&g_decimators[axis_num], g_voltages[axis_num][data & (AXIS_VOLTAGE_TABLE_SIZE - 1)], &output)) {
+        // The conversions of an axis are evenly spaced, so the outputs are too.
+        update_axis(axis_num, output, 1000000 / NAGI_AXIS_OUTPUT_FREQ_HZ);
       }
     }
   } else if (ret == ESP_ERR_TIMEOUT) {
@@ -209,38 +784,9 @@ void read_axis(void) {
   } else {
     ESP_LOGE(TAG, "Error occurred during reading the ADC continuous. Error %s", esp_err_to_name(ret));
   }
-}
 #else
-  oneshot_read_axis(ADC_CHANNEL_1);
-}
-
-void oneshot_read_axis(uint32_t chan_num) {
-  // Read the ADC oneshot data.
-  esp_err_t ret = adc_oneshot_read(g_adc1_oneshot_handle, chan_num, &g_adc1_raw[chan_num - ADC_CHANNEL_1]);
-  if (ret == ESP_OK) {
-    ret = adc_cali_raw_to_voltage(g_adc1_cali_chan1_handle, g_adc1_raw[chan_num - ADC_CHANNEL_1], &g_adc1_voltage[chan_num - ADC_CHANNEL_1][g_exp_weights_filter_index]);
-    if (ret == ESP_OK) {
-      g_exp_weights_filter_index = (g_exp_weights_filter_index + 1) % FILTER_WINDOW_SIZE;
-
-      int sum = 0;
-      int weight = 1 << FILTER_ALPHA_SHIFT;
-      int total_weight = 0;
-      for (uint8_t i = 0; i < FILTER_WINDOW_SIZE; i++) {
-        int idx = (g_exp_weights_filter_index - i - 1 + FILTER_WINDOW_SIZE) % FILTER_WINDOW_SIZE;
-        sum += g_adc1_voltage[chan_num - ADC_CHANNEL_1][idx] * weight;
-        total_weight += weight;
-        weight >>= 1;
-      }
-
-      int voltage = sum / total_weight;
-      if (abs(voltage - (int)g_axes_data[chan_num - ADC_CHANNEL_1]) > NAGI_AXIS_JITTER_THRESHOLD) {
-        g_axes_data[chan_num - ADC_CHANNEL_1] = voltage;
-      }
-    } else {
-      ESP_LOGE(TAG, "Error occurred during converting the raw data to voltage. Error %s", esp_err_to_name(ret));
-    }
-  } else {
-    ESP_LOGE(TAG, "Error occurred during reading the ADC oneshot. Error %s", esp_err_to_name(ret));
+  for (uint32_t i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    oneshot_read_axis(i);
   }
+#endif
 }
-#endif
\ No newline at end of file
@@ -1,9 +1,96 @@
 #ifndef __AXIS_H__
 #define __AXIS_H__
 
-// @brief The axis data.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// @brief The conversion rate of the scan over every axis, so each axis is converted at NAGI_AXIS_SAMPLE_FREQ_HZ.
+#define AXIS_SCAN_FREQ_HZ (NAGI_AXIS_SAMPLE_FREQ_HZ * NAGI_MAX_NUM_OF_AXES)
+
+// @brief How an axis is filtered after the decimator.
+typedef enum {
+  // Report the decimated voltage once it moved more than NAGI_AXIS_JITTER_THRESHOLD from the report.
+  AXIS_FILTER_DEADBAND = 0,
+  // The One-Euro filter, a low-pass whose cutoff rises with the speed of the axis.
+  AXIS_FILTER_ONE_EURO,
+} axis_filter_t;
+
+// @brief The One-Euro filter state, in fixed point.
+typedef struct {
+  // The filtered voltage, in 1/256 mV.
+  int32_t value;
+  // The filtered speed, in mV/s.
+  int32_t speed;
+  bool is_initialized;
+} axis_one_euro_t;
+
+// @brief The most integrator and comb stages of a decimator.
+#define AXIS_CIC_MAX_ORDER 4
+
+// @brief A CIC decimator, the integrators run at the conversion rate and the combs at the output rate, in
+// 32-bit arithmetic that wraps. Of order 1 it is the mean of every factor conversions.
+typedef struct {
+  uint32_t integrators[AXIS_CIC_MAX_ORDER];
+  uint32_t combs[AXIS_CIC_MAX_ORDER];
+  uint32_t order;
+  // The conversions per output, a power of two.
+  uint32_t factor;
+  // The shift from the gain of the stages to the fraction bits of the output, negative to shift left.
+  int32_t shift;
+  // The conversions since the last output, and the outputs to hold back until every stage is full.
+  uint32_t phase;
+  uint32_t warmup;
+} axis_decimator_t;
+
+// @brief The reported value of a centered axis, the values span the whole 16 bits.
+#define AXIS_CENTER_VALUE 32768
+
+// @brief A response curve, the output at a deflection is interpolated between 0:0 and the points, held past
+// the last point, and mirrored on the other side of the center.
+typedef struct {
+  // The number of points, 0 for a linear response.
+  uint32_t num_of_points;
+  // The deflections in percent past the deadzone, increasing.
+  uint8_t inputs[NAGI_AXIS_CURVE_MAX_POINTS];
+  // The outputs in percent of the half range.
+  uint8_t outputs[NAGI_AXIS_CURVE_MAX_POINTS];
+} axis_curve_t;
+
+// @brief The calibration and response of an axis, written by the console.
+typedef struct {
+  // The voltages at the ends and at rest, in millivolts. The ends are swapped for an inverted axis.
+  uint16_t min;
+  uint16_t center;
+  uint16_t max;
+  // The deflection around the center reported as centered, in percent of the half range.
+  uint8_t deadzone;
+  axis_curve_t curve;
+} axis_profile_t;
+
+// @brief The axis data, axis i is the joystick axis field i from axis_x on. 0 and 65535 are the calibrated
+// ends, AXIS_CENTER_VALUE the calibrated center.
 extern uint16_t g_axes_data[NAGI_MAX_NUM_OF_AXES];
 
+// @brief The filtered voltage of every axis the data is looked up from, in millivolts.
+extern uint16_t g_axes_voltages[NAGI_MAX_NUM_OF_AXES];
+
+// @brief The time the newest conversions in the axis data finished, 0 until it is known. With the frame
+// callback this is when the DMA finished the frame, so the sampler sees how old the data it reads is.
+extern int64_t g_axes_sample_us;
+
+// @brief The ADC frames lost, to a full DMA pool when polling, or to a full frame queue when the frames are
+// reduced in the conversion-done callback.
+extern uint32_t g_axis_adc_overflows;
+
+// @brief The filter of every axis.
+extern axis_filter_t g_axis_filters[NAGI_MAX_NUM_OF_AXES];
+
+// @brief The profile of every axis, set with set_axis_profile().
+extern axis_profile_t g_axis_profiles[NAGI_MAX_NUM_OF_AXES];
+
 // @brief Initialize the axis module.
 void initialize_axis(void);
 
@@ -19,4 +106,84 @@ void stop_axis(void);
 // @brief Read the axis data.
 void read_axis(void);
 
-#endif // __AXIS_H__
\ No newline at end of file
+// @brief Set the filter of an axis, the filter starts over from the next reading.
+// @param axis_num The axis number.
+// @param filter The filter.
+void set_axis_filter(int axis_num, axis_filter_t filter);
+
+// @brief Get the name of a filter.
+const char* get_axis_filter_name(axis_filter_t filter);
+
+// @brief Parse a filter name.
+// @return True if the name is valid.
+bool parse_axis_filter(const char* text, axis_filter_t* filter);
+
+// @brief Set the profile of an axis, and compile it into the table the readings are looked up in. The table
+// is built aside and swapped in, so the sampler may keep reading the axis. Call from one task at a time.
+// @param axis_num The axis number.
+// @param profile The profile.
+// @return ESP_ERR_INVALID_ARG if the ends are not on either side of the center.
+esp_err_t set_axis_profile(int axis_num, const axis_profile_t* profile);
+
+// @brief Get the profile of an uncalibrated axis, the whole range of its channel with the center halfway.
+// @param axis_num The axis number.
+// @param profile The profile to fill.
+void get_default_axis_profile(int axis_num, axis_profile_t* profile);
+
+// @brief Start calibrating an axis. The current voltage is the center, the axis should be at rest, and the
+// ends are the lowest and highest voltages until finish_axis_calibration().
+// @param axis_num The axis number.
+void start_axis_calibration(int axis_num);
+
+// @brief Take the current voltage of an axis as its center, the axis should be at rest.
+// @param axis_num The axis number.
+// @param profile The profile to update.
+void capture_axis_center(int axis_num, axis_profile_t* profile);
+
+// @brief Finish calibrating an axis, and take the voltages seen since start_axis_calibration() as its ends.
+// @param axis_num The axis number.
+// @param profile The profile to update.
+// @return ESP_ERR_INVALID_STATE if the axis is not calibrating, ESP_ERR_INVALID_SIZE if it did not move
+// far enough on both sides of the center.
+esp_err_t finish_axis_calibration(int axis_num, axis_profile_t* profile);
+
+// @brief Parse a response curve, "<deflection>:<output>,..." in percent, for example "0:0,50:25,100:100".
+// "linear" or an empty text is a linear response.
+esp_err_t parse_axis_curve(const char* text, axis_curve_t* curve);
+
+// @brief Format a response curve as parse_axis_curve() reads it.
+void format_axis_curve(const axis_curve_t* curve, char* text, size_t size);
+
+// @brief Parse calibrated voltages, "<min>:<center>:<max>" in millivolts.
+esp_err_t parse_axis_range(const char* text, axis_profile_t* profile);
+
+// @brief Build the output of every voltage of a profile.
+// @param profile The profile.
+// @param values The table to fill, indexed by millivolts.
+// @param size The entries of the table.
+void build_axis_response(const axis_profile_t* profile, uint16_t* values, uint32_t size);
+
+// @brief Initialize a decimator.
+// @param decimator The decimator.
+// @param order The stages, 1 to AXIS_CIC_MAX_ORDER.
+// @param factor The conversions per output, a power of two.
+// @param fraction_bits The fraction bits of the outputs, in millivolts.
+// @return ESP_ERR_INVALID_ARG if the stages would overflow 32 bits over 12-bit voltages.
+esp_err_t initialize_axis_decimator(axis_decimator_t* decimator, uint32_t order, uint32_t factor, uint32_t fraction_bits);
+
+// @brief Feed a conversion to a decimator.
+// @param decimator The decimator.
+// @param voltage The conversion in millivolts.
+// @param output The output to fill, in 1/2^fraction_bits mV.
+// @return True if an output is ready.
+bool decimate_axis(axis_decimator_t* decimator, int32_t voltage, int32_t* output);
+
+// @brief Filter a reading with the One-Euro filter. The cutoff is NAGI_AXIS_ONE_EURO_MIN_CUTOFF_MHZ at rest
+// and rises by NAGI_AXIS_ONE_EURO_BETA mHz per mV/s of the speed, smoothed at NAGI_AXIS_ONE_EURO_SPEED_CUTOFF_MHZ.
+// @param filter The filter.
+// @param voltage The reading, in 1/256 mV.
+// @param dt_us The time since the last reading.
+// @return The filtered voltage, in 1/256 mV.
+int32_t filter_one_euro(axis_one_euro_t* filter, int32_t voltage, uint32_t dt_us);
+
+#endif // __AXIS_H__
@@ -1,58 +1,272 @@
 #include <stdint.h>
+#include <string.h>
 
 #include "soc/gpio_num.h"
 
 #include "config.h"
 #include "button.h"
+#include "tasks.h"
+#if NAGI_TRACE
+#include "trace.h"
+#endif
 
-#include "driver/gpio.h"
+#include "hal.h"
+#include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_err.h"
+
+static const char* TAG = "button";
 
 button_t g_button_data[NAGI_MAX_NUM_OF_BUTTONS];
+button_scanner_type_t g_button_scanner = NAGI_BUTTON_SCANNER;
+uint32_t g_button_states[BUTTON_NUM_OF_WORDS];
+uint32_t g_button_changes[BUTTON_NUM_OF_WORDS];
+button_debounce_t g_button_debounces[NAGI_MAX_NUM_OF_BUTTONS];
+
+// The names of the debounce policies, as button_debounce_t.
+static const char* const DEBOUNCE_NAMES[] = {"integrate", "eager", "eager-press"};
+
+// The no button mark of _input_buttons.
+#define NO_BUTTON 0xFF
+
+// The scanner.
+static button_scanner_t _scanner;
+// The words of the scanner inputs.
+static uint32_t _num_of_input_words;
+// The input of every button, and the button of every input.
+static uint8_t _button_inputs[NAGI_MAX_NUM_OF_BUTTONS];
+static uint8_t _input_buttons[BUTTON_MAX_INPUTS];
+// The debouncers, one per word of inputs.
+static button_debouncer_t _debouncers[BUTTON_MAX_INPUTS / 32];
+// The levels of the last read, the edges are traced.
+static uint32_t _last_levels[BUTTON_MAX_INPUTS / 32];
+// The time of the last debounced sample.
+static int64_t _last_sample_us;
+
+#if NAGI_SYNC_EVENT_DRIVEN
+// @brief The ISR handler for the buttons.
+static void IRAM_ATTR button_isr_handler(void* arg) {
+  // Wake the sampler, it debounces and commits the new state.
+  notify_input_from_isr();
+}
+#endif
+
+// @brief Create the scanner of g_button_scanner.
+// @return The result.
+static esp_err_t create_scanner(void) {
+  switch (g_button_scanner) {
+    case BUTTON_SCANNER_MATRIX: {
+      static const uint8_t ROWS[] = NAGI_BUTTON_MATRIX_ROW_GPIO_NUMS;
+      static const uint8_t COLUMNS[] = NAGI_BUTTON_MATRIX_COLUMN_GPIO_NUMS;
+      _Static_assert(sizeof(ROWS) * sizeof(COLUMNS) >= NAGI_MAX_NUM_OF_BUTTONS, "The matrix is too small for the buttons.");
+      return create_matrix_scanner(&_scanner, ROWS, sizeof(ROWS), COLUMNS, sizeof(COLUMNS), NAGI_BUTTON_MATRIX_SETTLE_US);
+    }
+    case BUTTON_SCANNER_SHIFT: {
+      static const int PINS[3] = NAGI_BUTTON_SHIFT_GPIO_NUMS;
+      return create_shift_scanner(&_scanner, PINS[0], PINS[1], PINS[2], NAGI_MAX_NUM_OF_BUTTONS, NAGI_BUTTON_SHIFT_CLOCK_HZ);
+    }
+    default: {
+      uint32_t pin_mask = 0;
+      for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+        pin_mask |= 1u << g_button_data[i].gpio_num;
+      }
+      return create_gpio_scanner(&_scanner, pin_mask, NAGI_SYNC_EVENT_DRIVEN);
+    }
+  }
+}
 
 // @brief Initialize the button module.
 void initialize_button(void) {
-  g_button_data[0] = (button_t){5, 0, 0, 0, 0, 0, 0};
-  g_button_data[1] = (button_t){4, 0, 0, 0, 0, 0, 0};
-  g_button_data[2] = (button_t){14, 0, 0, 0, 0, 0, 0};
-  g_button_data[3] = (button_t){15, 0, 0, 0, 0, 0, 0};
-  g_button_data[4] = (button_t){18, 0, 0, 0, 0, 0, 0};
-  g_button_data[5] = (button_t){9, 0, 0, 0, 0, 0, 0};
-  g_button_data[6] = (button_t){22, 0, 0, 0, 0, 0, 0};
-  g_button_data[7] = (button_t){21, 0, 0, 0, 0, 0, 0};
-  g_button_data[8] = (button_t){23, 0, 0, 0, 0, 0, 0};
-
-  gpio_config_t io_conf = {
-    .intr_type = GPIO_INTR_DISABLE, // Disable interrupt.
-    .mode = GPIO_MODE_INPUT,        // Set as input mode.
-    .pin_bit_mask = 0,
-    .pull_down_en = 0,              // Disable the internal pull-down resistor.
-    .pull_up_en = 1,                // Use the internal pull-up resistor.
-  };
+  g_button_data[0] = (button_t){5};
+  g_button_data[1] = (button_t){4};
+  g_button_data[2] = (button_t){14};
+  g_button_data[3] = (button_t){15};
+  g_button_data[4] = (button_t){18};
+  g_button_data[5] = (button_t){9};
+  g_button_data[6] = (button_t){22};
+  g_button_data[7] = (button_t){21};
+  g_button_data[8] = (button_t){23};
+
+  esp_err_t err = create_scanner();
+  if (err != ESP_OK && g_button_scanner != BUTTON_SCANNER_GPIO) {
+    ESP_LOGE(TAG, "Failed to create the %s scanner (%s), using the GPIOs.", get_button_scanner_name(g_button_scanner), esp_err_to_name(err));
+    g_button_scanner = BUTTON_SCANNER_GPIO;
+    err = create_scanner();
+  }
+  ESP_ERROR_CHECK(err);
+  _num_of_input_words = (_scanner.num_of_inputs + 31) / 32;
+
+  // The GPIO scanner reads the input register, a GPIO is an input. The other scanners read the buttons in order.
+  memset(_input_buttons, NO_BUTTON, sizeof(_input_buttons));
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    _button_inputs[i] = g_button_scanner == BUTTON_SCANNER_GPIO ? g_button_data[i].gpio_num : i;
+    _input_buttons[_button_inputs[i]] = i;
+  }
+
+  // Start from the current levels, so nothing changes before the first press. A scan also proves the budget.
+  int64_t begin_us = hal_get_time_us();
+  scan_buttons(&_scanner, _last_levels);
+  int64_t scan_us = hal_get_time_us() - begin_us;
+  if (scan_us > NAGI_BUTTON_SCAN_BUDGET_US) {
+    ESP_LOGW(TAG, "A %s scan of %lu inputs took %ld us.", get_button_scanner_name(g_button_scanner), _scanner.num_of_inputs, (long)scan_us);
+  }
+  for (uint32_t w = 0; w < _num_of_input_words; w++) {
+    _debouncers[w] = (button_debouncer_t){.state = _last_levels[w]};
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    set_button_debounce(i, g_button_debounces[i]);
+  }
+  _last_sample_us = hal_get_time_us();
+  memset(g_button_states, 0, sizeof(g_button_states));
+  memset(g_button_changes, 0, sizeof(g_button_changes));
   for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
-    io_conf.pin_bit_mask |= (1ULL << g_button_data[i].gpio_num);
+    int input = _button_inputs[i];
+    g_button_states[i / 32] |= ((_last_levels[input / 32] >> (input % 32)) & 1) << (i % 32);
   }
-  gpio_config(&io_conf);
+
+#if NAGI_SYNC_EVENT_DRIVEN
+  // Hook the ISR handler, the other scanners are polled.
+  if (g_button_scanner == BUTTON_SCANNER_GPIO) {
+    for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+      hal_gpio_add_isr(g_button_data[i].gpio_num, button_isr_handler, (void*)(intptr_t)i);
+    }
+  }
+#endif
+}
+
+// @brief Count up the vertical counters of the inputs in a mask, reset the others.
+// @param planes The counters.
+// @param mask The inputs to count up.
+// @param threshold The count to reach.
+// @return The inputs whose counter reached the threshold, their counters are reset.
+static uint32_t count_up(uint32_t* planes, uint32_t mask, uint32_t threshold) {
+  uint32_t carry = mask;
+  for (int k = 0; k < NAGI_BUTTON_COUNTER_BITS; k++) {
+    uint32_t plane = planes[k];
+    planes[k] = (plane ^ carry) & mask;
+    carry &= plane;
+  }
+  uint32_t reached = mask;
+  for (int k = 0; k < NAGI_BUTTON_COUNTER_BITS; k++) {
+    reached &= (threshold >> k) & 1 ? planes[k] : ~planes[k];
+  }
+  for (int k = 0; k < NAGI_BUTTON_COUNTER_BITS; k++) {
+    planes[k] &= ~reached;
+  }
+  return reached;
+}
+
+// @brief Set the inputs of a debouncer that are eager, and those of them whose release is integrated.
+void set_debouncer_policy(button_debouncer_t* debouncer, uint32_t eager, uint32_t integrated_release) {
+  debouncer->eager = eager;
+  debouncer->integrated_release = integrated_release & eager;
+  debouncer->locked &= eager;
+}
+
+// @brief Debounce the levels of the sample periods.
+uint32_t debounce_buttons(button_debouncer_t* debouncer, uint32_t levels, uint32_t num_of_samples) {
+  // The counters saturate at the thresholds, so a long gap between reads is the larger threshold in samples.
+  const uint32_t max_samples = NAGI_BUTTON_JITTER_THRESHOLD > NAGI_BUTTON_LOCKOUT ? NAGI_BUTTON_JITTER_THRESHOLD : NAGI_BUTTON_LOCKOUT;
+  if (num_of_samples > max_samples) {
+    num_of_samples = max_samples;
+  }
+  // The integrated inputs, and the eager ones on a release, the released level is high.
+  uint32_t integrated = ~debouncer->eager | (debouncer->integrated_release & levels);
+  uint32_t changes = 0;
+  for (uint32_t n = 0; n < num_of_samples; n++) {
+    debouncer->locked &= ~count_up(debouncer->lockout_planes, debouncer->locked, NAGI_BUTTON_LOCKOUT);
+    // Count up the inputs that differ, reset the others. The inputs that reach the threshold take the sampled level.
+    uint32_t differ = (levels ^ debouncer->state) & integrated & ~debouncer->locked;
+    uint32_t reached = count_up(debouncer->planes, differ, NAGI_BUTTON_JITTER_THRESHOLD);
+    debouncer->state ^= reached;
+    changes |= reached;
+  }
+  return changes;
+}
+
+// @brief Take the first edges of the unlocked eager inputs and lock them, on every read.
+uint32_t debounce_buttons_eager(button_debouncer_t* debouncer, uint32_t levels) {
+  uint32_t eager = debouncer->eager & ~(debouncer->integrated_release & levels);
+  uint32_t changes = (levels ^ debouncer->state) & eager & ~debouncer->locked;
+  debouncer->state ^= changes;
+  debouncer->locked |= changes;
+  for (int k = 0; k < NAGI_BUTTON_COUNTER_BITS; k++) {
+    debouncer->lockout_planes[k] &= ~changes;
+  }
+  return changes;
+}
+
+// @brief Set the debounce policy of a button.
+void set_button_debounce(int button_num, button_debounce_t debounce) {
+  g_button_debounces[button_num] = debounce;
+  uint32_t eager[BUTTON_MAX_INPUTS / 32] = {0};
+  uint32_t integrated_release[BUTTON_MAX_INPUTS / 32] = {0};
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    int input = _button_inputs[i];
+    uint32_t bit = 1u << (input % 32);
+    if (g_button_debounces[i] != BUTTON_DEBOUNCE_INTEGRATE) {
+      eager[input / 32] |= bit;
+    }
+    if (g_button_debounces[i] == BUTTON_DEBOUNCE_EAGER_PRESS) {
+      integrated_release[input / 32] |= bit;
+    }
+  }
+  for (uint32_t w = 0; w < _num_of_input_words; w++) {
+    set_debouncer_policy(&_debouncers[w], eager[w], integrated_release[w]);
+  }
+}
+
+// @brief Get the name of a debounce policy.
+const char* get_button_debounce_name(button_debounce_t debounce) {
+  return (unsigned)debounce < sizeof(DEBOUNCE_NAMES) / sizeof(DEBOUNCE_NAMES[0]) ? DEBOUNCE_NAMES[debounce] : "unknown";
+}
+
+// @brief Parse a debounce policy name.
+bool parse_button_debounce(const char* text, button_debounce_t* debounce) {
+  for (int i = 0; i < sizeof(DEBOUNCE_NAMES) / sizeof(DEBOUNCE_NAMES[0]); i++) {
+    if (strcmp(text, DEBOUNCE_NAMES[i]) == 0) {
+      *debounce = (button_debounce_t)i;
+      return true;
+    }
+  }
+  return false;
 }
 
 // @brief Read the button data.
 void read_button(void) {
-  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
-    g_button_data[i].last_state = g_button_data[i].current_state;
-    g_button_data[i].current_state = gpio_get_level(g_button_data[i].gpio_num);
-    g_button_data[i].current_tick = xTaskGetTickCount();
-    if (g_button_data[i].current_state != g_button_data[i].last_state) {
-      g_button_data[i].last_tick = g_button_data[i].current_tick;
-    }
-    uint32_t diff = g_button_data[i].current_tick - g_button_data[i].last_tick;
-    if (diff > pdMS_TO_TICKS(NAGI_BUTTON_JITTER_THRESHOLD)) {
-      if (g_button_data[i].current_state != g_button_data[i].stable_state) {
-        g_button_data[i].changed = 1;
-      } else {
-        g_button_data[i].changed = 0;
+  // One scan reads every button, one read of the input register with the GPIO scanner.
+  uint32_t levels[BUTTON_MAX_INPUTS / 32];
+  scan_buttons(&_scanner, levels);
+  int64_t now_us = hal_get_time_us();
+#if NAGI_TRACE
+  // The trace replays GPIO levels, the GPIO scanner only.
+  if (g_button_scanner == BUTTON_SCANNER_GPIO) {
+    for (uint32_t edges = levels[0] ^ _last_levels[0]; edges != 0; edges &= edges - 1) {
+      int gpio_num = __builtin_ctz(edges);
+      trace_gpio_level(gpio_num, (levels[0] >> gpio_num) & 1, now_us);
+    }
+  }
+#endif
+
+  // The counters count sample periods, the reads woken by the input interrupts in between do not count.
+  memset(g_button_changes, 0, sizeof(g_button_changes));
+  uint32_t num_of_samples = (uint32_t)((now_us - _last_sample_us) / NAGI_BUTTON_SAMPLE_US);
+  _last_sample_us += (int64_t)num_of_samples * NAGI_BUTTON_SAMPLE_US;
+  for (uint32_t w = 0; w < _num_of_input_words; w++) {
+    _last_levels[w] = levels[w];
+    uint32_t changes = num_of_samples > 0 ? debounce_buttons(&_debouncers[w], levels[w], num_of_samples) : 0;
+    // The eager buttons take their first edge on any read, the interrupt woken ones included.
+    changes |= debounce_buttons_eager(&_debouncers[w], levels[w]);
+    for (; changes != 0; changes &= changes - 1) {
+      int button_num = _input_buttons[w * 32 + __builtin_ctz(changes)];
+      if (button_num != NO_BUTTON) {
+        g_button_changes[button_num / 32] |= 1u << (button_num % 32);
       }
-      g_button_data[i].stable_state = g_button_data[i].current_state;
     }
   }
-}
\ No newline at end of file
+  for (int w = 0; w < BUTTON_NUM_OF_WORDS; w++) {
+    g_button_states[w] ^= g_button_changes[w];
+  }
+}
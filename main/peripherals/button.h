@@ -1,33 +1,103 @@
 #ifndef __BUTTON_H__
 #define __BUTTON_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include <soc/gpio_num.h>
 
+#include "button_scanner.h"
+
+// The words of the button masks.
+#define BUTTON_NUM_OF_WORDS ((NAGI_MAX_NUM_OF_BUTTONS + 31) / 32)
+
+_Static_assert(NAGI_MAX_NUM_OF_BUTTONS <= BUTTON_MAX_INPUTS, "Too many buttons for a scanner.");
+_Static_assert(NAGI_BUTTON_JITTER_THRESHOLD > 0 && NAGI_BUTTON_JITTER_THRESHOLD < (1 << NAGI_BUTTON_COUNTER_BITS), "The debounce counters are too narrow.");
+_Static_assert(NAGI_BUTTON_LOCKOUT > 0 && NAGI_BUTTON_LOCKOUT < (1 << NAGI_BUTTON_COUNTER_BITS), "The lockout counters are too narrow.");
+
+// @brief How a button is debounced. The buttons pull the GPIO low when pressed.
+typedef enum {
+  // Report a level once it differed for NAGI_BUTTON_JITTER_THRESHOLD samples in a row.
+  BUTTON_DEBOUNCE_INTEGRATE = 0,
+  // Report the first edge on the read that sees it, then ignore the button for NAGI_BUTTON_LOCKOUT samples.
+  BUTTON_DEBOUNCE_EAGER,
+  // Eager on a press, integrated on a release, so a glitch while held is not a release.
+  BUTTON_DEBOUNCE_EAGER_PRESS,
+} button_debounce_t;
+
 // @brief The button data.
 typedef struct {
-  // The GPIO number.
+  // The GPIO number with the GPIO scanner, below 32 so it is in the input register.
   gpio_num_t gpio_num;
-  // The current state.
-  uint8_t current_state;
-  // The last state.
-  uint8_t last_state;
-  // The current anti-jitter counter.
-  uint32_t current_tick;
-  // The last anti-jitter tick
-  uint32_t last_tick;
-  // The stable state.
-  uint8_t stable_state;
-  // The changed flag.
-  uint8_t changed;
 } button_t;
 
+// @brief The vertical counters debouncing 32 inputs at once. Bit n of plane k is bit k of the
+// counter of input n, the number of samples in a row that differed from the debounced level.
+typedef struct {
+  uint32_t planes[NAGI_BUTTON_COUNTER_BITS];
+  // The debounced levels.
+  uint32_t state;
+  // The inputs that report their first edge at once.
+  uint32_t eager;
+  // The eager inputs whose release is integrated.
+  uint32_t integrated_release;
+  // The eager inputs ignoring their levels after an edge.
+  uint32_t locked;
+  // The samples since the edge of the locked inputs, as the planes.
+  uint32_t lockout_planes[NAGI_BUTTON_COUNTER_BITS];
+} button_debouncer_t;
+
 // @brief The button data.
 extern button_t g_button_data[NAGI_MAX_NUM_OF_BUTTONS];
 
+// @brief The scanner of the buttons, set before initialize_button().
+extern button_scanner_type_t g_button_scanner;
+
+// @brief The debounced button levels, bit i % 32 of word i / 32 is button i.
+extern uint32_t g_button_states[BUTTON_NUM_OF_WORDS];
+
+// @brief The buttons whose debounced level changed in the last read, as g_button_states.
+extern uint32_t g_button_changes[BUTTON_NUM_OF_WORDS];
+
+// @brief The debounce policy of every button.
+extern button_debounce_t g_button_debounces[NAGI_MAX_NUM_OF_BUTTONS];
+
 // @brief Initialize the button module.
 void initialize_button(void);
 
 // @brief Read the button data.
 void read_button(void);
 
+// @brief Set the debounce policy of a button.
+// @param button_num The button number.
+// @param debounce The policy.
+void set_button_debounce(int button_num, button_debounce_t debounce);
+
+// @brief Get the name of a debounce policy.
+const char* get_button_debounce_name(button_debounce_t debounce);
+
+// @brief Parse a debounce policy name.
+// @return True if the name is valid.
+bool parse_button_debounce(const char* text, button_debounce_t* debounce);
+
+// @brief Set the inputs of a debouncer that are eager, and those of them whose release is integrated.
+// @param debouncer The debouncer.
+// @param eager The eager inputs.
+// @param integrated_release The eager inputs whose release is integrated.
+void set_debouncer_policy(button_debouncer_t* debouncer, uint32_t eager, uint32_t integrated_release);
+
+// @brief Debounce the levels of the sample periods. An integrated input changes once it differed for
+// NAGI_BUTTON_JITTER_THRESHOLD samples in a row, a locked eager input unlocks after NAGI_BUTTON_LOCKOUT samples.
+// @param debouncer The debouncer.
+// @param levels The sampled levels.
+// @param num_of_samples The number of sample periods the levels stand for.
+// @return The inputs whose debounced level changed.
+uint32_t debounce_buttons(button_debouncer_t* debouncer, uint32_t levels, uint32_t num_of_samples);
+
+// @brief Take the first edges of the unlocked eager inputs and lock them, on every read.
+// @param debouncer The debouncer.
+// @param levels The read levels.
+// @return The inputs whose debounced level changed.
+uint32_t debounce_buttons_eager(button_debouncer_t* debouncer, uint32_t levels);
+
 #endif // __BUTTON_H__
\ No newline at end of file
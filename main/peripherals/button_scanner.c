@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "button_scanner.h"
+
+#include "hal.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+
+// The names of the scanners, as button_scanner_type_t.
+static const char* const SCANNER_NAMES[] = {"gpio", "matrix", "shift"};
+
+// @brief Create a scanner of one GPIO per button.
+esp_err_t create_gpio_scanner(button_scanner_t* scanner, uint32_t pin_mask, bool is_interrupt_enabled) {
+  *scanner = (button_scanner_t){
+    .type = BUTTON_SCANNER_GPIO,
+    .num_of_inputs = 32,
+    .pin_mask = pin_mask,
+  };
+  return hal_gpio_config_input(pin_mask, is_interrupt_enabled);
+}
+
+// @brief Create a scanner of a diode matrix.
+esp_err_t create_matrix_scanner(
+  button_scanner_t* scanner, const uint8_t* row_gpio_nums, uint32_t num_of_rows,
+  const uint8_t* column_gpio_nums, uint32_t num_of_columns, uint32_t settle_us
+) {
+  if (
+    num_of_rows == 0 || num_of_rows > BUTTON_MAX_MATRIX_LINES ||
+    num_of_columns == 0 || num_of_columns > BUTTON_MAX_MATRIX_LINES ||
+    num_of_rows * num_of_columns > BUTTON_MAX_INPUTS
+  ) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *scanner = (button_scanner_t){
+    .type = BUTTON_SCANNER_MATRIX,
+    .num_of_inputs = num_of_rows * num_of_columns,
+    .num_of_rows = num_of_rows,
+    .num_of_columns = num_of_columns,
+    .settle_us = settle_us,
+  };
+  uint64_t row_mask = 0;
+  uint64_t column_mask = 0;
+  for (uint32_t i = 0; i < num_of_rows; i++) {
+    scanner->row_gpio_nums[i] = row_gpio_nums[i];
+    row_mask |= 1ULL << row_gpio_nums[i];
+  }
+  for (uint32_t i = 0; i < num_of_columns; i++) {
+    if (column_gpio_nums[i] >= 32) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    scanner->column_gpio_nums[i] = column_gpio_nums[i];
+    column_mask |= 1ULL << column_gpio_nums[i];
+  }
+  // The rows idle high, so the columns only see the row being scanned.
+  esp_err_t err = hal_gpio_config_output(row_mask, true);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return hal_gpio_config_input(column_mask, false);
+}
+
+// @brief Create a scanner of a 74HC165 chain.
+esp_err_t create_shift_scanner(
+  button_scanner_t* scanner, int load_gpio_num, int clock_gpio_num, int data_gpio_num,
+  uint32_t num_of_inputs, uint32_t clock_hz
+) {
+  uint32_t num_of_bits = (num_of_inputs + 7) / 8 * 8;
+  if (num_of_bits == 0 || num_of_bits > BUTTON_MAX_INPUTS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *scanner = (button_scanner_t){
+    .type = BUTTON_SCANNER_SHIFT,
+    .num_of_inputs = num_of_bits,
+  };
+  return hal_shift_in_create(load_gpio_num, clock_gpio_num, data_gpio_num, num_of_bits, clock_hz, &scanner->shift_in);
+}
+
+// @brief Read every input.
+void scan_buttons(const button_scanner_t* scanner, uint32_t* levels) {
+  switch (scanner->type) {
+    case BUTTON_SCANNER_MATRIX: {
+      // Every row costs one settle and one read of the input register, whatever the buttons do.
+      uint32_t num_of_words = (scanner->num_of_inputs + 31) / 32;
+      memset(levels, 0xFF, num_of_words * sizeof(uint32_t));
+      uint32_t input = 0;
+      for (uint32_t r = 0; r < scanner->num_of_rows; r++) {
+        hal_gpio_set_level(scanner->row_gpio_nums[r], 0);
+        hal_delay_us(scanner->settle_us);
+        uint32_t columns = hal_gpio_get_levels();
+        hal_gpio_set_level(scanner->row_gpio_nums[r], 1);
+        for (uint32_t c = 0; c < scanner->num_of_columns; c++, input++) {
+          if (((columns >> scanner->column_gpio_nums[c]) & 1) == 0) {
+            levels[input / 32] &= ~(1u << (input % 32));
+          }
+        }
+      }
+      break;
+    }
+    case BUTTON_SCANNER_SHIFT: {
+      // The first bit out is bit 0, so the chain lands as the input mask. A failed read keeps every button released.
+      uint32_t num_of_words = (scanner->num_of_inputs + 31) / 32;
+      memset(levels, 0xFF, num_of_words * sizeof(uint32_t));
+      hal_shift_in_read(scanner->shift_in, levels);
+      break;
+    }
+    default:
+      levels[0] = hal_gpio_get_levels() & scanner->pin_mask;
+      break;
+  }
+}
+
+// @brief Get the name of a scanner type.
+const char* get_button_scanner_name(button_scanner_type_t type) {
+  return (unsigned)type < sizeof(SCANNER_NAMES) / sizeof(SCANNER_NAMES[0]) ? SCANNER_NAMES[type] : "unknown";
+}
+
+// @brief Parse a scanner type name.
+bool parse_button_scanner(const char* text, button_scanner_type_t* type) {
+  for (int i = 0; i < sizeof(SCANNER_NAMES) / sizeof(SCANNER_NAMES[0]); i++) {
+    if (strcmp(text, SCANNER_NAMES[i]) == 0) {
+      *type = (button_scanner_type_t)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,87 @@
+#ifndef __BUTTON_SCANNER_H__
+#define __BUTTON_SCANNER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+// The most inputs of a scanner, the buttons of the joystick report.
+#define BUTTON_MAX_INPUTS 128
+// The most rows or columns of a matrix.
+#define BUTTON_MAX_MATRIX_LINES 16
+
+// @brief How the buttons are wired.
+typedef enum {
+  // One GPIO per button, read at once from the input register.
+  BUTTON_SCANNER_GPIO = 0,
+  // A diode matrix, the rows are driven low one at a time and the columns read back.
+  BUTTON_SCANNER_MATRIX,
+  // A chain of 74HC165 shift registers, clocked in over SPI with DMA.
+  BUTTON_SCANNER_SHIFT,
+} button_scanner_type_t;
+
+// @brief A button scanner, it reads the raw level of every input, low when pressed.
+typedef struct {
+  button_scanner_type_t type;
+  // The number of inputs, the bits of the levels.
+  uint32_t num_of_inputs;
+  // GPIO: the input register bits of the buttons, the input is the GPIO number.
+  uint32_t pin_mask;
+  // Matrix: the row outputs and the column inputs, the input is row * num_of_columns + column.
+  uint8_t row_gpio_nums[BUTTON_MAX_MATRIX_LINES];
+  uint8_t column_gpio_nums[BUTTON_MAX_MATRIX_LINES];
+  uint8_t num_of_rows;
+  uint8_t num_of_columns;
+  // Matrix: the wait for the columns after a row is driven.
+  uint32_t settle_us;
+  // Shift: the chain, the input is the order the bits are shifted out.
+  hal_shift_in_handle_t shift_in;
+} button_scanner_t;
+
+// @brief Create a scanner of one GPIO per button.
+// @param scanner The scanner to fill.
+// @param pin_mask The GPIOs, all below 32.
+// @param is_interrupt_enabled True to interrupt on any edge.
+// @return The result.
+esp_err_t create_gpio_scanner(button_scanner_t* scanner, uint32_t pin_mask, bool is_interrupt_enabled);
+
+// @brief Create a scanner of a diode matrix, the diodes let a pressed button pull its column down to a low row.
+// @param scanner The scanner to fill.
+// @param row_gpio_nums The row GPIOs, driven open drain.
+// @param num_of_rows The number of rows.
+// @param column_gpio_nums The column GPIOs, pulled up and below 32.
+// @param num_of_columns The number of columns.
+// @param settle_us The wait for the columns after a row is driven.
+// @return The result.
+esp_err_t create_matrix_scanner(
+  button_scanner_t* scanner, const uint8_t* row_gpio_nums, uint32_t num_of_rows,
+  const uint8_t* column_gpio_nums, uint32_t num_of_columns, uint32_t settle_us
+);
+
+// @brief Create a scanner of a 74HC165 chain.
+// @param scanner The scanner to fill.
+// @param load_gpio_num The parallel load GPIO.
+// @param clock_gpio_num The clock GPIO.
+// @param data_gpio_num The serial data GPIO.
+// @param num_of_inputs The number of inputs, rounded up to whole registers.
+// @param clock_hz The clock rate.
+// @return The result.
+esp_err_t create_shift_scanner(
+  button_scanner_t* scanner, int load_gpio_num, int clock_gpio_num, int data_gpio_num,
+  uint32_t num_of_inputs, uint32_t clock_hz
+);
+
+// @brief Read every input.
+// @param scanner The scanner.
+// @param levels The levels to fill, bit n of word n / 32 is input n.
+void scan_buttons(const button_scanner_t* scanner, uint32_t* levels);
+
+// @brief Get the name of a scanner type.
+const char* get_button_scanner_name(button_scanner_type_t type);
+
+// @brief Parse a scanner type name.
+// @return True if the name is valid.
+bool parse_button_scanner(const char* text, button_scanner_type_t* type);
+
+#endif // __BUTTON_SCANNER_H__
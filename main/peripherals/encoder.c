@@ -1,80 +1,324 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "soc/gpio_num.h"
 
 #include "config.h"
 #include "encoder.h"
+#include "tasks.h"
+#if NAGI_TRACE
+#include "trace.h"
+#endif
 
-#include "driver/gpio.h"
+#include "hal.h"
+#include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 
+static const char* TAG = "encoder";
+
 encoder_t g_encoder_data[NAGI_MAX_NUM_OF_ENCODERS];
+encoder_backend_t g_encoder_backends[NAGI_MAX_NUM_OF_ENCODERS] = NAGI_ENCODER_BACKENDS;
+encoder_settings_t g_encoder_settings[NAGI_MAX_NUM_OF_ENCODERS];
+
+// The names of the encoder modes.
+static const char* MODE_NAMES[] = {"buttons", "axis", "pulses"};
+
+// The counter step of every transition, indexed by last << 2 | current with the levels left << 1 | right.
+// 00 -> 01 -> 11 -> 10 -> 00 counts up, the reverse counts down, no change or a skipped state counts nothing.
+static const DRAM_ATTR int8_t DECODE[16] = {
+  0, 1, -1, 0,
+  -1, 0, 0, 1,
+  1, 0, 0, -1,
+  0, -1, 1, 0,
+};
 
 // @brief The ISR handler for the encoder.
-static void IRAM_ATTR encoder_isr_handler(void* arg) {
-  int encoder_num = (int)arg;
+void IRAM_ATTR encoder_isr_handler(void* arg) {
+  int encoder_num = (int)(intptr_t)arg;
   encoder_t* encoder = &g_encoder_data[encoder_num];
 
   // Read the GPIO state.
-  int left_state = gpio_get_level(encoder->left_gpio_num);
-  int right_state = gpio_get_level(encoder->right_gpio_num);
-
-  // Update the counter.
-  int current = (left_state << 1) | right_state;
-  int last = (encoder->left_last_state << 1) | encoder->right_last_state;
-  int transition = (last << 2) | current;
-  switch (transition) {
-    case 0b0001: // 00 -> 01
-    case 0b0111: // 01 -> 11
-    case 0b1110: // 11 -> 10
-    case 0b1000: // 10 -> 00
-      encoder->counter++;
-      break;
-    case 0b0010: // 00 -> 10
-    case 0b1011: // 10 -> 11
-    case 0b1101: // 11 -> 01
-    case 0b0100: // 01 -> 00
-      encoder->counter--;
-      break;
-    default:
-      break;
-  }
-
-  // Update the last state.
-  encoder->left_last_state = left_state;
-  encoder->right_last_state = right_state;
+  int current = (hal_gpio_get_level(encoder->left_gpio_num) << 1) | hal_gpio_get_level(encoder->right_gpio_num);
+#if NAGI_TRACE
+  trace_encoder_levels(encoder_num, current, hal_get_time_us());
+#endif
+
+  // Update the counter, the ISR is its only writer.
+  int step = DECODE[(encoder->last_state << 2) | current];
+  encoder->last_state = current;
+  if (step != 0) {
+    __atomic_store_n(&encoder->counter, encoder->counter + step, __ATOMIC_RELAXED);
+  }
+
+#if NAGI_SYNC_EVENT_DRIVEN
+  // Wake the sampler to report the step right away.
+  notify_input_from_isr();
+#endif
+}
+
+// @brief Get the counter of an encoder, from any task.
+int32_t get_encoder_counter(int encoder_num) {
+  return __atomic_load_n(&g_encoder_data[encoder_num].counter, __ATOMIC_RELAXED);
+}
+
+// @brief Set up the pulse counter of an encoder.
+// Every edge of either pin counts, gated by the level of the other pin, so the count
+// follows the same 00 -> 01 -> 11 -> 10 sequence as the ISR.
+static esp_err_t create_encoder_pcnt(encoder_t* encoder) {
+  const hal_pcnt_channel_config_t channels[2] = {
+    {
+      .edge_gpio_num = encoder->left_gpio_num,
+      .level_gpio_num = encoder->right_gpio_num,
+      .pos_edge_action = HAL_PCNT_EDGE_INCREASE,
+      .neg_edge_action = HAL_PCNT_EDGE_DECREASE,
+      .high_level_action = HAL_PCNT_LEVEL_KEEP,
+      .low_level_action = HAL_PCNT_LEVEL_INVERSE,
+    },
+    {
+      .edge_gpio_num = encoder->right_gpio_num,
+      .level_gpio_num = encoder->left_gpio_num,
+      .pos_edge_action = HAL_PCNT_EDGE_DECREASE,
+      .neg_edge_action = HAL_PCNT_EDGE_INCREASE,
+      .high_level_action = HAL_PCNT_LEVEL_KEEP,
+      .low_level_action = HAL_PCNT_LEVEL_INVERSE,
+    },
+  };
+  return hal_pcnt_create(channels, 2, NAGI_ENCODER_GLITCH_FILTER_NS, &encoder->pcnt);
 }
 
 // @brief Initialize the encoder module.
 void initialize_encoder(void) {
-  g_encoder_data[0] = (encoder_t){7, 6, 0, 0, 0};
-  g_encoder_data[1] = (encoder_t){20, 19, 0, 0, 0};
-
-  // Setup the GPIO.
-  gpio_config_t io_conf = {
-    .intr_type = GPIO_INTR_ANYEDGE, // Interrupt.
-    .mode = GPIO_MODE_INPUT,        // Set as input mode.
-    .pin_bit_mask = 0,
-    .pull_down_en = 0,              // Disable the internal pull-down resistor.
-    .pull_up_en = 1,                // Use the internal pull-up resistor.
-  };
+  g_encoder_data[0] = (encoder_t){7, 6, 0, 0};
+  g_encoder_data[1] = (encoder_t){20, 19, 0, 0};
+
+  // Setup the GPIO, with any edge interrupts for the ISR backend.
+  uint64_t isr_pin_bit_mask = 0;
+  uint64_t pcnt_pin_bit_mask = 0;
   for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
-    io_conf.pin_bit_mask |= (1ULL << g_encoder_data[i].left_gpio_num) | (1ULL << g_encoder_data[i].right_gpio_num);
+    uint64_t mask = (1ULL << g_encoder_data[i].left_gpio_num) | (1ULL << g_encoder_data[i].right_gpio_num);
+    if (g_encoder_backends[i] == ENCODER_BACKEND_PCNT) {
+      pcnt_pin_bit_mask |= mask;
+    } else {
+      isr_pin_bit_mask |= mask;
+    }
+  }
+  if (isr_pin_bit_mask != 0) {
+    hal_gpio_config_input(isr_pin_bit_mask, true);
+  }
+  if (pcnt_pin_bit_mask != 0) {
+    hal_gpio_config_input(pcnt_pin_bit_mask, false);
   }
-  gpio_config(&io_conf);
-
-  // Install the ISR service.
-  gpio_install_isr_service(0);
 
-  // Hook the ISR handler.
   for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
-    gpio_isr_handler_add(g_encoder_data[i].left_gpio_num, encoder_isr_handler, (void*)i);
-    gpio_isr_handler_add(g_encoder_data[i].right_gpio_num, encoder_isr_handler, (void*)i);
+    encoder_t* encoder = &g_encoder_data[i];
+    encoder->backend = g_encoder_backends[i];
+    // Start from the pulled up levels, so the first step counts the right way.
+    encoder->last_state = (hal_gpio_get_level(encoder->left_gpio_num) << 1) | hal_gpio_get_level(encoder->right_gpio_num);
+    if (encoder->backend == ENCODER_BACKEND_PCNT) {
+      // Fall back to the ISR if the pulse counter units run out.
+      esp_err_t err = create_encoder_pcnt(encoder);
+      if (err == ESP_OK) {
+        continue;
+      }
+      ESP_LOGW(TAG, "Encoder[%d] has no pulse counter (%s), using the ISR.", i, esp_err_to_name(err));
+      encoder->backend = ENCODER_BACKEND_ISR;
+      hal_gpio_config_input((1ULL << encoder->left_gpio_num) | (1ULL << encoder->right_gpio_num), true);
+    }
+
+    // Hook the ISR handler.
+    hal_gpio_add_isr(encoder->left_gpio_num, encoder_isr_handler, (void*)(intptr_t)i);
+    hal_gpio_add_isr(encoder->right_gpio_num, encoder_isr_handler, (void*)(intptr_t)i);
   }
 }
 
+// The time of the last pulse counter read.
+static int64_t _last_read_us;
+
+// @brief Follow the pulse counter of an encoder through the Gray code, so its last state
+// stays the pin levels and a trace gets the same transitions the ISR would record,
+// spread over the time since the last read.
+static void step_encoder_state(int encoder_num, encoder_t* encoder, int32_t count, int64_t now_us) {
+  // The levels of the phases 00, 01, 11, 10, the mapping is its own inverse.
+  static const uint8_t GRAY[4] = {0b00, 0b01, 0b11, 0b10};
+  int32_t delta = (int32_t)((uint32_t)count - (uint32_t)encoder->counter);
+#if NAGI_TRACE
+  trace_encoder_steps(encoder_num, encoder->last_state, delta, _last_read_us, now_us);
+#endif
+  encoder->last_state = GRAY[(GRAY[encoder->last_state] + delta) & 3];
+}
+
 // @brief Read the encoder data.
 void read_encoder(void) {
-  // Do nothing.
-}
\ No newline at end of file
+  // The ISR updates its counters, the pulse counters are read here.
+  int64_t now_us = hal_get_time_us();
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    encoder_t* encoder = &g_encoder_data[i];
+    int count;
+    if (encoder->backend != ENCODER_BACKEND_PCNT || hal_pcnt_get_count(encoder->pcnt, &count) != ESP_OK) {
+      continue;
+    }
+    if (count != encoder->counter) {
+      step_encoder_state(i, encoder, count, now_us);
+      __atomic_store_n(&encoder->counter, count, __ATOMIC_RELAXED);
+    }
+  }
+  _last_read_us = now_us;
+}
+
+// @brief Get the gain of a curve at a speed, in 1/16 steps per detent.
+static int32_t get_encoder_gain(const encoder_accel_t* accel, int32_t speed) {
+  uint32_t n = accel->num_of_points;
+  if (n == 0) {
+    return 16;
+  }
+  if (speed <= accel->speeds[0]) {
+    return accel->gains[0];
+  }
+  for (uint32_t i = 1; i < n; i++) {
+    if (speed < accel->speeds[i]) {
+      int32_t s0 = accel->speeds[i - 1];
+      int32_t g0 = accel->gains[i - 1];
+      return g0 + (accel->gains[i] - g0) * (speed - s0) / (accel->speeds[i] - s0);
+    }
+  }
+  return accel->gains[n - 1];
+}
+
+// @brief Reset the report state of an encoder, when its mode changes.
+static void reset_encoder_report(encoder_t* encoder, encoder_mode_t mode) {
+  encoder->mode = mode;
+  encoder->reported_counter = get_encoder_counter(encoder - g_encoder_data);
+  encoder->fraction = 0;
+  encoder->position = 0;
+  encoder->pulse_head = encoder->pulse_tail = 0;
+  encoder->pulse = 0;
+  encoder->pulse_end_us = 0;
+}
+
+// @brief Turn the new detents of an encoder into its position or pulses, on the sampler task.
+void update_encoder_report(int encoder_num, int64_t now_us) {
+  encoder_t* encoder = &g_encoder_data[encoder_num];
+  const encoder_settings_t* settings = &g_encoder_settings[encoder_num];
+  if (settings->mode != encoder->mode) {
+    reset_encoder_report(encoder, settings->mode);
+  }
+  if (encoder->mode == ENCODER_MODE_BUTTONS) {
+    return;
+  }
+
+  // Whole detents only, a half turned detent stays pending.
+  int32_t delta = (int32_t)((uint32_t)get_encoder_counter(encoder_num) - (uint32_t)encoder->reported_counter);
+  int32_t detents = delta / NAGI_ENCODER_COUNTS_PER_DETENT;
+  if (detents != 0) {
+    encoder->reported_counter += detents * NAGI_ENCODER_COUNTS_PER_DETENT;
+
+    // The speed over the time since the previous detent, a slow turn after a pause gets the lowest gain.
+    int32_t magnitude = detents < 0 ? -detents : detents;
+    int64_t elapsed_us = now_us - encoder->last_detent_us;
+    int32_t speed = elapsed_us > 0 && elapsed_us < 1000000 ? (int32_t)(magnitude * 1000000LL / elapsed_us) : 0;
+    encoder->last_detent_us = now_us;
+
+    // A reversal drops the fraction left by the other direction.
+    if ((detents > 0) != (encoder->fraction > 0) && encoder->fraction != 0) {
+      encoder->fraction = 0;
+    }
+    encoder->fraction += detents * get_encoder_gain(&settings->accel, speed);
+    int32_t steps = encoder->fraction / 16;
+    encoder->fraction -= steps * 16;
+
+    if (encoder->mode == ENCODER_MODE_AXIS) {
+      encoder->position += (uint16_t)steps;
+    } else {
+      int8_t direction = steps > 0 ? 1 : -1;
+      for (int32_t i = steps * direction; i > 0; i--) {
+        if (encoder->pulse_tail - encoder->pulse_head >= NAGI_ENCODER_PULSE_QUEUE_SIZE) {
+          encoder->dropped_pulses += i;
+          break;
+        }
+        encoder->pulses[encoder->pulse_tail++ % NAGI_ENCODER_PULSE_QUEUE_SIZE] = direction;
+      }
+    }
+  }
+
+  // Press and release every queued pulse, each for a pulse period.
+  if (encoder->mode == ENCODER_MODE_PULSES && now_us >= encoder->pulse_end_us) {
+    if (encoder->pulse != 0) {
+      encoder->pulse = 0;
+      encoder->pulse_end_us = now_us + NAGI_ENCODER_PULSE_US;
+    } else if (encoder->pulse_head != encoder->pulse_tail) {
+      encoder->pulse = encoder->pulses[encoder->pulse_head++ % NAGI_ENCODER_PULSE_QUEUE_SIZE];
+      encoder->pulse_end_us = now_us + NAGI_ENCODER_PULSE_US;
+    }
+  }
+}
+
+// @brief Get the name of an encoder mode.
+const char* get_encoder_mode_name(encoder_mode_t mode) {
+  return (unsigned)mode < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]) ? MODE_NAMES[mode] : "unknown";
+}
+
+// @brief Parse an encoder mode name.
+bool parse_encoder_mode(const char* text, encoder_mode_t* mode) {
+  for (int i = 0; i < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]); i++) {
+    if (strcmp(text, MODE_NAMES[i]) == 0) {
+      *mode = (encoder_mode_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// @brief Parse an acceleration curve, "<speed>:<gain>,..." with the speed in detents per second,
+// for example "0:1,20:2,60:6". "none" or an empty text is no acceleration.
+esp_err_t parse_encoder_accel(const char* text, encoder_accel_t* accel) {
+  encoder_accel_t result = {0};
+  if (strcmp(text, "none") != 0) {
+    const char* p = text;
+    while (*p != '\0') {
+      if (result.num_of_points >= NAGI_ENCODER_ACCEL_MAX_POINTS) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      char* end;
+      long speed = strtol(p, &end, 10);
+      if (end == p || *end != ':' || speed < 0 || speed > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      p = end + 1;
+      float gain = strtof(p, &end);
+      if (end == p || gain < 0 || gain * 16 > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (result.num_of_points > 0 && speed <= result.speeds[result.num_of_points - 1]) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      result.speeds[result.num_of_points] = speed;
+      result.gains[result.num_of_points] = (uint16_t)(gain * 16 + 0.5f);
+      result.num_of_points++;
+      p = *end == ',' ? end + 1 : end;
+      if (*end != ',' && *end != '\0') {
+        return ESP_ERR_INVALID_ARG;
+      }
+    }
+  }
+  *accel = result;
+  return ESP_OK;
+}
+
+// @brief Format an acceleration curve as parse_encoder_accel() reads it.
+void format_encoder_accel(const encoder_accel_t* accel, char* text, size_t size) {
+  if (accel->num_of_points == 0) {
+    snprintf(text, size, "none");
+    return;
+  }
+  size_t length = 0;
+  text[0] = '\0';
+  for (uint32_t i = 0; i < accel->num_of_points && length < size; i++) {
+    length += snprintf(
+      text + length, size - length, "%s%u:%g", i > 0 ? "," : "",
+      accel->speeds[i], accel->gains[i] / 16.0
+    );
+  }
+}
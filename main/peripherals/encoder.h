@@ -1,27 +1,120 @@
 #ifndef __ENCODER_H__
 #define __ENCODER_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "soc/gpio_num.h"
+
+#include "hal.h"
+
+// @brief The way an encoder is decoded.
+typedef enum {
+  // A GPIO interrupt on every edge of both pins.
+  ENCODER_BACKEND_ISR = 0,
+  // The pulse counter quadrature decoder, no interrupt.
+  ENCODER_BACKEND_PCNT,
+} encoder_backend_t;
+
+// @brief The way an encoder is reported to the host.
+typedef enum {
+  // An inc or dec button held for an update window when the counter changed in it.
+  ENCODER_MODE_BUTTONS = 0,
+  // A wrapping 16-bit position on the axis after the ADC axes, the host takes the
+  // signed difference of two reports as the detent delta, so a lost report loses nothing.
+  ENCODER_MODE_AXIS,
+  // Every detent queued, and replayed as one inc or dec button press.
+  ENCODER_MODE_PULSES,
+} encoder_mode_t;
+
+// @brief An acceleration curve, the gain at a speed is interpolated between the points.
+typedef struct {
+  // The number of points, 0 for no acceleration.
+  uint32_t num_of_points;
+  // The speeds in detents per second, increasing.
+  uint16_t speeds[NAGI_ENCODER_ACCEL_MAX_POINTS];
+  // The gains in 1/16 steps per detent.
+  uint16_t gains[NAGI_ENCODER_ACCEL_MAX_POINTS];
+} encoder_accel_t;
+
+// @brief The encoder report settings, written by the console.
+typedef struct {
+  encoder_mode_t mode;
+  encoder_accel_t accel;
+} encoder_settings_t;
+
 // @brief The encoder data.
 typedef struct {
   // The left GPIO number.
   gpio_num_t left_gpio_num;
   // The right GPIO number.
   gpio_num_t right_gpio_num;
-  // The left last state.
-  uint8_t left_last_state;
-  // The right last state.
-  uint8_t right_last_state;
-  // The counter.
-  int64_t counter;
+  // The last levels, left << 1 | right.
+  uint8_t last_state;
+  // The counter, written by the ISR or the PCNT read only. A 32-bit access is single-copy
+  // atomic on the RISC-V core, so read it with get_encoder_counter() and it never tears.
+  int32_t counter;
+  // The backend.
+  encoder_backend_t backend;
+  // The pulse counter of the PCNT backend.
+  hal_pcnt_handle_t pcnt;
+  // The mode the report state below belongs to.
+  encoder_mode_t mode;
+  // The counter already turned into steps.
+  int32_t reported_counter;
+  // The accelerated steps not reported yet, in 1/16 steps.
+  int32_t fraction;
+  // The time of the last detent.
+  int64_t last_detent_us;
+  // The position of the axis mode.
+  uint16_t position;
+  // The queued directions of the pulse mode.
+  int8_t pulses[NAGI_ENCODER_PULSE_QUEUE_SIZE];
+  uint32_t pulse_head;
+  uint32_t pulse_tail;
+  // The pulses dropped because the queue was full.
+  uint32_t dropped_pulses;
+  // The direction of the pulse being pressed, 0 while released.
+  int8_t pulse;
+  // The end of the current press or release.
+  int64_t pulse_end_us;
 } encoder_t;
 
 // @brief The encoder data.
 extern encoder_t g_encoder_data[NAGI_MAX_NUM_OF_ENCODERS];
 
+// @brief The backend of every encoder, may be changed before initialize_encoder().
+extern encoder_backend_t g_encoder_backends[NAGI_MAX_NUM_OF_ENCODERS];
+
+// @brief The report settings of every encoder.
+extern encoder_settings_t g_encoder_settings[NAGI_MAX_NUM_OF_ENCODERS];
+
 // @brief Initialize the encoder module.
 void initialize_encoder(void);
 
 // @brief Read the encoder data.
 void read_encoder(void);
 
+// @brief The ISR handler of the ISR backend, public for the host benchmark.
+void encoder_isr_handler(void* arg);
+
+// @brief Get the counter of an encoder, from any task.
+int32_t get_encoder_counter(int encoder_num);
+
+// @brief Turn the new detents of an encoder into its position or pulses, on the sampler task.
+void update_encoder_report(int encoder_num, int64_t now_us);
+
+// @brief Get the name of an encoder mode.
+const char* get_encoder_mode_name(encoder_mode_t mode);
+
+// @brief Parse an encoder mode name.
+bool parse_encoder_mode(const char* text, encoder_mode_t* mode);
+
+// @brief Parse an acceleration curve, "<speed>:<gain>,..." with the speed in detents per second,
+// for example "0:1,20:2,60:6". "none" or an empty text is no acceleration.
+esp_err_t parse_encoder_accel(const char* text, encoder_accel_t* accel);
+
+// @brief Format an acceleration curve as parse_encoder_accel() reads it.
+void format_encoder_accel(const encoder_accel_t* accel, char* text, size_t size);
+
 #endif // __ENCODER_H__
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "joy_data.h"
+#include "snapshot.h"
+
+// The shared snapshot, guarded by a sequence lock.
+static joystick_info_t _snapshot;
+static int64_t _snapshot_time_us;
+// Odd while the writer is copying, even when the snapshot is stable.
+static uint32_t _snapshot_sequence;
+
+/// @brief Publish a new joystick snapshot.
+/// @param info The joystick information.
+/// @param sample_time_us The time the information was sampled, in microseconds.
+void publish_joystick_snapshot(const joystick_info_t* info, int64_t sample_time_us) {
+  uint32_t sequence = __atomic_load_n(&_snapshot_sequence, __ATOMIC_RELAXED);
+
+  // Mark the snapshot as being written before touching the data.
+  __atomic_store_n(&_snapshot_sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(&_snapshot, info, sizeof(joystick_info_t));
+  _snapshot_time_us = sample_time_us;
+
+  // Publish the data before marking the snapshot as stable.
+  __atomic_store_n(&_snapshot_sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/// @brief Read a consistent copy of the latest joystick snapshot.
+/// @param info The joystick information to fill.
+/// @param sample_time_us The time the information was sampled, in microseconds.
+/// @return The version of the snapshot, it changes on every publish.
+uint32_t read_joystick_snapshot(joystick_info_t* info, int64_t* sample_time_us) {
+  uint32_t begin;
+  uint32_t end;
+  do {
+    begin = __atomic_load_n(&_snapshot_sequence, __ATOMIC_ACQUIRE);
+    memcpy(info, &_snapshot, sizeof(joystick_info_t));
+    *sample_time_us = _snapshot_time_us;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    end = __atomic_load_n(&_snapshot_sequence, __ATOMIC_RELAXED);
+    // Retry if the writer was active during the copy.
+  } while ((begin & 1) || begin != end);
+
+  return begin;
+}
@@ -0,0 +1,20 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+
+typedef struct joystick_info joystick_info_t;
+
+/// @brief Publish a new joystick snapshot.
+/// Only one task may publish, and it must not be preempted by a reader spinning on the same core.
+/// @param info The joystick information.
+/// @param sample_time_us The time the information was sampled, in microseconds.
+void publish_joystick_snapshot(const joystick_info_t* info, int64_t sample_time_us);
+
+/// @brief Read a consistent copy of the latest joystick snapshot.
+/// @param info The joystick information to fill.
+/// @param sample_time_us The time the information was sampled, in microseconds.
+/// @return The version of the snapshot, it changes on every publish.
+uint32_t read_joystick_snapshot(joystick_info_t* info, int64_t* sample_time_us);
+
+#endif // __SNAPSHOT_H__
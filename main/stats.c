@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "hal.h"
+#include "stats.h"
+
+// Every power of two is split into 4 linear sub-buckets, so the error is below 25%.
+#define STATS_SUB_BUCKET_BITS 2
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+#define STATS_NUM_OF_BUCKETS ((32 - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+/// @brief A fixed-memory log-bucket histogram of cycle counts.
+typedef struct {
+  uint32_t buckets[STATS_NUM_OF_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+} stats_histogram_t;
+
+static const char* TAG = "stats";
+
+static const char* STAGE_NAMES[STATS_NUM_OF_STAGES] = {
+  "read_axis",
+  "axis_age",
+  "reduce_frame",
+  "read_button",
+  "read_encoder",
+  "update_state",
+  "queue",
+  "build_message",
+  "sendto",
+  "ack",
+};
+
+static stats_histogram_t _histograms[STATS_NUM_OF_STAGES];
+static uint32_t _packets_sent;
+static uint32_t _packets_acked;
+static uint32_t _packets_lost;
+
+/// @brief Get the bucket of a value, in IRAM as record_stage() runs in ISRs.
+/// @param value The value.
+/// @return The bucket index.
+static inline uint32_t IRAM_ATTR get_bucket(uint32_t value) {
+  if (value < STATS_SUB_BUCKETS) {
+    return value;
+  }
+  uint32_t msb = 31 - __builtin_clz(value);
+  uint32_t sub = (value >> (msb - STATS_SUB_BUCKET_BITS)) & (STATS_SUB_BUCKETS - 1);
+  return (msb - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+/// @brief Get the largest value of a bucket.
+/// @param bucket The bucket index.
+/// @return The largest value.
+static uint32_t get_bucket_limit(uint32_t bucket) {
+  if (bucket < STATS_SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t shift = bucket / STATS_SUB_BUCKETS - 1;
+  uint64_t base = STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS;
+  return (uint32_t)(((base + 1) << shift) - 1);
+}
+
+/// @brief Get a percentile of a histogram.
+/// @param histogram The histogram.
+/// @param percent The percentile, 0 to 100.
+/// @return The upper limit of the bucket holding the percentile, in cycles.
+static uint32_t get_percentile(const stats_histogram_t* histogram, uint32_t percent) {
+  uint32_t rank = (uint32_t)(((uint64_t)histogram->count * percent + 99) / 100);
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < STATS_NUM_OF_BUCKETS; ++i) {
+    total += histogram->buckets[i];
+    if (total >= rank) {
+      uint32_t limit = get_bucket_limit(i);
+      return limit < histogram->max ? limit : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+/// @brief Get the current cycle count, the start of a stage.
+/// @return The cycle count.
+uint32_t IRAM_ATTR begin_stage(void) {
+  return hal_get_cycle_count();
+}
+
+/// @brief Record the duration of a stage.
+/// @param stage The stage.
+/// @param begin The cycle count returned by begin_stage().
+void IRAM_ATTR end_stage(stats_stage_t stage, uint32_t begin) {
+  record_stage(stage, hal_get_cycle_count() - begin);
+}
+
+/// @brief Record the duration of a stage in cycles.
+/// @param stage The stage.
+/// @param cycles The duration in CPU cycles.
+void IRAM_ATTR record_stage(stats_stage_t stage, uint32_t cycles) {
+  stats_histogram_t* histogram = &_histograms[stage];
+  histogram->buckets[get_bucket(cycles)]++;
+  histogram->count++;
+  if (cycles > histogram->max) {
+    histogram->max = cycles;
+  }
+}
+
+/// @brief Count the sent packets.
+/// @param count The number of packets.
+void count_packets_sent(uint32_t count) {
+  _packets_sent += count;
+}
+
+/// @brief Count the acknowledged packets.
+/// @param count The number of packets.
+void count_packets_acked(uint32_t count) {
+  _packets_acked += count;
+}
+
+/// @brief Count the lost packets.
+/// @param count The number of packets.
+void count_packets_lost(uint32_t count) {
+  _packets_lost += count;
+}
+
+/// @brief Print the statistics.
+void print_stats(void) {
+  const uint32_t cycles_per_us = hal_get_cycles_per_us();
+  for (int i = 0; i < STATS_NUM_OF_STAGES; ++i) {
+    const stats_histogram_t* histogram = &_histograms[i];
+    if (histogram->count == 0) {
+      ESP_LOGI(TAG, "%s: no data.", STAGE_NAMES[i]);
+      continue;
+    }
+    // Print in nanoseconds, most stages are well below a microsecond.
+    ESP_LOGI(
+      TAG,
+      "%s: n %lu, p50 %lluns, p99 %lluns, max %lluns",
+      STAGE_NAMES[i],
+      histogram->count,
+      (uint64_t)get_percentile(histogram, 50) * 1000 / cycles_per_us,
+      (uint64_t)get_percentile(histogram, 99) * 1000 / cycles_per_us,
+      (uint64_t)histogram->max * 1000 / cycles_per_us
+    );
+  }
+  ESP_LOGI(TAG, "packets: sent %lu, acked %lu, lost %lu", _packets_sent, _packets_acked, _packets_lost);
+}
+
+/// @brief Reset the statistics.
+void reset_stats(void) {
+  memset(_histograms, 0, sizeof(_histograms));
+  _packets_sent = 0;
+  _packets_acked = 0;
+  _packets_lost = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+
+/// @brief The instrumented stages of the input path.
+typedef enum {
+  STATS_STAGE_READ_AXIS = 0,
+  // The age of the axis data when the sampler read it, from the end of its ADC frame.
+  STATS_STAGE_AXIS_AGE,
+  // The decimation of an ADC frame in the conversion-done ISR.
+  STATS_STAGE_REDUCE_FRAME,
+  STATS_STAGE_READ_BUTTON,
+  STATS_STAGE_READ_ENCODER,
+  STATS_STAGE_UPDATE_STATE,
+  STATS_STAGE_QUEUE,
+  STATS_STAGE_BUILD_MESSAGE,
+  STATS_STAGE_SENDTO,
+  STATS_STAGE_ACK,
+  STATS_NUM_OF_STAGES,
+} stats_stage_t;
+
+/// @brief Get the current cycle count, the start of a stage.
+/// @return The cycle count.
+uint32_t begin_stage(void);
+
+/// @brief Record the duration of a stage.
+/// @param stage The stage.
+/// @param begin The cycle count returned by begin_stage().
+void end_stage(stats_stage_t stage, uint32_t begin);
+
+/// @brief Record the duration of a stage in cycles.
+/// @param stage The stage.
+/// @param cycles The duration in CPU cycles.
+void record_stage(stats_stage_t stage, uint32_t cycles);
+
+/// @brief Count the sent packets.
+/// @param count The number of packets.
+void count_packets_sent(uint32_t count);
+
+/// @brief Count the acknowledged packets.
+/// @param count The number of packets.
+void count_packets_acked(uint32_t count);
+
+/// @brief Count the lost packets.
+/// @param count The number of packets.
+void count_packets_lost(uint32_t count);
+
+/// @brief Print the statistics.
+void print_stats(void);
+
+/// @brief Reset the statistics.
+void reset_stats(void);
+
+#endif // __STATS_H__
@@ -1,89 +1,355 @@
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "lwip/sockets.h"
 #include "esp_task_wdt.h"
 
 #include "config.h"
+#include "hal.h"
 #include "tasks.h"
 #include "global.h"
-#include "udp.h"
 #include "wifi.h"
 #include "joy_data.h"
 #include "axis.h"
 #include "button.h"
 #include "encoder.h"
 #include "message.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "timesync.h"
 
 joystick_info_t g_joystick;
+task_timing_t g_sampler_timing;
+task_timing_t g_network_timing;
 
 static const char* TAG = "tasks";
 
-static const int STATE_PING_PONG = 0;
-static const int STATE_SYNCING = 1;
+_Static_assert(
+  NAGI_MAX_NUM_OF_BUTTONS + NAGI_MAX_NUM_OF_ENCODERS * 2 <= sizeof(((joystick_info_t*)0)->buttons) * 8,
+  "The report must carry the encoder buttons after the buttons."
+);
+#if NAGI_SYNC_COMPACT
+_Static_assert(
+  NAGI_MAX_NUM_OF_AXES + NAGI_MAX_NUM_OF_ENCODERS <= JOYSTICK_COMPACT_NUM_OF_AXES,
+  "The compact format must carry the encoder axes after the ADC axes."
+);
+_Static_assert(
+  NAGI_MAX_NUM_OF_BUTTONS + NAGI_MAX_NUM_OF_ENCODERS * 2 <= JOYSTICK_COMPACT_NUM_OF_BUTTONS,
+  "The compact format must carry the encoder buttons after the buttons, raise JOYSTICK_COMPACT_NUM_OF_BUTTONS with the host."
+);
+#endif
+
+// The network states, an enum so older host compilers accept them as case labels.
+enum {
+  STATE_PING_PONG = 0,
+  STATE_SYNCING = 1,
+};
+
+#if NAGI_SYNC_PIPELINED
+// The joystick formats supported by this build.
+#define SYNC_FORMATS ( \
+  (1 << MESSAGE_JOYSTICK_FORMAT_FULL) | \
+  (NAGI_SYNC_DELTA << MESSAGE_JOYSTICK_FORMAT_DELTA) | \
+  (NAGI_SYNC_COMPACT << MESSAGE_JOYSTICK_FORMAT_COMPACT) | \
+  (NAGI_SYNC_REDUNDANT << MESSAGE_JOYSTICK_FORMAT_REDUNDANT))
+// The joystick format used when the server does not select one.
+#define SYNC_DEFAULT_FORMAT (NAGI_SYNC_DELTA ? MESSAGE_JOYSTICK_FORMAT_DELTA : MESSAGE_JOYSTICK_FORMAT_FULL)
+#else
+#define SYNC_FORMATS 0
+#endif
+
+// The sampler notification bits.
+#define SAMPLER_NOTIFY_PERIOD BIT0
+#define SAMPLER_NOTIFY_INPUT BIT1
 
 static char _rx_buffer[1472];
 static message_common_ping_t _ping_message;
+#if NAGI_SYNC_PIPELINED
+static message_joystick_seq_sync_t _joy_sync_message;
+// The stop-and-wait message, sent instead if the server did not negotiate a format.
+static message_joystick_sync_t _joy_wait_message;
+// True if the server negotiated a format, false for a server that only knows the stop-and-wait sync.
+static bool _is_pipelined;
+// The sequence number of the last sent sync message.
+static uint32_t _sync_sequence;
+// The highest sequence number acknowledged by the server.
+static uint32_t _acked_sequence;
+// The cycle counts when the recent sync messages were sent, indexed by sequence number.
+static uint32_t _send_cycles[32];
+static message_common_time_request_t _time_request_message;
+// The tick of the last time request.
+static TickType_t _last_time_request_time;
+// The joystick format selected by the server.
+static uint32_t _sync_format;
+#if NAGI_SYNC_COMPACT
+static message_joystick_compact_sync_t _joy_compact_message;
+#endif
+#if NAGI_SYNC_REDUNDANT
+static message_joystick_redundant_sync_t _joy_redundant_message;
+// The recently sent states, indexed by sequence number.
+static joystick_compact_t _redundant_states[MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES];
+// The number of previous states repeated in every message.
+static uint32_t _redundancy = NAGI_SYNC_DEFAULT_REDUNDANCY;
+#endif
+#if NAGI_SYNC_DELTA
+static message_joystick_delta_sync_t _joy_delta_message;
+// The recently sent states, so an acknowledged one can become the delta base.
+static joystick_info_t _sent_states[NAGI_SYNC_DELTA_HISTORY_SIZE];
+static uint32_t _sent_sequences[NAGI_SYNC_DELTA_HISTORY_SIZE];
+// The last state acknowledged by the server, the deltas are encoded against it.
+static joystick_info_t _base_state;
+static uint32_t _base_sequence;
+// The tick of the last keyframe.
+static TickType_t _last_keyframe_time;
+#endif
+#else
 static message_joystick_sync_t _joy_sync_message;
+#endif
+// The tick of the last sent sync message.
+static TickType_t _last_send_time;
 static int _state;
+// The snapshot version of the last successfully sent joystick data.
+static uint32_t _sent_version;
+// The sample time of the snapshot being sent, in device microseconds.
+static int64_t _sample_time_us;
+// The cycle count when the sampler published the last snapshot.
+static uint32_t _publish_cycles;
 // The last encoder counter.
-static int64_t last_counter[NAGI_MAX_NUM_OF_ENCODERS];
+static int32_t last_counter[NAGI_MAX_NUM_OF_ENCODERS];
+// The tick when the last encoder pulse started.
+static TickType_t _encoder_pulse_time[NAGI_MAX_NUM_OF_ENCODERS];
+// The sampler task handle, woken by the sampler timer and the input interrupts.
+static TaskHandle_t _sampler_task_handle;
+// The sampler polling rate in Hz.
+static uint32_t _polling_rate = NAGI_DEFAULT_POLLING_RATE;
+// The timer pacing the sampler.
+static hal_timer_handle_t _sampler_timer;
+// The number of sampler periods elapsed.
+static volatile uint32_t _sampler_period_count;
+// The last sampler period handled by the sampler task.
+static uint32_t _handled_period_count;
+// True if the last joystick data is sent, or the pong is received.
+static bool _is_send_success;
+// The network task handle, woken by the sampler on every change.
+static TaskHandle_t _network_task_handle;
+
+/// @brief Wake the sampler task from an input interrupt.
+void IRAM_ATTR notify_input_from_isr(void) {
+#if NAGI_SYNC_EVENT_DRIVEN
+  if (_sampler_task_handle == NULL) {
+    return;
+  }
+  BaseType_t is_higher_priority_task_woken = pdFALSE;
+  xTaskNotifyFromISR(_sampler_task_handle, SAMPLER_NOTIFY_INPUT, eSetBits, &is_higher_priority_task_woken);
+  portYIELD_FROM_ISR(is_higher_priority_task_woken);
+#endif
+}
+
+/// @brief The sampler timer callback, dispatched from the timer ISR.
+/// @param arg The argument.
+/// @return True if the sampler task must run right away.
+static bool IRAM_ATTR sampler_timer_callback(void* arg) {
+  _sampler_period_count++;
+  BaseType_t is_higher_priority_task_woken = pdFALSE;
+  xTaskNotifyFromISR(_sampler_task_handle, SAMPLER_NOTIFY_PERIOD, eSetBits, &is_higher_priority_task_woken);
+  return is_higher_priority_task_woken == pdTRUE;
+}
+
+/// @brief Set the sampler polling rate.
+/// @param rate_hz The polling rate, 1000, 2000, 4000 or 8000 Hz.
+/// @return The result.
+esp_err_t set_polling_rate(uint32_t rate_hz) {
+  if (rate_hz != 1000 && rate_hz != 2000 && rate_hz != 4000 && rate_hz != 8000) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  _polling_rate = rate_hz;
+
+  // Restart the timer if the sampler is already running.
+  if (_sampler_timer != NULL) {
+    hal_timer_stop(_sampler_timer);
+    reset_task_timing(&g_sampler_timing, 1000000 / rate_hz);
+    esp_err_t err = hal_timer_start_periodic(_sampler_timer, 1000000 / rate_hz);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to start the sampler timer. Error %s", esp_err_to_name(err));
+      return err;
+    }
+  }
+
+  return ESP_OK;
+}
+
+/// @brief Get the sampler polling rate.
+/// @return The polling rate in Hz.
+uint32_t get_polling_rate(void) {
+  return _polling_rate;
+}
+
+/// @brief Set the number of previous states repeated in every redundant sync message.
+/// @param redundancy The number of previous states.
+/// @return The result.
+esp_err_t set_sync_redundancy(uint32_t redundancy) {
+#if NAGI_SYNC_REDUNDANT
+  if (redundancy >= MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  _redundancy = redundancy;
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/// @brief Get the number of previous states repeated in every redundant sync message.
+/// @return The number of previous states.
+uint32_t get_sync_redundancy(void) {
+#if NAGI_SYNC_REDUNDANT
+  return _redundancy;
+#else
+  return 0;
+#endif
+}
+
+/// @brief Reset the task timing statistics.
+/// @param timing The task timing.
+/// @param period_us The nominal period of the task in microseconds.
+void reset_task_timing(task_timing_t* timing, uint32_t period_us) {
+  memset(timing, 0, sizeof(task_timing_t));
+  timing->period_us = period_us;
+  timing->min_period_us = UINT32_MAX;
+}
+
+/// @brief Mark the beginning of a task iteration.
+/// @param timing The task timing.
+/// @return The start time in microseconds.
+static int64_t begin_task_timing(task_timing_t* timing) {
+  int64_t now = hal_get_time_us();
+  if (timing->last_start_us != 0) {
+    uint32_t period = (uint32_t)(now - timing->last_start_us);
+    if (period < timing->min_period_us) {
+      timing->min_period_us = period;
+    }
+    if (period > timing->max_period_us) {
+      timing->max_period_us = period;
+    }
+    // Late means a whole period was skipped.
+    if (period >= 2 * timing->period_us) {
+      timing->late_count++;
+    }
+    timing->total_period_us += period;
+    timing->count++;
+  }
+  timing->last_start_us = now;
+  return now;
+}
+
+/// @brief Mark the end of a task iteration.
+/// @param timing The task timing.
+/// @param start_us The start time returned by begin_task_timing().
+static void end_task_timing(task_timing_t* timing, int64_t start_us) {
+  uint32_t busy = (uint32_t)(hal_get_time_us() - start_us);
+  if (busy > timing->max_busy_us) {
+    timing->max_busy_us = busy;
+  }
+}
 
 /// @brief Update the joystick state.
 /// @return True if the joystick state must be updated.
 static bool update_joystick_state(void) {
   // Get all data from peripherals.
+  uint32_t begin = begin_stage();
   read_axis();
+  end_stage(STATS_STAGE_READ_AXIS, begin);
+  if (g_axes_sample_us > 0) {
+    record_stage(STATS_STAGE_AXIS_AGE, (uint32_t)(hal_get_time_us() - g_axes_sample_us) * hal_get_cycles_per_us());
+  }
+  begin = begin_stage();
   read_button();
+  end_stage(STATS_STAGE_READ_BUTTON, begin);
+  begin = begin_stage();
   read_encoder();
+  end_stage(STATS_STAGE_READ_ENCODER, begin);
+  begin = begin_stage();
 
-  // Update rate is 1kHz.
+  TickType_t now = xTaskGetTickCount();
+#if !NAGI_SYNC_EVENT_DRIVEN
+  // Commit the changes once per update window (100Hz).
   static TickType_t last_update_time = 0;
-  if (xTaskGetTickCount() - last_update_time > pdMS_TO_TICKS(10)) {
-    bool is_anything_changed = false;
-    for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; ++i) {
-      int index = i / 32;
-      int bit = i % 32;
-      uint32_t old_button_mask = g_joystick.buttons[index] & (1 << bit);
-      uint8_t state = g_button_data[i].stable_state;
-      uint32_t new_button_mask = state ? (1 << bit) : 0;
-      is_anything_changed |= old_button_mask != new_button_mask;
-      g_joystick.buttons[index] = (g_joystick.buttons[index] & ~(1 << bit)) | (state << bit);
+  if (now - last_update_time <= pdMS_TO_TICKS(NAGI_UPDATE_INTERVAL)) {
+    return false;
+  }
+  last_update_time = now;
+#endif
+
+  bool is_anything_changed = false;
+  // The buttons are the low bits, the debounced words go in as they are.
+  for (int i = 0; i < BUTTON_NUM_OF_WORDS; ++i) {
+    const int num_of_bits = NAGI_MAX_NUM_OF_BUTTONS - i * 32;
+    const uint32_t button_mask = num_of_bits >= 32 ? UINT32_MAX : (1u << num_of_bits) - 1;
+    is_anything_changed |= ((g_joystick.buttons[i] ^ g_button_states[i]) & button_mask) != 0;
+    g_joystick.buttons[i] = (g_joystick.buttons[i] & ~button_mask) | g_button_states[i];
+  }
+  int32_t* axes = &g_joystick.axis_x;
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; ++i) {
+    is_anything_changed |= g_axes_data[i] != axes[i];
+    axes[i] = g_axes_data[i];
+  }
+  int64_t now_us = hal_get_time_us();
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; ++i) {
+    int inc_button_id = NAGI_MAX_NUM_OF_BUTTONS + i * 2 + 0;
+    int inc_index = (inc_button_id) / 32;
+    int inc_bit = (inc_button_id) % 32;
+    int dec_button_id = NAGI_MAX_NUM_OF_BUTTONS + i * 2 + 1;
+    int dec_index = (dec_button_id) / 32;
+    int dec_bit = (dec_button_id) % 32;
+
+    update_encoder_report(i, now_us);
+    const encoder_t* encoder = &g_encoder_data[i];
+    if (encoder->mode == ENCODER_MODE_AXIS) {
+      // The position goes on the axis after the ADC axes.
+      int32_t* axis = &axes[NAGI_MAX_NUM_OF_AXES + i];
+      is_anything_changed |= *axis != encoder->position;
+      *axis = encoder->position;
+      continue;
     }
-    int32_t* axes = &g_joystick.axis_x;
-    for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; ++i) {
-      is_anything_changed |= g_axes_data[i] != axes[i];
-      axes[i] = g_axes_data[i];
+    if (encoder->mode == ENCODER_MODE_PULSES) {
+      uint32_t old_buttons = (g_joystick.buttons[inc_index] & (1 << inc_bit)) | (g_joystick.buttons[dec_index] & (1 << dec_bit));
+      g_joystick.buttons[inc_index] = (g_joystick.buttons[inc_index] & ~(1 << inc_bit)) | (encoder->pulse > 0 ? (1 << inc_bit) : 0);
+      g_joystick.buttons[dec_index] = (g_joystick.buttons[dec_index] & ~(1 << dec_bit)) | (encoder->pulse < 0 ? (1 << dec_bit) : 0);
+      uint32_t new_buttons = (g_joystick.buttons[inc_index] & (1 << inc_bit)) | (g_joystick.buttons[dec_index] & (1 << dec_bit));
+      is_anything_changed |= old_buttons != new_buttons;
+      continue;
     }
-    for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; ++i) {
-      int inc_button_id = NAGI_MAX_NUM_OF_BUTTONS + i * 2 + 0;
-      int inc_index = (inc_button_id) / 32;
-      int inc_bit = (inc_button_id) % 32;
-      int dec_button_id = NAGI_MAX_NUM_OF_BUTTONS + i * 2 + 1;
-      int dec_index = (dec_button_id) / 32;
-      int dec_bit = (dec_button_id) % 32;
-      if (g_encoder_data[i].counter > last_counter[i]) { // Clockwise.
-        g_joystick.buttons[inc_index] |= (1 << inc_bit);
-        g_joystick.buttons[dec_index] &= ~(1 << dec_bit);
-        is_anything_changed = true;
-      } else if (g_encoder_data[i].counter < last_counter[i]) {  // Counter-clockwise.
-        g_joystick.buttons[inc_index] &= ~(1 << inc_bit);
-        g_joystick.buttons[dec_index] |= (1 << dec_bit);
-        is_anything_changed = true;
-      } else {
-        uint32_t old_inc_button_mask = g_joystick.buttons[inc_index] & (1 << inc_bit);
-        uint32_t old_dec_button_mask = g_joystick.buttons[dec_index] & (1 << dec_bit);
-        is_anything_changed |= old_inc_button_mask || old_dec_button_mask;
-        g_joystick.buttons[inc_index] &= ~(1 << inc_bit);
-        g_joystick.buttons[dec_index] &= ~(1 << dec_bit);
-      }
-      last_counter[i] = g_encoder_data[i].counter;
+
+    // Hold every pulse for a whole update window, so the host can see it.
+    if (now - _encoder_pulse_time[i] <= pdMS_TO_TICKS(NAGI_UPDATE_INTERVAL)) {
+      continue;
     }
-    last_update_time = xTaskGetTickCount();
-    return is_anything_changed;
+    int32_t counter = get_encoder_counter(i);
+    int32_t delta = (int32_t)((uint32_t)counter - (uint32_t)last_counter[i]);
+    if (delta > 0) { // Clockwise.
+      g_joystick.buttons[inc_index] |= (1 << inc_bit);
+      g_joystick.buttons[dec_index] &= ~(1 << dec_bit);
+      _encoder_pulse_time[i] = now;
+      is_anything_changed = true;
+    } else if (delta < 0) {  // Counter-clockwise.
+      g_joystick.buttons[inc_index] &= ~(1 << inc_bit);
+      g_joystick.buttons[dec_index] |= (1 << dec_bit);
+      _encoder_pulse_time[i] = now;
+      is_anything_changed = true;
+    } else {
+      uint32_t old_inc_button_mask = g_joystick.buttons[inc_index] & (1 << inc_bit);
+      uint32_t old_dec_button_mask = g_joystick.buttons[dec_index] & (1 << dec_bit);
+      is_anything_changed |= old_inc_button_mask || old_dec_button_mask;
+      g_joystick.buttons[inc_index] &= ~(1 << inc_bit);
+      g_joystick.buttons[dec_index] &= ~(1 << dec_bit);
+    }
+    last_counter[i] = counter;
   }
-
-  return false;
+  end_stage(STATS_STAGE_UPDATE_STATE, begin);
+  return is_anything_changed;
 }
 
 /// @brief Send the data to the server.
@@ -91,29 +357,15 @@ static bool update_joystick_state(void) {
 /// @param length The length of the data.
 /// @return The error code.
 static int send_data(const void* data, size_t length) {
-  return sendto(
-    g_sock,
-    data,
-    length,
-    0,
-    (struct sockaddr*)&g_server_addr,
-    sizeof(g_server_addr)
-  );
+  return hal_udp_send(data, length, &g_server_addr);
 }
 
 /// @brief Receive the data from the server.
 /// @param source_addr The source address.
+/// @param flags The receive flags, e.g. MSG_DONTWAIT.
 /// @return The length of the received data.
-static int receive_data(struct sockaddr_storage* source_addr) {
-  socklen_t socklen = sizeof(struct sockaddr_storage);
-  return recvfrom(
-    g_sock,
-    _rx_buffer,
-    sizeof(_rx_buffer) - 1,
-    0,
-    (struct sockaddr *)source_addr,
-    &socklen
-  );
+static int receive_data(struct sockaddr_storage* source_addr, int flags) {
+  return hal_udp_receive(_rx_buffer, sizeof(_rx_buffer) - 1, source_addr, flags);
 }
 
 /// @brief Check the address is from the server.
@@ -129,6 +381,7 @@ static bool is_from_server(const struct sockaddr_storage* source_addr) {
 void state_ping_pong(bool* is_send_success) {
   if (!(*is_send_success)) {
     // Send the ping message.
+    _ping_message.origin_time = hal_get_time_us();
     int err = send_data(
       &_ping_message,
       sizeof(message_common_ping_t)
@@ -139,19 +392,54 @@ void state_ping_pong(bool* is_send_success) {
     } else {
       // Receive a reply from the server.
       struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
-      int len = receive_data(&source_addr);
+      int len = receive_data(&source_addr, 0);
+      int64_t destination_time = hal_get_time_us();
 
       // Received something.
       if (len >= 0) {
         if (is_from_server(&source_addr)) {
           const message_common_pong_t* pong = (const message_common_pong_t*)_rx_buffer;
           // Received 'G' << 24 | 'I' << 16 | 'A' << 8 | 'N' from the server.
-          if (pong->magic == ('G' << 24 | 'I' << 16 | 'A' << 8 | 'N')) {
+          // A pong with the format field answers a ping with its origin time, only the answer to the latest
+          // ping selects the format and gives the first clock sample. A shorter pong is from a legacy server.
+          bool is_legacy_pong = len < (int)offsetof(message_common_pong_t, origin_time);
+          bool is_latest_pong = len >= (int)sizeof(message_common_pong_t) && pong->origin_time == _ping_message.origin_time;
+          if (pong->magic != ('G' << 24 | 'I' << 16 | 'A' << 8 | 'N')) {
+            ESP_LOGW(TAG, "Received unknown magic number %08lX from the server.", pong->magic);
+          } else if (!is_legacy_pong && !is_latest_pong) {
+            ESP_LOGW(TAG, "Received a stale PONG from the server.");
+          } else {
             *is_send_success = true;
             _state = STATE_SYNCING;
+
+            // The first clock sample of the session.
+            reset_time_sync();
+            if (is_latest_pong) {
+              update_time_sync(pong->origin_time, pong->receive_time, pong->transmit_time, destination_time);
+            }
+#if NAGI_SYNC_PIPELINED
+            _sync_sequence = 0;
+            _acked_sequence = 0;
+            _last_time_request_time = xTaskGetTickCount();
+
+            // Use the format selected by the server if it is supported, a server that selects none only
+            // knows the stop-and-wait sync.
+            _sync_format = SYNC_DEFAULT_FORMAT;
+            _is_pipelined = !is_legacy_pong;
+            if (_is_pipelined && pong->format < 32 && (SYNC_FORMATS & (1 << pong->format))) {
+              _sync_format = pong->format;
+            }
+            if (_is_pipelined) {
+              ESP_LOGI(TAG, "Joystick format %lu.", _sync_format);
+            } else {
+              ESP_LOGI(TAG, "The server does not negotiate a format, fall back to stop-and-wait.");
+            }
+#endif
+#if NAGI_SYNC_DELTA
+            _base_sequence = 0;
+            memset(_sent_sequences, 0, sizeof(_sent_sequences));
+#endif
             ESP_LOGI(TAG, "Received PONG from the server.");
-          } else {
-            ESP_LOGW(TAG, "Received unknown magic number %08lX from the server.", pong->magic);
           }
         } else {
           ESP_LOGW(TAG, "Received from unknown source.");
@@ -161,24 +449,29 @@ void state_ping_pong(bool* is_send_success) {
   }
 }
 
-/// @brief Send the joystick data.
+/// @brief Send the joystick data and wait for the ack.
+/// @param message The message to send.
 /// @return True if the data is sent successfully.
-static bool send_joystick_data(void) {
+static bool send_joystick_data_and_wait(const message_joystick_sync_t* message) {
   bool is_send_success = false;
 
-  memcpy(&_joy_sync_message.data, &g_joystick, sizeof(joystick_info_t));
-
+  uint32_t begin = begin_stage();
   int err = send_data(
-    &_joy_sync_message,
+    message,
     sizeof(message_joystick_sync_t)
   );
+  end_stage(STATS_STAGE_SENDTO, begin);
+  _last_send_time = xTaskGetTickCount();
   if (err < 0) {
     ESP_LOGE(TAG, "Error occurred during sending, sleep 100ms. Errno %d", errno);
     vTaskDelay(pdMS_TO_TICKS(100));
   } else {
+    count_packets_sent(1);
+
     // Receive a reply from the server.
     struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
-    int len = receive_data(&source_addr);
+    int len = receive_data(&source_addr, 0);
+    end_stage(STATS_STAGE_ACK, begin);
 
     // Received something.
     if (len >= 0) {
@@ -187,6 +480,7 @@ static bool send_joystick_data(void) {
         // Received 'O' << 8 | 'K' from the server.
         if (ack->payload == 0x4F4B) {
           is_send_success = true;
+          count_packets_acked(1);
         } else {
           ESP_LOGW(TAG, "Received NOK from the server.");
         }
@@ -194,55 +488,471 @@ static bool send_joystick_data(void) {
         ESP_LOGW(TAG, "Received from unknown source.");
       }
     }
+    if (!is_send_success) {
+      count_packets_lost(1);
+    }
   }
 
   return is_send_success;
 }
 
+#if NAGI_SYNC_PIPELINED
+#if NAGI_SYNC_DELTA
+/// @brief Build the delta message of the joystick data.
+/// @param data The joystick data.
+/// @param sequence The sequence number.
+/// @param timestamp The sample timestamp.
+/// @return The length of the message.
+static size_t build_joystick_delta(const joystick_info_t* data, uint32_t sequence, uint32_t timestamp) {
+  static const joystick_info_t zero_state;
+
+  // Keep the state, so it can become the base once acknowledged.
+  int slot = sequence % NAGI_SYNC_DELTA_HISTORY_SIZE;
+  memcpy(&_sent_states[slot], data, sizeof(joystick_info_t));
+  _sent_sequences[slot] = sequence;
+
+  // Send a keyframe until a base is acknowledged, and periodically for resynchronisation.
+  const joystick_info_t* base = &_base_state;
+  uint32_t base_sequence = _base_sequence;
+  TickType_t now = xTaskGetTickCount();
+  if (base_sequence == 0 || now - _last_keyframe_time >= pdMS_TO_TICKS(NAGI_SYNC_KEYFRAME_INTERVAL)) {
+    base = &zero_state;
+    base_sequence = 0;
+    _last_keyframe_time = now;
+  }
+
+  // Only the changed fields are sent.
+  const uint32_t* fields = (const uint32_t*)data;
+  const uint32_t* base_fields = (const uint32_t*)base;
+  uint32_t field_mask = 0;
+  int count = 0;
+  for (int i = 0; i < JOYSTICK_INFO_FIELD_COUNT; ++i) {
+    if (fields[i] != base_fields[i]) {
+      field_mask |= 1u << i;
+      _joy_delta_message.values[count++] = fields[i];
+    }
+  }
+
+  size_t length = offsetof(message_joystick_delta_sync_t, values) + count * sizeof(uint32_t);
+  _joy_delta_message.header.length = length - sizeof(message_header_t);
+  _joy_delta_message.sequence = sequence;
+  _joy_delta_message.timestamp = timestamp;
+  _joy_delta_message.base_sequence = base_sequence;
+  _joy_delta_message.field_mask = field_mask;
+  return length;
+}
+#endif
+
+#if NAGI_SYNC_COMPACT || NAGI_SYNC_REDUNDANT
+/// @brief Encode the joystick data in the compact layout.
+/// @param data The joystick data.
+/// @param compact The compact joystick data to fill.
+static void encode_joystick_compact(const joystick_info_t* data, joystick_compact_t* compact) {
+  const int32_t* axes = &data->axis_x;
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_AXES; ++i) {
+    int32_t value = axes[i];
+    compact->axes[i] = value < 0 ? 0 : (value > UINT16_MAX ? UINT16_MAX : value);
+  }
+
+  // The button words are little-endian, so their bytes are already the compact bit array.
+  memcpy(compact->buttons, data->buttons, sizeof(compact->buttons));
+
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_HATS; i += 2) {
+    compact->hats[i / 2] = (data->hats[i] & 0xF) | ((data->hats[i + 1] & 0xF) << 4);
+  }
+}
+#endif
+
+#if NAGI_SYNC_COMPACT
+/// @brief Build the compact message of the joystick data.
+/// @param data The joystick data.
+/// @param sequence The sequence number.
+/// @param timestamp The sample timestamp.
+/// @return The length of the message.
+static size_t build_joystick_compact(const joystick_info_t* data, uint32_t sequence, uint32_t timestamp) {
+  encode_joystick_compact(data, &_joy_compact_message.data);
+  _joy_compact_message.sequence = sequence;
+  _joy_compact_message.timestamp = timestamp;
+  return sizeof(message_joystick_compact_sync_t);
+}
+#endif
+
+#if NAGI_SYNC_REDUNDANT
+/// @brief Build the redundant message of the joystick data.
+/// @param data The joystick data.
+/// @param sequence The sequence number.
+/// @param timestamp The sample timestamp.
+/// @return The length of the message.
+static size_t build_joystick_redundant(const joystick_info_t* data, uint32_t sequence, uint32_t timestamp) {
+  encode_joystick_compact(data, &_redundant_states[sequence % MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES]);
+
+  // Repeat the previous states, but only those the server has not acknowledged yet.
+  uint32_t count = 1;
+  while (count <= _redundancy && (int32_t)(sequence - count - _acked_sequence) > 0) {
+    count++;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(
+      &_joy_redundant_message.states[i],
+      &_redundant_states[(sequence - i) % MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES],
+      sizeof(joystick_compact_t)
+    );
+  }
+
+  size_t length = offsetof(message_joystick_redundant_sync_t, states) + count * sizeof(joystick_compact_t);
+  _joy_redundant_message.header.length = length - sizeof(message_header_t);
+  _joy_redundant_message.sequence = sequence;
+  _joy_redundant_message.timestamp = timestamp;
+  _joy_redundant_message.count = count;
+  return length;
+}
+#endif
+
+/// @brief Send the joystick data with a new sequence number, without waiting for the ack.
+/// @return True if the data is sent successfully.
+static bool send_joystick_data(void) {
+  if (!_is_pipelined) {
+    memcpy(&_joy_wait_message.data, &_joy_sync_message.data, sizeof(joystick_info_t));
+    return send_joystick_data_and_wait(&_joy_wait_message);
+  }
+
+  _joy_sync_message.sequence = ++_sync_sequence;
+  // The sample time in host microseconds, the host unwraps it.
+  _joy_sync_message.timestamp = (uint32_t)get_host_time(_sample_time_us);
+
+  // Encode the snapshot in the selected format.
+  uint32_t begin = begin_stage();
+  const void* message = &_joy_sync_message;
+  size_t length = sizeof(message_joystick_seq_sync_t);
+  switch (_sync_format) {
+#if NAGI_SYNC_DELTA
+    case MESSAGE_JOYSTICK_FORMAT_DELTA:
+      message = &_joy_delta_message;
+      length = build_joystick_delta(&_joy_sync_message.data, _sync_sequence, _joy_sync_message.timestamp);
+      break;
+#endif
+#if NAGI_SYNC_COMPACT
+    case MESSAGE_JOYSTICK_FORMAT_COMPACT:
+      message = &_joy_compact_message;
+      length = build_joystick_compact(&_joy_sync_message.data, _sync_sequence, _joy_sync_message.timestamp);
+      break;
+#endif
+#if NAGI_SYNC_REDUNDANT
+    case MESSAGE_JOYSTICK_FORMAT_REDUNDANT:
+      message = &_joy_redundant_message;
+      length = build_joystick_redundant(&_joy_sync_message.data, _sync_sequence, _joy_sync_message.timestamp);
+      break;
+#endif
+    default:
+      break;
+  }
+  end_stage(STATS_STAGE_BUILD_MESSAGE, begin);
+
+  begin = begin_stage();
+  int err = send_data(
+    message,
+    length
+  );
+  end_stage(STATS_STAGE_SENDTO, begin);
+  _send_cycles[_sync_sequence % 32] = begin;
+  _last_send_time = xTaskGetTickCount();
+  if (err < 0) {
+    ESP_LOGE(TAG, "Error occurred during sending, sleep 100ms. Errno %d", errno);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    return false;
+  }
+  count_packets_sent(1);
+
+  return true;
+}
+
+/// @brief Send a time request to refresh the clock offset.
+static void send_time_request(void) {
+  _time_request_message.origin_time = hal_get_time_us();
+  int err = send_data(
+    &_time_request_message,
+    sizeof(message_common_time_request_t)
+  );
+  if (err < 0) {
+    ESP_LOGW(TAG, "Failed to send the time request. Errno %d", errno);
+  }
+  _last_time_request_time = xTaskGetTickCount();
+}
+
+/// @brief Handle a time response from the server.
+/// @param len The length of the message.
+static void receive_time_response(int len) {
+  int64_t destination_time = hal_get_time_us();
+  if (len < (int)sizeof(message_common_time_response_t)) {
+    return;
+  }
+  const message_common_time_response_t* response = (const message_common_time_response_t*)_rx_buffer;
+  // Only the answer to the latest request is trusted, older ones have unknown queuing.
+  if (response->origin_time == _time_request_message.origin_time) {
+    update_time_sync(response->origin_time, response->receive_time, response->transmit_time, destination_time);
+  }
+}
+
+/// @brief Drain all pending acks and time responses from the server without blocking.
+static void receive_server_messages(void) {
+  for (;;) {
+    struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
+    int len = receive_data(&source_addr, MSG_DONTWAIT);
+    if (len < 0) {
+      // EAGAIN means no more pending data.
+      break;
+    }
+    if (!is_from_server(&source_addr)) {
+      ESP_LOGW(TAG, "Received from unknown source.");
+      continue;
+    }
+    if (len < (int)sizeof(message_header_t)) {
+      continue;
+    }
+
+    const message_header_t* header = (const message_header_t*)_rx_buffer;
+    if (header->major_id == MESSAGE_MAJOR_ID_COMMON && header->minor_id == MESSAGE_MINOR_ID_COMMON_TIME_RESPONSE) {
+      receive_time_response(len);
+      continue;
+    }
+    if (len < (int)sizeof(message_joystick_seq_ack_t)) {
+      continue;
+    }
+
+    const message_joystick_seq_ack_t* ack = (const message_joystick_seq_ack_t*)_rx_buffer;
+    if (ack->header.major_id != MESSAGE_MAJOR_ID_JOYSTICK || ack->header.minor_id != MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_ACK) {
+      continue;
+    }
+    // Received 'O' << 8 | 'K' from the server.
+    if (ack->payload != 0x4F4B) {
+      ESP_LOGW(TAG, "Received NOK from the server.");
+      continue;
+    }
+
+    // Ignore stale or reordered acks, and count the gap as lost packets.
+    int32_t advance = (int32_t)(ack->sequence - _acked_sequence);
+    if (advance > 0 && (int32_t)(_sync_sequence - ack->sequence) >= 0) {
+      count_packets_lost(advance - 1);
+      count_packets_acked(1);
+      _acked_sequence = ack->sequence;
+
+      // Record the round trip if the send time is still known.
+      if (_sync_sequence - ack->sequence < 32) {
+        end_stage(STATS_STAGE_ACK, _send_cycles[ack->sequence % 32]);
+      }
+#if NAGI_SYNC_DELTA
+      // The acknowledged state becomes the new delta base.
+      int slot = ack->sequence % NAGI_SYNC_DELTA_HISTORY_SIZE;
+      if (_sent_sequences[slot] == ack->sequence) {
+        memcpy(&_base_state, &_sent_states[slot], sizeof(joystick_info_t));
+        _base_sequence = ack->sequence;
+      }
+#endif
+    }
+  }
+}
+#else
+/// @brief Send the joystick data.
+/// @return True if the data is sent successfully.
+static bool send_joystick_data(void) {
+  return send_joystick_data_and_wait(&_joy_sync_message);
+}
+#endif
+
 /// @brief State machine for joystick syncing.
 void state_joystick(bool* is_send_success) {
-  // Update the joystick state.
-  bool is_joystick_changed = update_joystick_state();
+  // Take the latest joystick state published by the sampler.
+  uint32_t version = read_joystick_snapshot(&_joy_sync_message.data, &_sample_time_us);
+  bool is_joystick_changed = version != _sent_version;
+
+#if NAGI_SYNC_PIPELINED
+  if (_is_pipelined) {
+    // Collect the acks of the previous sends.
+    receive_server_messages();
+
+    // Keep tracking the host clock.
+    if (xTaskGetTickCount() - _last_time_request_time >= pdMS_TO_TICKS(NAGI_TIME_SYNC_INTERVAL)) {
+      send_time_request();
+    }
+
+    // Resend the latest state if it is not acknowledged in time.
+    bool is_ack_overdue = _acked_sequence != _sync_sequence &&
+      xTaskGetTickCount() - _last_send_time > pdMS_TO_TICKS(NAGI_SYNC_RESEND_INTERVAL);
+    is_joystick_changed |= is_ack_overdue;
+  }
+#endif
+
+#if NAGI_SYNC_EVENT_DRIVEN
+  // Without changes, only send keepalives.
+  is_joystick_changed |= xTaskGetTickCount() - _last_send_time >= pdMS_TO_TICKS(NAGI_SYNC_KEEPALIVE_INTERVAL);
+#endif
 
   // Send the joystick data.
   if (!(*is_send_success) || is_joystick_changed) {
+    // Record how long a new snapshot waited for the network task.
+    if (version != _sent_version) {
+      record_stage(STATS_STAGE_QUEUE, begin_stage() - _publish_cycles);
+    }
+
     *is_send_success = send_joystick_data();
+    if (*is_send_success) {
+      _sent_version = version;
+    }
+  }
+}
+
+/// @brief Initialize the sampler and start its timer.
+void initialize_sampler(void) {
+  _sampler_task_handle = xTaskGetCurrentTaskHandle();
+  _handled_period_count = 0;
+
+  // Initialize the joystick.
+  memset(&g_joystick, 0, sizeof(joystick_info_t));
+  publish_joystick_snapshot(&g_joystick, hal_get_time_us());
+
+  // Pace the sampler with a microsecond timer, the tick rate caps vTaskDelayUntil() at 1kHz.
+  ESP_ERROR_CHECK(hal_timer_create("sampler", sampler_timer_callback, NULL, &_sampler_timer));
+  ESP_ERROR_CHECK(set_polling_rate(_polling_rate));
+}
 
-    // for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
-    //   ESP_LOGI(TAG, "Axis[%d] data: %d", i, g_axes_data[i]);
-    // }
-    // for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
-    //   ESP_LOGI(TAG, "Button[%d] data: %d, %d", i, g_button_data[i].stable_state, g_button_data[i].changed);
-    // }
-    // for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
-    //   ESP_LOGI(TAG, "Encoder[%d] data: %lld", i, g_encoder_data[i].counter);
-    // }
+/// @brief Run one sampler iteration.
+/// @param bits The notification bits that woke the sampler.
+void run_sampler(uint32_t bits) {
+  if (bits & SAMPLER_NOTIFY_PERIOD) {
+    // Every period elapsed since the last handled one has missed its deadline.
+    uint32_t period_count = _sampler_period_count;
+    if (_handled_period_count != 0 && period_count - _handled_period_count > 1) {
+      g_sampler_timing.missed_count += period_count - _handled_period_count - 1;
+    }
+    _handled_period_count = period_count;
   }
+
+  int64_t start_us = begin_task_timing(&g_sampler_timing);
+
+  // Sample the peripherals and publish the changes to the network task.
+  if (update_joystick_state()) {
+    publish_joystick_snapshot(&g_joystick, hal_get_time_us());
+    _publish_cycles = begin_stage();
+#if NAGI_SYNC_EVENT_DRIVEN
+    if (_network_task_handle != NULL) {
+      xTaskNotifyGive(_network_task_handle);
+    }
+#endif
+  }
+
+  end_task_timing(&g_sampler_timing, start_us);
 }
 
-/// @brief Main loop task.
+/// @brief Sampler task.
 /// @param pvParameters Task parameters.
-void main_loop_task(void* pvParameters) {
-  TickType_t last_wake_time;
-  bool is_send_success = false;
-
+void sampler_task(void* pvParameters) {
   esp_task_wdt_add(NULL);
+  initialize_sampler();
 
-  // Initialize the joystick.
-  memset(&g_joystick, 0, sizeof(joystick_info_t));
+  for (;;) {
+    // Wait for the next period, an input interrupt wakes the sampler earlier.
+    uint32_t bits = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &bits, pdMS_TO_TICKS(100));
+
+    run_sampler(bits);
+
+    // Feed the watchdog.
+    esp_task_wdt_reset();
+  }
+}
+
+/// @brief Initialize the network state machine.
+void initialize_network(void) {
+  _network_task_handle = xTaskGetCurrentTaskHandle();
+
+  // Initialize the messages.
   memset(&_ping_message, 0, sizeof(message_common_ping_t));
   _ping_message.header.major_id = MESSAGE_MAJOR_ID_COMMON;
   _ping_message.header.minor_id = MESSAGE_MINOR_ID_COMMON_PING;
-  _ping_message.header.length = sizeof(_ping_message.magic);
+  _ping_message.header.length = sizeof(message_common_ping_t) - sizeof(message_header_t);
   // 'N' << 24 | 'A' << 16 | 'G' << 8 | 'I'
   _ping_message.magic = ('N' << 24 | 'A' << 16 | 'G' << 8 | 'I');
+  _ping_message.formats = SYNC_FORMATS;
+#if NAGI_SYNC_PIPELINED
+  memset(&_joy_sync_message, 0, sizeof(message_joystick_seq_sync_t));
+  _joy_sync_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  _joy_sync_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_SYNC;
+  _joy_sync_message.header.length = sizeof(message_joystick_seq_sync_t) - sizeof(message_header_t);
+  memset(&_time_request_message, 0, sizeof(message_common_time_request_t));
+  _time_request_message.header.major_id = MESSAGE_MAJOR_ID_COMMON;
+  _time_request_message.header.minor_id = MESSAGE_MINOR_ID_COMMON_TIME_REQUEST;
+  _time_request_message.header.length = sizeof(message_common_time_request_t) - sizeof(message_header_t);
+  memset(&_joy_wait_message, 0, sizeof(message_joystick_sync_t));
+  _joy_wait_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  _joy_wait_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_SYNC;
+  _joy_wait_message.header.length = sizeof(_joy_wait_message.data);
+#if NAGI_SYNC_DELTA
+  memset(&_joy_delta_message, 0, sizeof(message_joystick_delta_sync_t));
+  _joy_delta_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  _joy_delta_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_DELTA_SYNC;
+#endif
+#if NAGI_SYNC_COMPACT
+  memset(&_joy_compact_message, 0, sizeof(message_joystick_compact_sync_t));
+  _joy_compact_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  _joy_compact_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_COMPACT_SYNC;
+  _joy_compact_message.header.length = sizeof(message_joystick_compact_sync_t) - sizeof(message_header_t);
+#endif
+#if NAGI_SYNC_REDUNDANT
+  memset(&_joy_redundant_message, 0, sizeof(message_joystick_redundant_sync_t));
+  _joy_redundant_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  _joy_redundant_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_REDUNDANT_SYNC;
+#endif
+#else
   memset(&_joy_sync_message, 0, sizeof(message_joystick_sync_t));
   _joy_sync_message.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
   _joy_sync_message.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_SYNC;
   _joy_sync_message.header.length = sizeof(_joy_sync_message.data);
+#endif
 
   // Set the state to ping-pong.
   _state = STATE_PING_PONG;
+  _is_send_success = false;
+  _sent_version = 0;
+  reset_task_timing(&g_network_timing, 1000);
+}
+
+/// @brief Run one network iteration, the server must be reachable.
+void run_network(void) {
+  int64_t start_us = begin_task_timing(&g_network_timing);
+  switch (_state) {
+    case STATE_PING_PONG:
+      state_ping_pong(&_is_send_success);
+      break;
+    case STATE_SYNCING:
+      state_joystick(&_is_send_success);
+      break;
+    default:
+      break;
+  }
+  end_task_timing(&g_network_timing, start_us);
+}
+
+/// @brief Check the network task has nothing pending.
+/// @return True if the network task can sleep until the next change or keepalive.
+bool is_network_idle(void) {
+#if NAGI_SYNC_EVENT_DRIVEN
+  bool is_idle = _state == STATE_SYNCING && _is_send_success;
+#if NAGI_SYNC_PIPELINED
+  is_idle &= _acked_sequence == _sync_sequence;
+#endif
+  return is_idle;
+#else
+  return false;
+#endif
+}
+
+/// @brief Network task.
+/// @param pvParameters Task parameters.
+void network_task(void* pvParameters) {
+  TickType_t last_wake_time;
+
+  esp_task_wdt_add(NULL);
+  initialize_network();
 
   for (;;) {
     bool is_server_setted = g_server_addr.sin_family == AF_INET && g_server_addr.sin_port != 0;
@@ -253,21 +963,17 @@ void main_loop_task(void* pvParameters) {
     // Wait for the wifi connected.
     EventBits_t bits = xEventGroupWaitBits(g_wifi_event_group, WIFI_CONNECTED_BIT, false, true, pdMS_TO_TICKS(1000));
     if ((bits & WIFI_CONNECTED_BIT) && is_server_setted) {
-      switch (_state) {
-        case STATE_PING_PONG:
-          state_ping_pong(&is_send_success);
-          break;
-        case STATE_SYNCING:
-          state_joystick(&is_send_success);
-          break;
-        default:
-          break;
-      }
+      run_network();
     }
 
-    vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(1));
+    if (is_network_idle()) {
+      // Nothing pending, sleep until the sampler publishes a change or a keepalive is due.
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NAGI_SYNC_KEEPALIVE_INTERVAL));
+    } else {
+      vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(1));
+    }
 
     // Feed the watchdog.
     esp_task_wdt_reset();
   }
-}
\ No newline at end of file
+}
@@ -1,13 +1,93 @@
 #ifndef __TASKS_H__
 #define __TASKS_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int esp_err_t;
+
 typedef struct joystick_info joystick_info_t;
 
-/// @brief joystick.
+/// @brief The timing statistics of a periodic task.
+typedef struct {
+  // The nominal period in microseconds.
+  uint32_t period_us;
+  // The number of measured periods.
+  uint32_t count;
+  // The start time of the last iteration in microseconds.
+  int64_t last_start_us;
+  // The shortest period in microseconds.
+  uint32_t min_period_us;
+  // The longest period in microseconds.
+  uint32_t max_period_us;
+  // The sum of all periods in microseconds.
+  uint64_t total_period_us;
+  // The longest time spent in one iteration in microseconds.
+  uint32_t max_busy_us;
+  // The number of periods that took at least twice the nominal period.
+  uint32_t late_count;
+  // The number of timer periods that passed without being handled.
+  uint32_t missed_count;
+} task_timing_t;
+
+/// @brief joystick, owned by the sampler task.
 extern joystick_info_t g_joystick;
 
-/// @brief Main loop task.
+/// @brief The sampler task timing.
+extern task_timing_t g_sampler_timing;
+
+/// @brief The network task timing.
+extern task_timing_t g_network_timing;
+
+/// @brief Reset the task timing statistics.
+/// @param timing The task timing.
+/// @param period_us The nominal period of the task in microseconds.
+void reset_task_timing(task_timing_t* timing, uint32_t period_us);
+
+/// @brief Set the sampler polling rate.
+/// @param rate_hz The polling rate, 1000, 2000, 4000 or 8000 Hz.
+/// @return The result.
+esp_err_t set_polling_rate(uint32_t rate_hz);
+
+/// @brief Get the sampler polling rate.
+/// @return The polling rate in Hz.
+uint32_t get_polling_rate(void);
+
+/// @brief Set the number of previous states repeated in every redundant sync message.
+/// @param redundancy The number of previous states.
+/// @return The result.
+esp_err_t set_sync_redundancy(uint32_t redundancy);
+
+/// @brief Get the number of previous states repeated in every redundant sync message.
+/// @return The number of previous states.
+uint32_t get_sync_redundancy(void);
+
+/// @brief Wake the sampler task from an input interrupt.
+void notify_input_from_isr(void);
+
+/// @brief Initialize the sampler and start its timer, on the sampler task.
+void initialize_sampler(void);
+
+/// @brief Run one sampler iteration.
+/// @param bits The notification bits that woke the sampler.
+void run_sampler(uint32_t bits);
+
+/// @brief Initialize the network state machine, on the network task.
+void initialize_network(void);
+
+/// @brief Run one network iteration, the server must be reachable.
+void run_network(void);
+
+/// @brief Check the network task has nothing pending.
+/// @return True if the network task can sleep until the next change or keepalive.
+bool is_network_idle(void);
+
+/// @brief Sampler task, reads the peripherals at a fixed rate.
+/// @param pvParameters Task parameters.
+void sampler_task(void* pvParameters);
+
+/// @brief Network task, syncs the joystick state with the server.
 /// @param pvParameters Task parameters.
-void main_loop_task(void* pvParameters);
+void network_task(void* pvParameters);
 
 #endif  // __TASKS_H__
\ No newline at end of file
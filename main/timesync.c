@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "timesync.h"
+
+// The number of recent samples the offset is chosen from.
+#define TIME_SYNC_NUM_OF_SAMPLES 8
+
+/// @brief A clock sample.
+typedef struct {
+  int64_t offset;
+  int64_t round_trip_time;
+} time_sample_t;
+
+static time_sample_t _samples[TIME_SYNC_NUM_OF_SAMPLES];
+static uint32_t _num_of_samples;
+// The estimate, written by the network task and read by everyone.
+static int64_t _clock_offset;
+static int64_t _round_trip_time;
+
+/// @brief Forget all clock samples, e.g. when a new session starts.
+void reset_time_sync(void) {
+  memset(_samples, 0, sizeof(_samples));
+  _num_of_samples = 0;
+  _clock_offset = 0;
+  _round_trip_time = 0;
+}
+
+/// @brief Add a clock sample from an NTP-style exchange.
+/// @param origin_time The device time when the request was sent.
+/// @param receive_time The host time when the request was received.
+/// @param transmit_time The host time when the response was sent.
+/// @param destination_time The device time when the response was received.
+void update_time_sync(int64_t origin_time, int64_t receive_time, int64_t transmit_time, int64_t destination_time) {
+  int64_t round_trip_time = (destination_time - origin_time) - (transmit_time - receive_time);
+  if (round_trip_time < 0) {
+    // The host clock is not monotonic or the fields are bogus.
+    return;
+  }
+
+  time_sample_t* sample = &_samples[_num_of_samples % TIME_SYNC_NUM_OF_SAMPLES];
+  sample->offset = ((receive_time - origin_time) + (transmit_time - destination_time)) / 2;
+  sample->round_trip_time = round_trip_time;
+  _num_of_samples++;
+
+  // The sample with the shortest round trip has the least queuing asymmetry, so trust it.
+  uint32_t count = _num_of_samples < TIME_SYNC_NUM_OF_SAMPLES ? _num_of_samples : TIME_SYNC_NUM_OF_SAMPLES;
+  const time_sample_t* best = &_samples[0];
+  for (uint32_t i = 1; i < count; ++i) {
+    if (_samples[i].round_trip_time < best->round_trip_time) {
+      best = &_samples[i];
+    }
+  }
+  _clock_offset = best->offset;
+  _round_trip_time = best->round_trip_time;
+}
+
+/// @brief Check if the clock offset is known.
+/// @return True if at least one sample was taken.
+bool is_time_synced(void) {
+  return _num_of_samples > 0;
+}
+
+/// @brief Convert a device time to host time.
+/// @param device_time_us The device time in microseconds.
+/// @return The host time in microseconds.
+int64_t get_host_time(int64_t device_time_us) {
+  return device_time_us + _clock_offset;
+}
+
+/// @brief Get the estimated clock offset, host time minus device time.
+/// @return The offset in microseconds.
+int64_t get_clock_offset(void) {
+  return _clock_offset;
+}
+
+/// @brief Get the round trip time of the sample the offset is based on.
+/// @return The round trip time in microseconds.
+int64_t get_round_trip_time(void) {
+  return _round_trip_time;
+}
@@ -0,0 +1,34 @@
+#ifndef __TIMESYNC_H__
+#define __TIMESYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// @brief Forget all clock samples, e.g. when a new session starts.
+void reset_time_sync(void);
+
+/// @brief Add a clock sample from an NTP-style exchange.
+/// @param origin_time The device time when the request was sent.
+/// @param receive_time The host time when the request was received.
+/// @param transmit_time The host time when the response was sent.
+/// @param destination_time The device time when the response was received.
+void update_time_sync(int64_t origin_time, int64_t receive_time, int64_t transmit_time, int64_t destination_time);
+
+/// @brief Check if the clock offset is known.
+/// @return True if at least one sample was taken.
+bool is_time_synced(void);
+
+/// @brief Convert a device time to host time.
+/// @param device_time_us The device time in microseconds.
+/// @return The host time in microseconds.
+int64_t get_host_time(int64_t device_time_us);
+
+/// @brief Get the estimated clock offset, host time minus device time.
+/// @return The offset in microseconds.
+int64_t get_clock_offset(void);
+
+/// @brief Get the round trip time of the sample the offset is based on.
+/// @return The round trip time in microseconds.
+int64_t get_round_trip_time(void);
+
+#endif // __TIMESYNC_H__
@@ -0,0 +1,265 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/gpio_num.h"
+
+#include "config.h"
+#include "hal.h"
+#include "trace.h"
+#include "button.h"
+#include "encoder.h"
+
+// The records written per fwrite().
+#define TRACE_WRITE_BLOCK_SIZE 64
+
+/// @brief The recorder state.
+enum {
+  TRACE_STATE_IDLE = 0,
+  TRACE_STATE_RECORDING,
+  // Stopped, the trace task flushes the rest and closes the file.
+  TRACE_STATE_STOPPING,
+};
+
+/// @brief A single-producer single-consumer ring of records.
+typedef struct {
+  trace_record_t* records;
+  uint32_t size;
+  // Advanced by the trace task.
+  uint32_t head;
+  // Advanced by the producer.
+  uint32_t tail;
+} trace_ring_t;
+
+static const char* TAG = "trace";
+
+// The sampler task and the encoder ISR record into their own ring, so neither needs a lock.
+// The transitions of the pulse counters are read on the sampler task and go to its ring.
+static trace_record_t _sampler_records[NAGI_TRACE_BUFFER_SIZE];
+static trace_record_t _isr_records[NAGI_TRACE_BUFFER_SIZE / 4];
+static trace_ring_t _sampler_ring = {_sampler_records, NAGI_TRACE_BUFFER_SIZE, 0, 0};
+static trace_ring_t _isr_ring = {_isr_records, NAGI_TRACE_BUFFER_SIZE / 4, 0, 0};
+
+static int _state;
+static FILE* _file;
+static trace_header_t _header;
+// The time the recording started in microseconds.
+static int64_t _start_us;
+static uint32_t _written;
+static uint32_t _dropped;
+
+/// @brief Append a record to a ring.
+/// @param ring The ring, only one context may append to it.
+/// @param type The record type.
+/// @param index The record index.
+/// @param value The record value.
+/// @param time_us The time in microseconds.
+static void IRAM_ATTR push_record(trace_ring_t* ring, uint8_t type, uint8_t index, uint16_t value, int64_t time_us) {
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (tail - head >= ring->size) {
+    __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  trace_record_t* record = &ring->records[tail % ring->size];
+  record->time_us = (uint32_t)(time_us - _start_us);
+  record->type = type;
+  record->index = index;
+  record->value = value;
+  // Publish the record before the trace task can see it.
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Check a recording is running.
+/// @return True if recording.
+bool IRAM_ATTR is_trace_recording(void) {
+  return __atomic_load_n(&_state, __ATOMIC_ACQUIRE) == TRACE_STATE_RECORDING;
+}
+
+/// @brief Start recording into a file, the file is overwritten.
+/// @param path The file path.
+/// @param adc_sample_freq_hz The ADC conversion rate, stored in the header.
+/// @return The result.
+esp_err_t start_trace(const char* path, uint32_t adc_sample_freq_hz) {
+  if (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) != TRACE_STATE_IDLE) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) {
+    ESP_LOGE(TAG, "Failed to open %s.", path);
+    return ESP_FAIL;
+  }
+  _header = (trace_header_t){
+    .magic = TRACE_MAGIC,
+    .version = TRACE_VERSION,
+    .record_size = sizeof(trace_record_t),
+    .adc_sample_freq_hz = adc_sample_freq_hz,
+    .dropped = 0,
+  };
+  if (fwrite(&_header, sizeof(_header), 1, f) != 1) {
+    fclose(f);
+    return ESP_FAIL;
+  }
+
+  _file = f;
+  _written = 0;
+  _dropped = 0;
+  _sampler_ring.head = _sampler_ring.tail = 0;
+  _isr_ring.head = _isr_ring.tail = 0;
+  _start_us = hal_get_time_us();
+
+  // The initial levels, the producers only record the changes. Nothing else appends yet.
+  for (int i = 0; g_button_scanner == BUTTON_SCANNER_GPIO && i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    int gpio_num = g_button_data[i].gpio_num;
+    push_record(&_sampler_ring, TRACE_RECORD_GPIO, gpio_num, hal_gpio_get_level(gpio_num), _start_us);
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    int levels = (hal_gpio_get_level(g_encoder_data[i].left_gpio_num) << 1) | hal_gpio_get_level(g_encoder_data[i].right_gpio_num);
+    push_record(&_isr_ring, TRACE_RECORD_ENCODER, i, levels, _start_us);
+  }
+
+  __atomic_store_n(&_state, TRACE_STATE_RECORDING, __ATOMIC_RELEASE);
+  ESP_LOGI(TAG, "Recording to %s.", path);
+  return ESP_OK;
+}
+
+/// @brief Stop recording, flush the pending records and close the file.
+void stop_trace(void) {
+  int expected = TRACE_STATE_RECORDING;
+  __atomic_compare_exchange_n(&_state, &expected, TRACE_STATE_STOPPING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/// @brief Record the ADC conversions of one read, spread back over the conversion period.
+/// @param samples The conversions.
+/// @param num_of_samples The number of conversions.
+/// @param time_us The time of the read, the last conversion, in microseconds.
+void trace_adc_samples(const hal_adc_sample_t* samples, uint32_t num_of_samples, int64_t time_us) {
+  if (!is_trace_recording()) {
+    return;
+  }
+  uint32_t freq = _header.adc_sample_freq_hz;
+  for (uint32_t i = 0; i < num_of_samples; i++) {
+    int64_t sample_time_us = freq != 0 ? time_us - (int64_t)(num_of_samples - 1 - i) * 1000000 / freq : time_us;
+    push_record(&_sampler_ring, TRACE_RECORD_ADC, samples[i].channel, samples[i].raw, sample_time_us);
+  }
+}
+
+/// @brief Record a button GPIO level, on the sampler task.
+/// @param gpio_num The GPIO number.
+/// @param level The level.
+/// @param time_us The sample time in microseconds.
+void trace_gpio_level(int gpio_num, int level, int64_t time_us) {
+  if (!is_trace_recording()) {
+    return;
+  }
+  push_record(&_sampler_ring, TRACE_RECORD_GPIO, gpio_num, level, time_us);
+}
+
+/// @brief Record the encoder GPIO levels, from the encoder ISR.
+/// @param encoder_num The encoder number.
+/// @param levels The levels, left << 1 | right.
+/// @param time_us The time of the levels in microseconds.
+void IRAM_ATTR trace_encoder_levels(int encoder_num, int levels, int64_t time_us) {
+  if (!is_trace_recording()) {
+    return;
+  }
+  push_record(&_isr_ring, TRACE_RECORD_ENCODER, encoder_num, levels, time_us);
+}
+
+/// @brief Record the encoder GPIO levels a pulse counter went through, on the sampler task.
+/// @param encoder_num The encoder number.
+/// @param levels The levels before the steps, left << 1 | right.
+/// @param steps The counter change, every step is one transition of the Gray code.
+/// @param from_us The time of the previous read in microseconds.
+/// @param to_us The time of this read, the transitions are spread evenly up to it.
+void trace_encoder_steps(int encoder_num, int levels, int32_t steps, int64_t from_us, int64_t to_us) {
+  if (!is_trace_recording() || steps == 0) {
+    return;
+  }
+  // The levels of the phases 00, 01, 11, 10, the mapping is its own inverse.
+  static const uint8_t GRAY[4] = {0b00, 0b01, 0b11, 0b10};
+  int32_t direction = steps > 0 ? 1 : -1;
+  int32_t count = steps * direction;
+  int32_t first = 1;
+  if (count > TRACE_MAX_ENCODER_STEPS) {
+    first = count - TRACE_MAX_ENCODER_STEPS + 1;
+    __atomic_fetch_add(&_dropped, first - 1, __ATOMIC_RELAXED);
+  }
+  int phase = (GRAY[levels] + direction * (first - 1)) & 3;
+  for (int32_t i = first; i <= count; i++) {
+    phase = (phase + direction) & 3;
+    push_record(&_sampler_ring, TRACE_RECORD_ENCODER, encoder_num, GRAY[phase], from_us + (to_us - from_us) * i / count);
+  }
+}
+
+/// @brief Write the pending records of a ring to the file.
+/// @param ring The ring.
+/// @return False if the file could not be written.
+static bool write_ring(trace_ring_t* ring) {
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    // Write up to the end of the ring, or a block.
+    uint32_t count = tail - head;
+    uint32_t contiguous = ring->size - head % ring->size;
+    count = count < contiguous ? count : contiguous;
+    count = count < TRACE_WRITE_BLOCK_SIZE ? count : TRACE_WRITE_BLOCK_SIZE;
+    if (fwrite(&ring->records[head % ring->size], sizeof(trace_record_t), count, _file) != count) {
+      return false;
+    }
+    head += count;
+    _written += count;
+    // Hand the slots back to the producer.
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+/// @brief Write the buffered records to the file, on a low priority task.
+/// The records are in time order per ring, a reader must sort them.
+void flush_trace(void) {
+  int state = __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+  if (state == TRACE_STATE_IDLE) {
+    return;
+  }
+
+  if (!write_ring(&_sampler_ring) || !write_ring(&_isr_ring)) {
+    ESP_LOGE(TAG, "Failed to write the trace, the storage may be full.");
+    stop_trace();
+    state = TRACE_STATE_STOPPING;
+  }
+
+  if (state == TRACE_STATE_STOPPING) {
+    // Keep the dropped count in the header, so a replay knows the trace has gaps.
+    _header.dropped = __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+    if (fseek(_file, 0, SEEK_SET) == 0) {
+      fwrite(&_header, sizeof(_header), 1, _file);
+    }
+    fclose(_file);
+    _file = NULL;
+    ESP_LOGI(TAG, "Recorded %lu records, dropped %lu.", _written, _header.dropped);
+    __atomic_store_n(&_state, TRACE_STATE_IDLE, __ATOMIC_RELEASE);
+  }
+}
+
+/// @brief Get the recording statistics.
+/// @param records The number of records written.
+/// @param dropped The number of records dropped because the ring buffer was full.
+void get_trace_stats(uint32_t* records, uint32_t* dropped) {
+  *records = _written;
+  *dropped = __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+/// @brief Trace task.
+/// @param pvParameters Task parameters.
+void trace_task(void* pvParameters) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(NAGI_TRACE_FLUSH_INTERVAL));
+    flush_trace();
+  }
+}
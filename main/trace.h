@@ -0,0 +1,103 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+// 'N' | 'J' << 8 | 'T' << 16 | 'R' << 24, "NJTR" in the file.
+#define TRACE_MAGIC 0x52544A4E
+#define TRACE_VERSION 1
+
+// The most encoder transitions recorded per pulse counter read, the older ones of a faster spin are dropped.
+#define TRACE_MAX_ENCODER_STEPS 32
+
+/// @brief The kind of a trace record.
+typedef enum {
+  // A raw ADC conversion code, as read_axis() got it from the driver.
+  TRACE_RECORD_ADC = 1,
+  // A button GPIO level, as read_button() sampled it.
+  TRACE_RECORD_GPIO = 2,
+  // The encoder GPIO levels, as the encoder ISR read them.
+  TRACE_RECORD_ENCODER = 3,
+} trace_record_type_t;
+
+/// @brief The trace file header, followed by the records in time order.
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  // The ADC conversion rate of the recording.
+  uint32_t adc_sample_freq_hz;
+  // The number of records dropped because the ring buffer was full.
+  uint32_t dropped;
+} trace_header_t;
+
+/// @brief A timestamped raw sample.
+typedef struct __attribute__((packed)) {
+  // The time since the recording started in microseconds, so a trace lasts at most 71 minutes.
+  uint32_t time_us;
+  // The trace_record_type_t.
+  uint8_t type;
+  // The ADC channel, the GPIO number or the encoder number.
+  uint8_t index;
+  // The raw ADC code, the GPIO level or the encoder levels, left << 1 | right.
+  uint16_t value;
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 8, "The trace record must have no padding.");
+
+/// @brief Start recording into a file, the file is overwritten.
+/// @param path The file path.
+/// @param adc_sample_freq_hz The ADC conversion rate, stored in the header.
+/// @return The result.
+esp_err_t start_trace(const char* path, uint32_t adc_sample_freq_hz);
+
+/// @brief Stop recording, flush the pending records and close the file.
+void stop_trace(void);
+
+/// @brief Check a recording is running.
+/// @return True if recording.
+bool is_trace_recording(void);
+
+/// @brief Record the ADC conversions of one read, spread back over the conversion period.
+/// @param samples The conversions.
+/// @param num_of_samples The number of conversions.
+/// @param time_us The time of the read, the last conversion, in microseconds.
+void trace_adc_samples(const hal_adc_sample_t* samples, uint32_t num_of_samples, int64_t time_us);
+
+/// @brief Record a button GPIO level, on the sampler task.
+/// @param gpio_num The GPIO number.
+/// @param level The level.
+/// @param time_us The sample time in microseconds.
+void trace_gpio_level(int gpio_num, int level, int64_t time_us);
+
+/// @brief Record the encoder GPIO levels, from the encoder ISR.
+/// @param encoder_num The encoder number.
+/// @param levels The levels, left << 1 | right.
+/// @param time_us The time of the levels in microseconds.
+void trace_encoder_levels(int encoder_num, int levels, int64_t time_us);
+
+/// @brief Record the encoder GPIO levels a pulse counter went through since its last read, on the sampler task.
+/// A faster spin than TRACE_MAX_ENCODER_STEPS per read drops its older transitions.
+/// @param encoder_num The encoder number.
+/// @param levels The levels before the steps, left << 1 | right.
+/// @param steps The counter change, every step is one transition of the Gray code.
+/// @param from_us The time of the previous read in microseconds.
+/// @param to_us The time of this read, the transitions are spread evenly up to it.
+void trace_encoder_steps(int encoder_num, int levels, int32_t steps, int64_t from_us, int64_t to_us);
+
+/// @brief Write the buffered records to the file, on a low priority task.
+void flush_trace(void);
+
+/// @brief Get the recording statistics.
+/// @param records The number of records written.
+/// @param dropped The number of records dropped because the ring buffer was full.
+void get_trace_stats(uint32_t* records, uint32_t* dropped);
+
+/// @brief Trace task, flushes the ring buffer to the file while recording.
+/// @param pvParameters Task parameters.
+void trace_task(void* pvParameters);
+
+#endif // __TRACE_H__
@@ -0,0 +1,1622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+#include "common.h"
+#include "encoder.h"
+#include "button.h"
+#include "button_scanner.h"
+#include "trace.h"
+#include "axis.h"
+#include "replay.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/// @brief The benchmark options.
+typedef struct {
+  // The iterations of every measured loop.
+  uint32_t iterations;
+  // The repetitions of every measurement, the fastest one is reported.
+  uint32_t repeat;
+  uint32_t seed;
+  // The presses of the debounce evaluation.
+  uint32_t presses;
+  // The contact glitches per second of the debounce evaluation.
+  double glitch_rate;
+  // The trace whose ADC conversions the filter evaluation replays, NULL for the generated scenes.
+  const char* replay_path;
+} bench_options_t;
+
+static bench_options_t _options;
+
+/// @brief The firmware wakes the sampler from the input interrupts, nothing to wake here.
+void notify_input_from_isr(void) {
+}
+
+/// @brief The benchmarks run no task, a blocked task only advances the clock.
+/// @param time_us The time in microseconds.
+void sim_wait(int64_t time_us) {
+  sim_advance_time(time_us);
+}
+
+/// @brief Get the host monotonic time.
+/// @return The time in nanoseconds.
+static int64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The Gray code sequence 00, 01, 11, 10 counts up.
+static const int GRAY_LEFT[4] = {0, 0, 1, 1};
+static const int GRAY_RIGHT[4] = {0, 1, 1, 0};
+
+/// @brief The encoder ISR before the decode table, a switch on the transition, kept as the reference.
+/// @param arg The encoder number.
+static void legacy_encoder_isr_handler(void* arg) {
+  static int64_t counter;
+  static uint8_t left_last_state = 1;
+  static uint8_t right_last_state = 1;
+  int encoder_num = (int)(intptr_t)arg;
+  encoder_t* encoder = &g_encoder_data[encoder_num];
+
+  int left_state = hal_gpio_get_level(encoder->left_gpio_num);
+  int right_state = hal_gpio_get_level(encoder->right_gpio_num);
+  int current = (left_state << 1) | right_state;
+#if NAGI_TRACE
+  trace_encoder_levels(encoder_num, current, hal_get_time_us());
+#endif
+  int last = (left_last_state << 1) | right_last_state;
+  int transition = (last << 2) | current;
+  switch (transition) {
+    case 0b0001:
+    case 0b0111:
+    case 0b1110:
+    case 0b1000:
+      counter++;
+      break;
+    case 0b0010:
+    case 0b1011:
+    case 0b1101:
+    case 0b0100:
+      counter--;
+      break;
+    default:
+      break;
+  }
+  left_last_state = left_state;
+  right_last_state = right_state;
+  __asm__ volatile("" : : "r"(counter) : "memory");
+#if NAGI_SYNC_EVENT_DRIVEN
+  notify_input_from_isr();
+#endif
+}
+
+/// @brief The decode of the legacy ISR alone, on the levels of a walk.
+/// @param levels The levels, left << 1 | right.
+/// @param count The number of levels.
+/// @return The counter.
+static __attribute__((noinline)) int64_t decode_switch(const uint8_t* levels, uint32_t count) {
+  int64_t counter = 0;
+  int last = levels[0];
+  for (uint32_t i = 1; i < count; i++) {
+    int current = levels[i];
+    switch ((last << 2) | current) {
+      case 0b0001:
+      case 0b0111:
+      case 0b1110:
+      case 0b1000:
+        counter++;
+        break;
+      case 0b0010:
+      case 0b1011:
+      case 0b1101:
+      case 0b0100:
+        counter--;
+        break;
+      default:
+        break;
+    }
+    last = current;
+  }
+  return counter;
+}
+
+/// @brief The decode of the firmware ISR alone, a copy of its table.
+/// @param levels The levels, left << 1 | right.
+/// @param count The number of levels.
+/// @return The counter.
+static __attribute__((noinline)) int32_t decode_table(const uint8_t* levels, uint32_t count) {
+  static const int8_t DECODE[16] = {0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0};
+  int32_t counter = 0;
+  int last = levels[0];
+  for (uint32_t i = 1; i < count; i++) {
+    int current = levels[i];
+    counter += DECODE[(last << 2) | current];
+    last = current;
+  }
+  return counter;
+}
+
+/// @brief Time a decode kernel over the levels of a walk, the fastest of the repetitions.
+/// @param is_table True for the table, false for the switch.
+/// @param levels The levels.
+/// @param count The number of levels.
+/// @return The time per transition in nanoseconds.
+static double time_decode(bool is_table, const uint8_t* levels, uint32_t count) {
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    int64_t start_ns = get_time_ns();
+    int64_t counter = is_table ? decode_table(levels, count) : decode_switch(levels, count);
+    __asm__ volatile("" : : "r"(counter) : "memory");
+    double ns = (double)(get_time_ns() - start_ns) / count;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+/// @brief Build a random walk of quadrature phases, a reversal with the given probability per step.
+/// @param phases The phases to fill.
+/// @param count The number of phases.
+/// @param reversal The probability to reverse the direction.
+static void build_walk(uint8_t* phases, uint32_t count, double reversal) {
+  uint32_t random = _options.seed;
+  int phase = 2;
+  int direction = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    if (roll_random(&random, reversal)) {
+      direction = -direction;
+    }
+    phase = (phase + direction) & 3;
+    phases[i] = phase;
+  }
+}
+
+/// @brief Time a handler over a walk, the fastest of the repetitions.
+/// @param handler The handler, NULL to time the GPIO changes alone.
+/// @param phases The walk.
+/// @param count The number of phases.
+/// @return The time per transition in nanoseconds.
+static double time_encoder_handler(hal_isr_t handler, const uint8_t* phases, uint32_t count) {
+  const encoder_t* encoder = &g_encoder_data[0];
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    int64_t start_ns = get_time_ns();
+    for (uint32_t i = 0; i < count; i++) {
+      // The interrupts are off, so the handler runs once per transition as the GPIO ISR would.
+      int phase = phases[i];
+      sim_set_gpio_level(encoder->left_gpio_num, GRAY_LEFT[phase]);
+      sim_set_gpio_level(encoder->right_gpio_num, GRAY_RIGHT[phase]);
+      if (handler != NULL) {
+        handler((void*)(intptr_t)0);
+      }
+    }
+    double ns = (double)(get_time_ns() - start_ns) / count;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+/// @brief The legacy counter as a 32-bit core keeps an int64_t, two words.
+typedef struct {
+  volatile uint32_t low;
+  volatile uint32_t high;
+} legacy_counter_t;
+
+/// @brief Step the legacy counter as the ISR did, an int64_t add on RV32 stores the low word, then the high word.
+/// @param counter The counter.
+/// @param step The step.
+static void step_legacy_counter(legacy_counter_t* counter, int step) {
+  uint64_t value = ((uint64_t)counter->high << 32 | counter->low) + (int64_t)step;
+  counter->low = (uint32_t)value;
+  counter->high = (uint32_t)(value >> 32);
+}
+
+/// @brief Read a counter while the ISR preempts every read, a read that is neither the value before nor after the
+/// ISR is torn.
+/// @param is_legacy True for the legacy two-word counter, false for the firmware counter.
+/// @param phases The walk the ISR follows.
+/// @param count The number of phases.
+/// @return The number of torn reads.
+static uint64_t stress_encoder_counter(bool is_legacy, const uint8_t* phases, uint32_t count) {
+  const encoder_t* encoder = &g_encoder_data[0];
+  legacy_counter_t legacy = {0, 0};
+  uint8_t last = phases[0];
+  uint64_t torn = 0;
+  sim_set_gpio_level(encoder->left_gpio_num, GRAY_LEFT[last]);
+  sim_set_gpio_level(encoder->right_gpio_num, GRAY_RIGHT[last]);
+  encoder_isr_handler((void*)(intptr_t)0);
+  for (uint32_t i = 1; i < count; i++) {
+    int64_t before;
+    int64_t after;
+    int64_t value;
+    if (is_legacy) {
+      // The sampler loads the low word, the ISR lands before it loads the high word. A step across zero borrows
+      // into the high word, so turning back and forth around the start tears the read.
+      before = (int64_t)((uint64_t)legacy.high << 32 | legacy.low);
+      uint32_t low = legacy.low;
+      int step = ((phases[i] - last) & 3) == 1 ? 1 : -1;
+      step_legacy_counter(&legacy, step);
+      uint32_t high = legacy.high;
+      value = (int64_t)((uint64_t)high << 32 | low);
+      after = (int64_t)((uint64_t)legacy.high << 32 | legacy.low);
+    } else {
+      // The counter is one word, the ISR lands before or after the single load, never inside it.
+      before = get_encoder_counter(0);
+      sim_set_gpio_level(encoder->left_gpio_num, GRAY_LEFT[phases[i]]);
+      sim_set_gpio_level(encoder->right_gpio_num, GRAY_RIGHT[phases[i]]);
+      encoder_isr_handler((void*)(intptr_t)0);
+      value = get_encoder_counter(0);
+      after = value;
+    }
+    last = phases[i];
+    if (value != before && value != after) {
+      torn++;
+    }
+  }
+  return torn;
+}
+
+/// @brief Benchmark the encoder decode and stress its counter.
+/// @return The process exit code.
+static int bench_encoder(void) {
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    g_encoder_backends[i] = ENCODER_BACKEND_ISR;
+  }
+  initialize_encoder();
+  const encoder_t* encoder = &g_encoder_data[0];
+  // The handlers are called directly, so the simulated interrupt does not run them twice.
+  hal_gpio_config_input((1ULL << encoder->left_gpio_num) | (1ULL << encoder->right_gpio_num), false);
+
+  uint8_t* phases = malloc(_options.iterations);
+  const double reversals[] = {0.0, 0.1, 0.5};
+  uint8_t* levels = malloc(_options.iterations);
+  printf("decode: ns per transition on the host CPU, the decode alone and the whole handler with the GPIO reads\n");
+  for (size_t i = 0; i < sizeof(reversals) / sizeof(reversals[0]); i++) {
+    build_walk(phases, _options.iterations, reversals[i]);
+    for (uint32_t j = 0; j < _options.iterations; j++) {
+      levels[j] = (GRAY_LEFT[phases[j]] << 1) | GRAY_RIGHT[phases[j]];
+    }
+    double switch_ns = time_decode(false, levels, _options.iterations);
+    double decode_ns = time_decode(true, levels, _options.iterations);
+    printf(
+      "  reversal %.1f decode:  switch %.2f ns, table %.2f ns (%.0f%%)\n",
+      reversals[i], switch_ns, decode_ns, switch_ns > 0 ? decode_ns * 100 / switch_ns : 0
+    );
+    double gpio_ns = time_encoder_handler(NULL, phases, _options.iterations);
+    double legacy_ns = time_encoder_handler(legacy_encoder_isr_handler, phases, _options.iterations) - gpio_ns;
+    double table_ns = time_encoder_handler(encoder_isr_handler, phases, _options.iterations) - gpio_ns;
+    printf(
+      "  reversal %.1f handler: switch %.2f ns, table %.2f ns (%.0f%%)\n",
+      reversals[i], legacy_ns, table_ns, legacy_ns > 0 ? table_ns * 100 / legacy_ns : 0
+    );
+  }
+
+  // Every read is preempted, on a walk that reverses half the time so it keeps crossing zero.
+  build_walk(phases, _options.iterations, 0.5);
+  uint64_t legacy_torn = stress_encoder_counter(true, phases, _options.iterations);
+  uint64_t table_torn = stress_encoder_counter(false, phases, _options.iterations);
+  printf(
+    "tearing: %u reads preempted by the ISR, int64_t counter torn %llu, int32_t counter torn %llu\n",
+    _options.iterations - 1, (unsigned long long)legacy_torn, (unsigned long long)table_torn
+  );
+  free(levels);
+  free(phases);
+  return 0;
+}
+
+/// @brief The button data of the loop before the vertical counters, one state machine per button.
+typedef struct {
+  gpio_num_t gpio_num;
+  uint8_t current_state;
+  uint8_t last_state;
+  uint32_t current_tick;
+  uint32_t last_tick;
+  uint8_t stable_state;
+  uint8_t changed;
+} legacy_button_t;
+
+static legacy_button_t _legacy_buttons[32];
+
+/// @brief The read_button() loop before the vertical counters, kept as the reference.
+/// @param num_of_buttons The number of buttons.
+static void legacy_read_button(int num_of_buttons) {
+  for (int i = 0; i < num_of_buttons; i++) {
+    legacy_button_t* button = &_legacy_buttons[i];
+    button->last_state = button->current_state;
+    button->current_state = hal_gpio_get_level(button->gpio_num);
+    button->current_tick = xTaskGetTickCount();
+    if (button->current_state != button->last_state) {
+      button->last_tick = button->current_tick;
+#if NAGI_TRACE
+      trace_gpio_level(button->gpio_num, button->current_state, hal_get_time_us());
+#endif
+    }
+    uint32_t diff = button->current_tick - button->last_tick;
+    if (diff > pdMS_TO_TICKS(NAGI_BUTTON_JITTER_THRESHOLD)) {
+      button->changed = button->current_state != button->stable_state;
+      button->stable_state = button->current_state;
+    }
+  }
+}
+
+/// @brief The read_button() of the vertical counters on the first GPIOs.
+/// @param debouncer The debouncer.
+/// @param pin_mask The GPIOs of the buttons.
+/// @param last_levels The levels of the last read.
+/// @param states The debounced button levels.
+static void bitwise_read_button(button_debouncer_t* debouncer, uint32_t pin_mask, uint32_t* last_levels, uint32_t* states) {
+  uint32_t levels = hal_gpio_get_levels() & pin_mask;
+  int64_t now_us = hal_get_time_us();
+#if NAGI_TRACE
+  for (uint32_t edges = levels ^ *last_levels; edges != 0; edges &= edges - 1) {
+    int gpio_num = __builtin_ctz(edges);
+    trace_gpio_level(gpio_num, (levels >> gpio_num) & 1, now_us);
+  }
+#endif
+  *last_levels = levels;
+  // The buttons are on GPIO 0 to n - 1, so the GPIO bit is the button bit.
+  *states ^= debounce_buttons(debouncer, levels, 1);
+}
+
+/// @brief Time a button read per poll, the fastest of the repetitions.
+/// @param num_of_buttons The number of buttons, -1 to time the GPIO changes alone.
+/// @param is_bitwise True for the vertical counters, false for the legacy loop.
+/// @param flips The GPIO to flip before every poll, -1 for none.
+/// @return The time per poll in nanoseconds.
+static double time_button_read(int num_of_buttons, bool is_bitwise, const int8_t* flips) {
+  uint32_t pin_mask = num_of_buttons == 32 ? UINT32_MAX : (1u << num_of_buttons) - 1;
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    button_debouncer_t debouncer = {.state = hal_gpio_get_levels() & pin_mask};
+    uint32_t last_levels = debouncer.state;
+    uint32_t states = 0;
+    int64_t time_us = hal_get_time_us();
+    int64_t start_ns = get_time_ns();
+    for (uint32_t i = 0; i < _options.iterations; i++) {
+      // One poll per millisecond, with the bounces of the walk.
+      time_us += 1000;
+      sim_advance_time(time_us);
+      if (flips[i] >= 0) {
+        sim_set_gpio_level(flips[i], !hal_gpio_get_level(flips[i]));
+      }
+      if (num_of_buttons < 0) {
+        continue;
+      }
+      if (is_bitwise) {
+        bitwise_read_button(&debouncer, pin_mask, &last_levels, &states);
+      } else {
+        legacy_read_button(num_of_buttons);
+      }
+    }
+    __asm__ volatile("" : : "r"(states) : "memory");
+    double ns = (double)(get_time_ns() - start_ns) / _options.iterations;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+/// @brief Benchmark the button read, the legacy loop against the vertical counters, as the buttons grow.
+/// @return The process exit code.
+static int bench_button(void) {
+  hal_gpio_config_input(UINT32_MAX, false);
+  for (int i = 0; i < 32; i++) {
+    _legacy_buttons[i] = (legacy_button_t){.gpio_num = i};
+  }
+
+  // A GPIO flips on one poll in four, so there is bounce to debounce.
+  int8_t* flips = malloc(_options.iterations);
+  uint32_t random = _options.seed;
+  for (uint32_t i = 0; i < _options.iterations; i++) {
+    flips[i] = roll_random(&random, 0.25) ? (int8_t)(next_random(&random) % 8) : -1;
+  }
+  double gpio_ns = time_button_read(-1, false, flips);
+
+  const int button_counts[] = {8, 16, 24, 32};
+  printf("button: ns per poll on the host CPU, the GPIO changes excluded\n");
+  for (size_t i = 0; i < sizeof(button_counts) / sizeof(button_counts[0]); i++) {
+    double legacy_ns = time_button_read(button_counts[i], false, flips) - gpio_ns;
+    double bitwise_ns = time_button_read(button_counts[i], true, flips) - gpio_ns;
+    printf(
+      "  %2d buttons: loop %.2f ns, vertical counters %.2f ns (%.0f%%)\n",
+      button_counts[i], legacy_ns, bitwise_ns, legacy_ns > 0 ? bitwise_ns * 100 / legacy_ns : 0
+    );
+  }
+  free(flips);
+  return 0;
+}
+
+// The longest contact bounce of a press or release, as the edges in a burst.
+#define DEBOUNCE_MAX_BOUNCES 8
+
+/// @brief A reference transition of the debounce evaluation, and what the firmware reported for it.
+typedef struct {
+  // The time of the first edge.
+  int64_t time_us;
+  // The level the button settles at, 0 when pressed.
+  int level;
+  bool is_detected;
+} debounce_window_t;
+
+/// @brief The outcome of a debounce policy on the bouncing waveforms.
+typedef struct {
+  histogram_t press_latency;
+  histogram_t release_latency;
+  // The reports that were not the first report of the new level of a transition.
+  uint64_t false_edges;
+  // The transitions never reported.
+  uint64_t missed;
+} debounce_result_t;
+
+/// @brief Get a random number in a range.
+/// @param random The generator state.
+/// @param min The minimum.
+/// @param max The maximum, inclusive.
+/// @return The number.
+static int64_t get_bench_random_range(uint32_t* random, int64_t min, int64_t max) {
+  return min + next_random(random) % (uint64_t)(max - min + 1);
+}
+
+/// @brief Get the time to the next random event.
+/// @param random The generator state.
+/// @param rate The events per second.
+/// @return The interval in microseconds.
+static int64_t get_bench_random_interval(uint32_t* random, double rate) {
+  double u = (next_random(random) + 1.0) / 4294967297.0;
+  return (int64_t)(-log(u) / rate * 1000000);
+}
+
+/// @brief Set the button level and read the buttons, on every edge as the interrupt wakes the sampler.
+/// @param gpio_num The GPIO of the button.
+/// @param level The level.
+/// @param time_us The time in microseconds.
+/// @param window The current transition.
+/// @param result The outcome to update.
+static void drive_debounce_read(int gpio_num, int level, int64_t time_us, debounce_window_t* window, debounce_result_t* result) {
+  sim_advance_time(time_us);
+  if (level >= 0) {
+    sim_set_gpio_level(gpio_num, level);
+  }
+  read_button();
+  if ((g_button_changes[0] & 1) == 0) {
+    return;
+  }
+  int reported = g_button_states[0] & 1;
+  if (!window->is_detected && reported == window->level) {
+    window->is_detected = true;
+    record_histogram(reported == 0 ? &result->press_latency : &result->release_latency, time_us - window->time_us);
+  } else {
+    result->false_edges++;
+  }
+}
+
+/// @brief Run the button reads over a bouncing waveform until a time, polled every sample period.
+/// @param gpio_num The GPIO of the button.
+/// @param edges The edge times, the level alternates from the current one.
+/// @param num_of_edges The number of edges.
+/// @param end_us The time to run until.
+/// @param time_us The current time, updated.
+/// @param window The current transition.
+/// @param result The outcome to update.
+static void run_debounce_waveform(
+  int gpio_num, const int64_t* edges, int num_of_edges, int64_t end_us, int64_t* time_us,
+  debounce_window_t* window, debounce_result_t* result
+) {
+  int next_edge = 0;
+  int64_t next_poll_us = (*time_us / NAGI_BUTTON_SAMPLE_US + 1) * NAGI_BUTTON_SAMPLE_US;
+  while (true) {
+    int64_t edge_us = next_edge < num_of_edges ? edges[next_edge] : INT64_MAX;
+    int64_t next_us = edge_us < next_poll_us ? edge_us : next_poll_us;
+    if (next_us >= end_us) {
+      break;
+    }
+    *time_us = next_us;
+    if (next_us == edge_us) {
+      drive_debounce_read(gpio_num, !hal_gpio_get_level(gpio_num), next_us, window, result);
+      next_edge++;
+    } else {
+      drive_debounce_read(gpio_num, -1, next_us, window, result);
+      next_poll_us += NAGI_BUTTON_SAMPLE_US;
+    }
+  }
+  *time_us = end_us;
+}
+
+/// @brief Evaluate a debounce policy on bouncing presses and releases with glitches in between.
+/// @param debounce The policy.
+/// @param result The outcome to fill.
+static void evaluate_debounce(button_debounce_t debounce, debounce_result_t* result) {
+  *result = (debounce_result_t){0};
+  const int gpio_num = g_button_data[0].gpio_num;
+  sim_set_gpio_level(gpio_num, 1);
+  int64_t time_us = hal_get_time_us() + 100000;
+  drive_debounce_read(gpio_num, -1, time_us, &(debounce_window_t){.level = 1, .is_detected = true}, result);
+  set_button_debounce(0, debounce);
+  result->false_edges = 0;
+
+  // The same waveforms for every policy.
+  uint32_t random = _options.seed;
+  int64_t edges[DEBOUNCE_MAX_BOUNCES + 1 + 64];
+  for (uint32_t i = 0; i < _options.presses * 2; i++) {
+    // A press, then a release, each a burst of bounces that ends at the new level.
+    int level = i % 2 == 0 ? 0 : 1;
+    debounce_window_t window = {.time_us = time_us, .level = level};
+    int num_of_edges = (int)get_bench_random_range(&random, 0, DEBOUNCE_MAX_BOUNCES / 2) * 2 + 1;
+    int64_t edge_us = time_us;
+    for (int j = 0; j < num_of_edges; j++) {
+      edges[j] = edge_us;
+      edge_us += get_bench_random_range(&random, 20, 1000);
+    }
+    // Held for 20 to 150 ms, released for 50 to 300 ms, the contact glitches for 5 to 100 us meanwhile.
+    int64_t end_us = level == 0 ? edge_us + get_bench_random_range(&random, 20000, 150000) : edge_us + get_bench_random_range(&random, 50000, 300000);
+    int64_t glitch_us = edge_us;
+    while (_options.glitch_rate > 0 && num_of_edges + 2 <= (int)(sizeof(edges) / sizeof(edges[0]))) {
+      glitch_us += get_bench_random_interval(&random, _options.glitch_rate);
+      int64_t width_us = get_bench_random_range(&random, 5, 100);
+      if (glitch_us + width_us >= end_us) {
+        break;
+      }
+      edges[num_of_edges++] = glitch_us;
+      edges[num_of_edges++] = glitch_us + width_us;
+      glitch_us += width_us;
+    }
+    run_debounce_waveform(gpio_num, edges, num_of_edges, end_us, &time_us, &window, result);
+    if (!window.is_detected) {
+      result->missed++;
+    }
+  }
+}
+
+/// @brief Evaluate the debounce policies on bouncing contacts.
+/// @return The process exit code.
+static int bench_debounce(void) {
+  initialize_button();
+  printf(
+    "debounce: %u presses, up to %d bounces of 20 to 1000 us, %.1f glitches per second of 5 to 100 us\n",
+    _options.presses, DEBOUNCE_MAX_BOUNCES, _options.glitch_rate
+  );
+  for (int i = 0; i <= BUTTON_DEBOUNCE_EAGER_PRESS; i++) {
+    debounce_result_t result;
+    evaluate_debounce((button_debounce_t)i, &result);
+    printf(
+      "%s: false edges %llu missed %llu\n", get_button_debounce_name((button_debounce_t)i),
+      (unsigned long long)result.false_edges, (unsigned long long)result.missed
+    );
+    print_histogram("  press latency", "us", &result.press_latency);
+    print_histogram("  release latency", "us", &result.release_latency);
+  }
+  return 0;
+}
+
+/// @brief Time full frames of a scanner, the bus time on the simulated clock and the debounce on the host CPU.
+/// @param scanner The scanner.
+/// @param press_button The function pressing a button.
+static void time_scanner(const button_scanner_t* scanner, void (*press_button)(int button_num, bool is_pressed)) {
+  // A quarter of the buttons are held, and one changes every frame.
+  uint32_t random = _options.seed;
+  for (uint32_t i = 0; i < scanner->num_of_inputs; i++) {
+    press_button(i, roll_random(&random, 0.25));
+  }
+  uint32_t num_of_words = (scanner->num_of_inputs + 31) / 32;
+  uint32_t levels[BUTTON_MAX_INPUTS / 32];
+  button_debouncer_t debouncers[BUTTON_MAX_INPUTS / 32];
+  scan_buttons(scanner, levels);
+  for (uint32_t w = 0; w < num_of_words; w++) {
+    debouncers[w] = (button_debouncer_t){.state = levels[w]};
+  }
+  uint32_t frames = _options.iterations / 10;
+  int64_t bus_us = 0;
+  int64_t debounce_ns = 0;
+  uint32_t changes = 0;
+  for (uint32_t f = 0; f < frames; f++) {
+    press_button(next_random(&random) % scanner->num_of_inputs, roll_random(&random, 0.25));
+    int64_t begin_us = hal_get_time_us();
+    scan_buttons(scanner, levels);
+    bus_us += hal_get_time_us() - begin_us;
+    int64_t begin_ns = get_time_ns();
+    for (uint32_t w = 0; w < num_of_words; w++) {
+      changes += __builtin_popcount(debounce_buttons(&debouncers[w], levels[w], 1));
+    }
+    debounce_ns += get_time_ns() - begin_ns;
+  }
+  printf(
+    "  %-6s %3lu inputs: bus %.1f us per frame (%.1f%% of a 1 ms report), debounce %.1f ns per frame, %u changes\n",
+    get_button_scanner_name(scanner->type), (unsigned long)scanner->num_of_inputs, (double)bus_us / frames,
+    (double)bus_us / frames / 10, (double)debounce_ns / frames, changes
+  );
+}
+
+// The matrix lines of the scan benchmark, the rows from GPIO 0 and the columns from GPIO 16.
+static uint32_t _bench_matrix_columns;
+
+/// @brief Press a button of the benchmark matrix.
+/// @param button_num The button number.
+/// @param is_pressed True to press.
+static void press_matrix_button(int button_num, bool is_pressed) {
+  sim_set_matrix_switch(button_num / _bench_matrix_columns, 16 + button_num % _bench_matrix_columns, is_pressed);
+}
+
+/// @brief Press a button of the benchmark shift register chain.
+/// @param button_num The button number.
+/// @param is_pressed True to press.
+static void press_shift_button(int button_num, bool is_pressed) {
+  sim_set_shift_in_level(button_num, !is_pressed);
+}
+
+/// @brief Benchmark full frames of the matrix and shift register scanners.
+/// @return The process exit code.
+static int bench_scan(void) {
+  printf(
+    "scan: matrix settle %d us, shift clock %d Hz, the bus time on the simulated clock, the debounce on the host CPU\n",
+    NAGI_BUTTON_MATRIX_SETTLE_US, NAGI_BUTTON_SHIFT_CLOCK_HZ
+  );
+  const uint8_t ROWS[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  const uint8_t COLUMNS[8] = {16, 17, 18, 19, 20, 21, 22, 23};
+  const uint32_t matrix_rows[] = {8, 16};
+  for (size_t i = 0; i < sizeof(matrix_rows) / sizeof(matrix_rows[0]); i++) {
+    button_scanner_t scanner;
+    _bench_matrix_columns = sizeof(COLUMNS);
+    if (create_matrix_scanner(&scanner, ROWS, matrix_rows[i], COLUMNS, sizeof(COLUMNS), NAGI_BUTTON_MATRIX_SETTLE_US) != ESP_OK) {
+      fprintf(stderr, "Failed to create the matrix scanner.\n");
+      return 1;
+    }
+    time_scanner(&scanner, press_matrix_button);
+  }
+  const uint32_t shift_bits[] = {64, 128};
+  for (size_t i = 0; i < sizeof(shift_bits) / sizeof(shift_bits[0]); i++) {
+    button_scanner_t scanner;
+    if (create_shift_scanner(&scanner, 24, 25, 26, shift_bits[i], NAGI_BUTTON_SHIFT_CLOCK_HZ) != ESP_OK) {
+      fprintf(stderr, "Failed to create the shift scanner.\n");
+      return 1;
+    }
+    time_scanner(&scanner, press_shift_button);
+  }
+  return 0;
+}
+
+// The most axes of the ADC benchmark, the channels of ADC1.
+#define ADC_BENCH_MAX_NUM_OF_AXES 7
+
+/// @brief Convert and demultiplex a frame as read_axis() did, through the calibration curve of the driver.
+/// @param samples The samples.
+/// @param count The number of samples.
+/// @param sums The sums of the axes to add to.
+static __attribute__((noinline)) void convert_frame_curve(const hal_adc_sample_t* samples, uint32_t count, int* sums) {
+  for (uint32_t i = 0; i < count; i++) {
+    int voltage;
+    if (hal_adc_raw_to_voltage(samples[i].channel, samples[i].raw, &voltage) == ESP_OK) {
+      sums[samples[i].channel] += voltage;
+    }
+  }
+}
+
+// The raw-to-millivolt tables of the axes and the axis of every channel, as initialize_axis() builds them.
+static uint16_t _adc_voltages[ADC_BENCH_MAX_NUM_OF_AXES][4096];
+static uint8_t _adc_channel_axes[8];
+
+/// @brief Convert and demultiplex a frame as read_axis() does, through the tables.
+/// @param samples The samples.
+/// @param count The number of samples.
+/// @param sums The sums of the axes to add to.
+static __attribute__((noinline)) void convert_frame_table(const hal_adc_sample_t* samples, uint32_t count, int* sums) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t axis = samples[i].channel < 8 ? _adc_channel_axes[samples[i].channel] : 0xFF;
+    if (axis < ADC_BENCH_MAX_NUM_OF_AXES) {
+      sums[axis] += _adc_voltages[axis][samples[i].raw & 4095];
+    }
+  }
+}
+
+/// @brief Time the conversion of frames, the fastest of the repetitions.
+/// @param samples The samples, frames of count back to back.
+/// @param num_of_frames The number of frames.
+/// @param count The samples per frame.
+/// @param is_table True for the tables, false for the curve.
+/// @return The time per frame in nanoseconds.
+static double time_adc_frames(const hal_adc_sample_t* samples, uint32_t num_of_frames, uint32_t count, bool is_table) {
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    int sums[ADC_BENCH_MAX_NUM_OF_AXES] = {0};
+    int64_t start_ns = get_time_ns();
+    for (uint32_t f = 0; f < num_of_frames; f++) {
+      if (is_table) {
+        convert_frame_table(&samples[f * count], count, sums);
+      } else {
+        convert_frame_curve(&samples[f * count], count, sums);
+      }
+    }
+    __asm__ volatile("" : : "r"(sums) : "memory");
+    double ns = (double)(get_time_ns() - start_ns) / num_of_frames;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+/// @brief Benchmark the raw-to-millivolt conversion of a 1 ms frame, the calibration curve against the table.
+/// @return The process exit code.
+static int bench_adc(void) {
+  // The boot cost, every code of every channel through the curve once. Axis i is channel 6 - i,
+  // so the demultiplex goes through the map as in read_axis().
+  memset(_adc_channel_axes, 0xFF, sizeof(_adc_channel_axes));
+  int64_t start_ns = get_time_ns();
+  for (int axis = 0; axis < ADC_BENCH_MAX_NUM_OF_AXES; axis++) {
+    _adc_channel_axes[ADC_BENCH_MAX_NUM_OF_AXES - 1 - axis] = axis;
+    for (int raw = 0; raw < 4096; raw++) {
+      int voltage;
+      hal_adc_raw_to_voltage(ADC_BENCH_MAX_NUM_OF_AXES - 1 - axis, raw, &voltage);
+      _adc_voltages[axis][raw] = voltage < 0 ? 0 : voltage;
+    }
+  }
+  printf(
+    "adc: tables of 4096 codes for %d channels built in %.1f us on the host CPU\n",
+    ADC_BENCH_MAX_NUM_OF_AXES, (double)(get_time_ns() - start_ns) / 1000
+  );
+
+  // Random walks of the axes, scanned round robin with the rate scaled by the axes, as the continuous mode does.
+  const uint32_t sample_rates[] = {1000, 4000, 10000};
+  const uint32_t axis_counts[] = {1, 2, 4, ADC_BENCH_MAX_NUM_OF_AXES};
+  printf("  ns per 1 ms frame on the host CPU, curve against tables, the rate is per axis\n");
+  for (size_t i = 0; i < sizeof(sample_rates) / sizeof(sample_rates[0]); i++) {
+    for (size_t j = 0; j < sizeof(axis_counts) / sizeof(axis_counts[0]); j++) {
+      uint32_t count = sample_rates[i] * axis_counts[j] / 1000;
+      uint32_t num_of_frames = _options.iterations / count;
+      num_of_frames = num_of_frames > 0 ? num_of_frames : 1;
+      hal_adc_sample_t* samples = malloc(sizeof(hal_adc_sample_t) * num_of_frames * count);
+      uint32_t random = _options.seed;
+      int raws[ADC_BENCH_MAX_NUM_OF_AXES];
+      for (uint32_t a = 0; a < axis_counts[j]; a++) {
+        raws[a] = 2048;
+      }
+      for (uint32_t k = 0; k < num_of_frames * count; k++) {
+        uint32_t axis = k % axis_counts[j];
+        raws[axis] += (int)(next_random(&random) % 65) - 32;
+        raws[axis] = raws[axis] < 0 ? 0 : (raws[axis] > 4095 ? 4095 : raws[axis]);
+        samples[k] = (hal_adc_sample_t){.channel = ADC_BENCH_MAX_NUM_OF_AXES - 1 - axis, .raw = raws[axis]};
+      }
+      double curve_ns = time_adc_frames(samples, num_of_frames, count, false);
+      double table_ns = time_adc_frames(samples, num_of_frames, count, true);
+      printf(
+        "  %5lu Hz, %lu axes, %2lu samples: curve %8.1f ns, table %7.1f ns (%.0f%%)\n",
+        (unsigned long)sample_rates[i], (unsigned long)axis_counts[j], (unsigned long)count, curve_ns, table_ns,
+        curve_ns > 0 ? table_ns * 100 / curve_ns : 0
+      );
+      free(samples);
+    }
+  }
+  return 0;
+}
+
+/// @brief Advance the clock, running the ADC ISR at the end of every frame on the way as the simulator does.
+/// @param time_us The time in microseconds.
+static void advance_adc_time(int64_t time_us) {
+  for (int64_t next_us = sim_get_next_timer_time(); next_us <= time_us; next_us = sim_get_next_timer_time()) {
+    sim_advance_time(next_us > hal_get_time_us() ? next_us : hal_get_time_us());
+    sim_run_timers();
+  }
+  sim_advance_time(time_us);
+}
+
+// The length of a filter scene, the time the filters settle first, and the lags searched.
+#define FILTER_SCENE_US 10000000
+#define FILTER_SETTLE_US 200000
+#define FILTER_MAX_LAG_MS 40
+// The half window of the speed that tells a moving axis from one at rest, and the speeds in mV/s.
+#define FILTER_SPEED_WINDOW_MS 10
+#define FILTER_MOVING_SPEED 20
+#define FILTER_REST_SPEED 5
+
+/// @brief A filter scene, a clean signal with the noise of the simulator, or the replayed trace.
+typedef struct {
+  const char* name;
+  // The clean signal in raw codes, NULL for the replay.
+  double (*signal)(int64_t time_us);
+} filter_scene_t;
+
+// The ADC channels of the axes, the scene drives the first.
+static const uint8_t FILTER_CHANNELS[] = NAGI_AXIS_ADC_CHANNELS;
+
+static const filter_scene_t* _filter_scene;
+static int64_t _filter_start_us;
+static uint32_t _filter_noise_random;
+static replay_trace_t _filter_trace;
+static uint32_t _filter_replay_channel;
+static size_t _filter_replay_cursor;
+
+/// @brief A scene at rest in the middle of the range.
+static double get_rest_signal(int64_t time_us) {
+  return 2048;
+}
+
+/// @brief A scene drifting slowly, a small and slow movement.
+static double get_drift_signal(int64_t time_us) {
+  return 2048 + 500.0 * time_us / FILTER_SCENE_US;
+}
+
+/// @brief A scene sweeping the range twice a second.
+static double get_sine_signal(int64_t time_us) {
+  return 2048 + 1200 * sin(2 * M_PI * 2 * time_us / 1e6);
+}
+
+/// @brief A scene of flicks across the range in 30 ms, held for a second in between.
+static double get_flick_signal(int64_t time_us) {
+  int64_t period = time_us / 1000000;
+  double from = period % 2 == 0 ? 3300 : 800;
+  double to = period % 2 == 0 ? 800 : 3300;
+  double x = (time_us % 1000000) / 30000.0;
+  x = x > 1 ? 1 : x;
+  return period == 0 ? to : from + (to - from) * x * x * (3 - 2 * x);
+}
+
+/// @brief The ADC input of the filter scenes.
+/// @param channel The ADC channel.
+/// @param time_us The conversion time in microseconds.
+/// @return The raw conversion code.
+static int get_filter_adc_signal(uint32_t channel, int64_t time_us) {
+  if (_filter_scene->signal == NULL) {
+    return get_replay_adc(&_filter_trace, _filter_replay_channel, time_us - _filter_start_us, &_filter_replay_cursor);
+  }
+  if (channel != FILTER_CHANNELS[0]) {
+    return 2048;
+  }
+  int noise = (int)(next_random(&_filter_noise_random) % 17) - 8;
+  return (int)lround(_filter_scene->signal(time_us - _filter_start_us)) + noise;
+}
+
+/// @brief Convert a raw code of the driven channel, as the axis tables do.
+/// @param raw The raw code.
+/// @return The voltage in millivolts.
+static double get_filter_voltage(double raw) {
+  int voltage;
+  int code = (int)lround(raw);
+  hal_adc_raw_to_voltage(FILTER_CHANNELS[0], code < 0 ? 0 : (code > 4095 ? 4095 : code), &voltage);
+  return voltage;
+}
+
+/// @brief Build the reference of a scene, the clean signal, or for the replay a centered average of the input.
+/// @param num_of_frames The number of 1 ms frames.
+/// @param reference The reference in millivolts to fill.
+static void build_filter_reference(uint32_t num_of_frames, double* reference) {
+  if (_filter_scene->signal != NULL) {
+    for (uint32_t f = 0; f < num_of_frames; f++) {
+      reference[f] = get_filter_voltage(_filter_scene->signal((int64_t)(f + 1) * 1000));
+    }
+    return;
+  }
+  double* means = malloc(sizeof(double) * num_of_frames);
+  size_t cursor = 0;
+  for (uint32_t f = 0; f < num_of_frames; f++) {
+    double sum = 0;
+    for (int k = 0; k < 4; k++) {
+      sum += get_filter_voltage(get_replay_adc(&_filter_trace, _filter_replay_channel, (int64_t)f * 1000 + k * 250, &cursor));
+    }
+    means[f] = sum / 4;
+  }
+  for (uint32_t f = 0; f < num_of_frames; f++) {
+    double sum = 0;
+    int count = 0;
+    for (int k = -5; k <= 5; k++) {
+      if ((int64_t)f + k >= 0 && f + k < num_of_frames) {
+        sum += means[f + k];
+        count++;
+      }
+    }
+    reference[f] = sum / count;
+  }
+  free(means);
+}
+
+/// @brief Run a scene through read_axis() with a filter, one read per millisecond as the sampler does.
+/// @param filter The filter.
+/// @param num_of_frames The number of 1 ms frames.
+/// @param output The reported voltages to fill.
+static void run_filter_scene(axis_filter_t filter, uint32_t num_of_frames, double* output) {
+  _filter_noise_random = _options.seed;
+  _filter_replay_cursor = 0;
+  sim_set_adc_signal(get_filter_adc_signal);
+  // The trace holds the conversions after the hardware filter.
+  sim_set_adc_filter(_filter_scene->signal != NULL);
+  initialize_axis();
+  set_axis_filter(0, filter);
+  _filter_start_us = hal_get_time_us();
+  start_axis();
+  for (uint32_t f = 0; f < num_of_frames; f++) {
+    advance_adc_time(_filter_start_us + (int64_t)(f + 1) * 1000);
+    read_axis();
+    output[f] = g_axes_voltages[0];
+  }
+  stop_axis();
+  deinitialize_axis();
+}
+
+/// @brief Evaluate the filters on a scene, the added latency and tracking error while moving and the noise at rest.
+/// @param scene The scene.
+/// @param num_of_frames The number of 1 ms frames.
+static void evaluate_filter_scene(const filter_scene_t* scene, uint32_t num_of_frames) {
+  _filter_scene = scene;
+  double* reference = malloc(sizeof(double) * num_of_frames);
+  double* output = malloc(sizeof(double) * num_of_frames);
+  build_filter_reference(num_of_frames, reference);
+
+  // Tell the moving frames from the ones at rest by the speed of the reference.
+  uint8_t* is_moving = malloc(num_of_frames);
+  uint32_t num_of_moving = 0;
+  uint32_t num_of_rest = 0;
+  uint32_t first = FILTER_SETTLE_US / 1000 + FILTER_MAX_LAG_MS;
+  for (uint32_t f = 0; f < num_of_frames; f++) {
+    is_moving[f] = 2;
+    if (f < first || f + FILTER_SPEED_WINDOW_MS >= num_of_frames) {
+      continue;
+    }
+    double speed = fabs(reference[f + FILTER_SPEED_WINDOW_MS] - reference[f - FILTER_SPEED_WINDOW_MS]) * 1000 / (2 * FILTER_SPEED_WINDOW_MS);
+    if (speed >= FILTER_MOVING_SPEED) {
+      is_moving[f] = 1;
+      num_of_moving++;
+    } else if (speed <= FILTER_REST_SPEED) {
+      is_moving[f] = 0;
+      num_of_rest++;
+    }
+  }
+
+  printf("  %-8s moving %5.1f s, rest %5.1f s\n", scene->name, num_of_moving / 1000.0, num_of_rest / 1000.0);
+  for (int filter = 0; filter <= AXIS_FILTER_ONE_EURO; filter++) {
+    run_filter_scene((axis_filter_t)filter, num_of_frames, output);
+
+    // The latency is the delay of the reference that best matches the output while moving.
+    double best_lag_ms = 0;
+    double best_error = 1e30;
+    for (int q = 0; q <= FILTER_MAX_LAG_MS * 4 && num_of_moving > 0; q++) {
+      double lag_ms = q / 4.0;
+      double error = 0;
+      for (uint32_t f = 0; f < num_of_frames; f++) {
+        if (is_moving[f] != 1) {
+          continue;
+        }
+        double position = f - lag_ms;
+        uint32_t index = (uint32_t)position;
+        double delayed = reference[index] + (reference[index + 1] - reference[index]) * (position - index);
+        error += (output[f] - delayed) * (output[f] - delayed);
+      }
+      if (error < best_error) {
+        best_error = error;
+        best_lag_ms = lag_ms;
+      }
+    }
+    double noise = 0;
+    uint32_t changes = 0;
+    for (uint32_t f = 1; f < num_of_frames; f++) {
+      if (is_moving[f] == 0) {
+        noise += (output[f] - reference[f]) * (output[f] - reference[f]);
+        changes += output[f] != output[f - 1];
+      }
+    }
+    printf("    %-9s", get_axis_filter_name((axis_filter_t)filter));
+    if (num_of_moving > 0) {
+      printf(" latency %5.2f ms, tracking %6.2f mV rms", best_lag_ms, sqrt(best_error / num_of_moving));
+    }
+    if (num_of_rest > 0) {
+      printf("%s noise %5.2f mV rms, %6.1f reports/s at rest", num_of_moving > 0 ? "," : "", sqrt(noise / num_of_rest), changes * 1000.0 / num_of_rest);
+    }
+    printf("\n");
+  }
+  free(is_moving);
+  free(output);
+  free(reference);
+}
+
+/// @brief Evaluate the axis filters on generated scenes, or on the ADC conversions of a recorded trace.
+/// @return The process exit code.
+static int bench_filter(void) {
+  printf(
+    "filter: axis 0 on ADC channel %d at %d Hz, one-euro min cutoff %d mHz, beta %d mHz per mV/s, deadband %d mV\n",
+    FILTER_CHANNELS[0], NAGI_AXIS_SAMPLE_FREQ_HZ, NAGI_AXIS_ONE_EURO_MIN_CUTOFF_MHZ, NAGI_AXIS_ONE_EURO_BETA,
+    NAGI_AXIS_JITTER_THRESHOLD
+  );
+  if (_options.replay_path != NULL) {
+    if (!load_replay_trace(_options.replay_path, &_filter_trace)) {
+      fprintf(stderr, "Failed to load the trace %s.\n", _options.replay_path);
+      return 1;
+    }
+    // The channel of the first axis, else the first channel the trace holds.
+    _filter_replay_channel = FILTER_CHANNELS[0];
+    for (uint32_t i = 0; i < REPLAY_MAX_ADC_CHANNELS && _filter_trace.num_of_adc[_filter_replay_channel] == 0; i++) {
+      _filter_replay_channel = i;
+    }
+    if (_filter_trace.num_of_adc[_filter_replay_channel] == 0) {
+      fprintf(stderr, "The trace holds no ADC conversion.\n");
+      free_replay_trace(&_filter_trace);
+      return 1;
+    }
+    const filter_scene_t scene = {.name = "replay"};
+    evaluate_filter_scene(&scene, _filter_trace.duration_us / 1000);
+    free_replay_trace(&_filter_trace);
+    return 0;
+  }
+  const filter_scene_t scenes[] = {
+    {"rest", get_rest_signal},
+    {"drift", get_drift_signal},
+    {"sine", get_sine_signal},
+    {"flick", get_flick_signal},
+  };
+  for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+    evaluate_filter_scene(&scenes[i], FILTER_SCENE_US / 1000);
+  }
+  return 0;
+}
+
+/// @brief Evaluate a profile at a voltage in floating point, as a host or a table-less firmware would on every sample.
+/// @param profile The profile.
+/// @param voltage The voltage in millivolts.
+/// @return The reported value.
+static __attribute__((noinline)) uint16_t evaluate_response(const axis_profile_t* profile, int voltage) {
+  double offset = voltage - profile->center;
+  double span = profile->max - profile->center;
+  bool is_positive = (offset >= 0) == (span >= 0);
+  if (!is_positive) {
+    span = profile->min - profile->center;
+  }
+  double deflection = fmin(offset / span, 1);
+  double deadzone = profile->deadzone / 100.0;
+  deflection = deflection <= deadzone ? 0 : (deflection - deadzone) / (1 - deadzone);
+  double output = deflection;
+  if (profile->curve.num_of_points > 0) {
+    double x0 = 0;
+    double y0 = 0;
+    output = -1;
+    for (uint32_t i = 0; i < profile->curve.num_of_points && output < 0; i++) {
+      double x1 = profile->curve.inputs[i] / 100.0;
+      double y1 = profile->curve.outputs[i] / 100.0;
+      if (deflection < x1) {
+        output = y0 + (y1 - y0) * (deflection - x0) / (x1 - x0);
+      }
+      x0 = x1;
+      y0 = y1;
+    }
+    output = output < 0 ? y0 : output;
+  }
+  return is_positive ? AXIS_CENTER_VALUE + (uint16_t)(output * 32767) : AXIS_CENTER_VALUE - (uint16_t)(output * 32768);
+}
+
+/// @brief Time the response of the samples, the fastest of the repetitions.
+/// @param profile The profile.
+/// @param values The compiled table of the profile, NULL to evaluate every sample.
+/// @param voltages The voltages of the samples.
+/// @param count The number of samples.
+/// @return The time per sample in nanoseconds.
+static double time_response(const axis_profile_t* profile, const uint16_t* values, const uint16_t* voltages, uint32_t count) {
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    uint32_t sum = 0;
+    int64_t start_ns = get_time_ns();
+    for (uint32_t i = 0; i < count; i++) {
+      sum += values != NULL ? values[voltages[i]] : evaluate_response(profile, voltages[i]);
+    }
+    __asm__ volatile("" : : "r"(sum) : "memory");
+    double ns = (double)(get_time_ns() - start_ns) / count;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+// The calibration sweep, at rest, then twice across the range and back to rest.
+#define RESPONSE_REST_US 200000
+#define RESPONSE_SWEEP_US 2000000
+
+/// @brief The ADC input of the calibration, the first axis sweeps from rest to both ends, the others rest.
+/// @param channel The ADC channel.
+/// @param time_us The conversion time in microseconds.
+/// @return The raw conversion code.
+static int get_response_adc_signal(uint32_t channel, int64_t time_us) {
+  time_us -= _filter_start_us;
+  if (channel != FILTER_CHANNELS[0] || time_us < RESPONSE_REST_US || time_us >= RESPONSE_REST_US + RESPONSE_SWEEP_US) {
+    return 2000;
+  }
+  int noise = (int)(next_random(&_filter_noise_random) % 17) - 8;
+  return 2000 + (int)(1600 * sin(2 * M_PI * 2 * (time_us - RESPONSE_REST_US) / RESPONSE_SWEEP_US)) + noise;
+}
+
+/// @brief Benchmark the response of an axis, the compiled table against evaluating the profile on every sample,
+/// and calibrate an axis from a sweep.
+/// @return The process exit code.
+static int bench_response(void) {
+  initialize_axis();
+  axis_profile_t profiles[3];
+  const char* names[] = {"linear", "deadzone 5%", "deadzone 5%, curve 50:25,100:100"};
+  get_default_axis_profile(0, &profiles[0]);
+  profiles[1] = profiles[0];
+  profiles[1].deadzone = 5;
+  profiles[2] = profiles[1];
+  parse_axis_curve("50:25,100:100", &profiles[2].curve);
+
+  // A random walk over the whole range, one voltage per sample.
+  uint32_t count = _options.iterations;
+  uint16_t* voltages = malloc(sizeof(uint16_t) * count);
+  uint32_t random = _options.seed;
+  int voltage = profiles[0].center;
+  for (uint32_t i = 0; i < count; i++) {
+    voltage += (int)(next_random(&random) % 65) - 32;
+    voltage = voltage < profiles[0].min ? profiles[0].min : (voltage > profiles[0].max ? profiles[0].max : voltage);
+    voltages[i] = voltage;
+  }
+
+  printf("response: axis 0, range %u:%u:%u mV, ns per sample on the host CPU\n", profiles[0].min, profiles[0].center, profiles[0].max);
+  static uint16_t values[4096];
+  for (int p = 0; p < 3; p++) {
+    int64_t start_ns = get_time_ns();
+    build_axis_response(&profiles[p], values, 4096);
+    double build_us = (double)(get_time_ns() - start_ns) / 1000;
+    // The table is the evaluation rounded down, off by the rounding of the fixed point at most.
+    int max_error = 0;
+    for (int v = profiles[0].min; v <= profiles[0].max; v++) {
+      int error = abs((int)values[v] - (int)evaluate_response(&profiles[p], v));
+      max_error = error > max_error ? error : max_error;
+    }
+    double evaluate_ns = time_response(&profiles[p], NULL, voltages, count);
+    double table_ns = time_response(&profiles[p], values, voltages, count);
+    printf(
+      "  %-34s evaluate %5.2f ns, table %5.2f ns, built in %6.1f us, max difference %d\n",
+      names[p], evaluate_ns, table_ns, build_us, max_error
+    );
+  }
+  free(voltages);
+
+  // Calibrate from a sweep as the axis command does, through read_axis() on the simulated ADC.
+  _filter_noise_random = _options.seed;
+  sim_set_adc_signal(get_response_adc_signal);
+  sim_set_adc_filter(true);
+  ESP_ERROR_CHECK(set_axis_profile(0, &profiles[0]));
+  _filter_start_us = hal_get_time_us();
+  start_axis();
+  axis_profile_t profile = profiles[0];
+  const int64_t end_us = RESPONSE_REST_US * 2 + RESPONSE_SWEEP_US;
+  uint16_t lowest = UINT16_MAX;
+  uint16_t highest = 0;
+  for (int64_t t = 1000; t <= end_us; t += 1000) {
+    advance_adc_time(_filter_start_us + t);
+    read_axis();
+    if (t == RESPONSE_REST_US / 2) {
+      start_axis_calibration(0);
+    }
+    if (t == end_us - RESPONSE_REST_US / 2 && finish_axis_calibration(0, &profile) == ESP_OK) {
+      ESP_ERROR_CHECK(set_axis_profile(0, &profile));
+    }
+  }
+  uint16_t rest = g_axes_data[0];
+  // Sweep again with the calibrated profile.
+  _filter_start_us = hal_get_time_us();
+  for (int64_t t = 1000; t <= end_us - RESPONSE_REST_US; t += 1000) {
+    advance_adc_time(_filter_start_us + t);
+    read_axis();
+    lowest = g_axes_data[0] < lowest ? g_axes_data[0] : lowest;
+    highest = g_axes_data[0] > highest ? g_axes_data[0] : highest;
+  }
+  stop_axis();
+  deinitialize_axis();
+  printf(
+    "  calibrated range %u:%u:%u mV, at rest %u, the sweep spans %u to %u\n",
+    profile.min, profile.center, profile.max, rest, lowest, highest
+  );
+  return 0;
+}
+
+// The length of a stall run, the period of the sampler and of its stalls.
+#define FRAMES_RUN_US 10000000
+#define FRAMES_SAMPLER_US 1000
+#define FRAMES_STALL_PERIOD_US 50000
+
+/// @brief The sample age and the lost frames of a way to take the ADC frames.
+typedef struct {
+  // The age of the newest conversion at every sampler run, in microseconds.
+  int64_t* ages;
+  uint32_t num_of_ages;
+  uint32_t lost;
+} frames_result_t;
+
+/// @brief Count a frame the pool dropped.
+/// @param arg The result.
+/// @return False.
+static bool count_bench_overflow(void* arg) {
+  ((frames_result_t*)arg)->lost++;
+  return false;
+}
+
+/// @brief Get whether the sampler is stalled at a time, for the first stall_us of every stall period.
+/// @param time_us The time since the start.
+/// @param stall_us The length of a stall.
+/// @return True if stalled.
+static bool is_sampler_stalled(int64_t time_us, int64_t stall_us) {
+  return time_us % FRAMES_STALL_PERIOD_US < stall_us;
+}
+
+/// @brief Poll the pool one frame per sampler run as the polling read_axis() does.
+/// @param stall_us The length of a stall.
+/// @param result The result to fill.
+static void run_frames_polling(int64_t stall_us, frames_result_t* result) {
+  static const uint8_t channels[] = NAGI_AXIS_ADC_CHANNELS;
+  hal_adc_sample_t samples[HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES];
+  ESP_ERROR_CHECK(hal_adc_initialize(channels, NAGI_MAX_NUM_OF_AXES, AXIS_SCAN_FREQ_HZ));
+  ESP_ERROR_CHECK(hal_adc_register_callbacks(NULL, count_bench_overflow, result));
+  int64_t start_us = hal_get_time_us();
+  ESP_ERROR_CHECK(hal_adc_start());
+  for (int64_t t = FRAMES_SAMPLER_US; t <= FRAMES_RUN_US; t += FRAMES_SAMPLER_US) {
+    if (is_sampler_stalled(t, stall_us)) {
+      continue;
+    }
+    advance_adc_time(start_us + t);
+    uint32_t num_of_samples;
+    hal_adc_read(samples, sizeof(samples) / sizeof(samples[0]), &num_of_samples);
+    result->ages[result->num_of_ages++] = hal_get_time_us() - sim_get_adc_read_time();
+  }
+  hal_adc_stop();
+  hal_adc_deinitialize();
+}
+
+/// @brief Read the frames the ADC ISR reduced through read_axis(), as the firmware does.
+/// @param stall_us The length of a stall.
+/// @param result The result to fill.
+static void run_frames_callback(int64_t stall_us, frames_result_t* result) {
+  initialize_axis();
+  g_axis_adc_overflows = 0;
+  g_axes_sample_us = 0;
+  int64_t start_us = hal_get_time_us();
+  start_axis();
+  for (int64_t t = FRAMES_SAMPLER_US; t <= FRAMES_RUN_US; t += FRAMES_SAMPLER_US) {
+    if (is_sampler_stalled(t, stall_us)) {
+      continue;
+    }
+    advance_adc_time(start_us + t);
+    read_axis();
+    if (g_axes_sample_us > 0) {
+      result->ages[result->num_of_ages++] = hal_get_time_us() - g_axes_sample_us;
+    }
+  }
+  stop_axis();
+  deinitialize_axis();
+  result->lost = g_axis_adc_overflows;
+}
+
+/// @brief Compare two ages.
+static int compare_ages(const void* a, const void* b) {
+  int64_t x = *(const int64_t*)a;
+  int64_t y = *(const int64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/// @brief Print the ages and the lost frames of a run.
+/// @param name The name of the way.
+/// @param result The result, the ages are sorted.
+static void print_frames_result(const char* name, frames_result_t* result) {
+  qsort(result->ages, result->num_of_ages, sizeof(int64_t), compare_ages);
+  double sum = 0;
+  for (uint32_t i = 0; i < result->num_of_ages; i++) {
+    sum += result->ages[i];
+  }
+  uint32_t n = result->num_of_ages;
+  printf(
+    "    %-8s age mean %6.0f us, p99 %6lld us, max %6lld us, frames lost %5lu\n", name, n > 0 ? sum / n : 0,
+    n > 0 ? (long long)result->ages[n * 99 / 100] : 0, n > 0 ? (long long)result->ages[n - 1] : 0,
+    (unsigned long)result->lost
+  );
+}
+
+/// @brief The axis at rest, the frames are timed, not their values.
+static int get_frames_adc_signal(uint32_t channel, int64_t time_us) {
+  return 2048;
+}
+
+/// @brief Benchmark the age of the axis data and the lost frames as the sampler stalls, polling the DMA pool
+/// against reducing the frames in the conversion-done callback.
+/// @return The process exit code.
+static int bench_frames(void) {
+  const int64_t stalls_us[] = {0, 2000, 5000, 10000, 20000};
+  const uint32_t frame_us = HAL_ADC_CONVERSIONS_PER_FRAME * 1000000 / NAGI_AXIS_SAMPLE_FREQ_HZ;
+  sim_set_adc_signal(get_frames_adc_signal);
+  sim_set_adc_filter(true);
+  printf(
+    "frames: %lu us frames, the sampler runs every %d us and stalls once every %d ms, a queue of %d frames\n",
+    (unsigned long)frame_us, FRAMES_SAMPLER_US, FRAMES_STALL_PERIOD_US / 1000, NAGI_AXIS_ADC_FRAME_QUEUE_SIZE
+  );
+  for (size_t i = 0; i < sizeof(stalls_us) / sizeof(stalls_us[0]); i++) {
+    frames_result_t polling = {.ages = malloc(sizeof(int64_t) * (FRAMES_RUN_US / FRAMES_SAMPLER_US))};
+    frames_result_t callback = {.ages = malloc(sizeof(int64_t) * (FRAMES_RUN_US / FRAMES_SAMPLER_US))};
+    run_frames_polling(stalls_us[i], &polling);
+    run_frames_callback(stalls_us[i], &callback);
+    printf("  stalls of %lld ms\n", (long long)(stalls_us[i] / 1000));
+    print_frames_result("polling", &polling);
+    print_frames_result("callback", &callback);
+    free(polling.ages);
+    free(callback.ages);
+  }
+  return 0;
+}
+
+// The conversions of the decimation evaluation, the time a level is held and the time it settles.
+#define DECIMATE_NUM_OF_SAMPLES 400000
+#define DECIMATE_LEVEL_SAMPLES 400
+#define DECIMATE_SETTLE_SAMPLES 160
+// The full scale of the voltages, and the clock the cycle budget is stated at.
+#define DECIMATE_FULL_SCALE_MV 3300
+#define DECIMATE_QUIET_NOISE_CODES 2
+#define DECIMATE_TARGET_MHZ 160
+
+/// @brief A decimator configuration.
+typedef struct {
+  uint32_t order;
+  uint32_t factor;
+} decimate_config_t;
+
+/// @brief Build the conversions of one axis, levels held with uniform noise and rounded to millivolts.
+/// @param noise_codes The noise, in raw codes either way.
+/// @param voltages The conversions to fill, in millivolts.
+/// @param levels The true voltages to fill, in millivolts.
+static void build_decimate_signal(int noise_codes, int32_t* voltages, double* levels) {
+  uint32_t random = _options.seed;
+  double level = 0;
+  for (uint32_t i = 0; i < DECIMATE_NUM_OF_SAMPLES; i++) {
+    if (i % DECIMATE_LEVEL_SAMPLES == 0) {
+      level = 1000 + (next_random(&random) % 1000000) / 1000.0;
+    }
+    double noise = ((int)(next_random(&random) % (2 * noise_codes + 1)) - noise_codes) * DECIMATE_FULL_SCALE_MV / 4096.0;
+    levels[i] = level;
+    voltages[i] = (int32_t)lround(level + noise);
+  }
+}
+
+/// @brief The frame average of read_axis() before the decimator, the integer mean of a frame of one axis.
+/// @param voltages The conversions.
+/// @param count The number of conversions.
+/// @param outputs The means to fill.
+/// @return The number of means.
+static __attribute__((noinline)) uint32_t average_frames(const int32_t* voltages, uint32_t count, int32_t* outputs) {
+  uint32_t num_of_outputs = 0;
+  for (uint32_t i = 0; i + HAL_ADC_CONVERSIONS_PER_FRAME <= count; i += HAL_ADC_CONVERSIONS_PER_FRAME) {
+    int32_t sum = 0;
+    for (uint32_t j = 0; j < HAL_ADC_CONVERSIONS_PER_FRAME; j++) {
+      sum += voltages[i + j];
+    }
+    outputs[num_of_outputs++] = sum / HAL_ADC_CONVERSIONS_PER_FRAME;
+  }
+  return num_of_outputs;
+}
+
+/// @brief Time the decimation of whole frames of every axis, as the ISR does, the fastest of the repetitions.
+/// @param config The configuration, an order of 0 for the frame average.
+/// @param voltages The conversions, the axes take them in turn.
+/// @return The time per frame in nanoseconds.
+static double time_decimate_frames(const decimate_config_t* config, const int32_t* voltages) {
+  const uint32_t frame_size = HAL_ADC_CONVERSIONS_PER_FRAME * NAGI_MAX_NUM_OF_AXES;
+  const uint32_t num_of_frames = DECIMATE_NUM_OF_SAMPLES / frame_size;
+  double best_ns = 1e30;
+  for (uint32_t r = 0; r < _options.repeat; r++) {
+    axis_decimator_t decimators[NAGI_MAX_NUM_OF_AXES];
+    int32_t sums[NAGI_MAX_NUM_OF_AXES] = {0};
+    for (int a = 0; a < NAGI_MAX_NUM_OF_AXES && config->order > 0; a++) {
+      ESP_ERROR_CHECK(initialize_axis_decimator(&decimators[a], config->order, config->factor, NAGI_AXIS_VOLTAGE_FRACTION_BITS));
+    }
+    int64_t start_ns = get_time_ns();
+    for (uint32_t f = 0; f < num_of_frames; f++) {
+      const int32_t* frame = &voltages[f * frame_size];
+      int32_t counts[NAGI_MAX_NUM_OF_AXES] = {0};
+      for (uint32_t i = 0; i < frame_size; i++) {
+        uint32_t axis = i % NAGI_MAX_NUM_OF_AXES;
+        int32_t output;
+        if (config->order == 0) {
+          sums[axis] += frame[i];
+          counts[axis]++;
+        } else if (decimate_axis(&decimators[axis], frame[i], &output)) {
+          sums[axis] += output;
+        }
+      }
+      for (int a = 0; a < NAGI_MAX_NUM_OF_AXES && config->order == 0; a++) {
+        sums[a] /= counts[a];
+      }
+      __asm__ volatile("" : : "r"(sums) : "memory");
+    }
+    double ns = (double)(get_time_ns() - start_ns) / num_of_frames;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+  return best_ns;
+}
+
+/// @brief Evaluate a configuration on the held levels, the error of the settled outputs against the true voltage.
+/// @param config The configuration, an order of 0 for the frame average.
+/// @param voltages The conversions of one axis.
+/// @param levels The true voltages.
+/// @return The rms error in millivolts.
+static double evaluate_decimate_error(const decimate_config_t* config, const int32_t* voltages, const double* levels) {
+  int32_t* outputs = malloc(sizeof(int32_t) * DECIMATE_NUM_OF_SAMPLES);
+  double sum = 0;
+  uint32_t count = 0;
+  if (config->order == 0) {
+    uint32_t num_of_outputs = average_frames(voltages, DECIMATE_NUM_OF_SAMPLES, outputs);
+    for (uint32_t i = 0; i < num_of_outputs; i++) {
+      uint32_t last = (i + 1) * HAL_ADC_CONVERSIONS_PER_FRAME - 1;
+      if (last % DECIMATE_LEVEL_SAMPLES >= DECIMATE_SETTLE_SAMPLES) {
+        double error = outputs[i] - levels[last];
+        sum += error * error;
+        count++;
+      }
+    }
+  } else {
+    axis_decimator_t decimator;
+    ESP_ERROR_CHECK(initialize_axis_decimator(&decimator, config->order, config->factor, NAGI_AXIS_VOLTAGE_FRACTION_BITS));
+    for (uint32_t i = 0; i < DECIMATE_NUM_OF_SAMPLES; i++) {
+      int32_t output;
+      if (decimate_axis(&decimator, voltages[i], &output) && i % DECIMATE_LEVEL_SAMPLES >= DECIMATE_SETTLE_SAMPLES) {
+        double error = (double)output / (1 << NAGI_AXIS_VOLTAGE_FRACTION_BITS) - levels[i];
+        sum += error * error;
+        count++;
+      }
+    }
+  }
+  free(outputs);
+  return count > 0 ? sqrt(sum / count) : 0;
+}
+
+/// @brief Benchmark the decimators, the cost of a frame against the cycle budget and the resolution they reach.
+/// @return The process exit code.
+static int bench_decimate(void) {
+  const decimate_config_t configs[] = {
+    {0, HAL_ADC_CONVERSIONS_PER_FRAME}, {1, 4}, {1, 8}, {1, 16}, {2, 4}, {2, 8}, {2, 16},
+    {3, 4}, {3, 8}, {3, 16}, {4, 4}, {4, 8}, {4, 16},
+  };
+  int32_t* voltages = malloc(sizeof(int32_t) * DECIMATE_NUM_OF_SAMPLES);
+  double* levels = malloc(sizeof(double) * DECIMATE_NUM_OF_SAMPLES);
+  int32_t* quiet_voltages = malloc(sizeof(int32_t) * DECIMATE_NUM_OF_SAMPLES);
+  double* quiet_levels = malloc(sizeof(double) * DECIMATE_NUM_OF_SAMPLES);
+  // The noise of the simulator, and a quiet board where the rounding to millivolts dominates.
+  build_decimate_signal(8, voltages, levels);
+  build_decimate_signal(DECIMATE_QUIET_NOISE_CODES, quiet_voltages, quiet_levels);
+  const double budget_ns = NAGI_AXIS_DECIMATION_BUDGET_CYCLES * 1000.0 / DECIMATE_TARGET_MHZ;
+  printf(
+    "decimate: %d axes at %d Hz, frames of %d conversions per axis, outputs in 1/%d mV, budget %d cycles per frame"
+    " (%.1f us at %d MHz)\n",
+    NAGI_MAX_NUM_OF_AXES, NAGI_AXIS_SAMPLE_FREQ_HZ, HAL_ADC_CONVERSIONS_PER_FRAME, 1 << NAGI_AXIS_VOLTAGE_FRACTION_BITS,
+    NAGI_AXIS_DECIMATION_BUDGET_CYCLES, budget_ns / 1000, DECIMATE_TARGET_MHZ
+  );
+  printf(
+    "  ns per frame on the host CPU, error against the true voltage and effective bits over %d mV, with noise of 8\n"
+    "  codes and of %d codes either way\n",
+    DECIMATE_FULL_SCALE_MV, DECIMATE_QUIET_NOISE_CODES
+  );
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+    const decimate_config_t* config = &configs[i];
+    double ns = time_decimate_frames(config, voltages);
+    double error = evaluate_decimate_error(config, voltages, levels);
+    double quiet_error = evaluate_decimate_error(config, quiet_voltages, quiet_levels);
+    // The group delay of the stages, order (factor - 1) / 2 conversions.
+    double delay_us = config->order == 0 ? (config->factor - 1) / 2.0 * 1e6 / NAGI_AXIS_SAMPLE_FREQ_HZ
+                                         : config->order * (config->factor - 1) / 2.0 * 1e6 / NAGI_AXIS_SAMPLE_FREQ_HZ;
+    char name[32];
+    if (config->order == 0) {
+      snprintf(name, sizeof(name), "frame mean");
+    } else {
+      snprintf(name, sizeof(name), "cic %lu, /%lu", (unsigned long)config->order, (unsigned long)config->factor);
+    }
+    bool is_configured = config->order == NAGI_AXIS_CIC_ORDER && config->factor == NAGI_AXIS_SAMPLE_FREQ_HZ / NAGI_AXIS_OUTPUT_FREQ_HZ;
+    printf(
+      "  %-12s %4lu Hz: %5.1f ns (%3.1f%% of budget), %4.2f mV %5.2f bits, quiet %4.2f mV %5.2f bits, delay %4.0f us%s\n",
+      name, (unsigned long)(NAGI_AXIS_SAMPLE_FREQ_HZ / config->factor), ns, ns * 100 / budget_ns, error,
+      log2(DECIMATE_FULL_SCALE_MV / (error * sqrt(12))), quiet_error, log2(DECIMATE_FULL_SCALE_MV / (quiet_error * sqrt(12))),
+      delay_us, is_configured ? ", configured" : ""
+    );
+  }
+  free(voltages);
+  free(levels);
+  free(quiet_voltages);
+  free(quiet_levels);
+  return 0;
+}
+
+/// @brief Print the usage.
+/// @param name The program name.
+static void print_usage(const char* name) {
+  printf(
+    "Usage: %s <benchmark> [options]\n"
+    "Microbenchmarks of the firmware hot paths on the host.\n"
+    "  encoder               The ISR decode, switch against table, and the counter read under preemption.\n"
+    "  button                The button read, the loop against the vertical counters, for 8 to 32 buttons.\n"
+    "  debounce              The latency and false edges of every debounce policy on bouncing contacts.\n"
+    "  scan                  Full frames of 64 and 128 inputs on a diode matrix and a 74HC165 chain.\n"
+    "  adc                   The raw-to-millivolt conversion of a frame, the calibration curve against the table.\n"
+    "  filter                The latency and noise of every axis filter, on generated scenes or a replayed trace.\n"
+    "  response              The axis response table against evaluating the profile per sample, and a calibration.\n"
+    "  frames                The age of the axis data and the lost frames as the sampler stalls, polling the pool\n"
+    "                        against the conversion-done callback.\n"
+    "  decimate              The cost of decimating a frame against the cycle budget, and the resolution reached.\n"
+    "  --iterations <n>      Iterations of every measured loop, default 1000000.\n"
+    "  --repeat <n>          Repetitions, the fastest is reported, default 5.\n"
+    "  --seed <n>            Random seed, default 1.\n"
+    "  --presses <n>         Presses of the debounce evaluation, default 2000.\n"
+    "  --glitch-rate <hz>    Contact glitches per second of the debounce evaluation, default 1.\n"
+    "  --replay <file>       Evaluate the filters on the ADC conversions of a trace, see nagi_joy_sim --record.\n",
+    name
+  );
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const char* benchmark = argv[1];
+  _options = (bench_options_t){
+    .iterations = 1000000,
+    .repeat = 5,
+    .seed = 1,
+    .presses = 2000,
+    .glitch_rate = 1,
+  };
+
+  for (int i = 2; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      fprintf(stderr, "Missing value for %s\n", arg);
+      return 1;
+    }
+    ++i;
+    if (strcmp(arg, "--iterations") == 0) {
+      _options.iterations = strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--repeat") == 0) {
+      _options.repeat = strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--seed") == 0) {
+      _options.seed = strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--presses") == 0) {
+      _options.presses = strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--glitch-rate") == 0) {
+      _options.glitch_rate = strtod(value, NULL);
+    } else if (strcmp(arg, "--replay") == 0) {
+      _options.replay_path = value;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (_options.iterations == 0 || _options.repeat == 0) {
+    fprintf(stderr, "Invalid options.\n");
+    return 1;
+  }
+  if (_options.seed == 0) {
+    _options.seed = 1;
+  }
+
+  if (strcmp(benchmark, "encoder") == 0) {
+    return bench_encoder();
+  }
+  if (strcmp(benchmark, "button") == 0) {
+    return bench_button();
+  }
+  if (strcmp(benchmark, "debounce") == 0) {
+    return bench_debounce();
+  }
+  if (strcmp(benchmark, "scan") == 0) {
+    return bench_scan();
+  }
+  if (strcmp(benchmark, "adc") == 0) {
+    return bench_adc();
+  }
+  if (strcmp(benchmark, "filter") == 0) {
+    return bench_filter();
+  }
+  if (strcmp(benchmark, "response") == 0) {
+    return bench_response();
+  }
+  if (strcmp(benchmark, "frames") == 0) {
+    return bench_frames();
+  }
+  if (strcmp(benchmark, "decimate") == 0) {
+    return bench_decimate();
+  }
+  fprintf(stderr, "Unknown benchmark %s\n", benchmark);
+  print_usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common.h"
+
+/// @brief Get the bucket of a value.
+/// @param value The value.
+/// @return The bucket index.
+static uint32_t get_bucket(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return (uint32_t)value;
+  }
+  uint32_t msb = 63 - __builtin_clzll(value);
+  uint32_t sub = (value >> (msb - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (msb - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/// @brief Get the largest value of a bucket.
+/// @param bucket The bucket index.
+/// @return The largest value.
+static uint64_t get_bucket_limit(uint32_t bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t base = HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS;
+  return ((base + 1) << shift) - 1;
+}
+
+/// @brief Get the monotonic time.
+/// @return The time in microseconds.
+int64_t get_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// @brief Get the next pseudo random number.
+/// @param state The generator state, must not be 0.
+/// @return The random number.
+uint32_t next_random(uint32_t* state) {
+  // xorshift32.
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/// @brief Check a pseudo random event.
+/// @param state The generator state, must not be 0.
+/// @param probability The probability, 0 to 1.
+/// @return True if the event happens.
+bool roll_random(uint32_t* state, double probability) {
+  return next_random(state) < probability * 4294967296.0;
+}
+
+/// @brief Record a value in a histogram.
+/// @param histogram The histogram.
+/// @param value The value.
+void record_histogram(histogram_t* histogram, uint64_t value) {
+  histogram->buckets[get_bucket(value)]++;
+  histogram->count++;
+  histogram->sum += value;
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+/// @brief Merge a histogram into another.
+/// @param target The target histogram.
+/// @param source The source histogram.
+void merge_histogram(histogram_t* target, const histogram_t* source) {
+  for (int i = 0; i < HISTOGRAM_NUM_OF_BUCKETS; ++i) {
+    target->buckets[i] += source->buckets[i];
+  }
+  target->count += source->count;
+  target->sum += source->sum;
+  if (source->max > target->max) {
+    target->max = source->max;
+  }
+}
+
+/// @brief Get a percentile of a histogram.
+/// @param histogram The histogram.
+/// @param percent The percentile, 0 to 100.
+/// @return The upper limit of the bucket holding the percentile.
+uint64_t get_histogram_percentile(const histogram_t* histogram, double percent) {
+  uint64_t rank = (uint64_t)(histogram->count * percent / 100.0 + 0.999999);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < HISTOGRAM_NUM_OF_BUCKETS; ++i) {
+    total += histogram->buckets[i];
+    if (total >= rank) {
+      uint64_t limit = get_bucket_limit(i);
+      return limit < histogram->max ? limit : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+/// @brief Print a histogram summary.
+/// @param name The name.
+/// @param unit The unit of the values.
+/// @param histogram The histogram.
+void print_histogram(const char* name, const char* unit, const histogram_t* histogram) {
+  if (histogram->count == 0) {
+    printf("%-14s no data\n", name);
+    return;
+  }
+  printf(
+    "%-14s n %-9llu avg %-8llu p50 %-8llu p99 %-8llu p99.9 %-8llu max %llu %s\n",
+    name,
+    (unsigned long long)histogram->count,
+    (unsigned long long)(histogram->sum / histogram->count),
+    (unsigned long long)get_histogram_percentile(histogram, 50),
+    (unsigned long long)get_histogram_percentile(histogram, 99),
+    (unsigned long long)get_histogram_percentile(histogram, 99.9),
+    (unsigned long long)histogram->max,
+    unit
+  );
+}
+
+/// @brief Parse a host:port address.
+/// @param text The text.
+/// @param addr The address to fill.
+/// @return True if the address is valid.
+bool parse_address(const char* text, struct sockaddr_in* addr) {
+  char host[64];
+  int port;
+  if (sscanf(text, "%63[^:]:%d", host, &port) != 2 || port <= 0 || port > 65535) {
+    return false;
+  }
+  memset(addr, 0, sizeof(struct sockaddr_in));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+/// @brief Open a non-blocking UDP socket.
+/// @param port The local port, 0 for any.
+/// @return The socket, or -1 on error.
+int open_udp_socket(uint16_t port) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  // Large buffers, so bursts from many devices are not dropped by the kernel.
+  int size = 4 * 1024 * 1024;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    close(sock);
+    return -1;
+  }
+
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  return sock;
+}
@@ -0,0 +1,69 @@
+#ifndef __COMMON_H__
+#define __COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+// Every power of two is split into 4 linear sub-buckets, so the error is below 25%.
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_NUM_OF_BUCKETS ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/// @brief A fixed-memory log-bucket histogram.
+typedef struct {
+  uint64_t buckets[HISTOGRAM_NUM_OF_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+} histogram_t;
+
+/// @brief Get the monotonic time.
+/// @return The time in microseconds.
+int64_t get_time_us(void);
+
+/// @brief Get the next pseudo random number.
+/// @param state The generator state, must not be 0.
+/// @return The random number.
+uint32_t next_random(uint32_t* state);
+
+/// @brief Check a pseudo random event.
+/// @param state The generator state, must not be 0.
+/// @param probability The probability, 0 to 1.
+/// @return True if the event happens.
+bool roll_random(uint32_t* state, double probability);
+
+/// @brief Record a value in a histogram.
+/// @param histogram The histogram.
+/// @param value The value.
+void record_histogram(histogram_t* histogram, uint64_t value);
+
+/// @brief Merge a histogram into another.
+/// @param target The target histogram.
+/// @param source The source histogram.
+void merge_histogram(histogram_t* target, const histogram_t* source);
+
+/// @brief Get a percentile of a histogram.
+/// @param histogram The histogram.
+/// @param percent The percentile, 0 to 100.
+/// @return The upper limit of the bucket holding the percentile.
+uint64_t get_histogram_percentile(const histogram_t* histogram, double percent);
+
+/// @brief Print a histogram summary.
+/// @param name The name.
+/// @param unit The unit of the values.
+/// @param histogram The histogram.
+void print_histogram(const char* name, const char* unit, const histogram_t* histogram);
+
+/// @brief Parse a host:port address.
+/// @param text The text.
+/// @param addr The address to fill.
+/// @return True if the address is valid.
+bool parse_address(const char* text, struct sockaddr_in* addr);
+
+/// @brief Open a non-blocking UDP socket.
+/// @param port The local port, 0 for any.
+/// @return The socket, or -1 on error.
+int open_udp_socket(uint16_t port);
+
+#endif // __COMMON_H__
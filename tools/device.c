@@ -0,0 +1,304 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "message.h"
+#include "protocol.h"
+#include "device.h"
+
+// The ping interval until the server replies.
+#define DEVICE_PING_INTERVAL_US 1000000
+// The time request interval while syncing, as NAGI_TIME_SYNC_INTERVAL.
+#define DEVICE_TIME_SYNC_INTERVAL_US 1000000
+// The keyframe interval of the delta format, as NAGI_SYNC_KEYFRAME_INTERVAL.
+#define DEVICE_KEYFRAME_INTERVAL_US 1000000
+
+/// @brief Send a message to the server.
+/// @param device The device.
+/// @param message The message.
+/// @param length The length of the message.
+/// @return True if the message is sent.
+static bool send_message(virtual_device_t* device, const void* message, size_t length) {
+  ssize_t err = sendto(device->sock, message, length, 0, (const struct sockaddr*)&device->server, sizeof(device->server));
+  if (err < 0) {
+    return false;
+  }
+  device->bytes += length;
+  return true;
+}
+
+/// @brief Send a ping to the server.
+/// @param device The device.
+/// @param now_us The current time in microseconds.
+static void send_ping(virtual_device_t* device, int64_t now_us) {
+  message_common_ping_t ping = {
+    .header = {
+      .major_id = MESSAGE_MAJOR_ID_COMMON,
+      .minor_id = MESSAGE_MINOR_ID_COMMON_PING,
+      .length = sizeof(message_common_ping_t) - sizeof(message_header_t),
+    },
+    .magic = ('N' << 24 | 'A' << 16 | 'G' << 8 | 'I'),
+    .formats = 1 << device->options.format,
+    .origin_time = now_us,
+  };
+  send_message(device, &ping, sizeof(ping));
+  device->last_ping_us = now_us;
+}
+
+/// @brief Send a time request to the server.
+/// @param device The device.
+/// @param now_us The current time in microseconds.
+static void send_time_request(virtual_device_t* device, int64_t now_us) {
+  message_common_time_request_t request = {
+    .header = {
+      .major_id = MESSAGE_MAJOR_ID_COMMON,
+      .minor_id = MESSAGE_MINOR_ID_COMMON_TIME_REQUEST,
+      .length = sizeof(message_common_time_request_t) - sizeof(message_header_t),
+    },
+    .origin_time = now_us,
+  };
+  send_message(device, &request, sizeof(request));
+  device->last_time_request_us = now_us;
+}
+
+/// @brief Change the joystick state randomly.
+/// @param device The device.
+static void change_state(virtual_device_t* device) {
+  uint32_t r = next_random(&device->random);
+  switch (r % 4) {
+    case 0:
+      device->state.buttons[0] ^= 1u << ((r >> 8) % 32);
+      break;
+    case 1:
+      device->state.hats[(r >> 8) % 2] = (r >> 16) % 9;
+      break;
+    default:
+      (&device->state.axis_x)[(r >> 8) % JOYSTICK_COMPACT_NUM_OF_AXES] = (r >> 16) & 0xFFFF;
+      break;
+  }
+  device->is_changed = true;
+}
+
+/// @brief Send the joystick state with a new sequence number.
+/// @param device The device.
+/// @param now_us The current time in microseconds.
+static void send_sync(virtual_device_t* device, int64_t now_us) {
+  uint32_t sequence = ++device->sequence;
+  uint32_t timestamp = (uint32_t)(now_us + device->clock_offset_us);
+  union {
+    message_joystick_seq_sync_t full;
+    message_joystick_delta_sync_t delta;
+    message_joystick_compact_sync_t compact;
+    message_joystick_redundant_sync_t redundant;
+  } message;
+  size_t length;
+
+  switch (device->format) {
+    case MESSAGE_JOYSTICK_FORMAT_DELTA: {
+      static const joystick_info_t zero_state;
+      int slot = sequence % DEVICE_DELTA_HISTORY_SIZE;
+      memcpy(&device->delta_states[slot], &device->state, sizeof(joystick_info_t));
+      device->delta_sequences[slot] = sequence;
+
+      // A keyframe until a base is acknowledged, and periodically for resynchronisation.
+      const joystick_info_t* base = &device->base_state;
+      uint32_t base_sequence = device->base_sequence;
+      if (base_sequence == 0 || now_us - device->last_keyframe_us >= DEVICE_KEYFRAME_INTERVAL_US) {
+        base = &zero_state;
+        base_sequence = 0;
+        device->last_keyframe_us = now_us;
+      }
+      const uint32_t* fields = (const uint32_t*)&device->state;
+      const uint32_t* base_fields = (const uint32_t*)base;
+      uint32_t count = 0;
+      message.delta.field_mask = 0;
+      for (uint32_t i = 0; i < JOYSTICK_INFO_FIELD_COUNT; ++i) {
+        if (fields[i] != base_fields[i]) {
+          message.delta.field_mask |= 1u << i;
+          message.delta.values[count++] = fields[i];
+        }
+      }
+      message.delta.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_DELTA_SYNC;
+      message.delta.sequence = sequence;
+      message.delta.timestamp = timestamp;
+      message.delta.base_sequence = base_sequence;
+      length = offsetof(message_joystick_delta_sync_t, values) + count * sizeof(uint32_t);
+      break;
+    }
+    case MESSAGE_JOYSTICK_FORMAT_COMPACT:
+      message.compact.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_COMPACT_SYNC;
+      message.compact.sequence = sequence;
+      message.compact.timestamp = timestamp;
+      encode_joystick_compact(&device->state, &message.compact.data);
+      length = sizeof(message_joystick_compact_sync_t);
+      break;
+    case MESSAGE_JOYSTICK_FORMAT_REDUNDANT: {
+      encode_joystick_compact(&device->state, &device->sent_states[sequence % 8]);
+      uint32_t count = 1;
+      while (count <= device->options.redundancy && (int32_t)(sequence - count - device->acked_sequence) > 0) {
+        count++;
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        memcpy(&message.redundant.states[i], &device->sent_states[(sequence - i) % 8], sizeof(joystick_compact_t));
+      }
+      message.redundant.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_REDUNDANT_SYNC;
+      message.redundant.sequence = sequence;
+      message.redundant.timestamp = timestamp;
+      message.redundant.count = count;
+      length = offsetof(message_joystick_redundant_sync_t, states) + count * sizeof(joystick_compact_t);
+      break;
+    }
+    default:
+      message.full.header.minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_SYNC;
+      message.full.sequence = sequence;
+      message.full.timestamp = timestamp;
+      memcpy(&message.full.data, &device->state, sizeof(joystick_info_t));
+      length = sizeof(message_joystick_seq_sync_t);
+      break;
+  }
+  message.full.header.major_id = MESSAGE_MAJOR_ID_JOYSTICK;
+  message.full.header.length = length - sizeof(message_header_t);
+
+  device->send_times[sequence % DEVICE_SEND_HISTORY_SIZE] = now_us;
+  if (send_message(device, &message, length)) {
+    device->sent++;
+  }
+  device->last_send_us = now_us;
+  device->is_changed = false;
+}
+
+/// @brief Initialize a virtual device.
+/// @param device The device.
+/// @param sock The non-blocking socket owned by the device.
+/// @param server The server address.
+/// @param options The options.
+/// @param seed The random seed.
+void initialize_device(virtual_device_t* device, int sock, const struct sockaddr_in* server, const device_options_t* options, uint32_t seed) {
+  memset(device, 0, sizeof(virtual_device_t));
+  device->sock = sock;
+  device->server = *server;
+  device->options = *options;
+  device->random = seed ? seed : 1;
+  device->clock_rtt_us = INT64_MAX;
+}
+
+/// @brief Send the messages due at the time.
+/// @param device The device.
+/// @param now_us The current time in microseconds.
+/// @return The time of the next due message.
+int64_t update_device(virtual_device_t* device, int64_t now_us) {
+  if (!device->is_syncing) {
+    if (now_us - device->last_ping_us >= DEVICE_PING_INTERVAL_US || device->last_ping_us == 0) {
+      send_ping(device, now_us);
+    }
+    return device->last_ping_us + DEVICE_PING_INTERVAL_US;
+  }
+
+  if (now_us - device->last_time_request_us >= DEVICE_TIME_SYNC_INTERVAL_US) {
+    send_time_request(device, now_us);
+  }
+
+  int64_t period_us = 1000000 / device->options.rate_hz;
+  while (now_us >= device->next_period_us) {
+    // Bursts of activity followed by idle periods, like a player pressing buttons.
+    uint32_t cycle = device->options.burst_periods + device->options.idle_periods;
+    bool is_active = device->options.burst_periods == 0 || device->period % cycle < device->options.burst_periods;
+    if (is_active && roll_random(&device->random, device->options.change_probability)) {
+      change_state(device);
+    }
+    device->period++;
+    device->next_period_us += period_us;
+    // Do not catch up when the driver falls far behind.
+    if (now_us - device->next_period_us > 100 * period_us) {
+      device->next_period_us = now_us + period_us;
+    }
+  }
+
+  // Send on every change, and keep alive while idle, like the event-driven firmware.
+  if (device->is_changed || now_us - device->last_send_us >= device->options.keepalive_us) {
+    send_sync(device, now_us);
+  }
+  int64_t keepalive_us = device->last_send_us + device->options.keepalive_us;
+  return device->next_period_us < keepalive_us ? device->next_period_us : keepalive_us;
+}
+
+/// @brief Update the clock offset with a new sample.
+/// @param device The device.
+/// @param origin The device time when the request was sent.
+/// @param receive The host time when the request was received.
+/// @param transmit The host time when the reply was sent.
+/// @param destination The device time when the reply was received.
+static void update_clock(virtual_device_t* device, int64_t origin, int64_t receive, int64_t transmit, int64_t destination) {
+  int64_t rtt = (destination - origin) - (transmit - receive);
+  if (rtt < device->clock_rtt_us) {
+    device->clock_rtt_us = rtt;
+    device->clock_offset_us = ((receive - origin) + (transmit - destination)) / 2;
+  }
+}
+
+/// @brief Receive and handle all pending replies.
+/// @param device The device.
+/// @return The number of received messages.
+int receive_device(virtual_device_t* device) {
+  char buffer[1472];
+  int count = 0;
+  for (;;) {
+    ssize_t len = recv(device->sock, buffer, sizeof(buffer), 0);
+    if (len < 0) {
+      return count;
+    }
+    if (len < (ssize_t)sizeof(message_header_t)) {
+      continue;
+    }
+    int64_t now_us = get_time_us();
+    count++;
+
+    const message_header_t* header = (const message_header_t*)buffer;
+    if (header->major_id == MESSAGE_MAJOR_ID_COMMON && header->minor_id == MESSAGE_MINOR_ID_COMMON_PONG) {
+      const message_common_pong_t* pong = (const message_common_pong_t*)buffer;
+      if (device->is_syncing || pong->magic != ('G' << 24 | 'I' << 16 | 'A' << 8 | 'N')) {
+        continue;
+      }
+      device->is_syncing = true;
+      device->base_sequence = 0;
+      memset(device->delta_sequences, 0, sizeof(device->delta_sequences));
+      device->format = MESSAGE_JOYSTICK_FORMAT_FULL;
+      if (len >= (ssize_t)offsetof(message_common_pong_t, origin_time) && pong->format == device->options.format) {
+        device->format = pong->format;
+      }
+      if (len >= (ssize_t)sizeof(message_common_pong_t)) {
+        update_clock(device, pong->origin_time, pong->receive_time, pong->transmit_time, now_us);
+      }
+      device->next_period_us = now_us;
+      device->last_send_us = now_us;
+      device->last_time_request_us = now_us;
+      device->is_changed = true;
+    } else if (header->major_id == MESSAGE_MAJOR_ID_COMMON && header->minor_id == MESSAGE_MINOR_ID_COMMON_TIME_RESPONSE) {
+      const message_common_time_response_t* response = (const message_common_time_response_t*)buffer;
+      if (len >= (ssize_t)sizeof(message_common_time_response_t)) {
+        update_clock(device, response->origin_time, response->receive_time, response->transmit_time, now_us);
+      }
+    } else if (header->major_id == MESSAGE_MAJOR_ID_JOYSTICK && header->minor_id == MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_ACK) {
+      const message_joystick_seq_ack_t* ack = (const message_joystick_seq_ack_t*)buffer;
+      if (len < (ssize_t)sizeof(message_joystick_seq_ack_t) || ack->payload != 0x4F4B) {
+        continue;
+      }
+      // Acks are cumulative, a gap means the skipped messages were lost.
+      if ((int32_t)(ack->sequence - device->acked_sequence) <= 0 || (int32_t)(ack->sequence - device->sequence) > 0) {
+        continue;
+      }
+      device->lost += ack->sequence - device->acked_sequence - 1;
+      device->acked++;
+      device->acked_sequence = ack->sequence;
+      if (device->sequence - ack->sequence < DEVICE_SEND_HISTORY_SIZE) {
+        record_histogram(&device->ack_latency, now_us - device->send_times[ack->sequence % DEVICE_SEND_HISTORY_SIZE]);
+      }
+      // The acknowledged state becomes the new delta base.
+      int slot = ack->sequence % DEVICE_DELTA_HISTORY_SIZE;
+      if (device->delta_sequences[slot] == ack->sequence) {
+        memcpy(&device->base_state, &device->delta_states[slot], sizeof(joystick_info_t));
+        device->base_sequence = ack->sequence;
+      }
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef __DEVICE_H__
+#define __DEVICE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "joy_data.h"
+#include "common.h"
+
+// The number of in-flight sync messages whose send time is kept for the ack latency.
+#define DEVICE_SEND_HISTORY_SIZE 256
+// The number of sent states kept to become the delta base once acknowledged, as NAGI_SYNC_DELTA_HISTORY_SIZE.
+#define DEVICE_DELTA_HISTORY_SIZE 32
+
+/// @brief The virtual device options.
+typedef struct {
+  // The joystick format requested in the ping, MESSAGE_JOYSTICK_FORMAT_*.
+  uint32_t format;
+  // The sync rate in Hz.
+  uint32_t rate_hz;
+  // The probability that the state changes at every sync period.
+  double change_probability;
+  // The number of sync periods in a burst, and the idle periods after it, 0 for no bursts.
+  uint32_t burst_periods;
+  uint32_t idle_periods;
+  // The keepalive interval in microseconds, while the state does not change.
+  int64_t keepalive_us;
+  // The number of previous states repeated in every redundant message.
+  uint32_t redundancy;
+} device_options_t;
+
+/// @brief A virtual device, speaking the message.h protocol like the firmware.
+typedef struct {
+  int sock;
+  struct sockaddr_in server;
+  device_options_t options;
+  uint32_t random;
+
+  bool is_syncing;
+  // The format selected by the server.
+  uint32_t format;
+  // The host clock is the device clock plus the offset, from the sample with the smallest round trip.
+  int64_t clock_offset_us;
+  int64_t clock_rtt_us;
+
+  joystick_info_t state;
+  bool is_changed;
+  uint32_t period;
+  uint32_t sequence;
+  uint32_t acked_sequence;
+  int64_t send_times[DEVICE_SEND_HISTORY_SIZE];
+  joystick_compact_t sent_states[8];
+  // The states sent in the delta format, and the acknowledged one the deltas are taken from.
+  joystick_info_t delta_states[DEVICE_DELTA_HISTORY_SIZE];
+  uint32_t delta_sequences[DEVICE_DELTA_HISTORY_SIZE];
+  joystick_info_t base_state;
+  uint32_t base_sequence;
+  int64_t last_keyframe_us;
+
+  int64_t next_period_us;
+  int64_t last_send_us;
+  int64_t last_ping_us;
+  int64_t last_time_request_us;
+
+  uint64_t sent;
+  uint64_t acked;
+  uint64_t lost;
+  uint64_t bytes;
+  histogram_t ack_latency;
+} virtual_device_t;
+
+/// @brief Initialize a virtual device.
+/// @param device The device.
+/// @param sock The non-blocking socket owned by the device.
+/// @param server The server address.
+/// @param options The options.
+/// @param seed The random seed.
+void initialize_device(virtual_device_t* device, int sock, const struct sockaddr_in* server, const device_options_t* options, uint32_t seed);
+
+/// @brief Send the messages due at the time.
+/// @param device The device.
+/// @param now_us The current time in microseconds.
+/// @return The time of the next due message.
+int64_t update_device(virtual_device_t* device, int64_t now_us);
+
+/// @brief Receive and handle all pending replies.
+/// @param device The device.
+/// @return The number of received messages.
+int receive_device(virtual_device_t* device);
+
+#endif // __DEVICE_H__
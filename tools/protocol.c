@@ -0,0 +1,286 @@
+#include <string.h>
+
+#include "protocol.h"
+
+/// @brief Encode a joystick state in the compact layout.
+/// @param data The joystick state.
+/// @param compact The compact joystick state to fill.
+void encode_joystick_compact(const joystick_info_t* data, joystick_compact_t* compact) {
+  const int32_t* axes = &data->axis_x;
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_AXES; ++i) {
+    compact->axes[i] = axes[i] < 0 ? 0 : (axes[i] > UINT16_MAX ? UINT16_MAX : axes[i]);
+  }
+  memcpy(compact->buttons, data->buttons, sizeof(compact->buttons));
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_HATS; i += 2) {
+    compact->hats[i / 2] = (data->hats[i] & 0xF) | ((data->hats[i + 1] & 0xF) << 4);
+  }
+}
+
+/// @brief Decode a compact joystick state.
+/// @param compact The compact joystick state.
+/// @param data The joystick state to fill.
+void decode_joystick_compact(const joystick_compact_t* compact, joystick_info_t* data) {
+  memset(data, 0, sizeof(joystick_info_t));
+  int32_t* axes = &data->axis_x;
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_AXES; ++i) {
+    axes[i] = compact->axes[i];
+  }
+  memcpy(data->buttons, compact->buttons, sizeof(compact->buttons));
+  for (int i = 0; i < JOYSTICK_COMPACT_NUM_OF_HATS; i += 2) {
+    data->hats[i] = compact->hats[i / 2] & 0xF;
+    data->hats[i + 1] = compact->hats[i / 2] >> 4;
+  }
+}
+
+/// @brief Choose the joystick format for a device.
+/// @param formats The formats advertised by the device.
+/// @param format The preferred format, -1 for the firmware order of preference.
+/// @return The format.
+uint32_t choose_joystick_format(uint32_t formats, int format) {
+  if (format >= 0 && format < 32 && (formats & (1u << format))) {
+    return format;
+  }
+  static const uint32_t preferences[] = {
+    MESSAGE_JOYSTICK_FORMAT_REDUNDANT,
+    MESSAGE_JOYSTICK_FORMAT_COMPACT,
+    MESSAGE_JOYSTICK_FORMAT_DELTA,
+  };
+  for (size_t i = 0; i < sizeof(preferences) / sizeof(preferences[0]); ++i) {
+    if (formats & (1u << preferences[i])) {
+      return preferences[i];
+    }
+  }
+  return MESSAGE_JOYSTICK_FORMAT_FULL;
+}
+
+/// @brief Account a new sequenced sync message and keep its state.
+/// @param session The session.
+/// @param sequence The sequence number.
+/// @param timestamp The sample time in host microseconds, truncated to 32 bits.
+/// @param redundant The number of previous states carried by the message.
+/// @param now_us The receive time in microseconds.
+static void account_sync(protocol_session_t* session, uint32_t sequence, uint32_t timestamp, uint32_t redundant, int64_t now_us) {
+  if (session->has_sequence) {
+    uint32_t gap = sequence - session->last_sequence - 1;
+    uint32_t recovered = gap < redundant ? gap : redundant;
+    session->recovered += recovered;
+    session->lost += gap - recovered;
+  }
+  session->has_sequence = true;
+  session->last_sequence = sequence;
+
+  int slot = sequence % PROTOCOL_STATE_HISTORY_SIZE;
+  memcpy(&session->states[slot], &session->state, sizeof(joystick_info_t));
+  session->sequences[slot] = sequence;
+
+  // The timestamp is on this clock when the device synchronized against it. On loopback the
+  // latency is within the clock offset error, so small negative values count as 0.
+  int32_t latency = (int32_t)((uint32_t)now_us - timestamp);
+  if (latency > -1000000) {
+    record_histogram(&session->latency, latency < 0 ? 0 : latency);
+  }
+}
+
+/// @brief Handle a common message.
+/// @param session The session.
+/// @param buffer The message.
+/// @param length The length of the message.
+/// @param now_us The host time in microseconds.
+/// @param format The preferred format.
+/// @param reply The reply to fill.
+/// @param reply_length The length of the reply.
+/// @return The kind of the message.
+static protocol_result_t handle_common_message(
+  protocol_session_t* session, const void* buffer, size_t length, int64_t now_us, int format,
+  protocol_reply_t* reply, size_t* reply_length
+) {
+  const message_header_t* header = (const message_header_t*)buffer;
+  if (header->minor_id == MESSAGE_MINOR_ID_COMMON_PING && length >= offsetof(message_common_ping_t, formats)) {
+    const message_common_ping_t* ping = (const message_common_ping_t*)buffer;
+    if (ping->magic != ('N' << 24 | 'A' << 16 | 'G' << 8 | 'I')) {
+      return PROTOCOL_RESULT_INVALID;
+    }
+    uint32_t formats = length >= offsetof(message_common_ping_t, origin_time) ? ping->formats : 0;
+    reply->pong = (message_common_pong_t){
+      .header = {
+        .major_id = MESSAGE_MAJOR_ID_COMMON,
+        .minor_id = MESSAGE_MINOR_ID_COMMON_PONG,
+        .length = sizeof(message_common_pong_t) - sizeof(message_header_t),
+      },
+      .magic = ('G' << 24 | 'I' << 16 | 'A' << 8 | 'N'),
+      .format = choose_joystick_format(formats, format),
+      .origin_time = length >= sizeof(message_common_ping_t) ? ping->origin_time : 0,
+      .receive_time = now_us,
+    };
+    *reply_length = sizeof(message_common_pong_t);
+    // A new session.
+    session->format = reply->pong.format;
+    session->has_sequence = false;
+    memset(session->sequences, 0, sizeof(session->sequences));
+    return PROTOCOL_RESULT_PING;
+  }
+  if (header->minor_id == MESSAGE_MINOR_ID_COMMON_TIME_REQUEST && length >= sizeof(message_common_time_request_t)) {
+    const message_common_time_request_t* request = (const message_common_time_request_t*)buffer;
+    reply->time_response = (message_common_time_response_t){
+      .header = {
+        .major_id = MESSAGE_MAJOR_ID_COMMON,
+        .minor_id = MESSAGE_MINOR_ID_COMMON_TIME_RESPONSE,
+        .length = sizeof(message_common_time_response_t) - sizeof(message_header_t),
+      },
+      .origin_time = request->origin_time,
+      .receive_time = now_us,
+    };
+    *reply_length = sizeof(message_common_time_response_t);
+    return PROTOCOL_RESULT_TIME_REQUEST;
+  }
+  return PROTOCOL_RESULT_INVALID;
+}
+
+/// @brief Handle a message from a device.
+/// @param session The session of the device.
+/// @param buffer The message.
+/// @param length The length of the message.
+/// @param now_us The host time in microseconds.
+/// @param format The preferred format, -1 for the firmware order of preference.
+/// @param reply The reply to fill.
+/// @param reply_length The length of the reply, 0 for no reply.
+/// @return The kind of the message.
+protocol_result_t handle_protocol_message(
+  protocol_session_t* session, const void* buffer, size_t length, int64_t now_us, int format,
+  protocol_reply_t* reply, size_t* reply_length
+) {
+  *reply_length = 0;
+  if (length < sizeof(message_header_t)) {
+    return PROTOCOL_RESULT_INVALID;
+  }
+  const message_header_t* header = (const message_header_t*)buffer;
+  if (header->major_id == MESSAGE_MAJOR_ID_COMMON) {
+    return handle_common_message(session, buffer, length, now_us, format, reply, reply_length);
+  }
+  if (header->major_id != MESSAGE_MAJOR_ID_JOYSTICK) {
+    return PROTOCOL_RESULT_INVALID;
+  }
+
+  joystick_info_t data;
+  uint32_t sequence;
+  uint32_t timestamp;
+  uint32_t redundant = 0;
+  switch (header->minor_id) {
+    case MESSAGE_MINOR_ID_JOYSTICK_DATA_SYNC: {
+      // The legacy stop-and-wait sync has neither sequence nor timestamp.
+      if (length < sizeof(message_joystick_sync_t)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      const message_joystick_sync_t* sync = (const message_joystick_sync_t*)buffer;
+      memcpy(&session->state, &sync->data, sizeof(joystick_info_t));
+      session->received++;
+      reply->ack = (message_joystick_ack_t){
+        .header = {
+          .major_id = MESSAGE_MAJOR_ID_JOYSTICK,
+          .minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_ACK,
+          .length = sizeof(uint16_t),
+        },
+        .payload = 0x4F4B,
+      };
+      *reply_length = offsetof(message_joystick_ack_t, payload) + sizeof(uint16_t);
+      return PROTOCOL_RESULT_LEGACY_SYNC;
+    }
+    case MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_SYNC: {
+      const message_joystick_seq_sync_t* sync = (const message_joystick_seq_sync_t*)buffer;
+      if (length < sizeof(message_joystick_seq_sync_t)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      sequence = sync->sequence;
+      timestamp = sync->timestamp;
+      memcpy(&data, &sync->data, sizeof(joystick_info_t));
+      break;
+    }
+    case MESSAGE_MINOR_ID_JOYSTICK_DATA_DELTA_SYNC: {
+      const message_joystick_delta_sync_t* sync = (const message_joystick_delta_sync_t*)buffer;
+      if (length < offsetof(message_joystick_delta_sync_t, values)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      int count = __builtin_popcount(sync->field_mask);
+      if (length < offsetof(message_joystick_delta_sync_t, values) + count * sizeof(uint32_t)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      // The delta only applies to a base this session still has, otherwise it is not acknowledged.
+      memset(&data, 0, sizeof(data));
+      if (sync->base_sequence != 0) {
+        int slot = sync->base_sequence % PROTOCOL_STATE_HISTORY_SIZE;
+        if (session->sequences[slot] != sync->base_sequence) {
+          return PROTOCOL_RESULT_INVALID;
+        }
+        memcpy(&data, &session->states[slot], sizeof(joystick_info_t));
+      }
+      uint32_t* fields = (uint32_t*)&data;
+      int index = 0;
+      for (uint32_t i = 0; i < JOYSTICK_INFO_FIELD_COUNT; ++i) {
+        if (sync->field_mask & (1u << i)) {
+          fields[i] = sync->values[index++];
+        }
+      }
+      sequence = sync->sequence;
+      timestamp = sync->timestamp;
+      break;
+    }
+    case MESSAGE_MINOR_ID_JOYSTICK_DATA_COMPACT_SYNC: {
+      const message_joystick_compact_sync_t* sync = (const message_joystick_compact_sync_t*)buffer;
+      if (length < sizeof(message_joystick_compact_sync_t)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      sequence = sync->sequence;
+      timestamp = sync->timestamp;
+      decode_joystick_compact(&sync->data, &data);
+      break;
+    }
+    case MESSAGE_MINOR_ID_JOYSTICK_DATA_REDUNDANT_SYNC: {
+      const message_joystick_redundant_sync_t* sync = (const message_joystick_redundant_sync_t*)buffer;
+      if (length < offsetof(message_joystick_redundant_sync_t, states) ||
+          sync->count == 0 || sync->count > MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES ||
+          length < offsetof(message_joystick_redundant_sync_t, states) + sync->count * sizeof(joystick_compact_t)) {
+        return PROTOCOL_RESULT_INVALID;
+      }
+      sequence = sync->sequence;
+      timestamp = sync->timestamp;
+      redundant = sync->count - 1;
+      decode_joystick_compact(&sync->states[0], &data);
+      break;
+    }
+    default:
+      return PROTOCOL_RESULT_INVALID;
+  }
+
+  session->received++;
+  if (session->has_sequence && (int32_t)(sequence - session->last_sequence) <= 0) {
+    session->stale++;
+    return PROTOCOL_RESULT_STALE;
+  }
+  memcpy(&session->state, &data, sizeof(joystick_info_t));
+  account_sync(session, sequence, timestamp, redundant, now_us);
+  reply->seq_ack = (message_joystick_seq_ack_t){
+    .header = {
+      .major_id = MESSAGE_MAJOR_ID_JOYSTICK,
+      .minor_id = MESSAGE_MINOR_ID_JOYSTICK_DATA_SEQ_ACK,
+      .length = sizeof(message_joystick_seq_ack_t) - sizeof(message_header_t),
+    },
+    .sequence = sequence,
+    .payload = 0x4F4B,
+  };
+  *reply_length = sizeof(message_joystick_seq_ack_t);
+  return PROTOCOL_RESULT_SYNC;
+}
+
+/// @brief Stamp the transmit time of a reply, right before it leaves.
+/// @param reply The reply.
+/// @param now_us The host time in microseconds.
+void stamp_protocol_reply(protocol_reply_t* reply, int64_t now_us) {
+  if (reply->header.major_id != MESSAGE_MAJOR_ID_COMMON) {
+    return;
+  }
+  if (reply->header.minor_id == MESSAGE_MINOR_ID_COMMON_PONG) {
+    reply->pong.transmit_time = now_us;
+  } else if (reply->header.minor_id == MESSAGE_MINOR_ID_COMMON_TIME_RESPONSE) {
+    reply->time_response.transmit_time = now_us;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "message.h"
+#include "common.h"
+
+// The number of decoded states kept per session, as delta bases.
+#define PROTOCOL_STATE_HISTORY_SIZE 32
+
+/// @brief The host side of a device session.
+typedef struct {
+  // The joystick format selected at the last ping.
+  uint32_t format;
+  bool has_sequence;
+  uint32_t last_sequence;
+  uint64_t received;
+  uint64_t lost;
+  uint64_t recovered;
+  uint64_t stale;
+  // The sync latency, from the device timestamp to the receive time.
+  histogram_t latency;
+  // The last decoded state.
+  joystick_info_t state;
+  joystick_info_t states[PROTOCOL_STATE_HISTORY_SIZE];
+  uint32_t sequences[PROTOCOL_STATE_HISTORY_SIZE];
+} protocol_session_t;
+
+/// @brief The kind of a handled message.
+typedef enum {
+  PROTOCOL_RESULT_INVALID,
+  // A ping, the session restarted.
+  PROTOCOL_RESULT_PING,
+  PROTOCOL_RESULT_TIME_REQUEST,
+  // A stop-and-wait sync, session->state holds its state.
+  PROTOCOL_RESULT_LEGACY_SYNC,
+  // A new sequenced sync, session->state holds its state.
+  PROTOCOL_RESULT_SYNC,
+  // A sequenced sync older than the last one.
+  PROTOCOL_RESULT_STALE,
+} protocol_result_t;
+
+/// @brief A reply to a device.
+typedef union {
+  message_header_t header;
+  message_common_pong_t pong;
+  message_common_time_response_t time_response;
+  message_joystick_ack_t ack;
+  message_joystick_seq_ack_t seq_ack;
+} protocol_reply_t;
+
+/// @brief Encode a joystick state in the compact layout.
+/// @param data The joystick state.
+/// @param compact The compact joystick state to fill.
+void encode_joystick_compact(const joystick_info_t* data, joystick_compact_t* compact);
+
+/// @brief Decode a compact joystick state.
+/// @param compact The compact joystick state.
+/// @param data The joystick state to fill.
+void decode_joystick_compact(const joystick_compact_t* compact, joystick_info_t* data);
+
+/// @brief Choose the joystick format for a device.
+/// @param formats The formats advertised by the device.
+/// @param format The preferred format, -1 for the firmware order of preference.
+/// @return The format.
+uint32_t choose_joystick_format(uint32_t formats, int format);
+
+/// @brief Handle a message from a device.
+/// @param session The session of the device.
+/// @param buffer The message.
+/// @param length The length of the message.
+/// @param now_us The host time in microseconds.
+/// @param format The preferred format, -1 for the firmware order of preference.
+/// @param reply The reply to fill.
+/// @param reply_length The length of the reply, 0 for no reply.
+/// @return The kind of the message.
+protocol_result_t handle_protocol_message(
+  protocol_session_t* session, const void* buffer, size_t length, int64_t now_us, int format,
+  protocol_reply_t* reply, size_t* reply_length
+);
+
+/// @brief Stamp the transmit time of a reply, right before it leaves.
+/// @param reply The reply.
+/// @param now_us The host time in microseconds.
+void stamp_protocol_reply(protocol_reply_t* reply, int64_t now_us);
+
+#endif // __PROTOCOL_H__
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+/// @brief A record with its position in the file, so the sort is stable.
+typedef struct {
+  trace_record_t record;
+  size_t position;
+} sort_entry_t;
+
+/// @brief Order the records by time, then by file position.
+/// @param a The first entry.
+/// @param b The second entry.
+/// @return The order.
+static int compare_entries(const void* a, const void* b) {
+  const sort_entry_t* x = a;
+  const sort_entry_t* y = b;
+  if (x->record.time_us != y->record.time_us) {
+    return x->record.time_us < y->record.time_us ? -1 : 1;
+  }
+  return x->position < y->position ? -1 : (x->position > y->position ? 1 : 0);
+}
+
+/// @brief Load a trace file.
+/// @param path The file path.
+/// @param trace The trace to fill.
+/// @return True if the trace is valid.
+bool load_replay_trace(const char* path, replay_trace_t* trace) {
+  memset(trace, 0, sizeof(replay_trace_t));
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+  if (
+    fread(&trace->header, sizeof(trace_header_t), 1, f) != 1 ||
+    trace->header.magic != TRACE_MAGIC ||
+    trace->header.version != TRACE_VERSION ||
+    trace->header.record_size != sizeof(trace_record_t)
+  ) {
+    fprintf(stderr, "%s is not a trace of version %d\n", path, TRACE_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  // Read all records, the recorder writes them in time order per source only.
+  size_t capacity = 4096;
+  size_t count = 0;
+  sort_entry_t* entries = malloc(capacity * sizeof(sort_entry_t));
+  trace_record_t record;
+  while (entries != NULL && fread(&record, sizeof(record), 1, f) == 1) {
+    if (count == capacity) {
+      capacity *= 2;
+      sort_entry_t* grown = realloc(entries, capacity * sizeof(sort_entry_t));
+      if (grown == NULL) {
+        free(entries);
+        entries = NULL;
+        break;
+      }
+      entries = grown;
+    }
+    entries[count].record = record;
+    entries[count].position = count;
+    count++;
+  }
+  fclose(f);
+  if (entries == NULL) {
+    fprintf(stderr, "Out of memory loading %s\n", path);
+    return false;
+  }
+  qsort(entries, count, sizeof(sort_entry_t), compare_entries);
+
+  // Split the ADC channels from the input events.
+  trace->events = malloc((count + 1) * sizeof(trace_record_t));
+  for (int i = 0; i < REPLAY_MAX_ADC_CHANNELS; i++) {
+    trace->adc[i] = malloc((count + 1) * sizeof(trace_record_t));
+  }
+  for (size_t i = 0; i < count; i++) {
+    const trace_record_t* r = &entries[i].record;
+    if (r->type == TRACE_RECORD_ADC) {
+      if (r->index < REPLAY_MAX_ADC_CHANNELS) {
+        trace->adc[r->index][trace->num_of_adc[r->index]++] = *r;
+      }
+    } else if (r->type == TRACE_RECORD_GPIO || r->type == TRACE_RECORD_ENCODER) {
+      trace->events[trace->num_of_events++] = *r;
+    }
+    trace->duration_us = r->time_us;
+  }
+  free(entries);
+  return true;
+}
+
+/// @brief Free a loaded trace.
+/// @param trace The trace.
+void free_replay_trace(replay_trace_t* trace) {
+  free(trace->events);
+  for (int i = 0; i < REPLAY_MAX_ADC_CHANNELS; i++) {
+    free(trace->adc[i]);
+  }
+  memset(trace, 0, sizeof(replay_trace_t));
+}
+
+/// @brief Get the ADC code of a channel at a time, the last record at or before it.
+/// @param trace The trace.
+/// @param channel The ADC channel.
+/// @param time_us The time in microseconds.
+/// @param cursor The search position of the channel, start at 0, the times must not decrease.
+/// @return The raw ADC code, 2048 if the channel has no record yet.
+int get_replay_adc(const replay_trace_t* trace, uint32_t channel, int64_t time_us, size_t* cursor) {
+  if (channel >= REPLAY_MAX_ADC_CHANNELS || trace->num_of_adc[channel] == 0) {
+    return 2048;
+  }
+  const trace_record_t* records = trace->adc[channel];
+  size_t count = trace->num_of_adc[channel];
+  while (*cursor + 1 < count && records[*cursor + 1].time_us <= time_us) {
+    (*cursor)++;
+  }
+  if (records[*cursor].time_us > time_us) {
+    return 2048;
+  }
+  return records[*cursor].value;
+}
@@ -0,0 +1,44 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "trace.h"
+
+// The ADC1 channels a trace can hold.
+#define REPLAY_MAX_ADC_CHANNELS 8
+
+/// @brief A loaded input trace, see main/trace.h.
+typedef struct {
+  trace_header_t header;
+  // The GPIO and encoder records, in time order.
+  trace_record_t* events;
+  size_t num_of_events;
+  // The ADC records of every channel, in time order.
+  trace_record_t* adc[REPLAY_MAX_ADC_CHANNELS];
+  size_t num_of_adc[REPLAY_MAX_ADC_CHANNELS];
+  // The time of the last record in microseconds.
+  uint32_t duration_us;
+} replay_trace_t;
+
+/// @brief Load a trace file.
+/// @param path The file path.
+/// @param trace The trace to fill.
+/// @return True if the trace is valid.
+bool load_replay_trace(const char* path, replay_trace_t* trace);
+
+/// @brief Free a loaded trace.
+/// @param trace The trace.
+void free_replay_trace(replay_trace_t* trace);
+
+/// @brief Get the ADC code of a channel at a time, the last record at or before it.
+/// @param trace The trace.
+/// @param channel The ADC channel.
+/// @param time_us The time in microseconds.
+/// @param cursor The search position of the channel, start at 0, the times must not decrease.
+/// @return The raw ADC code, 2048 if the channel has no record yet.
+int get_replay_adc(const replay_trace_t* trace, uint32_t channel, int64_t time_us, size_t* cursor);
+
+#endif // __REPLAY_H__
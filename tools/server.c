@@ -0,0 +1,791 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "message.h"
+#include "common.h"
+#include "protocol.h"
+#include "device.h"
+
+// The most clients tracked by the server, the table size must be a power of two.
+#define SERVER_MAX_CLIENTS 4096
+#define SERVER_CLIENT_TABLE_SIZE (SERVER_MAX_CLIENTS * 2)
+// The most delayed replies in flight.
+#define SERVER_MAX_PENDING_REPLIES 65536
+
+/// @brief The server options.
+typedef struct {
+  uint16_t port;
+  // The delay of every reply in microseconds.
+  int64_t delay_us;
+  // The probability to drop an incoming message.
+  double loss;
+  // The probability to drop a reply.
+  double ack_loss;
+  // The joystick format selected for the devices advertising it, -1 for the device default.
+  int format;
+  // The report interval in seconds, 0 for the final report only.
+  int interval;
+  // The random seed, so lossy runs are repeatable.
+  uint32_t seed;
+} server_options_t;
+
+/// @brief A client seen by the server.
+typedef struct {
+  struct sockaddr_in addr;
+  protocol_session_t session;
+  uint64_t bytes;
+  int64_t last_arrival_us;
+  histogram_t inter_arrival;
+} client_t;
+
+/// @brief A delayed reply.
+typedef struct {
+  int64_t due_us;
+  struct sockaddr_in addr;
+  size_t length;
+  protocol_reply_t message;
+} pending_reply_t;
+
+/// @brief The server.
+typedef struct {
+  int sock;
+  server_options_t options;
+  uint32_t random;
+  client_t* clients[SERVER_CLIENT_TABLE_SIZE];
+  int num_of_clients;
+  pending_reply_t* pending;
+  uint32_t pending_head;
+  uint32_t pending_tail;
+  uint64_t dropped;
+  uint64_t dropped_replies;
+  uint64_t invalid;
+} server_t;
+
+/// @brief The load generator options.
+typedef struct {
+  // The number of virtual devices.
+  int num_of_devices;
+  // The time to start all devices in seconds, 0 to start them at once.
+  int ramp;
+  // The report interval in seconds, 0 for the final report only.
+  int interval;
+  // True to print every device in the final report.
+  bool is_verbose;
+} load_options_t;
+
+static volatile sig_atomic_t _is_running = 1;
+
+/// @brief Stop on Ctrl+C.
+/// @param sig The signal.
+static void handle_signal(int sig) {
+  (void)sig;
+  _is_running = 0;
+}
+
+/// @brief Find or add the client of an address.
+/// @param server The server.
+/// @param addr The address.
+/// @return The client, or NULL if the table is full.
+static client_t* get_client(server_t* server, const struct sockaddr_in* addr) {
+  uint32_t hash = (addr->sin_addr.s_addr * 2654435761u) ^ (addr->sin_port * 40503u);
+  for (uint32_t i = 0; i < SERVER_CLIENT_TABLE_SIZE; ++i) {
+    uint32_t slot = (hash + i) & (SERVER_CLIENT_TABLE_SIZE - 1);
+    client_t* client = server->clients[slot];
+    if (client == NULL) {
+      if (server->num_of_clients >= SERVER_MAX_CLIENTS) {
+        return NULL;
+      }
+      client = calloc(1, sizeof(client_t));
+      if (client == NULL) {
+        return NULL;
+      }
+      client->addr = *addr;
+      server->clients[slot] = client;
+      server->num_of_clients++;
+      return client;
+    }
+    if (client->addr.sin_addr.s_addr == addr->sin_addr.s_addr && client->addr.sin_port == addr->sin_port) {
+      return client;
+    }
+  }
+  return NULL;
+}
+
+/// @brief Queue a reply, sent after the configured delay.
+/// @param server The server.
+/// @param addr The destination.
+/// @param message The message.
+/// @param length The length of the message.
+static void queue_reply(server_t* server, const struct sockaddr_in* addr, const void* message, size_t length) {
+  if (roll_random(&server->random, server->options.ack_loss)) {
+    server->dropped_replies++;
+    return;
+  }
+  if (server->pending_tail - server->pending_head >= SERVER_MAX_PENDING_REPLIES) {
+    server->dropped_replies++;
+    return;
+  }
+  pending_reply_t* reply = &server->pending[server->pending_tail++ % SERVER_MAX_PENDING_REPLIES];
+  reply->due_us = get_time_us() + server->options.delay_us;
+  reply->addr = *addr;
+  reply->length = length;
+  memcpy(&reply->message, message, length);
+}
+
+/// @brief Send the replies that are due.
+/// @param server The server.
+/// @param now_us The current time in microseconds.
+/// @return The time of the next due reply, or -1 if there is none.
+static int64_t flush_replies(server_t* server, int64_t now_us) {
+  // Every reply has the same delay, so the queue is in due order.
+  while (server->pending_head != server->pending_tail) {
+    pending_reply_t* reply = &server->pending[server->pending_head % SERVER_MAX_PENDING_REPLIES];
+    if (reply->due_us > now_us) {
+      return reply->due_us;
+    }
+    // The clock fields are stamped when the reply actually leaves.
+    stamp_protocol_reply(&reply->message, get_time_us());
+    ssize_t err = sendto(server->sock, &reply->message, reply->length, 0, (const struct sockaddr*)&reply->addr, sizeof(reply->addr));
+    if (err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return now_us;
+    }
+    server->pending_head++;
+  }
+  return -1;
+}
+
+/// @brief Handle a message from a device.
+/// @param server The server.
+/// @param addr The source address.
+/// @param buffer The message.
+/// @param len The length of the message.
+static void handle_message(server_t* server, const struct sockaddr_in* addr, const char* buffer, ssize_t len) {
+  int64_t now_us = get_time_us();
+  if (len < (ssize_t)sizeof(message_header_t)) {
+    server->invalid++;
+    return;
+  }
+  if (roll_random(&server->random, server->options.loss)) {
+    server->dropped++;
+    return;
+  }
+  client_t* client = get_client(server, addr);
+  if (client == NULL) {
+    server->dropped++;
+    return;
+  }
+
+  client->bytes += len;
+  if (client->last_arrival_us != 0) {
+    record_histogram(&client->inter_arrival, now_us - client->last_arrival_us);
+  }
+  client->last_arrival_us = now_us;
+
+  protocol_reply_t reply;
+  size_t reply_length;
+  protocol_result_t result = handle_protocol_message(&client->session, buffer, len, now_us, server->options.format, &reply, &reply_length);
+  if (result == PROTOCOL_RESULT_INVALID) {
+    server->invalid++;
+  }
+  if (reply_length > 0) {
+    queue_reply(server, addr, &reply, reply_length);
+  }
+}
+
+/// @brief Print the server statistics.
+/// @param server The server.
+/// @param is_verbose True to print every client.
+static void print_server_stats(const server_t* server, bool is_verbose) {
+  histogram_t inter_arrival = {0};
+  histogram_t latency = {0};
+  uint64_t received = 0;
+  uint64_t lost = 0;
+  uint64_t recovered = 0;
+  uint64_t stale = 0;
+  uint64_t bytes = 0;
+  for (int i = 0; i < SERVER_CLIENT_TABLE_SIZE; ++i) {
+    const client_t* client = server->clients[i];
+    if (client == NULL) {
+      continue;
+    }
+    merge_histogram(&inter_arrival, &client->inter_arrival);
+    merge_histogram(&latency, &client->session.latency);
+    received += client->session.received;
+    lost += client->session.lost;
+    recovered += client->session.recovered;
+    stale += client->session.stale;
+    bytes += client->bytes;
+    if (is_verbose) {
+      char host[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &client->addr.sin_addr, host, sizeof(host));
+      printf(
+        "  %s:%u format %u received %llu lost %llu recovered %llu stale %llu latency p99 %llu us\n",
+        host, ntohs(client->addr.sin_port), client->session.format,
+        (unsigned long long)client->session.received, (unsigned long long)client->session.lost,
+        (unsigned long long)client->session.recovered, (unsigned long long)client->session.stale,
+        (unsigned long long)get_histogram_percentile(&client->session.latency, 99)
+      );
+    }
+  }
+  printf(
+    "server: clients %d received %llu lost %llu recovered %llu stale %llu bytes %llu dropped %llu/%llu invalid %llu\n",
+    server->num_of_clients,
+    (unsigned long long)received, (unsigned long long)lost, (unsigned long long)recovered,
+    (unsigned long long)stale, (unsigned long long)bytes,
+    (unsigned long long)server->dropped, (unsigned long long)server->dropped_replies,
+    (unsigned long long)server->invalid
+  );
+  print_histogram("inter-arrival", "us", &inter_arrival);
+  print_histogram("latency", "us", &latency);
+}
+
+/// @brief Run the server until it is stopped.
+/// @param server The server.
+/// @param duration The run time in seconds, 0 to run until stopped.
+static void run_server(server_t* server, int duration) {
+  char buffer[1472];
+  int64_t start_us = get_time_us();
+  int64_t next_report_us = start_us + server->options.interval * 1000000LL;
+  while (_is_running) {
+    int64_t now_us = get_time_us();
+    if (duration > 0 && now_us - start_us >= duration * 1000000LL) {
+      break;
+    }
+    if (server->options.interval > 0 && now_us >= next_report_us) {
+      print_server_stats(server, false);
+      next_report_us += server->options.interval * 1000000LL;
+    }
+
+    int64_t due_us = flush_replies(server, now_us);
+    int64_t wait_us = due_us >= 0 ? due_us - now_us : 100000;
+    struct pollfd fd = {.fd = server->sock, .events = POLLIN};
+    struct timespec timeout = {.tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000};
+    if (ppoll(&fd, 1, &timeout, NULL) <= 0) {
+      continue;
+    }
+
+    for (;;) {
+      struct sockaddr_in source_addr;
+      socklen_t socklen = sizeof(source_addr);
+      ssize_t len = recvfrom(server->sock, buffer, sizeof(buffer), 0, (struct sockaddr*)&source_addr, &socklen);
+      if (len < 0) {
+        break;
+      }
+      handle_message(server, &source_addr, buffer, len);
+    }
+  }
+}
+
+/// @brief Create the server.
+/// @param server The server.
+/// @param options The options.
+/// @return True if the server is created.
+static bool create_server(server_t* server, const server_options_t* options) {
+  memset(server, 0, sizeof(server_t));
+  server->options = *options;
+  server->random = options->seed ? options->seed : 1;
+  server->pending = calloc(SERVER_MAX_PENDING_REPLIES, sizeof(pending_reply_t));
+  server->sock = open_udp_socket(options->port);
+  return server->pending != NULL && server->sock >= 0;
+}
+
+/// @brief Destroy the server.
+/// @param server The server.
+static void destroy_server(server_t* server) {
+  for (int i = 0; i < SERVER_CLIENT_TABLE_SIZE; ++i) {
+    free(server->clients[i]);
+  }
+  free(server->pending);
+  if (server->sock >= 0) {
+    close(server->sock);
+  }
+}
+
+/// @brief Drive a virtual device against a server.
+/// @param server_addr The server address.
+/// @param options The device options.
+/// @param duration The run time in seconds.
+/// @param seed The random seed.
+/// @return The exit code.
+static int drive_device(const struct sockaddr_in* server_addr, const device_options_t* options, int duration, uint32_t seed) {
+  int sock = open_udp_socket(0);
+  if (sock < 0) {
+    return 1;
+  }
+  virtual_device_t* device = malloc(sizeof(virtual_device_t));
+  initialize_device(device, sock, server_addr, options, seed);
+
+  int64_t start_us = get_time_us();
+  int64_t sync_start_us = 0;
+  while (_is_running) {
+    int64_t now_us = get_time_us();
+    if (now_us - start_us >= duration * 1000000LL) {
+      break;
+    }
+    int64_t due_us = update_device(device, now_us);
+    if (device->is_syncing && sync_start_us == 0) {
+      sync_start_us = now_us;
+    }
+
+    // Wait for a reply or the next due message, whichever comes first.
+    int64_t wait_us = due_us - get_time_us();
+    if (wait_us > 0) {
+      struct pollfd fd = {.fd = sock, .events = POLLIN};
+      struct timespec timeout = {.tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000};
+      ppoll(&fd, 1, &timeout, NULL);
+    }
+    receive_device(device);
+  }
+
+  double seconds = sync_start_us ? (get_time_us() - sync_start_us) / 1e6 : 0;
+  printf(
+    "device: format %u sent %llu (%.0f/s, %.1f kB/s) acked %llu lost %llu clock offset %lld us rtt %lld us\n",
+    device->format,
+    (unsigned long long)device->sent, seconds > 0 ? device->sent / seconds : 0,
+    seconds > 0 ? device->bytes / seconds / 1000 : 0,
+    (unsigned long long)device->acked, (unsigned long long)device->lost,
+    (long long)device->clock_offset_us, (long long)device->clock_rtt_us
+  );
+  print_histogram("ack latency", "us", &device->ack_latency);
+
+  int code = device->is_syncing ? 0 : 1;
+  free(device);
+  close(sock);
+  return code;
+}
+
+/// @brief Sum the counters and the ack latency of the virtual devices.
+/// @param devices The devices.
+/// @param num_of_devices The number of devices.
+/// @param total The sum to fill, only the counters and ack_latency are set.
+/// @return The number of syncing devices.
+static int sum_devices(virtual_device_t* const* devices, int num_of_devices, virtual_device_t* total) {
+  memset(total, 0, sizeof(virtual_device_t));
+  int num_of_syncing = 0;
+  for (int i = 0; i < num_of_devices; ++i) {
+    const virtual_device_t* device = devices[i];
+    total->sent += device->sent;
+    total->acked += device->acked;
+    total->lost += device->lost;
+    total->bytes += device->bytes;
+    merge_histogram(&total->ack_latency, &device->ack_latency);
+    num_of_syncing += device->is_syncing;
+  }
+  return num_of_syncing;
+}
+
+/// @brief Print the load generator report of an interval.
+/// @param total The device sums at the end of the interval.
+/// @param last The device sums at the start of the interval.
+/// @param num_of_devices The number of started devices.
+/// @param num_of_syncing The number of syncing devices.
+/// @param seconds The length of the interval.
+static void print_load_interval(const virtual_device_t* total, const virtual_device_t* last, int num_of_devices, int num_of_syncing, double seconds) {
+  // The latency of the interval only, the buckets count up.
+  histogram_t latency = total->ack_latency;
+  for (int i = 0; i < HISTOGRAM_NUM_OF_BUCKETS; ++i) {
+    latency.buckets[i] -= last->ack_latency.buckets[i];
+  }
+  latency.count -= last->ack_latency.count;
+  latency.sum -= last->ack_latency.sum;
+  uint64_t sent = total->sent - last->sent;
+  uint64_t lost = total->lost - last->lost;
+  printf(
+    "load: devices %d syncing %d sent %.0f/s acked %.0f/s lost %.3f%% ack p50 %llu p99 %llu us\n",
+    num_of_devices, num_of_syncing, sent / seconds, (total->acked - last->acked) / seconds,
+    sent > 0 ? 100.0 * lost / sent : 0,
+    (unsigned long long)(latency.count ? get_histogram_percentile(&latency, 50) : 0),
+    (unsigned long long)(latency.count ? get_histogram_percentile(&latency, 99) : 0)
+  );
+}
+
+/// @brief Get the loss of a device.
+/// @param device The device.
+/// @return The lost fraction of the sent messages, in percent.
+static double get_device_loss(const virtual_device_t* device) {
+  return device->sent > 0 ? 100.0 * device->lost / device->sent : 0;
+}
+
+/// @brief Order the devices by loss, the worst first.
+/// @param a The first device.
+/// @param b The second device.
+/// @return The order.
+static int compare_device_loss(const void* a, const void* b) {
+  double x = get_device_loss(*(virtual_device_t* const*)a);
+  double y = get_device_loss(*(virtual_device_t* const*)b);
+  return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+/// @brief Drive many virtual devices from one thread against a server.
+/// @param server_addr The server address.
+/// @param options The device options.
+/// @param load The load generator options.
+/// @param duration The run time in seconds.
+/// @param seed The random seed.
+/// @return The exit code.
+static int load_devices(const struct sockaddr_in* server_addr, const device_options_t* options, const load_options_t* load, int duration, uint32_t seed) {
+  int n = load->num_of_devices;
+  virtual_device_t** devices = calloc(n, sizeof(virtual_device_t*));
+  struct pollfd* fds = calloc(n, sizeof(struct pollfd));
+  int64_t* due_times = calloc(n, sizeof(int64_t));
+  virtual_device_t* total = malloc(sizeof(virtual_device_t));
+  virtual_device_t* last = calloc(1, sizeof(virtual_device_t));
+  if (devices == NULL || fds == NULL || due_times == NULL || total == NULL || last == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+  }
+
+  int num_of_started = 0;
+  int64_t start_us = get_time_us();
+  int64_t last_report_us = start_us;
+  int64_t sync_start_us = 0;
+  while (_is_running) {
+    int64_t now_us = get_time_us();
+    if (now_us - start_us >= duration * 1000000LL) {
+      break;
+    }
+
+    // Start the devices of the ramp, each with its own socket and seed.
+    int target = n;
+    if (load->ramp > 0) {
+      int64_t started = (now_us - start_us) * n / (load->ramp * 1000000LL) + 1;
+      target = started < n ? (int)started : n;
+    }
+    while (num_of_started < target) {
+      int sock = open_udp_socket(0);
+      devices[num_of_started] = sock >= 0 ? malloc(sizeof(virtual_device_t)) : NULL;
+      if (devices[num_of_started] == NULL) {
+        fprintf(stderr, "Failed to start device %d, raise the file limit with ulimit -n.\n", num_of_started);
+        n = num_of_started;
+        break;
+      }
+      initialize_device(devices[num_of_started], sock, server_addr, options, seed + num_of_started * 7919);
+      fds[num_of_started] = (struct pollfd){.fd = sock, .events = POLLIN};
+      due_times[num_of_started] = now_us;
+      num_of_started++;
+    }
+    if (num_of_started == 0) {
+      break;
+    }
+
+    // Send what is due, and sleep until the next due message or a reply.
+    int64_t next_due_us = now_us + 100000;
+    for (int i = 0; i < num_of_started; ++i) {
+      if (due_times[i] <= now_us) {
+        due_times[i] = update_device(devices[i], now_us);
+      }
+      if (due_times[i] < next_due_us) {
+        next_due_us = due_times[i];
+      }
+    }
+
+    if (load->interval > 0 && now_us - last_report_us >= load->interval * 1000000LL) {
+      int num_of_syncing = sum_devices(devices, num_of_started, total);
+      print_load_interval(total, last, num_of_started, num_of_syncing, (now_us - last_report_us) / 1e6);
+      memcpy(last, total, sizeof(virtual_device_t));
+      last_report_us = now_us;
+    }
+
+    int64_t wait_us = next_due_us - get_time_us();
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = 0};
+    if (wait_us > 0) {
+      timeout = (struct timespec){.tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000};
+    }
+    if (ppoll(fds, num_of_started, &timeout, NULL) > 0) {
+      for (int i = 0; i < num_of_started; ++i) {
+        // A reply may start the syncing, so update the device right away.
+        if ((fds[i].revents & POLLIN) && receive_device(devices[i]) > 0) {
+          due_times[i] = 0;
+        }
+      }
+    }
+    if (sync_start_us == 0 && devices[0]->is_syncing) {
+      sync_start_us = get_time_us();
+    }
+  }
+
+  double seconds = sync_start_us ? (get_time_us() - sync_start_us) / 1e6 : 0;
+  int num_of_syncing = sum_devices(devices, num_of_started, total);
+  printf(
+    "load: devices %d syncing %d sent %llu (%.0f/s, %.1f kB/s) acked %llu (%.0f/s) lost %llu (%.3f%%)\n",
+    num_of_started, num_of_syncing,
+    (unsigned long long)total->sent, seconds > 0 ? total->sent / seconds : 0,
+    seconds > 0 ? total->bytes / seconds / 1000 : 0,
+    (unsigned long long)total->acked, seconds > 0 ? total->acked / seconds : 0,
+    (unsigned long long)total->lost, total->sent > 0 ? 100.0 * total->lost / total->sent : 0
+  );
+  print_histogram("ack latency", "us", &total->ack_latency);
+
+  // The loss per device, the spread shows if some devices starve.
+  if (num_of_started > 0) {
+    virtual_device_t** sorted = malloc(num_of_started * sizeof(virtual_device_t*));
+    memcpy(sorted, devices, num_of_started * sizeof(virtual_device_t*));
+    qsort(sorted, num_of_started, sizeof(virtual_device_t*), compare_device_loss);
+    printf(
+      "device loss: worst %.3f%% p90 %.3f%% median %.3f%% best %.3f%%\n",
+      get_device_loss(sorted[0]), get_device_loss(sorted[num_of_started / 10]),
+      get_device_loss(sorted[num_of_started / 2]), get_device_loss(sorted[num_of_started - 1])
+    );
+    free(sorted);
+  }
+  if (load->is_verbose) {
+    for (int i = 0; i < num_of_started; ++i) {
+      const virtual_device_t* device = devices[i];
+      printf(
+        "  device %d: format %u sent %llu acked %llu lost %llu (%.3f%%) ack p50 %llu p99 %llu us\n",
+        i, device->format, (unsigned long long)device->sent, (unsigned long long)device->acked,
+        (unsigned long long)device->lost, get_device_loss(device),
+        (unsigned long long)get_histogram_percentile(&device->ack_latency, 50),
+        (unsigned long long)get_histogram_percentile(&device->ack_latency, 99)
+      );
+    }
+  }
+
+  int code = num_of_syncing == num_of_started && num_of_started == load->num_of_devices ? 0 : 1;
+  for (int i = 0; i < num_of_started; ++i) {
+    close(devices[i]->sock);
+    free(devices[i]);
+  }
+  free(devices);
+  free(fds);
+  free(due_times);
+  free(total);
+  free(last);
+  return code;
+}
+
+/// @brief The server thread of the bench and load modes.
+/// @param arg The server.
+/// @return NULL.
+static void* server_thread(void* arg) {
+  run_server((server_t*)arg, 0);
+  return NULL;
+}
+
+/// @brief Print the usage.
+/// @param name The program name.
+static void print_usage(const char* name) {
+  printf(
+    "Usage: %s <serve|drive|bench|load> [options]\n"
+    "  serve                 Run the reference server.\n"
+    "  drive                 Drive a virtual device against --server.\n"
+    "  bench                 Run the server and a virtual device on loopback.\n"
+    "  load                  Drive many virtual devices against --server, or a server on loopback.\n"
+    "Server options:\n"
+    "  --port <port>         Listen port, default 12321.\n"
+    "  --delay-us <us>       Delay every reply, default 0.\n"
+    "  --loss <p>            Drop incoming messages with probability p.\n"
+    "  --ack-loss <p>        Drop replies with probability p.\n"
+    "  --format <n>          Select format n (0 full, 1 delta, 2 compact, 3 redundant) if advertised.\n"
+    "  --interval <s>        Report every s seconds.\n"
+    "Device options:\n"
+    "  --server <host:port>  Server address for drive.\n"
+    "  --format <n>          Requested format, default 0.\n"
+    "  --rate <hz>           Sampling rate, default 1000.\n"
+    "  --change <p>          Change probability per period, default 0.1.\n"
+    "  --burst <n>           Active periods per burst, 0 for steady traffic.\n"
+    "  --idle <n>            Idle periods after every burst.\n"
+    "  --keepalive-ms <ms>   Keepalive interval, default 100.\n"
+    "  --redundancy <n>      Repeated states of the redundant format, default 2.\n"
+    "Load options:\n"
+    "  --devices <n>         Virtual devices, default 100.\n"
+    "  --ramp <s>            Start the devices evenly over s seconds, default 0.\n"
+    "  --interval <s>        Report every s seconds.\n"
+    "  --verbose             Print every device.\n"
+    "Common options:\n"
+    "  --duration <s>        Run time, default 10, serve runs until Ctrl+C by default.\n"
+    "  --seed <n>            Random seed, default 1.\n",
+    name
+  );
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const char* mode = argv[1];
+
+  server_options_t server_options = {
+    .port = 12321,
+    .format = -1,
+    .seed = 1,
+  };
+  device_options_t device_options = {
+    .format = MESSAGE_JOYSTICK_FORMAT_FULL,
+    .rate_hz = 1000,
+    .change_probability = 0.1,
+    .keepalive_us = 100000,
+    .redundancy = 2,
+  };
+  load_options_t load_options = {
+    .num_of_devices = 100,
+  };
+  struct sockaddr_in server_addr;
+  bool has_server_addr = false;
+  int duration = -1;
+
+  for (int i = 2; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--verbose") == 0) {
+      load_options.is_verbose = true;
+      continue;
+    }
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      fprintf(stderr, "Missing value for %s\n", arg);
+      return 1;
+    }
+    ++i;
+    if (strcmp(arg, "--port") == 0) {
+      server_options.port = atoi(value);
+    } else if (strcmp(arg, "--delay-us") == 0) {
+      server_options.delay_us = atoll(value);
+    } else if (strcmp(arg, "--loss") == 0) {
+      server_options.loss = atof(value);
+    } else if (strcmp(arg, "--ack-loss") == 0) {
+      server_options.ack_loss = atof(value);
+    } else if (strcmp(arg, "--interval") == 0) {
+      server_options.interval = atoi(value);
+      load_options.interval = atoi(value);
+    } else if (strcmp(arg, "--format") == 0) {
+      server_options.format = atoi(value);
+      device_options.format = atoi(value);
+    } else if (strcmp(arg, "--server") == 0) {
+      has_server_addr = parse_address(value, &server_addr);
+      if (!has_server_addr) {
+        fprintf(stderr, "Invalid server address %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--rate") == 0) {
+      device_options.rate_hz = atoi(value);
+    } else if (strcmp(arg, "--change") == 0) {
+      device_options.change_probability = atof(value);
+    } else if (strcmp(arg, "--burst") == 0) {
+      device_options.burst_periods = atoi(value);
+    } else if (strcmp(arg, "--idle") == 0) {
+      device_options.idle_periods = atoi(value);
+    } else if (strcmp(arg, "--keepalive-ms") == 0) {
+      device_options.keepalive_us = atoll(value) * 1000;
+    } else if (strcmp(arg, "--redundancy") == 0) {
+      device_options.redundancy = atoi(value);
+    } else if (strcmp(arg, "--devices") == 0) {
+      load_options.num_of_devices = atoi(value);
+    } else if (strcmp(arg, "--ramp") == 0) {
+      load_options.ramp = atoi(value);
+    } else if (strcmp(arg, "--duration") == 0) {
+      duration = atoi(value);
+    } else if (strcmp(arg, "--seed") == 0) {
+      server_options.seed = strtoul(value, NULL, 0);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (device_options.rate_hz == 0 || device_options.rate_hz > 1000000 || device_options.format > MESSAGE_JOYSTICK_FORMAT_REDUNDANT ||
+      device_options.redundancy >= MESSAGE_JOYSTICK_MAX_REDUNDANT_STATES) {
+    if (strcmp(mode, "serve") != 0) {
+      fprintf(stderr, "Invalid device options, the virtual device supports the formats 0 to 3.\n");
+      return 1;
+    }
+  }
+
+  if (duration < 0) {
+    duration = strcmp(mode, "serve") == 0 ? 0 : 10;
+  }
+
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  if (strcmp(mode, "serve") == 0) {
+    server_t* server = malloc(sizeof(server_t));
+    if (!create_server(server, &server_options)) {
+      destroy_server(server);
+      free(server);
+      return 1;
+    }
+    printf("Listening on UDP port %u.\n", server_options.port);
+    run_server(server, duration);
+    print_server_stats(server, true);
+    destroy_server(server);
+    free(server);
+    return 0;
+  }
+
+  if (strcmp(mode, "drive") == 0) {
+    if (!has_server_addr) {
+      fprintf(stderr, "The drive mode needs --server.\n");
+      return 1;
+    }
+    return drive_device(&server_addr, &device_options, duration, server_options.seed);
+  }
+
+  if (strcmp(mode, "bench") == 0) {
+    server_t* server = malloc(sizeof(server_t));
+    if (!create_server(server, &server_options)) {
+      destroy_server(server);
+      free(server);
+      return 1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, server);
+
+    parse_address("127.0.0.1:0", &server_addr);
+    server_addr.sin_port = htons(server_options.port);
+    int code = drive_device(&server_addr, &device_options, duration, server_options.seed);
+
+    _is_running = 0;
+    pthread_join(thread, NULL);
+    print_server_stats(server, false);
+    destroy_server(server);
+    free(server);
+    return code;
+  }
+
+  if (strcmp(mode, "load") == 0) {
+    if (load_options.num_of_devices <= 0 || load_options.ramp < 0) {
+      fprintf(stderr, "Invalid load options.\n");
+      return 1;
+    }
+    // Without --server, a stand-in server runs on loopback in this process.
+    server_t* server = NULL;
+    pthread_t thread;
+    if (!has_server_addr) {
+      server = malloc(sizeof(server_t));
+      server_options.interval = 0;
+      if (!create_server(server, &server_options)) {
+        destroy_server(server);
+        free(server);
+        return 1;
+      }
+      pthread_create(&thread, NULL, server_thread, server);
+      parse_address("127.0.0.1:0", &server_addr);
+      server_addr.sin_port = htons(server_options.port);
+    }
+
+    int code = load_devices(&server_addr, &device_options, &load_options, duration, server_options.seed);
+
+    if (server != NULL) {
+      _is_running = 0;
+      pthread_join(thread, NULL);
+      print_server_stats(server, false);
+      destroy_server(server);
+      free(server);
+    }
+    return code;
+  }
+
+  print_usage(argv[0]);
+  return 1;
+}
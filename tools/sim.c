@@ -0,0 +1,896 @@
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+#include "tasks.h"
+#include "global.h"
+#include "wifi.h"
+#include "axis.h"
+#include "button.h"
+#include "encoder.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "timesync.h"
+#include "trace.h"
+#include "message.h"
+#include "common.h"
+#include "protocol.h"
+#include "replay.h"
+
+// The most contact bounce edges of one press or release.
+#define SIM_MAX_BOUNCES 6
+// The interval between the quadrature transitions of an encoder detent.
+#define SIM_ENCODER_TRANSITION_US 250
+
+/// @brief The simulator options.
+typedef struct {
+  // The simulated time in seconds.
+  int duration;
+  uint32_t seed;
+  // The one-way network latency in microseconds.
+  int64_t latency_us;
+  // The probability to drop a datagram, in either direction.
+  double loss;
+  // The offset of the host clock from the device clock in microseconds.
+  int64_t clock_offset_us;
+  // The presses per second of every button.
+  double press_rate;
+  // The detents per second of every encoder.
+  double step_rate;
+  // True to run in real time against a real server.
+  bool is_realtime;
+  // True if the in-process server predates the format negotiation and only knows the stop-and-wait sync.
+  bool is_legacy_server;
+  // The format the in-process server selects if the firmware supports it, -1 for its preference.
+  int format;
+  struct sockaddr_in server_addr;
+  // The trace to record the firmware inputs to, NULL for none.
+  const char* record_path;
+  // The trace to replay instead of the generated inputs, NULL for none.
+  const char* replay_path;
+  // The backend of every encoder.
+  encoder_backend_t encoder_backend;
+  // The report settings of every encoder.
+  encoder_settings_t encoder_settings;
+  // The debounce policy of every button.
+  button_debounce_t button_debounce;
+  // The scanner of the buttons.
+  button_scanner_type_t button_scanner;
+  // The filter of every axis.
+  axis_filter_t axis_filter;
+  // The profile of every axis, the default one if the range is not set.
+  axis_profile_t axis_profile;
+} sim_options_t;
+
+/// @brief A simulated button.
+typedef struct {
+  bool is_pressed;
+  // The pending edges of the current press or release, in time order.
+  int64_t edge_times[SIM_MAX_BOUNCES + 1];
+  int num_of_edges;
+  int next_edge;
+  // The time of the next press or release.
+  int64_t next_action_us;
+  // The time of the press or release not yet seen by the server, 0 if it has seen the last one.
+  int64_t pending_edge_us;
+  // The level the server must report for the pending press or release.
+  int pending_level;
+} sim_button_t;
+
+/// @brief A simulated encoder.
+typedef struct {
+  // The quadrature phase, 0 to 3.
+  int phase;
+  // The remaining transitions of the current detent, the sign is the direction.
+  int remaining;
+  int64_t next_transition_us;
+  int64_t next_step_us;
+  // The counter expected from the generated transitions.
+  int64_t expected_counter;
+  // The steps the server saw, from the button presses or the axis position.
+  int64_t server_steps;
+  int server_buttons;
+  uint16_t server_position;
+} sim_encoder_t;
+
+static sim_options_t _options;
+static uint32_t _random = 1;
+// The button and encoder inputs draw from their own stream, so they do not depend on the firmware timing.
+static uint32_t _input_random = 1;
+static volatile sig_atomic_t _is_running = 1;
+
+// The network task scheduling.
+static int64_t _network_wake_us;
+static bool _is_network_waiting_notify;
+static uint64_t _sampler_runs;
+static uint64_t _network_runs;
+
+// The input scenario.
+static sim_button_t _buttons[NAGI_MAX_NUM_OF_BUTTONS];
+static sim_encoder_t _encoders[NAGI_MAX_NUM_OF_ENCODERS];
+static uint64_t _edges;
+static uint64_t _missed_edges;
+static histogram_t _button_latency;
+static double _axis_phases[NAGI_MAX_NUM_OF_AXES];
+
+// The replayed trace.
+static bool _is_replaying;
+static replay_trace_t _trace;
+static size_t _replay_next_event;
+static size_t _replay_adc_cursors[REPLAY_MAX_ADC_CHANNELS];
+static int _replay_encoder_levels[NAGI_MAX_NUM_OF_ENCODERS];
+static int64_t _last_flush_us;
+
+// The in-process server.
+static protocol_session_t _session;
+static uint64_t _server_dropped;
+static uint64_t _server_legacy_syncs;
+// The syncs after which the server state differs from the state the firmware sent.
+static uint64_t _server_mismatches;
+
+EventGroupHandle_t g_wifi_event_group;
+const int WIFI_STARTED_BIT = BIT0;
+const int WIFI_CONNECTING_BIT = BIT1;
+const int WIFI_CONNECTED_BIT = BIT2;
+
+/// @brief Stop on Ctrl+C.
+/// @param sig The signal.
+static void handle_signal(int sig) {
+  (void)sig;
+  _is_running = 0;
+}
+
+/// @brief Get an exponentially distributed interval.
+/// @param rate The events per second.
+/// @return The interval in microseconds.
+static int64_t get_random_interval(double rate) {
+  double u = (next_random(&_input_random) + 1.0) / 4294967296.0;
+  return (int64_t)(-log(u) / rate * 1e6) + 1;
+}
+
+/// @brief Get a uniformly distributed value.
+/// @param min The minimum.
+/// @param max The maximum.
+/// @return The value.
+static int64_t get_random_range(int64_t min, int64_t max) {
+  return min + next_random(&_input_random) % (uint32_t)(max - min + 1);
+}
+
+/// @brief The ADC input, a slow sine with noise on every channel.
+/// @param channel The ADC channel.
+/// @param time_us The conversion time in microseconds.
+/// @return The raw conversion code.
+static int get_adc_signal(uint32_t channel, int64_t time_us) {
+  double phase = _axis_phases[channel % NAGI_MAX_NUM_OF_AXES];
+  double value = 2048 + 1500 * sin(2 * M_PI * 0.5 * time_us / 1e6 + phase);
+  int noise = (int)(next_random(&_random) % 17) - 8;
+  return (int)value + noise;
+}
+
+/// @brief The ADC input, the recorded conversions.
+/// @param channel The ADC channel.
+/// @param time_us The conversion time in microseconds.
+/// @return The raw conversion code.
+static int get_replay_adc_signal(uint32_t channel, int64_t time_us) {
+  size_t* cursor = &_replay_adc_cursors[channel % REPLAY_MAX_ADC_CHANNELS];
+  return get_replay_adc(&_trace, channel, time_us, cursor);
+}
+
+/// @brief Schedule the edges of a press or release, with contact bounce.
+/// @param button The button.
+/// @param now_us The current time in microseconds.
+static void schedule_edges(sim_button_t* button, int64_t now_us) {
+  // The bounces alternate the level, so their count is even and the last edge is the new level.
+  int num_of_bounces = get_random_range(0, SIM_MAX_BOUNCES / 2) * 2;
+  int64_t time_us = now_us;
+  for (int i = 0; i <= num_of_bounces; i++) {
+    button->edge_times[i] = time_us;
+    time_us += get_random_range(50, 800);
+  }
+  button->num_of_edges = num_of_bounces + 1;
+  button->next_edge = 0;
+}
+
+/// @brief Get the time of the next input change.
+/// @return The time in microseconds.
+static int64_t get_next_input_time(void) {
+  if (_is_replaying) {
+    return _replay_next_event < _trace.num_of_events ? _trace.events[_replay_next_event].time_us : INT64_MAX;
+  }
+  int64_t next_us = INT64_MAX;
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    const sim_button_t* button = &_buttons[i];
+    int64_t time_us = button->next_edge < button->num_of_edges ? button->edge_times[button->next_edge] : button->next_action_us;
+    if (time_us < next_us) {
+      next_us = time_us;
+    }
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    const sim_encoder_t* encoder = &_encoders[i];
+    int64_t time_us = encoder->remaining != 0 ? encoder->next_transition_us : encoder->next_step_us;
+    if (time_us < next_us) {
+      next_us = time_us;
+    }
+  }
+  return next_us;
+}
+
+/// @brief Apply a replayed button level.
+/// @param gpio_num The GPIO number.
+/// @param level The level.
+/// @param now_us The current time in microseconds.
+static void replay_gpio_level(int gpio_num, int level, int64_t now_us) {
+  if (hal_gpio_get_level(gpio_num) == level) {
+    return;
+  }
+  sim_set_gpio_level(gpio_num, level);
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    sim_button_t* button = &_buttons[i];
+    if (g_button_data[i].gpio_num != gpio_num) {
+      continue;
+    }
+    // The latency runs from the first edge the server has not seen, bounces included.
+    if (button->pending_edge_us == 0) {
+      _edges++;
+      button->pending_edge_us = now_us;
+    }
+    button->pending_level = level;
+  }
+}
+
+/// @brief Apply replayed encoder levels.
+/// @param encoder_num The encoder number.
+/// @param levels The levels, left << 1 | right.
+static void replay_encoder_levels(int encoder_num, int levels) {
+  if (encoder_num >= NAGI_MAX_NUM_OF_ENCODERS) {
+    return;
+  }
+  // The counter expected from the recorded transitions, with the firmware decoding.
+  static const int8_t STEPS[16] = {0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0};
+  const encoder_t* data = &g_encoder_data[encoder_num];
+  int* last_levels = &_replay_encoder_levels[encoder_num];
+  if (*last_levels < 0) {
+    // The first record holds the levels when the recording started, the ISR did not see them.
+    *last_levels = data->last_state;
+  } else {
+    _encoders[encoder_num].expected_counter += STEPS[(*last_levels << 2) | levels];
+    *last_levels = levels;
+  }
+
+  sim_set_gpio_level(data->left_gpio_num, levels >> 1);
+  sim_set_gpio_level(data->right_gpio_num, levels & 1);
+}
+
+/// @brief Apply the replayed input changes due at the time, the GPIO interrupts run meanwhile.
+/// @param now_us The current time in microseconds.
+static void update_replay_inputs(int64_t now_us) {
+  while (_replay_next_event < _trace.num_of_events && _trace.events[_replay_next_event].time_us <= now_us) {
+    const trace_record_t* record = &_trace.events[_replay_next_event++];
+    if (record->type == TRACE_RECORD_GPIO) {
+      replay_gpio_level(record->index, record->value, now_us);
+    } else {
+      replay_encoder_levels(record->index, record->value);
+    }
+  }
+}
+
+/// @brief Drive a button contact, as the scanner wires it.
+/// @param button_num The button number.
+/// @param level The level, 0 when pressed.
+static void set_button_level(int button_num, int level) {
+  if (g_button_scanner == BUTTON_SCANNER_MATRIX) {
+    static const uint8_t ROWS[] = NAGI_BUTTON_MATRIX_ROW_GPIO_NUMS;
+    static const uint8_t COLUMNS[] = NAGI_BUTTON_MATRIX_COLUMN_GPIO_NUMS;
+    (void)ROWS;
+    int columns = sizeof(COLUMNS);
+    sim_set_matrix_switch(ROWS[button_num / columns], COLUMNS[button_num % columns], level == 0);
+  } else if (g_button_scanner == BUTTON_SCANNER_SHIFT) {
+    sim_set_shift_in_level(button_num, level);
+  } else {
+    sim_set_gpio_level(g_button_data[button_num].gpio_num, level);
+  }
+}
+
+/// @brief Apply the input changes due at the time, the GPIO interrupts run meanwhile.
+/// @param now_us The current time in microseconds.
+static void update_inputs(int64_t now_us) {
+  if (_is_replaying) {
+    update_replay_inputs(now_us);
+    return;
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    sim_button_t* button = &_buttons[i];
+    while (button->next_edge < button->num_of_edges && button->edge_times[button->next_edge] <= now_us) {
+      // The buttons pull down to ground when pressed.
+      int level = (button->next_edge % 2 == 0) == button->is_pressed ? 0 : 1;
+      set_button_level(i, level);
+      button->next_edge++;
+    }
+    if (button->next_edge < button->num_of_edges || button->next_action_us > now_us) {
+      continue;
+    }
+
+    // Start the next press or release.
+    button->is_pressed = !button->is_pressed;
+    _edges++;
+    // The server never saw the previous press or release.
+    if (button->pending_edge_us != 0) {
+      _missed_edges++;
+    }
+    button->pending_edge_us = now_us;
+    button->pending_level = button->is_pressed ? 0 : 1;
+    if (button->is_pressed) {
+      button->next_action_us = now_us + get_random_range(30000, 150000);
+    } else {
+      button->next_action_us = now_us + get_random_interval(_options.press_rate);
+    }
+    schedule_edges(button, now_us);
+  }
+
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    sim_encoder_t* encoder = &_encoders[i];
+    const encoder_t* data = &g_encoder_data[i];
+    while (encoder->remaining == 0 && encoder->next_step_us <= now_us) {
+      encoder->remaining = next_random(&_input_random) & 1 ? 4 : -4;
+      // A detent starts no sooner than a transition after the previous one ended.
+      if (encoder->next_transition_us < encoder->next_step_us) {
+        encoder->next_transition_us = encoder->next_step_us;
+      }
+      encoder->next_step_us += get_random_interval(_options.step_rate);
+    }
+    while (encoder->remaining != 0 && encoder->next_transition_us <= now_us) {
+      // The Gray code sequence 00, 01, 11, 10 counts up.
+      static const int LEFT[4] = {0, 0, 1, 1};
+      static const int RIGHT[4] = {0, 1, 1, 0};
+      int direction = encoder->remaining > 0 ? 1 : -1;
+      encoder->phase = (encoder->phase + direction) & 3;
+      encoder->remaining -= direction;
+      encoder->expected_counter += direction;
+      // Only one line changes per transition.
+      if (hal_gpio_get_level(data->left_gpio_num) != LEFT[encoder->phase]) {
+        sim_set_gpio_level(data->left_gpio_num, LEFT[encoder->phase]);
+      } else {
+        sim_set_gpio_level(data->right_gpio_num, RIGHT[encoder->phase]);
+      }
+      encoder->next_transition_us += SIM_ENCODER_TRANSITION_US;
+    }
+  }
+}
+
+/// @brief Check the server rebuilt the state the firmware just sent, across the lost deltas and keyframes.
+/// The datagram is handled while the firmware sends it, so the snapshot is still the one it sent.
+/// @param header The header of the sync message.
+static void check_server_state(const message_header_t* header) {
+  joystick_info_t sent;
+  int64_t sample_time_us;
+  read_joystick_snapshot(&sent, &sample_time_us);
+  if (header->minor_id == MESSAGE_MINOR_ID_JOYSTICK_DATA_COMPACT_SYNC || header->minor_id == MESSAGE_MINOR_ID_JOYSTICK_DATA_REDUNDANT_SYNC) {
+    // The compact formats carry fewer fields.
+    joystick_compact_t compact;
+    encode_joystick_compact(&sent, &compact);
+    decode_joystick_compact(&compact, &sent);
+  }
+  if (memcmp(&sent, &_session.state, sizeof(joystick_info_t)) != 0) {
+    _server_mismatches++;
+  }
+}
+
+/// @brief The in-process server, called for every datagram the firmware sends.
+/// @param data The datagram.
+/// @param length The length of the datagram.
+/// @param time_us The send time in microseconds.
+static void handle_datagram(const void* data, size_t length, int64_t time_us) {
+  if (roll_random(&_random, _options.loss)) {
+    _server_dropped++;
+    return;
+  }
+  int64_t arrival_us = time_us + _options.latency_us;
+  int64_t host_time_us = arrival_us + _options.clock_offset_us;
+  protocol_reply_t reply;
+  size_t reply_length;
+  protocol_result_t result = handle_protocol_message(&_session, data, length, host_time_us, _options.format, &reply, &reply_length);
+  if (_options.is_legacy_server) {
+    // A legacy server answers a ping without the format and does not know the sequenced syncs.
+    if (result == PROTOCOL_RESULT_PING) {
+      reply_length = offsetof(message_common_pong_t, format);
+    } else if (result != PROTOCOL_RESULT_LEGACY_SYNC) {
+      return;
+    }
+  }
+  if (result == PROTOCOL_RESULT_LEGACY_SYNC) {
+    _server_legacy_syncs++;
+  }
+
+  if (result == PROTOCOL_RESULT_SYNC || result == PROTOCOL_RESULT_LEGACY_SYNC) {
+    check_server_state(data);
+
+    // A press or release is seen when the server reports its final level.
+    for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+      sim_button_t* button = &_buttons[i];
+      int level = (_session.state.buttons[i / 32] >> (i % 32)) & 1;
+      if (button->pending_edge_us != 0 && level == button->pending_level) {
+        record_histogram(&_button_latency, arrival_us - button->pending_edge_us);
+        button->pending_edge_us = 0;
+      }
+    }
+
+    // Count the encoder steps as a host would, a press is one step and the axis moves by a wrapping delta.
+    for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+      sim_encoder_t* encoder = &_encoders[i];
+      if (_options.encoder_settings.mode == ENCODER_MODE_AXIS) {
+        uint16_t position = (uint16_t)(&_session.state.axis_x)[NAGI_MAX_NUM_OF_AXES + i];
+        encoder->server_steps += (int16_t)(position - encoder->server_position);
+        encoder->server_position = position;
+        continue;
+      }
+      int button_id = NAGI_MAX_NUM_OF_BUTTONS + i * 2;
+      int buttons = 0;
+      for (int j = 0; j < 2; j++) {
+        buttons |= ((_session.state.buttons[(button_id + j) / 32] >> ((button_id + j) % 32)) & 1) << j;
+      }
+      int pressed = buttons & ~encoder->server_buttons;
+      encoder->server_steps += (pressed & 1) - ((pressed >> 1) & 1);
+      encoder->server_buttons = buttons;
+    }
+  }
+
+  if (reply_length > 0) {
+    if (roll_random(&_random, _options.loss)) {
+      _server_dropped++;
+      return;
+    }
+    stamp_protocol_reply(&reply, host_time_us);
+    sim_queue_udp_reply(&reply, reply_length, arrival_us + _options.latency_us);
+  }
+}
+
+/// @brief Run one step of the network task.
+static void step_network(void) {
+  sim_set_current_task(&g_sim_network_task);
+  TickType_t last_wake_time = xTaskGetTickCount();
+
+  bool is_server_setted = g_server_addr.sin_family == AF_INET && g_server_addr.sin_port != 0;
+  EventBits_t bits = xEventGroupGetBits(g_wifi_event_group);
+  if ((bits & WIFI_CONNECTED_BIT) && is_server_setted) {
+    run_network();
+  }
+  _network_runs++;
+
+  if (is_network_idle()) {
+    // Sleep until the sampler publishes a change or a keepalive is due.
+    _is_network_waiting_notify = true;
+    _network_wake_us = hal_get_time_us() + NAGI_SYNC_KEEPALIVE_INTERVAL * 1000LL;
+  } else {
+    _is_network_waiting_notify = false;
+    _network_wake_us = (int64_t)(last_wake_time + pdMS_TO_TICKS(1)) * (1000000 / configTICK_RATE_HZ);
+  }
+}
+
+/// @brief Check the network task is ready to run.
+/// @param now_us The current time in microseconds.
+/// @return True if it is ready, its pending notification is taken.
+static bool is_network_ready(int64_t now_us) {
+  if (_is_network_waiting_notify && g_sim_network_task.notify_count > 0) {
+    g_sim_network_task.notify_count = 0;
+    return true;
+  }
+  if (now_us >= _network_wake_us) {
+    if (_is_network_waiting_notify) {
+      g_sim_network_task.notify_count = 0;
+    }
+    return true;
+  }
+  return false;
+}
+
+/// @brief Run the interrupts and the tasks until the time.
+/// @param end_us The time in microseconds.
+/// @param blocked_task The task blocked meanwhile, NULL for none.
+static void run_scheduler(int64_t end_us, sim_task_t* blocked_task) {
+  for (;;) {
+    int64_t now_us = hal_get_time_us();
+
+    // The interrupts preempt the tasks.
+    update_inputs(now_us);
+    sim_run_timers();
+
+    // The sampler task has the higher priority.
+    if (g_sim_sampler_task.notify_bits != 0 && blocked_task != &g_sim_sampler_task) {
+      sim_set_current_task(&g_sim_sampler_task);
+      uint32_t bits = 0;
+      xTaskNotifyWait(0, UINT32_MAX, &bits, 0);
+      run_sampler(bits);
+      _sampler_runs++;
+      continue;
+    }
+    if (blocked_task != &g_sim_network_task && is_network_ready(now_us)) {
+      step_network();
+      continue;
+    }
+    if (now_us >= end_us || !_is_running) {
+      return;
+    }
+
+    // The trace task, at the lowest priority.
+    if (_options.record_path != NULL && now_us - _last_flush_us >= NAGI_TRACE_FLUSH_INTERVAL * 1000LL) {
+      flush_trace();
+      _last_flush_us = now_us;
+    }
+
+    // Sleep until the next event.
+    int64_t next_us = end_us;
+    int64_t timer_us = sim_get_next_timer_time();
+    int64_t input_us = get_next_input_time();
+    next_us = timer_us < next_us ? timer_us : next_us;
+    next_us = input_us < next_us ? input_us : next_us;
+    if (blocked_task != &g_sim_network_task) {
+      next_us = _network_wake_us < next_us ? _network_wake_us : next_us;
+    }
+    sim_advance_time(next_us > now_us ? next_us : now_us);
+  }
+}
+
+/// @brief Run the other tasks until the time, while the current task blocks.
+/// @param time_us The time in microseconds.
+void sim_wait(int64_t time_us) {
+  sim_task_t* task = xTaskGetCurrentTaskHandle();
+  run_scheduler(time_us, task);
+  sim_set_current_task(task);
+}
+
+/// @brief Print the simulation report.
+/// @param real_us The real run time in microseconds.
+static void print_report(int64_t real_us) {
+  double sim_seconds = hal_get_time_us() / 1e6;
+  printf(
+    "sim: %.1f s simulated in %.2f s (%.0fx), sampler runs %llu, network runs %llu\n",
+    sim_seconds, real_us / 1e6, real_us > 0 ? sim_seconds * 1e6 / real_us : 0,
+    (unsigned long long)_sampler_runs, (unsigned long long)_network_runs
+  );
+  if (!_options.is_realtime) {
+    printf(
+      "server: format %u received %llu legacy %llu lost %llu recovered %llu stale %llu dropped %llu mismatched %llu\n",
+      _session.format, (unsigned long long)_session.received, (unsigned long long)_server_legacy_syncs,
+      (unsigned long long)_session.lost, (unsigned long long)_session.recovered, (unsigned long long)_session.stale,
+      (unsigned long long)_server_dropped, (unsigned long long)_server_mismatches
+    );
+    print_histogram("sync latency", "us", &_session.latency);
+    printf(
+      "buttons: scanner %s, debounce %s, edges %llu missed %llu\n", get_button_scanner_name(g_button_scanner),
+      get_button_debounce_name(_options.button_debounce), (unsigned long long)_edges, (unsigned long long)_missed_edges
+    );
+    print_histogram("edge to server", "us", &_button_latency);
+  }
+  if (_options.record_path != NULL) {
+    uint32_t records;
+    uint32_t dropped;
+    get_trace_stats(&records, &dropped);
+    printf("trace: recorded %lu records to %s, dropped %lu\n", (unsigned long)records, _options.record_path, (unsigned long)dropped);
+  }
+  if (_is_replaying) {
+    printf(
+      "replay: %zu events of %.1f s from %s, dropped while recording %lu\n",
+      _trace.num_of_events, _trace.duration_us / 1e6, _options.replay_path, (unsigned long)_trace.header.dropped
+    );
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    printf(
+      "encoder %d: counter %lld expected %lld",
+      i, (long long)get_encoder_counter(i), (long long)_encoders[i].expected_counter
+    );
+    if (!_options.is_realtime) {
+      printf(
+        ", detents %lld server steps %lld dropped pulses %lu",
+        (long long)(_encoders[i].expected_counter / NAGI_ENCODER_COUNTS_PER_DETENT),
+        (long long)_encoders[i].server_steps, (unsigned long)g_encoder_data[i].dropped_pulses
+      );
+    }
+    printf("\n");
+  }
+  char accel[64];
+  format_encoder_accel(&_options.encoder_settings.accel, accel, sizeof(accel));
+  printf(
+    "encoders: backend %s, mode %s, acceleration %s, gpio interrupts %llu\n",
+    _options.encoder_backend == ENCODER_BACKEND_PCNT ? "pcnt" : "isr",
+    get_encoder_mode_name(_options.encoder_settings.mode), accel,
+    (unsigned long long)sim_get_gpio_interrupt_count()
+  );
+  uint64_t conversions;
+  uint64_t dropped;
+  sim_get_adc_stats(&conversions, &dropped);
+  printf(
+    "adc: conversions %llu dropped %llu, frames lost %lu\n", (unsigned long long)conversions, (unsigned long long)dropped,
+    (unsigned long)g_axis_adc_overflows
+  );
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    printf(
+      "axis %d: filter %s, %u mV, value %u, server %ld\n",
+      i, get_axis_filter_name(g_axis_filters[i]), g_axes_voltages[i], g_axes_data[i], (long)(&_session.state.axis_x)[i]
+    );
+  }
+  printf("clock: offset %lld us rtt %lld us", (long long)get_clock_offset(), (long long)get_round_trip_time());
+  printf(_options.is_realtime ? "\n" : " (actual %lld us)\n", (long long)_options.clock_offset_us);
+  printf(
+    "sampler: missed %lu late %lu max busy %lu us\n",
+    g_sampler_timing.missed_count, g_sampler_timing.late_count, g_sampler_timing.max_busy_us
+  );
+
+  // The firmware statistics, as the stats command prints them.
+  fflush(stdout);
+  g_sim_log_level = ESP_LOG_INFO;
+  print_stats();
+}
+
+/// @brief Print the usage.
+/// @param name The program name.
+static void print_usage(const char* name) {
+  printf(
+    "Usage: %s [options]\n"
+    "Runs the firmware sampler and network tasks on the host, with simulated inputs.\n"
+    "  --duration <s>        Simulated time, default 10.\n"
+    "  --seed <n>            Random seed, default 1.\n"
+    "  --latency-us <us>     One-way latency of the in-process server, default 500.\n"
+    "  --loss <p>            Drop datagrams with probability p, in either direction.\n"
+    "  --clock-offset-us <us> Host clock offset of the in-process server, default 1000000.\n"
+    "  --legacy-server       The in-process server only knows the stop-and-wait sync, as before the format negotiation.\n"
+    "  --format <n>          The joystick format the in-process server selects, 0 full, 1 delta, 2 compact, 3 redundant.\n"
+    "  --press-rate <hz>     Presses per second of every button, default 2.\n"
+    "  --step-rate <hz>      Detents per second of every encoder, default 5.\n"
+    "  --realtime            Run in real time against --server instead of the in-process server.\n"
+    "  --server <host:port>  Server address for --realtime.\n"
+    "  --record <file>       Record the raw inputs the firmware reads to a trace.\n"
+    "  --replay <file>       Replay a trace instead of the generated inputs, the duration defaults to its length.\n"
+    "  --encoder-backend <isr|pcnt> Decode every encoder with the GPIO interrupts or the pulse counter, default pcnt.\n"
+    "  --encoder-mode <buttons|axis|pulses> Report every encoder as held buttons, a relative axis or queued pulses.\n"
+    "  --encoder-accel <curve> The acceleration curve, <speed>:<gain>,... with the speed in detents per second.\n"
+    "  --button-debounce <integrate|eager|eager-press> Debounce every button as in the button command, default integrate.\n"
+    "  --button-scanner <gpio|matrix|shift> Wire the buttons to one GPIO each, a diode matrix or a 74HC165 chain, default gpio.\n"
+    "  --axis-filter <deadband|one-euro> Filter every axis as in the axis command, default deadband.\n"
+    "  --axis-range <min:center:max> The calibrated voltages of every axis in mV, default the whole channel range.\n"
+    "  --axis-deadzone <percent> The deadzone of every axis, default 0.\n"
+    "  --axis-curve <curve>  The response curve of every axis, <deflection>:<output>,... in percent, default linear.\n"
+    "  --verbose             Print the firmware logs.\n",
+    name
+  );
+}
+
+int main(int argc, char** argv) {
+  _options = (sim_options_t){
+    .duration = 10,
+    .seed = 1,
+    .latency_us = 500,
+    .clock_offset_us = 1000000,
+    .press_rate = 2,
+    .step_rate = 5,
+    .format = -1,
+    .encoder_backend = ENCODER_BACKEND_PCNT,
+    .button_scanner = NAGI_BUTTON_SCANNER,
+  };
+  bool has_server_addr = false;
+  bool has_duration = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--realtime") == 0) {
+      _options.is_realtime = true;
+      continue;
+    }
+    if (strcmp(arg, "--legacy-server") == 0) {
+      _options.is_legacy_server = true;
+      continue;
+    }
+    if (strcmp(arg, "--verbose") == 0) {
+      g_sim_log_level = ESP_LOG_INFO;
+      continue;
+    }
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      fprintf(stderr, "Missing value for %s\n", arg);
+      print_usage(argv[0]);
+      return 1;
+    }
+    ++i;
+    if (strcmp(arg, "--duration") == 0) {
+      _options.duration = atoi(value);
+      has_duration = true;
+    } else if (strcmp(arg, "--seed") == 0) {
+      _options.seed = strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--latency-us") == 0) {
+      _options.latency_us = atoll(value);
+    } else if (strcmp(arg, "--format") == 0) {
+      _options.format = atoi(value);
+      if (_options.format < 0 || _options.format > MESSAGE_JOYSTICK_FORMAT_REDUNDANT) {
+        fprintf(stderr, "Unknown format %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--loss") == 0) {
+      _options.loss = atof(value);
+    } else if (strcmp(arg, "--clock-offset-us") == 0) {
+      _options.clock_offset_us = atoll(value);
+    } else if (strcmp(arg, "--press-rate") == 0) {
+      _options.press_rate = atof(value);
+    } else if (strcmp(arg, "--step-rate") == 0) {
+      _options.step_rate = atof(value);
+    } else if (strcmp(arg, "--record") == 0) {
+      _options.record_path = value;
+    } else if (strcmp(arg, "--replay") == 0) {
+      _options.replay_path = value;
+    } else if (strcmp(arg, "--encoder-backend") == 0) {
+      if (strcmp(value, "isr") == 0) {
+        _options.encoder_backend = ENCODER_BACKEND_ISR;
+      } else if (strcmp(value, "pcnt") == 0) {
+        _options.encoder_backend = ENCODER_BACKEND_PCNT;
+      } else {
+        fprintf(stderr, "Unknown encoder backend %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--encoder-mode") == 0) {
+      if (!parse_encoder_mode(value, &_options.encoder_settings.mode)) {
+        fprintf(stderr, "Unknown encoder mode %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--encoder-accel") == 0) {
+      if (parse_encoder_accel(value, &_options.encoder_settings.accel) != ESP_OK) {
+        fprintf(stderr, "Invalid acceleration curve %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--button-debounce") == 0) {
+      if (!parse_button_debounce(value, &_options.button_debounce)) {
+        fprintf(stderr, "Unknown button debounce %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--axis-filter") == 0) {
+      if (!parse_axis_filter(value, &_options.axis_filter)) {
+        fprintf(stderr, "Unknown axis filter %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--axis-range") == 0) {
+      if (parse_axis_range(value, &_options.axis_profile) != ESP_OK) {
+        fprintf(stderr, "Invalid axis range %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--axis-deadzone") == 0) {
+      _options.axis_profile.deadzone = atoi(value);
+    } else if (strcmp(arg, "--axis-curve") == 0) {
+      if (parse_axis_curve(value, &_options.axis_profile.curve) != ESP_OK) {
+        fprintf(stderr, "Invalid axis curve %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--button-scanner") == 0) {
+      if (!parse_button_scanner(value, &_options.button_scanner)) {
+        fprintf(stderr, "Unknown button scanner %s\n", value);
+        return 1;
+      }
+    } else if (strcmp(arg, "--server") == 0) {
+      has_server_addr = parse_address(value, &_options.server_addr);
+      if (!has_server_addr) {
+        fprintf(stderr, "Invalid server address %s\n", value);
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (_options.duration <= 0 || _options.press_rate <= 0 || _options.step_rate <= 0 || _options.latency_us < 0) {
+    fprintf(stderr, "Invalid options.\n");
+    return 1;
+  }
+  if (_options.is_realtime && !has_server_addr) {
+    fprintf(stderr, "The realtime mode needs --server.\n");
+    return 1;
+  }
+  _random = _options.seed ? _options.seed : 1;
+  _input_random = _random ^ 0x9E3779B9;
+  if (_options.replay_path != NULL) {
+    if (_options.button_scanner != BUTTON_SCANNER_GPIO) {
+      fprintf(stderr, "A trace replays the button GPIOs, it needs the gpio scanner.\n");
+      return 1;
+    }
+    if (!load_replay_trace(_options.replay_path, &_trace)) {
+      return 1;
+    }
+    _is_replaying = true;
+    if (!has_duration) {
+      _options.duration = _trace.duration_us / 1000000 + 1;
+    }
+    for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+      _replay_encoder_levels[i] = -1;
+    }
+  }
+
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  // The connected wifi and the configured server.
+  g_wifi_event_group = xEventGroupCreate();
+  xEventGroupSetBits(g_wifi_event_group, WIFI_STARTED_BIT | WIFI_CONNECTED_BIT);
+  if (_options.is_realtime) {
+    g_server_addr = _options.server_addr;
+    if (!sim_open_udp_socket()) {
+      fprintf(stderr, "Failed to open the UDP socket.\n");
+      return 1;
+    }
+  } else {
+    parse_address("127.0.0.1:12321", &g_server_addr);
+    sim_set_udp_handler(handle_datagram);
+  }
+
+  // Boot as app_main does.
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    _axis_phases[i] = i * 1.3;
+  }
+  if (_is_replaying) {
+    // The recorded codes already went through the hardware filter.
+    sim_set_adc_signal(get_replay_adc_signal);
+    sim_set_adc_filter(false);
+  } else {
+    sim_set_adc_signal(get_adc_signal);
+  }
+  initialize_axis();
+  for (int i = 0; i < NAGI_MAX_NUM_OF_AXES; i++) {
+    set_axis_filter(i, _options.axis_filter);
+    axis_profile_t profile = _options.axis_profile;
+    if (profile.min == profile.max) {
+      get_default_axis_profile(i, &profile);
+      profile.deadzone = _options.axis_profile.deadzone;
+      profile.curve = _options.axis_profile.curve;
+    }
+    if (set_axis_profile(i, &profile) != ESP_OK) {
+      fprintf(stderr, "Invalid axis profile, the center must be between the ends and the deadzone below 100.\n");
+      return 1;
+    }
+  }
+  start_axis();
+  g_button_scanner = _options.button_scanner;
+  initialize_button();
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    set_button_debounce(i, _options.button_debounce);
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    g_encoder_backends[i] = _options.encoder_backend;
+    g_encoder_settings[i] = _options.encoder_settings;
+  }
+  initialize_encoder();
+  for (int i = 0; i < NAGI_MAX_NUM_OF_BUTTONS; i++) {
+    _buttons[i].next_action_us = get_random_interval(_options.press_rate);
+  }
+  for (int i = 0; i < NAGI_MAX_NUM_OF_ENCODERS; i++) {
+    // The pins idle pulled up, phase 2 of the sequence.
+    _encoders[i].phase = 2;
+    _encoders[i].next_step_us = get_random_interval(_options.step_rate);
+  }
+
+  if (_options.record_path != NULL && start_trace(_options.record_path, AXIS_SCAN_FREQ_HZ) != ESP_OK) {
+    fprintf(stderr, "Failed to record to %s\n", _options.record_path);
+    return 1;
+  }
+
+  sim_set_realtime(_options.is_realtime);
+  sim_set_current_task(&g_sim_sampler_task);
+  initialize_sampler();
+  sim_set_current_task(&g_sim_network_task);
+  initialize_network();
+  _network_wake_us = hal_get_time_us();
+
+  int64_t real_start_us = get_time_us();
+  run_scheduler(_options.duration * 1000000LL, NULL);
+  if (_options.record_path != NULL) {
+    stop_trace();
+    flush_trace();
+  }
+  print_report(get_time_us() - real_start_us);
+  return _server_mismatches == 0 ? 0 : 1;
+}